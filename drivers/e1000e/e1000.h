@@ -366,6 +366,7 @@ struct e1000_adapter {
 	struct pci_dev *pdev;
 
 	struct rtskb_queue skb_pool;
+	struct rtskb_queue copy_pool;	/* small frames, see copybreak */
 	rtdm_irq_t irq_handle;
 	rtdm_irq_t rx_irq_handle;
 	rtdm_irq_t tx_irq_handle;
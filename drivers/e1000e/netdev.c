@@ -59,6 +59,8 @@
 
 #include "e1000.h"
 
+#include <rtskb_ring.h>
+
 #define RT_E1000E_NUM_RXD	64
 
 #define DRV_EXTRAVERSION "-k-rt"
@@ -613,7 +615,7 @@ static void e1000_alloc_rx_buffers(struct e1000_adapter *adapter,
 	struct e1000_buffer *buffer_info;
 	struct rtskb *skb;
 	unsigned int i;
-	unsigned int bufsz = adapter->rx_buffer_len;
+	unsigned int bufsz = adapter->rx_buffer_len + NET_IP_ALIGN;
 
 	i = rx_ring->next_to_use;
 	buffer_info = &rx_ring->buffer_info[i];
@@ -741,11 +743,28 @@ static bool e1000_clean_rx_irq(struct e1000_adapter *adapter,
 		if (!(adapter->flags2 & FLAG2_CRC_STRIPPING))
 			length -= 4;
 
+		/*
+		 * copy small frames into a buffer of the copy pool and leave
+		 * the large one in the ring
+		 */
+		if (length < copybreak) {
+			struct rtskb *new_skb =
+				rtskb_ring_rx_copybreak(&adapter->pdev->dev,
+							skb, &adapter->copy_pool,
+							length, NET_IP_ALIGN);
+			/* recycle */
+			buffer_info->skb = skb;
+			if (!new_skb) {
+				adapter->alloc_rx_buff_failed++;
+				goto next_desc;
+			}
+			skb = new_skb;
+		} else
+			rtskb_put(skb, length);
+
 		total_rx_bytes += length;
 		total_rx_packets++;
 
-		rtskb_put(skb, length);
-
 		/* Receive Checksum Offload */
 		e1000_rx_checksum(adapter, staterr,
 				  le16_to_cpu(rx_desc->wb.lower.hi_dword.
@@ -1633,8 +1652,13 @@ void e1000e_free_rx_resources(struct e1000_adapter *adapter)
  **/
 static int e1000_alloc_queues(struct e1000_adapter *adapter)
 {
+	unsigned int copy_rtskbs = copybreak ? RT_E1000E_NUM_RXD : 0;
+
 	if (rtskb_pool_init(&adapter->skb_pool,
 			    RT_E1000E_NUM_RXD) < RT_E1000E_NUM_RXD)
+		goto err_skb_pool;
+
+	if (rtskb_pool_init(&adapter->copy_pool, copy_rtskbs) < copy_rtskbs)
 		goto err;
 
 	adapter->tx_ring = kzalloc(sizeof(struct e1000_ring), GFP_KERNEL);
@@ -1649,10 +1673,12 @@ static int e1000_alloc_queues(struct e1000_adapter *adapter)
 
 	return 0;
 err:
-	e_err("Unable to allocate memory for queues\n");
 	kfree(adapter->rx_ring);
 	kfree(adapter->tx_ring);
+	rtskb_pool_release(&adapter->copy_pool);
+err_skb_pool:
 	rtskb_pool_release(&adapter->skb_pool);
+	e_err("Unable to allocate memory for queues\n");
 	return -ENOMEM;
 }
 
@@ -2179,6 +2205,8 @@ static void e1000_set_multi(struct rtnet_device *netdev)
 {
 	struct e1000_adapter *adapter = netdev->priv;
 	struct e1000_hw *hw = &adapter->hw;
+	u8 mta_list[RTDEV_MC_ADDRS * ETH_ALEN];
+	unsigned int i;
 	u32 rctl;
 
 	/* Check for Promiscuous and All Multicast modes */
@@ -2202,7 +2230,10 @@ static void e1000_set_multi(struct rtnet_device *netdev)
 
 	ew32(RCTL, rctl);
 
-	e1000_update_mc_addr_list(hw, NULL, 0);
+	for (i = 0; i < netdev->mc_count; i++)
+		memcpy(mta_list + i * ETH_ALEN, netdev->mc_list[i].addr,
+		       ETH_ALEN);
+	e1000_update_mc_addr_list(hw, mta_list, netdev->mc_count);
 
 	if (netdev->features & NETIF_F_HW_VLAN_RX)
 		e1000e_vlan_strip_enable(adapter);
@@ -3910,7 +3941,7 @@ static dma_addr_t e1000_map_rtskb(struct rtnet_device *netdev,
 	struct device *dev = &adapter->pdev->dev;
 	dma_addr_t addr;
 
-	addr = dma_map_single(dev, skb->buf_start, RTSKB_SIZE,
+	addr = dma_map_single(dev, skb->buf_start, rtskb_buf_size,
 			      DMA_BIDIRECTIONAL);
 	if (dma_mapping_error(dev, addr)) {
 		dev_err(dev, "DMA map failed\n");
@@ -3925,10 +3956,79 @@ static void e1000_unmap_rtskb(struct rtnet_device *netdev,
 	struct e1000_adapter *adapter = netdev->priv;
 	struct device *dev = &adapter->pdev->dev;
 
-	dma_unmap_single(dev, skb->buf_dma_addr, RTSKB_SIZE,
+	dma_unmap_single(dev, skb->buf_dma_addr, rtskb_buf_size,
 			 DMA_BIDIRECTIONAL);
 }
 
+/**
+ * e1000_change_mtu - Change the Maximum Transfer Unit
+ * @netdev: network interface device structure
+ * @new_mtu: new value for maximum frame size
+ *
+ * Called by the stack while the interface is down. Every frame has to fit
+ * into a single receive buffer, and the hardware may fill the complete
+ * buffer size programmed in RCTL. Jumbo frames therefore require rtskbs of
+ * at least that size (see the rtskb_size parameter of rtnet), e.g. 16386
+ * bytes for a 9000 bytes MTU.
+ *
+ * Returns 0 on success, negative on failure
+ **/
+static int e1000_change_mtu(struct rtnet_device *netdev, int new_mtu)
+{
+	struct e1000_adapter *adapter = netdev->priv;
+	int max_frame = new_mtu + ETH_HLEN + ETH_FCS_LEN;
+	unsigned int bufsz;
+
+	/* Jumbo frame support */
+	if ((max_frame > ETH_FRAME_LEN + ETH_FCS_LEN) &&
+	    !(adapter->flags & FLAG_HAS_JUMBO_FRAMES)) {
+		e_err("Jumbo Frames not supported.\n");
+		return -EINVAL;
+	}
+
+	/* Supported frame sizes */
+	if ((new_mtu < ETH_ZLEN + ETH_FCS_LEN + VLAN_HLEN) ||
+	    (max_frame > adapter->max_hw_frame_size)) {
+		e_err("Unsupported MTU setting\n");
+		return -EINVAL;
+	}
+
+	/* Jumbo frame workaround on 82579 requires CRC be stripped */
+	if ((adapter->hw.mac.type == e1000_pch2lan) &&
+	    !(adapter->flags2 & FLAG2_CRC_STRIPPING) &&
+	    (new_mtu > ETH_DATA_LEN)) {
+		e_err("Jumbo Frames not supported on 82579 when CRC "
+		      "stripping is disabled.\n");
+		return -EINVAL;
+	}
+
+	/* without LPE, the hardware stops at standard frame sizes */
+	if (max_frame <= ETH_FRAME_LEN + ETH_FCS_LEN)
+		bufsz = ETH_FRAME_LEN + VLAN_HLEN + ETH_FCS_LEN;
+	else if (max_frame + VLAN_HLEN <= 4096)
+		bufsz = 4096;
+	else if (max_frame + VLAN_HLEN <= 8192)
+		bufsz = 8192;
+	else
+		bufsz = 16384;
+
+	if (bufsz + NET_IP_ALIGN > rtskb_buf_size) {
+		e_err("MTU %d requires rtskb_size >= %d\n", new_mtu,
+		      bufsz + NET_IP_ALIGN);
+		return -EINVAL;
+	}
+
+	e_info("changing MTU from %d to %d\n", netdev->mtu, new_mtu);
+	netdev->mtu = new_mtu;
+	adapter->max_frame_size = max_frame;
+	adapter->rx_buffer_len = bufsz;
+
+	/* recompute the packet buffer allocation */
+	e1000e_reset(adapter);
+
+	return 0;
+}
+
 /**
  * e1000_probe - Device Initialization Routine
  * @pdev: PCI device information struct
@@ -4060,6 +4160,8 @@ static int e1000_probe(struct pci_dev *pdev,
         //netdev->get_stats = e1000_get_stats;
 	netdev->map_rtskb = e1000_map_rtskb;
 	netdev->unmap_rtskb = e1000_unmap_rtskb;
+	netdev->change_mtu = e1000_change_mtu;
+	netdev->set_multicast_list = e1000_set_multi;
 	strncpy(netdev->name, pci_name(pdev), sizeof(netdev->name) - 1);
 
 	netdev->mem_start = mmio_start;
@@ -4331,6 +4433,7 @@ static void e1000_remove(struct pci_dev *pdev)
 	kfree(adapter->tx_ring);
 	kfree(adapter->rx_ring);
 
+	rtskb_pool_release(&adapter->copy_pool);
 	rtskb_pool_release(&adapter->skb_pool);
 
 	iounmap(adapter->hw.hw_addr);
@@ -44,9 +44,10 @@
 
 #define COPYBREAK_DEFAULT 256
 unsigned int copybreak = COPYBREAK_DEFAULT;
-module_param(copybreak, uint, 0644);
+module_param(copybreak, uint, 0444);
 MODULE_PARM_DESC(copybreak,
-	"Maximum size of packet that is copied to a new buffer on receive");
+	"Maximum size of packet that is copied to a new buffer on receive "
+	"(0 disables)");
 
 /*
  * All parameters are treated the same, as an integer array of values.
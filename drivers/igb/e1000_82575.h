@@ -47,6 +47,24 @@ extern void igb_rx_fifo_flush_82575(struct e1000_hw *hw);
 #define E1000_MRQC_RSS_FIELD_IPV6_UDP       0x00800000
 #define E1000_MRQC_RSS_FIELD_IPV6_UDP_EX    0x01000000
 
+/* ETQF register bit definitions */
+#define E1000_ETQF_FILTER_ENABLE            (1 << 26)
+#define E1000_ETQF_IMM_INT                  (1 << 29)
+#define E1000_ETQF_QUEUE_ENABLE             (1 << 31)
+#define E1000_ETQF_QUEUE_SHIFT              16
+
+/* FTQF register bit definitions (82576) */
+#define E1000_FTQF_QUEUE_ENABLE             0x00000100
+#define E1000_FTQF_VF_BP                    0x00008000
+#define E1000_FTQF_QUEUE_SHIFT              16
+#define E1000_FTQF_MASK                     0xF0000000
+#define E1000_FTQF_MASK_PROTO_BP            0x10000000
+
+/* IMIR/IMIREXT register bit definitions */
+#define E1000_IMIR_PORT_IM_EN               0x00010000
+#define E1000_IMIREXT_SIZE_BP               0x00001000
+#define E1000_IMIREXT_CTRL_BP               0x00080000
+
 #define E1000_EICR_TX_QUEUE ( \
     E1000_EICR_TX_QUEUE0 |    \
     E1000_EICR_TX_QUEUE1 |    \
@@ -253,6 +253,8 @@
 #define E1000_IMIR(_i)      (0x05A80 + ((_i) * 4))  /* Immediate Interrupt */
 #define E1000_IMIREXT(_i)   (0x05AA0 + ((_i) * 4))  /* Immediate Interrupt Ext*/
 #define E1000_IMIRVP    0x05AC0 /* Immediate Interrupt RX VLAN Priority - RW */
+#define E1000_FTQF(_n)  (0x059E0 + ((_n) * 4)) /* 5-tuple Queue Filter - RW */
+#define E1000_ETQF(_n)  (0x05CB0 + ((_n) * 4)) /* EType Queue Filter - RW */
 /* MSI-X Allocation Register (_i) - RW */
 #define E1000_MSIXBM(_i)    (0x01600 + ((_i) * 4))
 /* MSI-X Table entry addr low reg 0 - RW */
@@ -72,6 +72,9 @@ struct igb_adapter;
 #define IGB_MAX_RX_QUEUES                  4
 #define IGB_MAX_TX_QUEUES                  4
 
+/* ETQF and 2-tuple filters available for flow steering */
+#define IGB_MAX_RX_FILTERS                 8
+
 /* RX descriptor control thresholds.
  * PTHRESH - MAC will consider prefetch if it has fewer than this number of
  *           descriptors available in its onboard memory.
@@ -265,6 +268,7 @@ struct igb_adapter {
 	/* OS defined structs */
 	struct rtnet_device *netdev;
 	struct rtskb_queue skb_pool;
+	struct rtskb_queue copy_pool;	/* small frames, see copybreak */
 
 	// struct napi_struct napi;
 	struct pci_dev *pdev;
@@ -308,6 +312,10 @@ struct igb_adapter {
 #endif
 	unsigned int tx_ring_count;
 	unsigned int rx_ring_count;
+
+	/* flow steering, slot i uses ETQF(i) or IMIR(i)/FTQF(i) */
+	struct rtdev_rx_filter rx_filter[IGB_MAX_RX_FILTERS];
+	unsigned int num_rt_rx_filters;
 };
 
 #define IGB_FLAG_HAS_MSI           (1 << 0)
@@ -42,6 +42,7 @@
 #include <linux/delay.h>
 #include <linux/interrupt.h>
 #include <linux/if_ether.h>
+#include <linux/if_vlan.h>
 #include <linux/etherdevice.h>
 #include <linux/aer.h>
 #ifdef CONFIG_IGB_DCA
@@ -50,6 +51,7 @@
 #include "igb.h"
 
 #include <rtnet_port.h>
+#include <rtskb_ring.h>
 
 // RTNET redefines
 #ifdef  NETIF_F_TSO
@@ -136,6 +138,11 @@ static int cards[MAX_UNITS] = { [0 ... (MAX_UNITS-1)] = 1 };
 compat_module_int_param_array(cards, MAX_UNITS);
 MODULE_PARM_DESC(cards, "array of cards to be supported (eg. 1,0,1)");
 
+static unsigned int copybreak = 256;
+module_param(copybreak, uint, 0444);
+MODULE_PARM_DESC(copybreak, "Maximum size of packet that is copied to a new "
+		 "buffer on receive (0 disables)");
+
 static struct pci_device_id igb_pci_tbl[] = {
 	{ PCI_VDEVICE(INTEL, E1000_DEV_ID_82576), board_82575 },
 	{ PCI_VDEVICE(INTEL, E1000_DEV_ID_82576_FIBER), board_82575 },
@@ -162,6 +169,10 @@ static int igb_open(struct rtnet_device *);
 static int igb_close(struct rtnet_device *);
 static void igb_configure_tx(struct igb_adapter *);
 static void igb_configure_rx(struct igb_adapter *);
+static void igb_setup_reta(struct igb_adapter *);
+static void igb_restore_rx_filters(struct igb_adapter *);
+static int igb_add_rx_filter(struct rtnet_device *, struct rtdev_rx_filter *);
+static int igb_del_rx_filter(struct rtnet_device *, struct rtdev_rx_filter *);
 static void igb_setup_rctl(struct igb_adapter *);
 static void igb_clean_all_tx_rings(struct igb_adapter *);
 static void igb_clean_all_rx_rings(struct igb_adapter *);
@@ -175,7 +186,7 @@ static int igb_xmit_frame_ring_adv(struct rtskb *, struct rtnet_device *,
 				  struct igb_ring *);
 static int igb_xmit_frame_adv(struct rtskb *skb, struct rtnet_device *);
 static struct net_device_stats *igb_get_stats(struct rtnet_device *);
-/* static int igb_change_mtu(struct net_device *, int); */
+static int igb_change_mtu(struct rtnet_device *, int);
 /* static int igb_set_mac(struct net_device *, void *); */
 static int igb_intr(rtdm_irq_t *irq_handle);
 #ifdef CONFIG_PCI_MSI
@@ -861,6 +872,7 @@ static void igb_configure(struct igb_adapter *adapter)
 	igb_configure_tx(adapter);
 	igb_setup_rctl(adapter);
 	igb_configure_rx(adapter);
+	igb_restore_rx_filters(adapter);
 
 	igb_rx_fifo_flush_82575(&adapter->hw);
 
@@ -1088,7 +1100,7 @@ static dma_addr_t igb_map_rtskb(struct rtnet_device *netdev,
 	struct device *dev = &adapter->pdev->dev;
 	dma_addr_t addr;
 
-	addr = dma_map_single(dev, skb->buf_start, RTSKB_SIZE,
+	addr = dma_map_single(dev, skb->buf_start, rtskb_buf_size,
 			      DMA_BIDIRECTIONAL);
 	if (dma_mapping_error(dev, addr)) {
 		dev_err(dev, "DMA map failed\n");
@@ -1103,7 +1115,7 @@ static void igb_unmap_rtskb(struct rtnet_device *netdev,
 	struct igb_adapter *adapter = netdev->priv;
 	struct device *dev = &adapter->pdev->dev;
 
-	dma_unmap_single(dev, skb->buf_dma_addr, RTSKB_SIZE,
+	dma_unmap_single(dev, skb->buf_dma_addr, rtskb_buf_size,
 			 DMA_BIDIRECTIONAL);
 }
 
@@ -1218,11 +1230,13 @@ static int igb_probe(struct pci_dev *pdev,
 	netdev->get_stats = igb_get_stats;
 	netdev->map_rtskb = igb_map_rtskb;
 	netdev->unmap_rtskb = igb_unmap_rtskb;
+	netdev->add_rx_filter = igb_add_rx_filter;
+	netdev->del_rx_filter = igb_del_rx_filter;
+	netdev->change_mtu = igb_change_mtu;
+	netdev->set_multicast_list = igb_set_multi;
 #if 0
 	netdev->do_ioctl = igb_ioctl;
-	netdev->set_multicast_list = igb_set_multi;
 	netdev->set_mac_address = igb_set_mac;
-	netdev->change_mtu = igb_change_mtu;
 
 	// No ethtool support for now
 	igb_set_ethtool_ops(netdev);
@@ -1466,6 +1480,8 @@ err_eeprom:
 
 	igb_remove_device(hw);
 	igb_free_queues(adapter);
+	rtskb_pool_release(&adapter->copy_pool);
+	rtskb_pool_release(&adapter->skb_pool);
 err_sw_init:
 err_hw_init:
 	iounmap(hw->hw_addr);
@@ -1530,6 +1546,7 @@ static void igb_remove(struct pci_dev *pdev)
 #endif
 	igb_free_queues(adapter);
 
+	rtskb_pool_release(&adapter->copy_pool);
 	rtskb_pool_release(&adapter->skb_pool);
 
 	iounmap(adapter->hw.hw_addr);
@@ -1560,6 +1577,7 @@ static int igb_sw_init(struct igb_adapter *adapter)
 	struct e1000_hw *hw = &adapter->hw;
 	struct rtnet_device *netdev = adapter->netdev;
 	struct pci_dev *pdev = adapter->pdev;
+	unsigned int copy_rtskbs;
 
 	pci_read_config_word(pdev, PCI_COMMAND, &hw->bus.pci_cmd_word);
 
@@ -1581,6 +1599,13 @@ static int igb_sw_init(struct igb_adapter *adapter)
             return -ENOMEM;
         }
 
+	copy_rtskbs = copybreak ? 16 : 0;
+	if (rtskb_pool_init(&adapter->copy_pool, copy_rtskbs) < copy_rtskbs) {
+		rtskb_pool_release(&adapter->copy_pool);
+		rtskb_pool_release(&adapter->skb_pool);
+		return -ENOMEM;
+	}
+
 #ifdef CONFIG_PCI_MSI
 	/* This call may decrease the number of queues depending on
 	 * interrupt mode. */
@@ -1973,24 +1998,12 @@ static void igb_setup_rctl(struct igb_adapter *adapter)
 		break;
 	}
 
-	/* 82575 and greater support packet-split where the protocol
-	 * header is placed in skb->data and the packet data is
-	 * placed in pages hanging off of skb_shinfo(skb)->nr_frags.
-	 * In the case of a non-split, skb->data is linearly filled,
-	 * followed by the page buffers.  Therefore, skb->data is
-	 * sized to hold the largest protocol header.
+	/* rtskbs are linear, so jumbo frames are received into a single
+	 * buffer as well instead of using packet split.  RLPML keeps the
+	 * hardware from writing beyond max_frame_size.
 	 */
-	/* allocations using alloc_page take too long for regular MTU
-	 * so only enable packet split for jumbo frames */
-	if (adapter->netdev->mtu > ETH_DATA_LEN) {
-		adapter->rx_ps_hdr_size = IGB_RXBUFFER_128;
-		srrctl |= adapter->rx_ps_hdr_size <<
-			 E1000_SRRCTL_BSIZEHDRSIZE_SHIFT;
-		srrctl |= E1000_SRRCTL_DESCTYPE_HDR_SPLIT_ALWAYS;
-	} else {
-		adapter->rx_ps_hdr_size = 0;
-		srrctl |= E1000_SRRCTL_DESCTYPE_ADV_ONEBUF;
-	}
+	adapter->rx_ps_hdr_size = 0;
+	srrctl |= E1000_SRRCTL_DESCTYPE_ADV_ONEBUF;
 
 	for (i = 0; i < adapter->num_rx_queues; i++) {
 		j = adapter->rx_ring[i].reg_idx;
@@ -2062,25 +2075,11 @@ static void igb_configure_rx(struct igb_adapter *adapter)
 	if (adapter->num_rx_queues > 1) {
 		u32 random[10];
 		u32 mrqc;
-		u32 j, shift;
-		union e1000_reta {
-			u32 dword;
-			u8  bytes[4];
-		} reta;
+		u32 j;
 
 		get_random_bytes(&random[0], 40);
 
-		if (hw->mac.type >= e1000_82576)
-			shift = 0;
-		else
-			shift = 6;
-		for (j = 0; j < (32 * 4); j++) {
-			reta.bytes[j & 3] =
-				adapter->rx_ring[(j % adapter->num_rx_queues)].reg_idx << shift;
-			if ((j & 3) == 3)
-				writel(reta.dword,
-				       hw->hw_addr + E1000_RETA(0) + (j & ~3));
-		}
+		igb_setup_reta(adapter);
 		mrqc = E1000_MRQC_ENABLE_RSS_4Q;
 
 		/* Fill out hash function seeds */
@@ -2128,6 +2127,197 @@ static void igb_configure_rx(struct igb_adapter *adapter)
 	wr32(E1000_RCTL, rctl);
 }
 
+/**
+ * igb_setup_reta - Fill the RSS redirection table
+ * @adapter: board private structure
+ *
+ * As long as flow steering filters target the real-time queue (the last
+ * one), that queue is left out of the table so that it only receives the
+ * steered frames and never holds bulk traffic.
+ **/
+static void igb_setup_reta(struct igb_adapter *adapter)
+{
+	struct e1000_hw *hw = &adapter->hw;
+	int num_queues = adapter->num_rx_queues;
+	u32 j, shift;
+	union e1000_reta {
+		u32 dword;
+		u8  bytes[4];
+	} reta;
+
+	if (adapter->num_rt_rx_filters > 0)
+		num_queues--;
+
+	if (hw->mac.type >= e1000_82576)
+		shift = 0;
+	else
+		shift = 6;
+	for (j = 0; j < (32 * 4); j++) {
+		reta.bytes[j & 3] =
+			adapter->rx_ring[(j % num_queues)].reg_idx << shift;
+		if ((j & 3) == 3)
+			writel(reta.dword,
+			       hw->hw_addr + E1000_RETA(0) + (j & ~3));
+	}
+}
+
+/**
+ * igb_write_rx_filter - Program a flow steering filter slot
+ * @adapter: board private structure
+ * @i: filter slot
+ *
+ * Matching frames raise an immediate interrupt, bypassing the interrupt
+ * throttling. With more than one queue, they are also steered to the
+ * requested queue which has its own MSI-X vector.
+ **/
+static void igb_write_rx_filter(struct igb_adapter *adapter, int i)
+{
+	struct e1000_hw *hw = &adapter->hw;
+	struct rtdev_rx_filter *filter = &adapter->rx_filter[i];
+	bool steer = (adapter->num_rx_queues > 1);
+	u32 etqf = 0, ftqf;
+	u32 queue = 0;
+
+	if (steer) {
+		queue = filter->queue;
+		if (queue == RTDEV_RX_QUEUE_RT)
+			queue = adapter->num_rx_queues - 1;
+		queue = adapter->rx_ring[queue].reg_idx;
+	}
+
+	switch (filter->type) {
+	case RTDEV_RX_FILTER_ETHERTYPE:
+		etqf = filter->value | E1000_ETQF_FILTER_ENABLE |
+			E1000_ETQF_IMM_INT;
+		if (steer)
+			etqf |= E1000_ETQF_QUEUE_ENABLE |
+				(queue << E1000_ETQF_QUEUE_SHIFT);
+		break;
+
+	case RTDEV_RX_FILTER_UDP_DPORT:
+		/* 2-tuple filter: protocol and destination port */
+		ftqf = IPPROTO_UDP | E1000_FTQF_VF_BP |
+			(E1000_FTQF_MASK & ~E1000_FTQF_MASK_PROTO_BP);
+		if (steer)
+			ftqf |= E1000_FTQF_QUEUE_ENABLE |
+				(queue << E1000_FTQF_QUEUE_SHIFT);
+
+		wr32(E1000_IMIR(i), htons(filter->value) |
+		     E1000_IMIR_PORT_IM_EN);
+		wr32(E1000_IMIREXT(i), E1000_IMIREXT_SIZE_BP |
+		     E1000_IMIREXT_CTRL_BP);
+		wr32(E1000_FTQF(i), ftqf);
+		break;
+	}
+
+	wr32(E1000_ETQF(i), etqf);
+}
+
+/**
+ * igb_clear_rx_filter - Disable a flow steering filter slot
+ * @adapter: board private structure
+ * @i: filter slot
+ **/
+static void igb_clear_rx_filter(struct igb_adapter *adapter, int i)
+{
+	struct e1000_hw *hw = &adapter->hw;
+
+	if (adapter->rx_filter[i].type == RTDEV_RX_FILTER_UDP_DPORT) {
+		wr32(E1000_IMIR(i), 0);
+		wr32(E1000_IMIREXT(i), 0);
+		wr32(E1000_FTQF(i), E1000_FTQF_MASK | E1000_FTQF_VF_BP);
+	} else
+		wr32(E1000_ETQF(i), 0);
+
+	adapter->rx_filter[i].type = 0;
+}
+
+/**
+ * igb_restore_rx_filters - Reprogram flow steering filters after reset
+ * @adapter: board private structure
+ **/
+static void igb_restore_rx_filters(struct igb_adapter *adapter)
+{
+	int i;
+
+	for (i = 0; i < IGB_MAX_RX_FILTERS; i++)
+		if (adapter->rx_filter[i].type)
+			igb_write_rx_filter(adapter, i);
+}
+
+/**
+ * igb_add_rx_filter - Install a flow steering filter
+ * @netdev: network interface device structure
+ * @filter: filter to install
+ *
+ * The 82575 lacks the 2-tuple queue filters and only supports ethertype
+ * steering.
+ **/
+static int igb_add_rx_filter(struct rtnet_device *netdev,
+			     struct rtdev_rx_filter *filter)
+{
+	struct igb_adapter *adapter = netdev->priv;
+	int i, slot = -1;
+
+	if (filter->type == RTDEV_RX_FILTER_UDP_DPORT &&
+	    adapter->hw.mac.type != e1000_82576)
+		return -EOPNOTSUPP;
+
+	if (filter->queue != RTDEV_RX_QUEUE_RT &&
+	    filter->queue >= adapter->num_rx_queues)
+		return -EINVAL;
+
+	for (i = 0; i < IGB_MAX_RX_FILTERS; i++) {
+		if (!adapter->rx_filter[i].type) {
+			if (slot < 0)
+				slot = i;
+		} else if (adapter->rx_filter[i].type == filter->type &&
+			   adapter->rx_filter[i].value == filter->value)
+			return -EEXIST;
+	}
+	if (slot < 0)
+		return -ENOSPC;
+
+	adapter->rx_filter[slot] = *filter;
+
+	if (filter->queue == RTDEV_RX_QUEUE_RT &&
+	    adapter->num_rt_rx_filters++ == 0 && adapter->num_rx_queues > 1)
+		igb_setup_reta(adapter);
+
+	igb_write_rx_filter(adapter, slot);
+
+	return 0;
+}
+
+/**
+ * igb_del_rx_filter - Remove a flow steering filter
+ * @netdev: network interface device structure
+ * @filter: filter to remove
+ **/
+static int igb_del_rx_filter(struct rtnet_device *netdev,
+			     struct rtdev_rx_filter *filter)
+{
+	struct igb_adapter *adapter = netdev->priv;
+	unsigned int queue;
+	int i;
+
+	for (i = 0; i < IGB_MAX_RX_FILTERS; i++)
+		if (adapter->rx_filter[i].type == filter->type &&
+		    adapter->rx_filter[i].value == filter->value)
+			break;
+	if (i == IGB_MAX_RX_FILTERS)
+		return -ENOENT;
+
+	queue = adapter->rx_filter[i].queue;
+	igb_clear_rx_filter(adapter, i);
+
+	if (queue == RTDEV_RX_QUEUE_RT &&
+	    --adapter->num_rt_rx_filters == 0 && adapter->num_rx_queues > 1)
+		igb_setup_reta(adapter);
+
+	return 0;
+}
+
 /**
  * igb_free_tx_resources - Free Tx Resources per Queue
  * @tx_ring: Tx descriptor ring for a specific queue
@@ -2358,6 +2548,8 @@ static void igb_set_multi(struct rtnet_device *netdev)
 	struct igb_adapter *adapter = netdev->priv;
 	struct e1000_hw *hw = &adapter->hw;
 	struct e1000_mac_info *mac = &hw->mac;
+	u8 mta_list[RTDEV_MC_ADDRS * ETH_ALEN];
+	unsigned int i;
 	u32 rctl;
 
 	/* Check for Promiscuous and All Multicast modes */
@@ -2377,8 +2569,11 @@ static void igb_set_multi(struct rtnet_device *netdev)
 	}
 	wr32(E1000_RCTL, rctl);
 
-	/* nothing to program, so clear mc list */
-	igb_update_mc_addr_list_82575(hw, NULL, 0, 1, mac->rar_entry_count);
+	for (i = 0; i < netdev->mc_count; i++)
+		memcpy(mta_list + i * ETH_ALEN, netdev->mc_list[i].addr,
+		       ETH_ALEN);
+	igb_update_mc_addr_list_82575(hw, mta_list, netdev->mc_count, 1,
+				      mac->rar_entry_count);
 }
 
 /* Need to wait a few seconds after link up to get diagnostic information from
@@ -3149,18 +3344,21 @@ igb_get_stats(struct rtnet_device *netdev)
 	return &adapter->net_stats;
 }
 
-#if 0
 /**
  * igb_change_mtu - Change the Maximum Transfer Unit
  * @netdev: network interface device structure
  * @new_mtu: new value for maximum frame size
  *
+ * Only called while the device is down. Jumbo frames are received into a
+ * single rtskb, so rtskb_size has to be raised accordingly.
+ *
  * Returns 0 on success, negative on failure
  **/
-static int igb_change_mtu(struct net_device *netdev, int new_mtu)
+static int igb_change_mtu(struct rtnet_device *netdev, int new_mtu)
 {
 	struct igb_adapter *adapter = netdev->priv;
 	int max_frame = new_mtu + ETH_HLEN + ETH_FCS_LEN;
+	unsigned int rx_buffer_len;
 
 	if ((max_frame < ETH_ZLEN + ETH_FCS_LEN) ||
 	    (max_frame > MAX_JUMBO_FRAME_SIZE)) {
@@ -3174,52 +3372,35 @@ static int igb_change_mtu(struct net_device *netdev, int new_mtu)
 		return -EINVAL;
 	}
 
+	/* LPE and RLPML protect us, so the buffer only needs to hold the
+	 * largest accepted frame plus a VLAN tag */
+	if (max_frame <= MAXIMUM_ETHERNET_VLAN_SIZE)
+		rx_buffer_len = MAXIMUM_ETHERNET_VLAN_SIZE;
+	else
+		rx_buffer_len = max_frame + VLAN_HLEN;
+
+	if (rx_buffer_len + NET_IP_ALIGN > rtskb_buf_size) {
+		dev_err(&adapter->pdev->dev, "MTU %d requires rtskb_size >= "
+			"%d\n", new_mtu, rx_buffer_len + NET_IP_ALIGN);
+		return -EINVAL;
+	}
+
 	while (test_and_set_bit(__IGB_RESETTING, &adapter->state))
 		msleep(1);
-	/* igb_down has a dependency on max_frame_size */
-	adapter->max_frame_size = max_frame;
-	if (rtnetif_running(netdev))
-		igb_down(adapter);
-
-	/* NOTE: netdev_alloc_skb reserves 16 bytes, and typically NET_IP_ALIGN
-	 * means we reserve 2 more, this pushes us to allocate from the next
-	 * larger slab size.
-	 * i.e. RXBUFFER_2048 --> size-4096 slab
-	 */
 
-	if (max_frame <= IGB_RXBUFFER_256)
-		adapter->rx_buffer_len = IGB_RXBUFFER_256;
-	else if (max_frame <= IGB_RXBUFFER_512)
-		adapter->rx_buffer_len = IGB_RXBUFFER_512;
-	else if (max_frame <= IGB_RXBUFFER_1024)
-		adapter->rx_buffer_len = IGB_RXBUFFER_1024;
-	else if (max_frame <= IGB_RXBUFFER_2048)
-		adapter->rx_buffer_len = IGB_RXBUFFER_2048;
-	else
-#if (PAGE_SIZE / 2) > IGB_RXBUFFER_16384
-		adapter->rx_buffer_len = IGB_RXBUFFER_16384;
-#else
-		adapter->rx_buffer_len = PAGE_SIZE / 2;
-#endif
-	/* adjust allocation if LPE protects us, and we aren't using SBP */
-	if ((max_frame == ETH_FRAME_LEN + ETH_FCS_LEN) ||
-	     (max_frame == MAXIMUM_ETHERNET_VLAN_SIZE))
-		adapter->rx_buffer_len = MAXIMUM_ETHERNET_VLAN_SIZE;
+	adapter->max_frame_size = max_frame;
+	adapter->rx_buffer_len = rx_buffer_len;
 
 	dev_info(&adapter->pdev->dev, "changing MTU from %d to %d\n",
 		 netdev->mtu, new_mtu);
 	netdev->mtu = new_mtu;
 
-	if (rtnetif_running(netdev))
-		igb_up(adapter);
-	else
-		igb_reset(adapter);
+	igb_reset(adapter);
 
 	clear_bit(__IGB_RESETTING, &adapter->state);
 
 	return 0;
 }
-#endif
 
 /**
  * igb_update_stats - Update the board statistics counters
@@ -4057,6 +4238,23 @@ send_up:
 			goto next_desc;
 		}
 
+		/* copy small frames into a buffer of the copy pool and
+		 * leave the large one in the ring */
+		if (skb->len < copybreak) {
+			struct rtskb *new_skb =
+				rtskb_ring_rx_copybreak(&adapter->pdev->dev,
+							skb, &adapter->copy_pool,
+							skb->len, NET_IP_ALIGN);
+			/* recycle */
+			rtskb_trim(skb, 0);
+			buffer_info->skb = skb;
+			if (!new_skb) {
+				adapter->net_stats.rx_dropped++;
+				goto next_desc;
+			}
+			skb = new_skb;
+		}
+
 		total_bytes += skb->len;
 		total_packets++;
 
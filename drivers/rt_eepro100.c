@@ -109,6 +109,7 @@ static int debug = -1;	/* The debug level */
 // *** RTnet ***
 #include <linux/if_vlan.h>
 #include <rtnet_port.h>
+#include <rtskb_ring.h>
 
 #define MAX_UNITS               8
 
@@ -562,6 +563,8 @@ static int speedo_close(struct rtnet_device *rtdev);
 static void set_rx_mode(struct rtnet_device *rtdev);
 static void speedo_show_state(struct rtnet_device *rtdev);
 static struct net_device_stats *speedo_get_stats(struct rtnet_device *rtdev);
+static dma_addr_t speedo_map_rtskb(struct rtnet_device *rtdev, struct rtskb *skb);
+static void speedo_unmap_rtskb(struct rtnet_device *rtdev, struct rtskb *skb);
 
 
 static inline void speedo_write_flush(long ioaddr)
@@ -798,6 +801,8 @@ static int speedo_found1(struct pci_dev *pdev,
 	rtdev->stop = &speedo_close;
 	rtdev->hard_header = &rt_eth_header;
 	rtdev->get_stats = &speedo_get_stats;
+	rtdev->map_rtskb = &speedo_map_rtskb;
+	rtdev->unmap_rtskb = &speedo_unmap_rtskb;
 	//rtdev->do_ioctl = NULL;
 
 	if (rtskb_pool_init(&sp->skb_pool, RX_RING_SIZE*2) < RX_RING_SIZE*2) {
@@ -1057,6 +1062,22 @@ static struct net_device_stats *speedo_get_stats(struct rtnet_device *rtdev)
 	return &sp->stats;
 }
 
+// *** RTnet ***
+static dma_addr_t speedo_map_rtskb(struct rtnet_device *rtdev, struct rtskb *skb)
+{
+	struct speedo_private *sp = (struct speedo_private *)rtdev->priv;
+
+	return rtskb_ring_map(&sp->pdev->dev, skb);
+}
+
+static void speedo_unmap_rtskb(struct rtnet_device *rtdev, struct rtskb *skb)
+{
+	struct speedo_private *sp = (struct speedo_private *)rtdev->priv;
+
+	rtskb_ring_unmap(&sp->pdev->dev, skb);
+}
+// *** RTnet ***
+
 /* Initialize the Rx and Tx rings, along with various 'dev' bits. */
 static void
 speedo_init_rx_ring(struct rtnet_device *rtdev)
@@ -1080,9 +1101,7 @@ speedo_init_rx_ring(struct rtnet_device *rtdev)
 		// *** RTnet ***
 		rxf = (struct RxFD *)skb->tail;
 		sp->rx_ringp[i] = rxf;
-		sp->rx_ring_dma[i] =
-			pci_map_single(sp->pdev, rxf,
-					PKT_BUF_SZ + sizeof(struct RxFD), PCI_DMA_BIDIRECTIONAL);
+		sp->rx_ring_dma[i] = rtskb_data_dma_addr(skb, 0); // *** RTnet ***
 		rtskb_reserve(skb, sizeof(struct RxFD));
 		if (last_rxf) {
 			last_rxf->link = cpu_to_le32(sp->rx_ring_dma[i]);
@@ -1150,8 +1169,7 @@ speedo_start_xmit(struct rtskb *skb, struct rtnet_device *rtdev)
 	/* The data region is always in one buffer descriptor. */
 	sp->tx_ring[entry].count = cpu_to_le32(sp->tx_threshold);
 	sp->tx_ring[entry].tx_buf_addr0 =
-		cpu_to_le32(pci_map_single(sp->pdev, skb->data,
-					   skb->len, PCI_DMA_TODEVICE));
+		cpu_to_le32(rtskb_data_dma_addr(skb, 0)); // *** RTnet ***
 	sp->tx_ring[entry].tx_buf_size0 = cpu_to_le32(skb->len);
 
 // *** RTnet ***
@@ -1176,6 +1194,8 @@ speedo_start_xmit(struct rtskb *skb, struct rtnet_device *rtdev)
 	/* get and patch time stamp just before the transmission */
 	if (skb->xmit_stamp)
 		*skb->xmit_stamp = cpu_to_be64(rtdm_clock_read() + *skb->xmit_stamp);
+
+	rtskb_ring_tx_sync(&sp->pdev->dev, skb);
 // *** RTnet ***
 
 	clear_suspend(sp->last_cmd);
@@ -1225,9 +1245,6 @@ static void speedo_tx_buffer_gc(struct rtnet_device *rtdev)
 		if (sp->tx_skbuff[entry]) {
 			sp->stats.tx_packets++;	/* Count only user packets. */
 			sp->stats.tx_bytes += sp->tx_skbuff[entry]->len;
-			pci_unmap_single(sp->pdev,
-					le32_to_cpu(sp->tx_ring[entry].tx_buf_addr0),
-					sp->tx_skbuff[entry]->len, PCI_DMA_TODEVICE);
 
 			// *** RTnet ***
 			dev_kfree_rtskb(sp->tx_skbuff[entry]);
@@ -1434,9 +1451,7 @@ static inline struct RxFD *speedo_rx_alloc(struct rtnet_device *rtdev, int entry
 	}
 	rtskb_reserve(skb, 2);  /* IP header alignment */
 	rxf = sp->rx_ringp[entry] = (struct RxFD *)skb->tail;
-	sp->rx_ring_dma[entry] =
-		pci_map_single(sp->pdev, rxf,
-					   PKT_BUF_SZ + sizeof(struct RxFD), PCI_DMA_FROMDEVICE);
+	sp->rx_ring_dma[entry] = rtskb_data_dma_addr(skb, 0); // *** RTnet ***
 	// *** RTnet ***
 	skb->rtdev = rtdev;
 	// *** RTnet ***
@@ -1601,11 +1616,12 @@ speedo_rx(struct rtnet_device *rtdev, int* packets, nanosecs_abs_t *time_stamp)
 						   rtdev->name);
 					break;
 				}
+				/* the buffer stays mapped, sync header and payload */
+				pci_dma_sync_single_for_cpu(sp->pdev, sp->rx_ring_dma[entry],
+					sizeof(struct RxFD) + pkt_len, PCI_DMA_BIDIRECTIONAL);
 				sp->rx_skbuff[entry] = NULL;
 				rtskb_put(skb, pkt_len);
 				sp->rx_ringp[entry] = NULL;
-				pci_unmap_single(sp->pdev, sp->rx_ring_dma[entry],
-						PKT_BUF_SZ + sizeof(struct RxFD), PCI_DMA_FROMDEVICE);
 			}
 			skb->protocol = rt_eth_type_trans(skb, rtdev);
 			//rtmac
@@ -1673,12 +1689,8 @@ speedo_close(struct rtnet_device *rtdev)
 		struct rtskb *skb = sp->rx_skbuff[i];
 		sp->rx_skbuff[i] = 0;
 		/* Clear the Rx descriptors. */
-		if (skb) {
-			pci_unmap_single(sp->pdev,
-					 sp->rx_ring_dma[i],
-					 PKT_BUF_SZ + sizeof(struct RxFD), PCI_DMA_FROMDEVICE);
+		if (skb)
 			dev_kfree_rtskb(skb);
-		}
 	}
 
 	for (i = 0; i < TX_RING_SIZE; i++) {
@@ -1686,10 +1698,6 @@ speedo_close(struct rtnet_device *rtdev)
 		sp->tx_skbuff[i] = 0;
 		/* Clear the Tx descriptors. */
 		if (skb) {
-			pci_unmap_single(sp->pdev,
-					 le32_to_cpu(sp->tx_ring[i].tx_buf_addr0),
-					 skb->len, PCI_DMA_TODEVICE);
-
 			// *** RTnet ***
 			dev_kfree_rtskb(skb);
 			// *** RTnet ***
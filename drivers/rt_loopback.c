@@ -79,6 +79,7 @@ static int rt_loopback_xmit(struct rtskb *rtskb, struct rtnet_device *rtdev)
 
     /* make sure that critical fields are re-intialised */
     rtskb->chain_end = rtskb;
+    rtskb->time_stamp = rtdm_clock_read();
 
     /* parse the Ethernet header as usual */
     rtskb->protocol = rt_eth_type_trans(rtskb, rtdev);
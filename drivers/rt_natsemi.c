@@ -173,6 +173,7 @@
 
 /*** RTnet ***/
 #include <rtnet_port.h>
+#include <rtskb_ring.h>
 
 #define MAX_UNITS 8		/* More are supported, limit only on options */
 #define DEFAULT_RX_POOL_SIZE    16
@@ -714,11 +715,15 @@ static int start_tx(struct rtskb *skb, struct rtnet_device *dev);
 static int intr_handler(rtdm_irq_t *irq_handle);
 static void netdev_error(struct rtnet_device *dev, int intr_status);
 static void netdev_rx(struct rtnet_device *dev, nanosecs_abs_t *time_stamp);
-static void netdev_tx_done(struct rtnet_device *dev);
+static void netdev_tx_done(struct rtnet_device *dev,
+			   struct rtskb_queue *tx_done);
 static void __set_rx_mode(struct rtnet_device *dev);
 /*static void set_rx_mode(struct rtnet_device *dev);*/
 static void __get_stats(struct rtnet_device *rtdev);
 static struct net_device_stats *get_stats(struct rtnet_device *dev);
+static dma_addr_t natsemi_map_rtskb(struct rtnet_device *dev,
+				    struct rtskb *skb);
+static void natsemi_unmap_rtskb(struct rtnet_device *dev, struct rtskb *skb);
 /*static int netdev_ioctl(struct net_device *dev, struct ifreq *rq, int cmd);
 static int netdev_set_wol(struct rtnet_device *dev, u32 newval);
 static int netdev_get_wol(struct rtnet_device *dev, u32 *supported, u32 *cur);
@@ -865,6 +870,8 @@ static int natsemi_probe1 (struct pci_dev *pdev,
 	dev->hard_start_xmit = &start_tx;
 	dev->stop = &netdev_close;
 	dev->get_stats = &get_stats;
+	dev->map_rtskb = &natsemi_map_rtskb;
+	dev->unmap_rtskb = &natsemi_unmap_rtskb;
 /*** RTnet ***
 	dev->set_multicast_list = &set_rx_mode;
 	dev->do_ioctl = &netdev_ioctl;
@@ -1543,13 +1550,11 @@ static void refill_rx(struct rtnet_device *dev)
 		struct rtskb *skb;
 		int entry = np->dirty_rx % RX_RING_SIZE;
 		if (np->rx_skbuff[entry] == NULL) {
-			skb = dev_alloc_rtskb(np->rx_buf_sz, &np->skb_pool);
+			skb = rtskb_ring_rx_alloc(dev, &np->skb_pool,
+				np->rx_buf_sz, 0, &np->rx_dma[entry]);
 			np->rx_skbuff[entry] = skb;
 			if (skb == NULL)
 				break; /* Better luck next round. */
-			skb->rtdev = dev; /* Mark as being used by this device. */
-			np->rx_dma[entry] = pci_map_single(np->pci_dev,
-				skb->data, np->rx_buf_sz, PCI_DMA_FROMDEVICE);
 			np->rx_ring[entry].addr = cpu_to_le32(np->rx_dma[entry]);
 		}
 		np->rx_ring[entry].cmd_status = cpu_to_le32(np->rx_buf_sz);
@@ -1606,9 +1611,6 @@ static void drain_tx(struct rtnet_device *dev)
 
 	for (i = 0; i < TX_RING_SIZE; i++) {
 		if (np->tx_skbuff[i]) {
-			pci_unmap_single(np->pci_dev,
-				np->rx_dma[i], np->tx_skbuff[i]->len,
-				PCI_DMA_TODEVICE);
 			dev_kfree_rtskb(np->tx_skbuff[i]);
 			np->stats.tx_dropped++;
 		}
@@ -1625,12 +1627,8 @@ static void drain_ring(struct rtnet_device *dev)
 	for (i = 0; i < RX_RING_SIZE; i++) {
 		np->rx_ring[i].cmd_status = 0;
 		np->rx_ring[i].addr = 0xBADF00D0; /* An invalid address. */
-		if (np->rx_skbuff[i]) {
-			pci_unmap_single(np->pci_dev,
-				np->rx_dma[i], np->rx_skbuff[i]->len,
-				PCI_DMA_FROMDEVICE);
+		if (np->rx_skbuff[i])
 			dev_kfree_rtskb(np->rx_skbuff[i]);
-		}
 		np->rx_skbuff[i] = NULL;
 	}
 	drain_tx(dev);
@@ -1674,6 +1672,7 @@ static int start_tx(struct rtskb *skb, struct rtnet_device *dev) /*** RTnet ***/
 	unsigned entry;
 /*** RTnet ***/
 	rtdm_lockctx_t context;
+	struct rtskb_queue tx_done;
 /*** RTnet ***/
 
 	/* Note: Ordering is important here, set the field with the
@@ -1683,13 +1682,13 @@ static int start_tx(struct rtskb *skb, struct rtnet_device *dev) /*** RTnet ***/
 	entry = np->cur_tx % TX_RING_SIZE;
 
 	np->tx_skbuff[entry] = skb;
-	np->tx_dma[entry] = pci_map_single(np->pci_dev,
-				skb->data,skb->len, PCI_DMA_TODEVICE);
+	np->tx_dma[entry] = rtskb_data_dma_addr(skb, 0); /*** RTnet ***/
 
 	np->tx_ring[entry].addr = cpu_to_le32(np->tx_dma[entry]);
 
 /*	spin_lock_irq(&np->lock);*/
 /*** RTnet ***/
+	rtskb_queue_init(&tx_done);
 	rtdm_lock_get_irqsave(&np->lock, context);
 /*** RTnet ***/
 
@@ -1698,13 +1697,14 @@ static int start_tx(struct rtskb *skb, struct rtnet_device *dev) /*** RTnet ***/
 		if (skb->xmit_stamp)
 			*skb->xmit_stamp = cpu_to_be64(rtdm_clock_read() +
 				*skb->xmit_stamp);
+		rtskb_ring_tx_sync(&np->pci_dev->dev, skb); /*** RTnet ***/
 		np->tx_ring[entry].cmd_status = cpu_to_le32(DescOwn | skb->len);
 		/* StrongARM: Explicitly cache flush np->tx_ring and
 		 * skb->data,skb->len. */
 		wmb();
 		np->cur_tx++;
 		if (np->cur_tx - np->dirty_tx >= TX_QUEUE_LEN - 1) {
-			netdev_tx_done(dev);
+			netdev_tx_done(dev, &tx_done);
 			if (np->cur_tx - np->dirty_tx >= TX_QUEUE_LEN - 1)
 				rtnetif_stop_queue(dev);
 		}
@@ -1718,6 +1718,8 @@ static int start_tx(struct rtskb *skb, struct rtnet_device *dev) /*** RTnet ***/
 /*	spin_unlock_irq(&np->lock);*/
 /*** RTnet ***/
 	rtdm_lock_put_irqrestore(&np->lock, context);
+
+	rtskb_ring_tx_free(&tx_done);
 /*** RTnet ***/
 
 /*	dev->trans_start = jiffies;*/
@@ -1729,7 +1731,8 @@ static int start_tx(struct rtskb *skb, struct rtnet_device *dev) /*** RTnet ***/
 	return 0;
 }
 
-static void netdev_tx_done(struct rtnet_device *dev)
+static void netdev_tx_done(struct rtnet_device *dev,
+			   struct rtskb_queue *tx_done)
 {
 	struct netdev_private *np = dev->priv;
 
@@ -1758,13 +1761,9 @@ static void netdev_tx_done(struct rtnet_device *dev)
 				np->stats.tx_window_errors++;
 			np->stats.tx_errors++;
 		}
-		pci_unmap_single(np->pci_dev,np->tx_dma[entry],
-					np->tx_skbuff[entry]->len,
-					PCI_DMA_TODEVICE);
 		/* Free the original skb. */
-		dev_kfree_rtskb(np->tx_skbuff[entry]); /*** RTnet ***/
+		rtskb_ring_tx_reclaim(&np->tx_skbuff[entry], tx_done); /*** RTnet ***/
 /*		dev_kfree_skb_irq(np->tx_skbuff[entry]);*/
-		np->tx_skbuff[entry] = NULL;
 	}
 	if (rtnetif_queue_stopped(dev)
 		&& np->cur_tx - np->dirty_tx < TX_QUEUE_LEN - 4) {
@@ -1785,9 +1784,11 @@ static int intr_handler(rtdm_irq_t *irq_handle)
 	long ioaddr = dev->base_addr;
 	int boguscnt = max_interrupt_work;
 	int ret = RTDM_IRQ_NONE;
+	struct rtskb_queue tx_done; /*** RTnet ***/
 
 	if (np->hands_off)
 		return ret;
+	rtskb_queue_init(&tx_done); /*** RTnet ***/
 	do {
 		/* Reading automatically acknowledges all int sources. */
 		u32 intr_status = readl((void *)(ioaddr + IntrStatus));
@@ -1812,8 +1813,9 @@ static int intr_handler(rtdm_irq_t *irq_handle)
 		if (intr_status &
 		   (IntrTxDone | IntrTxIntr | IntrTxIdle | IntrTxErr)) {
 			rtdm_lock_get(&np->lock);
-			netdev_tx_done(dev);
+			netdev_tx_done(dev, &tx_done);
 			rtdm_lock_put(&np->lock);
+			rtskb_ring_tx_free(&tx_done); /*** RTnet ***/
 		}
 
 		/* Abnormal error summary/uncommon events handlers. */
@@ -1906,12 +1908,9 @@ static void netdev_rx(struct rtnet_device *dev, nanosecs_abs_t *time_stamp)
 			} else {
 #endif
 			{
-				skb = np->rx_skbuff[entry];
-				pci_unmap_single(np->pci_dev, np->rx_dma[entry],
-					np->rx_skbuff[entry]->len,
-					PCI_DMA_FROMDEVICE);
-				rtskb_put(skb, pkt_len);
-				np->rx_skbuff[entry] = NULL;
+				skb = rtskb_ring_rx_take(&np->pci_dev->dev,
+							 &np->rx_skbuff[entry],
+							 pkt_len);
 			}
 /*** RTnet ***/
 			skb->protocol = rt_eth_type_trans(skb, dev);
@@ -2001,6 +2000,23 @@ static void __get_stats(struct rtnet_device *dev)
 	np->stats.rx_missed_errors += readl((void *)(ioaddr + RxMissed));
 }
 
+/*** RTnet ***/
+static dma_addr_t natsemi_map_rtskb(struct rtnet_device *dev,
+				    struct rtskb *skb)
+{
+	struct netdev_private *np = dev->priv;
+
+	return rtskb_ring_map(&np->pci_dev->dev, skb);
+}
+
+static void natsemi_unmap_rtskb(struct rtnet_device *dev, struct rtskb *skb)
+{
+	struct netdev_private *np = dev->priv;
+
+	rtskb_ring_unmap(&np->pci_dev->dev, skb);
+}
+/*** RTnet ***/
+
 static struct net_device_stats *get_stats(struct rtnet_device *rtdev)
 {
 	struct netdev_private *np = rtdev->priv;
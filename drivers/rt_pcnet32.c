@@ -58,6 +58,7 @@ DRV_NAME ".c:v" DRV_VERSION " " DRV_RELDATE " Jan.Kiszka@web.de\n";
 
 /*** RTnet ***/
 #include <rtnet_port.h>
+#include <rtskb_ring.h>
 
 #define MAX_UNITS 8	/* More are supported, limit only on options */
 #define DEFAULT_RX_POOL_SIZE    16
@@ -351,6 +352,8 @@ static int  pcnet32_rx(struct rtnet_device *, nanosecs_abs_t *time_stamp);
 static int pcnet32_interrupt(rtdm_irq_t *irq_handle);
 static int  pcnet32_close(struct rtnet_device *);
 static struct net_device_stats *pcnet32_get_stats(struct rtnet_device *);
+static dma_addr_t pcnet32_map_rtskb(struct rtnet_device *, struct rtskb *);
+static void pcnet32_unmap_rtskb(struct rtnet_device *, struct rtskb *);
 //static void pcnet32_set_multicast_list(struct net_device *);
 //static int  pcnet32_ioctl(struct net_device *, struct ifreq *, int);
 //static int mdio_read(struct net_device *dev, int phy_id, int reg_num);
@@ -828,6 +831,8 @@ static int pcnet32_probe1(unsigned long ioaddr, unsigned int irq_line, int share
     dev->hard_start_xmit = &pcnet32_start_xmit;
     dev->stop = &pcnet32_close;
     dev->get_stats = &pcnet32_get_stats;
+    dev->map_rtskb = &pcnet32_map_rtskb;
+    dev->unmap_rtskb = &pcnet32_unmap_rtskb;
 /*** RTnet ***
     dev->set_multicast_list = &pcnet32_set_multicast_list;
     dev->do_ioctl = &pcnet32_ioctl;
@@ -1030,15 +1035,13 @@ pcnet32_init_ring(struct rtnet_device *dev) /*** RTnet ***/
     for (i = 0; i < RX_RING_SIZE; i++) {
         struct rtskb *rx_skbuff = lp->rx_skbuff[i]; /*** RTnet ***/
 	if (rx_skbuff == NULL) {
-	    if (!(rx_skbuff = lp->rx_skbuff[i] = dev_alloc_rtskb (PKT_BUF_SZ, &lp->skb_pool))) { /*** RTnet ***/
+	    if (!(rx_skbuff = lp->rx_skbuff[i] = rtskb_ring_rx_alloc(dev, &lp->skb_pool, PKT_BUF_SZ, 2, &lp->rx_dma_addr[i]))) { /*** RTnet ***/
 		/* there is not much, we can do at this point */
 		printk(KERN_ERR "%s: pcnet32_init_ring dev_alloc_rtskb failed.\n",dev->name);
 		return -1;
 	    }
-	    rtskb_reserve (rx_skbuff, 2); /*** RTnet ***/
-	}
-        lp->rx_dma_addr[i] = pci_map_single(lp->pci_dev, rx_skbuff->tail,
-                                            rx_skbuff->len, PCI_DMA_FROMDEVICE);
+	} else
+	    lp->rx_dma_addr[i] = rtskb_data_dma_addr(rx_skbuff, 0); /*** RTnet ***/
 	lp->rx_ring[i].base = (u32)le32_to_cpu(lp->rx_dma_addr[i]);
 	lp->rx_ring[i].buf_length = le16_to_cpu(-PKT_BUF_SZ);
 	lp->rx_ring[i].status = le16_to_cpu(0x8000);
@@ -1168,14 +1171,15 @@ pcnet32_start_xmit(struct rtskb *skb, struct rtnet_device *dev) /*** RTnet ***/
     lp->tx_ring[entry].misc = 0x00000000;
 
     lp->tx_skbuff[entry] = skb;
-    lp->tx_dma_addr[entry] = pci_map_single(lp->pci_dev,
-        skb->data, skb->len, PCI_DMA_TODEVICE);
+    lp->tx_dma_addr[entry] = rtskb_data_dma_addr(skb, 0); /*** RTnet ***/
     lp->tx_ring[entry].base = (u32)le32_to_cpu(lp->tx_dma_addr[entry]);
 
 /*** RTnet ***/
     /* get and patch time stamp just before the transmission */
     if (skb->xmit_stamp)
         *skb->xmit_stamp = cpu_to_be64(rtdm_clock_read() + *skb->xmit_stamp);
+
+    rtskb_ring_tx_sync(lp->pci_dev ? &lp->pci_dev->dev : NULL, skb);
 /*** RTnet ***/
 
     wmb();
@@ -1213,6 +1217,7 @@ static int pcnet32_interrupt(rtdm_irq_t *irq_handle) /*** RTnet ***/
     int boguscnt =  max_interrupt_work;
     int must_restart;
     unsigned int old_packet_cnt; /*** RTnet ***/
+    struct rtskb_queue tx_done; /*** RTnet ***/
     int ret = RTDM_IRQ_NONE;
 
 /*** RTnet ***
@@ -1226,6 +1231,7 @@ static int pcnet32_interrupt(rtdm_irq_t *irq_handle) /*** RTnet ***/
     ioaddr = dev->base_addr;
     lp = dev->priv;
     old_packet_cnt = lp->stats.rx_packets; /*** RTnet ***/
+    rtskb_queue_init(&tx_done); /*** RTnet ***/
 
     rtdm_lock_get(&lp->lock); /*** RTnet ***/
 
@@ -1293,10 +1299,9 @@ static int pcnet32_interrupt(rtdm_irq_t *irq_handle) /*** RTnet ***/
 
 		/* We must free the original skb */
 		if (lp->tx_skbuff[entry]) {
-                    pci_unmap_single(lp->pci_dev, lp->tx_dma_addr[entry],
-			lp->tx_skbuff[entry]->len, PCI_DMA_TODEVICE);
-		    dev_kfree_rtskb(lp->tx_skbuff[entry]); /*** RTnet ***/
-		    lp->tx_skbuff[entry] = 0;
+		    /*** RTnet ***/
+		    rtskb_ring_tx_reclaim(&lp->tx_skbuff[entry], &tx_done);
+		    /*** RTnet ***/
                     lp->tx_dma_addr[entry] = 0;
 		}
 		dirty_tx++;
@@ -1361,6 +1366,8 @@ static int pcnet32_interrupt(rtdm_irq_t *irq_handle) /*** RTnet ***/
 /*** RTnet ***/
     rtdm_lock_put(&lp->lock);
 
+    rtskb_ring_tx_free(&tx_done);
+
     if (old_packet_cnt != lp->stats.rx_packets)
         rt_mark_stack_mgr(dev);
 
@@ -1405,22 +1412,12 @@ pcnet32_rx(struct rtnet_device *dev, nanosecs_abs_t *time_stamp) /*** RTnet ***/
 		/*int rx_in_place = 0;*/
 
 		/*if (pkt_len > rx_copybreak)*/ {
-		    struct rtskb *newskb;
-
-		    if ((newskb = dev_alloc_rtskb (PKT_BUF_SZ, &lp->skb_pool))) {
-			rtskb_reserve (newskb, 2);
-			skb = lp->rx_skbuff[entry];
-			pci_unmap_single(lp->pci_dev, lp->rx_dma_addr[entry], skb->len, PCI_DMA_FROMDEVICE);
-			rtskb_put (skb, pkt_len);
-			lp->rx_skbuff[entry] = newskb;
-			newskb->rtdev = dev; /*** RTnet ***/
-                        lp->rx_dma_addr[entry] =
-				pci_map_single(lp->pci_dev, newskb->tail,
-					newskb->len, PCI_DMA_FROMDEVICE);
-			lp->rx_ring[entry].base = le32_to_cpu(lp->rx_dma_addr[entry]);
-			/*rx_in_place = 1;*/
-		    } else
-			skb = NULL;
+		    skb = rtskb_ring_rx_swap(lp->pci_dev ? &lp->pci_dev->dev : NULL,
+					     &lp->rx_skbuff[entry],
+					     &lp->skb_pool, PKT_BUF_SZ, 2,
+					     pkt_len, &lp->rx_dma_addr[entry]);
+		    lp->rx_ring[entry].base = le32_to_cpu(lp->rx_dma_addr[entry]);
+		    /*rx_in_place = 1;*/
 		} /*else {
 		    skb = dev_alloc_skb(pkt_len+2);
 		}*/
@@ -1506,19 +1503,15 @@ pcnet32_close(struct rtnet_device *dev) /*** RTnet ***/
     /* free all allocated skbuffs */
     for (i = 0; i < RX_RING_SIZE; i++) {
 	lp->rx_ring[i].status = 0;
-	if (lp->rx_skbuff[i]) {
-            pci_unmap_single(lp->pci_dev, lp->rx_dma_addr[i], lp->rx_skbuff[i]->len, PCI_DMA_FROMDEVICE);
+	if (lp->rx_skbuff[i])
 	    dev_kfree_rtskb(lp->rx_skbuff[i]); /*** RTnet ***/
-        }
 	lp->rx_skbuff[i] = NULL;
         lp->rx_dma_addr[i] = 0;
     }
 
     for (i = 0; i < TX_RING_SIZE; i++) {
-	if (lp->tx_skbuff[i]) {
-            pci_unmap_single(lp->pci_dev, lp->tx_dma_addr[i], lp->tx_skbuff[i]->len, PCI_DMA_TODEVICE);
+	if (lp->tx_skbuff[i])
 	    dev_kfree_rtskb(lp->tx_skbuff[i]); /*** RTnet ***/
-        }
 	lp->tx_skbuff[i] = NULL;
         lp->tx_dma_addr[i] = 0;
     }
@@ -1529,6 +1522,24 @@ pcnet32_close(struct rtnet_device *dev) /*** RTnet ***/
 }
 
 /*** RTnet ***/
+/*** RTnet ***/
+static dma_addr_t
+pcnet32_map_rtskb(struct rtnet_device *dev, struct rtskb *skb)
+{
+    struct pcnet32_private *lp = dev->priv;
+
+    return rtskb_ring_map(lp->pci_dev ? &lp->pci_dev->dev : NULL, skb);
+}
+
+static void
+pcnet32_unmap_rtskb(struct rtnet_device *dev, struct rtskb *skb)
+{
+    struct pcnet32_private *lp = dev->priv;
+
+    rtskb_ring_unmap(lp->pci_dev ? &lp->pci_dev->dev : NULL, skb);
+}
+/*** RTnet ***/
+
 static struct net_device_stats *
 pcnet32_get_stats(struct rtnet_device *rtdev)
 {
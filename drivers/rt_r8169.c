@@ -34,6 +34,7 @@
 #include <asm/irq.h>
 
 #include <rtnet_port.h>
+#include <rtskb_ring.h>
 
 #define MAX_UNITS 8
 static int cards[MAX_UNITS] = { [0 ... (MAX_UNITS-1)] = 1 };
@@ -760,23 +761,16 @@ struct rtl8169_private {
 #define RTL_FIRMWARE_UNKNOWN	ERR_PTR(-EAGAIN)
 
     struct rtskb_queue skb_pool;
+    struct rtskb_queue copy_pool;	/* small frames, see copybreak */
     rtdm_irq_t irq_handle;
 };
 
-static inline struct rtskb *rtnetdev_alloc_rtskb_ip_align(struct rtnet_device *dev,
-    unsigned int length)
-{
-    struct rtl8169_private *tp = dev->priv;
-    struct rtskb *skb = dev_alloc_rtskb(length + NET_IP_ALIGN, &tp->skb_pool);
-    if(skb)
-        skb->rtdev = dev;
-    if(NET_IP_ALIGN && skb)
-        rtskb_reserve(skb, NET_IP_ALIGN);
-    return skb;
-}
-
 MODULE_AUTHOR("Realtek and the Linux r8169 crew <netdev@vger.kernel.org>");
 MODULE_DESCRIPTION("RealTek RTL-8169 Gigabit Ethernet driver");
+static unsigned int copybreak = 256;
+module_param(copybreak, uint, 0444);
+MODULE_PARM_DESC(copybreak, "Maximum size of packet that is copied into a "
+		 "buffer of the separate copy pool (0 disables)");
 module_param(use_dac, int, 0);
 MODULE_PARM_DESC(use_dac, "Enable PCI DAC. Unsafe on 32 bit PCI slot.");
 module_param_named(debug, debug.msg_enable, int, 0);
@@ -802,6 +796,9 @@ static int rtl8169_close(struct rtnet_device *dev);
 static void rtl_set_rx_mode(struct rtnet_device *dev);
 static void rtl8169_tx_timeout(struct rtnet_device *dev);
 static struct net_device_stats *rtl8169_get_stats(struct rtnet_device *dev);
+static dma_addr_t rtl8169_map_rtskb(struct rtnet_device *dev,
+				    struct rtskb *skb);
+static void rtl8169_unmap_rtskb(struct rtnet_device *dev, struct rtskb *skb);
 static int rtl8169_rx_interrupt(struct rtnet_device *, struct rtl8169_private *,
 				void __iomem *, u32 budget);
 static void rtl8169_schedule_work(struct rtnet_device *dev, work_func_t task);				
@@ -3325,6 +3322,7 @@ static void rtl8169_release_board(struct pci_dev *pdev, struct rtnet_device *dev
 	pci_release_regions(pdev);
 	pci_clear_mwi(pdev);
 	pci_disable_device(pdev);
+	rtskb_pool_release(&tp->copy_pool);
 	rtskb_pool_release(&tp->skb_pool);
 	rt_rtdev_disconnect(dev);
 	rtdev_free(dev);
@@ -4056,6 +4054,7 @@ rtl8169_init_one(struct pci_dev *pdev, const struct pci_device_id *ent)
 	struct mii_if_info *mii;
 	struct rtnet_device *dev;
 	void __iomem *ioaddr;
+	unsigned int copy_rtskbs;
 	int chipset, i;
 	int rc;
 
@@ -4094,8 +4093,14 @@ rtl8169_init_one(struct pci_dev *pdev, const struct pci_device_id *ent)
 	
 	if (rtskb_pool_init(&tp->skb_pool, NUM_RX_DESC*2) < NUM_RX_DESC*2) {
         rc = -ENOMEM;
-        goto err_out_free_dev_1;
+        goto err_out_free_pool_1;
     }
+
+	copy_rtskbs = copybreak ? NUM_RX_DESC : 0;
+	if (rtskb_pool_init(&tp->copy_pool, copy_rtskbs) < copy_rtskbs) {
+		rc = -ENOMEM;
+		goto err_out_free_dev_1;
+	}
 	
 	mii = &tp->mii;
 	mii->dev = dev;
@@ -4242,6 +4247,8 @@ rtl8169_init_one(struct pci_dev *pdev, const struct pci_device_id *ent)
 	dev->open = rtl8169_open;
 	dev->hard_start_xmit = rtl8169_start_xmit;
 	dev->get_stats = rtl8169_get_stats;
+	dev->map_rtskb = rtl8169_map_rtskb;
+	dev->unmap_rtskb = rtl8169_unmap_rtskb;
 	dev->stop = rtl8169_close;
 	dev->irq = pdev->irq;
 	dev->base_addr = (unsigned long) ioaddr;
@@ -4319,6 +4326,8 @@ err_out_mwi_2:
 	pci_clear_mwi(pdev);
 	pci_disable_device(pdev);
 err_out_free_dev_1:
+    rtskb_pool_release(&tp->copy_pool);
+err_out_free_pool_1:
     rtskb_pool_release(&tp->skb_pool);
     rt_rtdev_disconnect(dev);
 	rtdev_free(dev);
@@ -5437,13 +5446,10 @@ static int rtl8169_init_ring(struct rtnet_device *dev)
 	return rtl8169_rx_fill(tp);
 }
 
-static void rtl8169_unmap_tx_skb(struct device *d, struct ring_info *tx_skb,
-				 struct TxDesc *desc)
+static void rtl8169_clear_tx_desc(struct ring_info *tx_skb,
+				  struct TxDesc *desc)
 {
-	unsigned int len = tx_skb->len;
-
-	dma_unmap_single(d, le64_to_cpu(desc->addr), len, DMA_TO_DEVICE);
-
+	/* rtskbs are pre-mapped, nothing to unmap here */
 	desc->opts1 = 0x00;
 	desc->opts2 = 0x00;
 	desc->addr = 0x00;
@@ -5463,8 +5469,7 @@ static void rtl8169_tx_clear_range(struct rtl8169_private *tp, u32 start,
 		if (len) {
 			struct rtskb *skb = tx_skb->skb;
 
-			rtl8169_unmap_tx_skb(&tp->pci_dev->dev, tx_skb,
-					     tp->TxDescArray + entry);
+			rtl8169_clear_tx_desc(tx_skb, tp->TxDescArray + entry);
 			if (skb) {
 				tp->stats.tx_dropped++;
 				dev_kfree_rtskb(skb);
@@ -5650,8 +5655,6 @@ static netdev_tx_t rtl8169_start_xmit(struct rtskb *skb,
 	unsigned int entry = tp->cur_tx % NUM_TX_DESC;
 	struct TxDesc *txd = tp->TxDescArray + entry;
 	void __iomem *ioaddr = tp->mmio_addr;
-	struct device *d = &tp->pci_dev->dev;
-	dma_addr_t mapping;
 	u32 status, len;
 	u32 opts[2];
 	int frags;
@@ -5671,15 +5674,8 @@ static netdev_tx_t rtl8169_start_xmit(struct rtskb *skb,
         	*skb->xmit_stamp = cpu_to_be64(rtdm_clock_read() + *skb->xmit_stamp);
 
 	len = skb->len;
-	mapping = dma_map_single(d, skb->data, len, DMA_TO_DEVICE);
-	if (unlikely(dma_mapping_error(d, mapping))) {
-		if (net_ratelimit())
-			rtnetif_err(tp, drv, dev, "Failed to map TX DMA!\n");
-		goto err_dma_0;
-	}
-
 	tp->tx_skb[entry].len = len;
-	txd->addr = cpu_to_le64(mapping);
+	txd->addr = cpu_to_le64(rtskb_ring_tx_sync(&tp->pci_dev->dev, skb));
 
 	opts[1] = 0;
 	opts[0] = DescOwn;
@@ -5725,12 +5721,6 @@ static netdev_tx_t rtl8169_start_xmit(struct rtskb *skb,
 	rtdm_lock_put_irqrestore(&tp->lock, context);
 	return NETDEV_TX_OK;
 
-err_dma_0:
-	dev_kfree_rtskb(skb);
-	tp->stats.tx_dropped++;
-	rtdm_lock_put_irqrestore(&tp->lock, context);
-	return NETDEV_TX_OK;
-
 err_stop_0:
 	rtnetif_stop_queue(dev);
 	tp->stats.tx_dropped++;
@@ -5804,8 +5794,7 @@ static void rtl8169_tx_interrupt(struct rtnet_device *dev,
 		if (status & DescOwn)
 			break;
 
-		rtl8169_unmap_tx_skb(&tp->pci_dev->dev, tx_skb,
-				     tp->TxDescArray + entry);
+		rtl8169_clear_tx_desc(tx_skb, tp->TxDescArray + entry);
 		if (status & LastFrag) {
 			tp->stats.tx_packets++;
 			tp->stats.tx_bytes += tx_skb->skb->len;
@@ -5867,13 +5856,15 @@ static struct rtskb *rtl8169_try_rx_copy(void *data,
 {
 	struct rtskb *skb;
 	struct device *d = &tp->pci_dev->dev;
+	struct rtskb_queue *pool;
+
+	/* keep small frames from draining the pool of large ones */
+	pool = (pkt_size < copybreak) ? &tp->copy_pool : &tp->skb_pool;
 
 	data = rtl8169_align(data);
 	dma_sync_single_for_cpu(d, addr, pkt_size, DMA_FROM_DEVICE);
 	prefetch(data);
-	skb = rtnetdev_alloc_rtskb_ip_align(tp->dev, pkt_size);
-	if (skb)
-		memcpy(skb->data, data, pkt_size);
+	skb = rtskb_ring_rx_copy(tp->dev, pool, data, pkt_size, NET_IP_ALIGN);
 	dma_sync_single_for_device(d, addr, pkt_size, DMA_FROM_DEVICE);
 
 	return skb;
@@ -5940,7 +5931,6 @@ static int rtl8169_rx_interrupt(struct rtnet_device *dev,
 			}
 
 			rtl8169_rx_csum(skb, status);
-			rtskb_put(skb, pkt_size);
 			skb->protocol = rt_eth_type_trans(skb, dev);
 			skb->time_stamp = time_stamp;
 			rtnetif_rx(skb);
@@ -6223,6 +6213,21 @@ static void rtl_set_rx_mode(struct rtnet_device *dev)
  *
  *  Get TX/RX statistics for rtl8169
  */
+static dma_addr_t rtl8169_map_rtskb(struct rtnet_device *dev,
+				    struct rtskb *skb)
+{
+	struct rtl8169_private *tp = dev->priv;
+
+	return rtskb_ring_map(&tp->pci_dev->dev, skb);
+}
+
+static void rtl8169_unmap_rtskb(struct rtnet_device *dev, struct rtskb *skb)
+{
+	struct rtl8169_private *tp = dev->priv;
+
+	rtskb_ring_unmap(&tp->pci_dev->dev, skb);
+}
+
 static struct net_device_stats *rtl8169_get_stats(struct rtnet_device *dev)
 {
 	struct rtl8169_private *tp = dev->priv;
@@ -207,6 +207,7 @@ static const int multicast_filter_limit = 32;
 
 /*** RTnet ***/
 #include <rtnet_port.h>
+#include <rtskb_ring.h>
 
 #define DEFAULT_RX_POOL_SIZE    16
 
@@ -557,6 +558,8 @@ static void via_rhine_rx(struct rtnet_device *dev, nanosecs_abs_t *time_stamp);
 static void via_rhine_error(struct rtnet_device *dev, int intr_status);
 static void via_rhine_set_rx_mode(struct rtnet_device *dev);
 static struct net_device_stats *via_rhine_get_stats(struct rtnet_device *rtdev);
+static dma_addr_t via_rhine_map_rtskb(struct rtnet_device *dev, struct rtskb *skb);
+static void via_rhine_unmap_rtskb(struct rtnet_device *dev, struct rtskb *skb);
 /*static int netdev_ioctl(struct net_device *dev, struct ifreq *rq, int cmd);*/
 static int  via_rhine_close(struct rtnet_device *dev);
 /*** RTnet ***/
@@ -808,6 +811,8 @@ static int via_rhine_init_one (struct pci_dev *pdev,
 	dev->hard_start_xmit = via_rhine_start_tx;
 	dev->stop = via_rhine_close;
 	dev->get_stats = via_rhine_get_stats;
+	dev->map_rtskb = via_rhine_map_rtskb;
+	dev->unmap_rtskb = via_rhine_unmap_rtskb;
 /*** RTnet ***
 	dev->set_multicast_list = via_rhine_set_rx_mode;
 	dev->do_ioctl = netdev_ioctl;
@@ -987,15 +992,11 @@ static void alloc_rbufs(struct rtnet_device *dev) /*** RTnet ***/
 
 	/* Fill in the Rx buffers.  Handle allocation failure gracefully. */
 	for (i = 0; i < RX_RING_SIZE; i++) {
-		struct rtskb *skb = dev_alloc_rtskb(np->rx_buf_sz, &np->skb_pool); /*** RTnet ***/
+		struct rtskb *skb = rtskb_ring_rx_alloc(dev, &np->skb_pool, /*** RTnet ***/
+			np->rx_buf_sz, 0, &np->rx_skbuff_dma[i]);
 		np->rx_skbuff[i] = skb;
 		if (skb == NULL)
 			break;
-		skb->rtdev = dev; /*** RTnet ***/
-
-		np->rx_skbuff_dma[i] =
-			pci_map_single(np->pdev, skb->tail, np->rx_buf_sz,
-						   PCI_DMA_FROMDEVICE);
 
 		np->rx_ring[i].addr = cpu_to_le32(np->rx_skbuff_dma[i]);
 		np->rx_ring[i].rx_status = cpu_to_le32(DescOwn);
@@ -1012,12 +1013,8 @@ static void free_rbufs(struct rtnet_device* dev) /*** RTnet ***/
 	for (i = 0; i < RX_RING_SIZE; i++) {
 		np->rx_ring[i].rx_status = 0;
 		np->rx_ring[i].addr = cpu_to_le32(0xBADF00D0); /* An invalid address. */
-		if (np->rx_skbuff[i]) {
-			pci_unmap_single(np->pdev,
-							 np->rx_skbuff_dma[i],
-							 np->rx_buf_sz, PCI_DMA_FROMDEVICE);
+		if (np->rx_skbuff[i])
 			dev_kfree_rtskb(np->rx_skbuff[i]); /*** RTnet ***/
-		}
 		np->rx_skbuff[i] = 0;
 	}
 }
@@ -1051,14 +1048,8 @@ static void free_tbufs(struct rtnet_device* dev) /*** RTnet ***/
 		np->tx_ring[i].tx_status = 0;
 		np->tx_ring[i].desc_length = cpu_to_le32(TXDESC);
 		np->tx_ring[i].addr = cpu_to_le32(0xBADF00D0); /* An invalid address. */
-		if (np->tx_skbuff[i]) {
-			if (np->tx_skbuff_dma[i]) {
-				pci_unmap_single(np->pdev,
-								 np->tx_skbuff_dma[i],
-								 np->tx_skbuff[i]->len, PCI_DMA_TODEVICE);
-			}
+		if (np->tx_skbuff[i])
 			dev_kfree_rtskb(np->tx_skbuff[i]); /*** RTnet ***/
-		}
 		np->tx_skbuff[i] = 0;
 		np->tx_buf[i] = 0;
 	}
@@ -1374,8 +1365,7 @@ static int via_rhine_start_tx(struct rtskb *skb, struct rtnet_device *dev) /***
 		np->tx_ring[entry].addr = cpu_to_le32(np->tx_bufs_dma +
 										  (np->tx_buf[entry] - np->tx_bufs));
 	} else {
-		np->tx_skbuff_dma[entry] =
-			pci_map_single(np->pdev, skb->data, skb->len, PCI_DMA_TODEVICE);
+		np->tx_skbuff_dma[entry] = rtskb_data_dma_addr(skb, 0); /*** RTnet ***/
 		np->tx_ring[entry].addr = cpu_to_le32(np->tx_skbuff_dma[entry]);
 
 /*** RTnet ***/
@@ -1385,6 +1375,8 @@ static int via_rhine_start_tx(struct rtskb *skb, struct rtnet_device *dev) /***
 		if (skb->xmit_stamp)
 			*skb->xmit_stamp = cpu_to_be64(rtdm_clock_read() +
 				*skb->xmit_stamp);
+
+		rtskb_ring_tx_sync(&np->pdev->dev, skb);
 /*** RTnet ***/
 	}
 
@@ -1507,7 +1499,9 @@ static void via_rhine_tx(struct rtnet_device *dev) /*** RTnet ***/
 {
 	struct netdev_private *np = dev->priv;
 	int txstatus = 0, entry = np->dirty_tx % TX_RING_SIZE;
+	struct rtskb_queue tx_done; /*** RTnet ***/
 
+	rtskb_queue_init(&tx_done); /*** RTnet ***/
 	rtdm_lock_get(&np->lock); /*** RTnet ***/
 
 	/* find and cleanup dirty tx descriptors */
@@ -1547,19 +1541,15 @@ static void via_rhine_tx(struct rtnet_device *dev) /*** RTnet ***/
 			np->stats.tx_packets++;
 		}
 		/* Free the original skb. */
-		if (np->tx_skbuff_dma[entry]) {
-			pci_unmap_single(np->pdev,
-							 np->tx_skbuff_dma[entry],
-							 np->tx_skbuff[entry]->len, PCI_DMA_TODEVICE);
-		}
-		dev_kfree_rtskb(np->tx_skbuff[entry]); /*** RTnet ***/
-		np->tx_skbuff[entry] = NULL;
+		rtskb_ring_tx_reclaim(&np->tx_skbuff[entry], &tx_done); /*** RTnet ***/
 		entry = (++np->dirty_tx) % TX_RING_SIZE;
 	}
 	if ((np->cur_tx - np->dirty_tx) < TX_QUEUE_LEN - 4)
 		rtnetif_wake_queue (dev); /*** RTnet ***/
 
 	rtdm_lock_put(&np->lock); /*** RTnet ***/
+
+	rtskb_ring_tx_free(&tx_done); /*** RTnet ***/
 }
 
 /* This routine is logically part of the interrupt handler, but isolated
@@ -1637,16 +1627,13 @@ static void via_rhine_rx(struct rtnet_device *dev, nanosecs_abs_t *time_stamp) /
 #endif
 			{
 /*** RTnet ***/
-				skb = np->rx_skbuff[entry];
-				if (skb == NULL) {
+				if (np->rx_skbuff[entry] == NULL) {
 					rtdm_printk(KERN_ERR "%s: Inconsistent Rx descriptor chain.\n", /*** RTnet ***/
 						   dev->name);
 					break;
 				}
-				np->rx_skbuff[entry] = NULL;
-				rtskb_put(skb, pkt_len); /*** RTnet ***/
-				pci_unmap_single(np->pdev, np->rx_skbuff_dma[entry],
-								 np->rx_buf_sz, PCI_DMA_FROMDEVICE);
+				skb = rtskb_ring_rx_take(&np->pdev->dev, /*** RTnet ***/
+							&np->rx_skbuff[entry], pkt_len);
 			}
 /*** RTnet ***/
 			skb->protocol = rt_eth_type_trans(skb, dev);
@@ -1666,14 +1653,11 @@ static void via_rhine_rx(struct rtnet_device *dev, nanosecs_abs_t *time_stamp) /
 		struct rtskb *skb; /*** RTnet ***/
 		entry = np->dirty_rx % RX_RING_SIZE;
 		if (np->rx_skbuff[entry] == NULL) {
-			skb = dev_alloc_rtskb(np->rx_buf_sz, &np->skb_pool); /*** RTnet ***/
+			skb = rtskb_ring_rx_alloc(dev, &np->skb_pool, /*** RTnet ***/
+				np->rx_buf_sz, 0, &np->rx_skbuff_dma[entry]);
 			np->rx_skbuff[entry] = skb;
 			if (skb == NULL)
 				break;			/* Better luck next round. */
-			skb->rtdev = dev; /*** RTnet ***/
-			np->rx_skbuff_dma[entry] =
-				pci_map_single(np->pdev, skb->tail, np->rx_buf_sz,
-							   PCI_DMA_FROMDEVICE);
 			np->rx_ring[entry].addr = cpu_to_le32(np->rx_skbuff_dma[entry]);
 		}
 		np->rx_ring[entry].rx_status = cpu_to_le32(DescOwn);
@@ -1794,6 +1778,22 @@ static void via_rhine_error(struct rtnet_device *dev, int intr_status) /*** RTne
 	rtdm_lock_put(&np->lock); /*** RTnet ***/
 }
 
+/*** RTnet ***/
+static dma_addr_t via_rhine_map_rtskb(struct rtnet_device *dev, struct rtskb *skb)
+{
+	struct netdev_private *np = dev->priv;
+
+	return rtskb_ring_map(&np->pdev->dev, skb);
+}
+
+static void via_rhine_unmap_rtskb(struct rtnet_device *dev, struct rtskb *skb)
+{
+	struct netdev_private *np = dev->priv;
+
+	rtskb_ring_unmap(&np->pdev->dev, skb);
+}
+/*** RTnet ***/
+
 static struct net_device_stats *via_rhine_get_stats(struct rtnet_device *rtdev)
 {
 	struct netdev_private *np = rtdev->priv;
@@ -74,15 +74,12 @@ int tulip_refill_rx(/*RTnet*/struct rtnet_device *rtdev)
 			struct /*RTnet*/rtskb *skb;
 			dma_addr_t mapping;
 
-			skb = tp->rx_buffers[entry].skb = /*RTnet*/dev_alloc_rtskb(PKT_BUF_SZ, &tp->skb_pool);
+			skb = tp->rx_buffers[entry].skb = /*RTnet*/rtskb_ring_rx_alloc(rtdev,
+				&tp->skb_pool, PKT_BUF_SZ, 0, &mapping);
 			if (skb == NULL)
 				break;
 
-			mapping = pci_map_single(tp->pdev, skb->tail, PKT_BUF_SZ,
-						 PCI_DMA_FROMDEVICE);
 			tp->rx_buffers[entry].mapping = mapping;
-
-			skb->rtdev = rtdev;			/* Mark as being used by this device. */
 			tp->rx_ring[entry].buffer1 = cpu_to_le32(mapping);
 			refilled++;
 		}
@@ -178,7 +175,12 @@ static int tulip_rx(/*RTnet*/struct rtnet_device *rtdev, nanosecs_abs_t *time_st
 			} else { 	/* Pass up the skb already on the Rx ring. */
 #endif /*RTnet*/
 			{
-				unsigned char *temp = /*RTnet*/rtskb_put(skb = tp->rx_buffers[entry].skb, pkt_len);
+				unsigned char *temp;
+
+				/*RTnet*/skb = rtskb_ring_rx_take(&tp->pdev->dev,
+								  &tp->rx_buffers[entry].skb,
+								  pkt_len);
+				temp = skb->data;
 
 #ifndef final_version
 				if (tp->rx_buffers[entry].mapping !=
@@ -192,10 +194,6 @@ static int tulip_rx(/*RTnet*/struct rtnet_device *rtdev, nanosecs_abs_t *time_st
 				}
 #endif
 
-				pci_unmap_single(tp->pdev, tp->rx_buffers[entry].mapping,
-						 PKT_BUF_SZ, PCI_DMA_FROMDEVICE);
-
-				tp->rx_buffers[entry].skb = NULL;
 				tp->rx_buffers[entry].mapping = 0;
 			}
 			skb->protocol = /*RTnet*/rt_eth_type_trans(skb, rtdev);
@@ -299,10 +297,6 @@ int tulip_interrupt(rtdm_irq_t *irq_handle)
 					tp->stats.tx_packets++;
 				}
 
-				pci_unmap_single(tp->pdev, tp->tx_buffers[entry].mapping,
-						 tp->tx_buffers[entry].skb->len,
-						 PCI_DMA_TODEVICE);
-
 				/* Free the original skb. */
 				/*RTnet*/dev_kfree_rtskb(tp->tx_buffers[entry].skb);
 				tp->tx_buffers[entry].skb = NULL;
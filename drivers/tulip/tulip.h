@@ -27,6 +27,7 @@
 #include <asm/irq.h>
 
 #include <rtnet_port.h>
+#include <rtskb_ring.h>
 
 
 
@@ -536,13 +536,12 @@ static void tulip_init_ring(/*RTnet*/struct rtnet_device *rtdev)
 		/* Note the receive buffer must be longword aligned.
 		   dev_alloc_skb() provides 16 byte alignment.  But do *not*
 		   use skb_reserve() to align the IP header! */
-		struct /*RTnet*/rtskb *skb = /*RTnet*/dev_alloc_rtskb(PKT_BUF_SZ, &tp->skb_pool);
+		struct /*RTnet*/rtskb *skb = /*RTnet*/rtskb_ring_rx_alloc(rtdev,
+			&tp->skb_pool, PKT_BUF_SZ, 0, &mapping);
 		tp->rx_buffers[i].skb = skb;
 		if (skb == NULL)
 			break;
-		mapping = pci_map_single(tp->pdev, skb->tail, PKT_BUF_SZ, PCI_DMA_FROMDEVICE);
 		tp->rx_buffers[i].mapping = mapping;
-		skb->rtdev = rtdev;			/* Mark as being used by this device. */
 		tp->rx_ring[i].status = cpu_to_le32(DescOwned);	/* Owned by Tulip chip */
 		tp->rx_ring[i].buffer1 = cpu_to_le32(mapping);
 	}
@@ -586,7 +585,7 @@ tulip_start_xmit(struct /*RTnet*/rtskb *skb, /*RTnet*/struct rtnet_device *rtdev
 	entry = tp->cur_tx % TX_RING_SIZE;
 
 	tp->tx_buffers[entry].skb = skb;
-	mapping = pci_map_single(tp->pdev, skb->data, skb->len, PCI_DMA_TODEVICE);
+	mapping = rtskb_data_dma_addr(skb, 0);
 	tp->tx_buffers[entry].mapping = mapping;
 	tp->tx_ring[entry].buffer1 = cpu_to_le32(mapping);
 
@@ -604,16 +603,20 @@ tulip_start_xmit(struct /*RTnet*/rtskb *skb, /*RTnet*/struct rtnet_device *rtdev
 		flag = 0xe0000000 | DESC_RING_WRAP;
 
 	tp->tx_ring[entry].length = cpu_to_le32(skb->len | flag);
-	/* if we were using Transmit Automatic Polling, we would need a
-	 * wmb() here. */
-	tp->tx_ring[entry].status = cpu_to_le32(DescOwned);
 
 	/*RTnet*/
 	/* get and patch time stamp just before the transmission */
 	if (skb->xmit_stamp)
 		*skb->xmit_stamp = cpu_to_be64(rtdm_clock_read() + *skb->xmit_stamp);
+
+	/* the frame is complete, pass it to the device before handing over */
+	rtskb_ring_tx_sync(&tp->pdev->dev, skb);
 	/*RTnet*/
 
+	/* if we were using Transmit Automatic Polling, we would need a
+	 * wmb() here. */
+	tp->tx_ring[entry].status = cpu_to_le32(DescOwned);
+
 	wmb();
 
 	tp->cur_tx++;
@@ -653,10 +656,6 @@ static void tulip_clean_tx_ring(struct tulip_private *tp)
 			continue;
 		}
 
-		pci_unmap_single(tp->pdev, tp->tx_buffers[entry].mapping,
-				tp->tx_buffers[entry].skb->len,
-				PCI_DMA_TODEVICE);
-
 		/* Free the original skb. */
 		/*RTnet*/dev_kfree_rtskb(tp->tx_buffers[entry].skb);
 		tp->tx_buffers[entry].skb = NULL;
@@ -670,6 +669,23 @@ static struct net_device_stats *tulip_get_stats(struct rtnet_device *rtdev)
 	return &tp->stats;
 }
 
+/*RTnet*/
+static dma_addr_t tulip_map_rtskb(struct rtnet_device *rtdev,
+				  struct rtskb *skb)
+{
+	struct tulip_private *tp = (struct tulip_private *) rtdev->priv;
+
+	return rtskb_ring_map(&tp->pdev->dev, skb);
+}
+
+static void tulip_unmap_rtskb(struct rtnet_device *rtdev, struct rtskb *skb)
+{
+	struct tulip_private *tp = (struct tulip_private *) rtdev->priv;
+
+	rtskb_ring_unmap(&tp->pdev->dev, skb);
+}
+/*RTnet*/
+
 static void tulip_down (/*RTnet*/struct rtnet_device *rtdev)
 {
 	long ioaddr = rtdev->base_addr;
@@ -726,7 +742,6 @@ static int tulip_close (/*RTnet*/struct rtnet_device *rtdev)
 	/* Free all the skbuffs in the Rx queue. */
 	for (i = 0; i < RX_RING_SIZE; i++) {
 		struct /*RTnet*/rtskb *skb = tp->rx_buffers[i].skb;
-		dma_addr_t mapping = tp->rx_buffers[i].mapping;
 
 		tp->rx_buffers[i].skb = NULL;
 		tp->rx_buffers[i].mapping = 0;
@@ -734,20 +749,14 @@ static int tulip_close (/*RTnet*/struct rtnet_device *rtdev)
 		tp->rx_ring[i].status = 0;	/* Not owned by Tulip chip. */
 		tp->rx_ring[i].length = 0;
 		tp->rx_ring[i].buffer1 = 0xBADF00D0;	/* An invalid address. */
-		if (skb) {
-			pci_unmap_single(tp->pdev, mapping, PKT_BUF_SZ,
-					 PCI_DMA_FROMDEVICE);
+		if (skb)
 			/*RTnet*/dev_kfree_rtskb (skb);
-		}
 	}
 	for (i = 0; i < TX_RING_SIZE; i++) {
 		struct /*RTnet*/rtskb *skb = tp->tx_buffers[i].skb;
 
-		if (skb != NULL) {
-			pci_unmap_single(tp->pdev, tp->tx_buffers[i].mapping,
-					 skb->len, PCI_DMA_TODEVICE);
+		if (skb != NULL)
 			/*RTnet*/dev_kfree_rtskb (skb);
-		}
 		tp->tx_buffers[i].skb = NULL;
 		tp->tx_buffers[i].mapping = 0;
 	}
@@ -1420,6 +1429,8 @@ static int tulip_init_one (struct pci_dev *pdev,
 	rtdev->hard_header = rt_eth_header;
 	rtdev->hard_start_xmit = tulip_start_xmit;
 	rtdev->get_stats = tulip_get_stats;
+	rtdev->map_rtskb = tulip_map_rtskb;
+	rtdev->unmap_rtskb = tulip_unmap_rtskb;
 
 	/*RTnet*/
 	if (rtskb_pool_init(&tp->skb_pool, RX_RING_SIZE*2) < RX_RING_SIZE*2)
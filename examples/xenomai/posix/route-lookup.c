@@ -0,0 +1,333 @@
+/***
+ *
+ *  examples/xenomai/posix/route-lookup.c
+ *
+ *  Route Lookup Benchmark - measures the UDP send path of several real-time
+ *                           threads under contention on the routing tables
+ *
+ *  The benchmark installs a number of host routes to dummy stations on the
+ *  given device and lets one thread per CPU send small datagrams to them.
+ *  Every datagram goes to another station, so each send has to perform a
+ *  full routing table lookup. Optionally, a Linux thread keeps adding and
+ *  removing an unrelated route meanwhile, e.g.
+ *
+ *      route-lookup -d rteth0 -n 1024 -t 4 -u
+ *
+ *  The frames are sent to non-existing stations. Use an isolated network
+ *  segment or the loopback device (default) which, however, adds the receive
+ *  path to the measurement.
+ *
+ *  RTnet - real-time networking example
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <limits.h>
+
+#include <rtnet.h>
+#include <ipv4_chrdev.h>
+
+char *dev_name = "rtlo";
+unsigned int routes = 1024;
+unsigned int threads = 2;
+unsigned int duration = 10; /* s */
+unsigned int port = 37001;
+int update_routes = 0;
+
+#define MAX_THREADS             32
+#define DEST_NET                0x0AC80000  /* 10.200.0.0 */
+#define UPDATE_ADDR             0x0AC9FFFE  /* 10.201.255.254 */
+
+#define SEND_PERIOD             50000000LL  /* ns */
+#define SEND_PAUSE              1000000     /* ns */
+
+struct sender {
+    pthread_t           thread;
+    unsigned int        index;
+    unsigned long long  sends;
+    unsigned long long  no_buffers;
+    long long           total;
+    long long           max;
+};
+
+struct sender sender[MAX_THREADS];
+volatile int running;
+unsigned long long updates;
+int rtnet_fd;
+
+
+static inline long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static int host_route(unsigned long request, unsigned int addr)
+{
+    struct ipv4_cmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    strncpy(cmd.head.if_name, dev_name, IFNAMSIZ);
+    if (request == IOC_RT_HOST_ROUTE_ADD) {
+        cmd.args.addhost.ip_addr     = htonl(addr);
+        /* locally administered dummy address */
+        cmd.args.addhost.dev_addr[0] = 0x02;
+        cmd.args.addhost.dev_addr[4] = (addr >> 8) & 0xFF;
+        cmd.args.addhost.dev_addr[5] = addr & 0xFF;
+    } else
+        cmd.args.delhost.ip_addr     = htonl(addr);
+
+    return ioctl(rtnet_fd, request, &cmd);
+}
+
+
+void *send_loop(void *arg)
+{
+    struct sender       *s = arg;
+    struct sched_param  param = { .sched_priority = 80 };
+    struct sockaddr_in  local_addr;
+    struct sockaddr_in  dest_addr;
+    struct timespec     backoff = { 0, 100000 };
+    struct timespec     pause = { 0, SEND_PAUSE };
+    unsigned int        dest = s->index;
+    long long           start, elapsed, period_end;
+    char                data = 0;
+    int                 sock;
+
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    if ((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        perror("socket cannot be created");
+        return NULL;
+    }
+
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family      = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
+        perror("cannot bind to local ip/port");
+        close(sock);
+        return NULL;
+    }
+
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port   = htons(port);
+
+    period_end = now() + SEND_PERIOD;
+    while (running) {
+        /* give Linux some time, it has to perform the route updates */
+        if (now() >= period_end) {
+            nanosleep(&pause, NULL);
+            period_end = now() + SEND_PERIOD;
+        }
+
+        /* a new destination each time, the socket route cache never hits */
+        dest = (dest + threads) % routes;
+        dest_addr.sin_addr.s_addr = htonl(DEST_NET + 1 + dest);
+
+        start = now();
+        if (sendto(sock, &data, sizeof(data), 0,
+                   (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+            if (errno != ENOBUFS && errno != EAGAIN) {
+                perror("sendto failed");
+                break;
+            }
+            s->no_buffers++;
+            nanosleep(&backoff, NULL);
+            continue;
+        }
+        elapsed = now() - start;
+
+        s->sends++;
+        s->total += elapsed;
+        if (elapsed > s->max)
+            s->max = elapsed;
+    }
+
+    close(sock);
+    return NULL;
+}
+
+
+void *update_loop(void *arg)
+{
+    while (running) {
+        if (host_route(IOC_RT_HOST_ROUTE_ADD, UPDATE_ADDR) < 0 ||
+            host_route(IOC_RT_HOST_ROUTE_DELETE, UPDATE_ADDR) < 0) {
+            perror("route update failed");
+            break;
+        }
+        updates++;
+    }
+    return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+    pthread_attr_t      thattr;
+    pthread_t           update_thread;
+    cpu_set_t           cpus;
+    struct timespec     run;
+    unsigned long long  total_sends = 0;
+    long long           total_time = 0;
+    long long           max = 0;
+    long                cpu_count;
+    unsigned int        i;
+    int                 ret = 0;
+
+
+    while (1) {
+        switch (getopt(argc, argv, "d:n:t:s:p:u")) {
+            case 'd':
+                dev_name = optarg;
+                break;
+
+            case 'n':
+                routes = atoi(optarg);
+                break;
+
+            case 't':
+                threads = atoi(optarg);
+                break;
+
+            case 's':
+                duration = atoi(optarg);
+                break;
+
+            case 'p':
+                port = atoi(optarg);
+                break;
+
+            case 'u':
+                update_routes = 1;
+                break;
+
+            case -1:
+                goto end_of_opt;
+
+            default:
+                printf("usage: %s [-d <dev>] [-n <routes>] [-t <threads>] "
+                       "[-s <secs>]\n"
+                       "       [-p <port>] [-u]\n", argv[0]);
+                return 0;
+        }
+    }
+ end_of_opt:
+
+    if (routes == 0 || routes > 65534 || threads == 0 ||
+        threads > MAX_THREADS) {
+        printf("invalid arguments, see %s -h\n", argv[0]);
+        return 1;
+    }
+
+    mlockall(MCL_CURRENT|MCL_FUTURE);
+
+    if ((rtnet_fd = open("/dev/rtnet", O_RDWR)) < 0) {
+        perror("/dev/rtnet");
+        return 1;
+    }
+
+    printf("adding %u host routes on %s\n", routes, dev_name);
+    for (i = 0; i < routes; i++)
+        if (host_route(IOC_RT_HOST_ROUTE_ADD, DEST_NET + 1 + i) < 0) {
+            perror("adding host route failed (see max_host_routes)");
+            routes = i;
+            ret = 1;
+            goto cleanup;
+        }
+
+    cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1)
+        cpu_count = 1;
+
+    pthread_attr_init(&thattr);
+    pthread_attr_setdetachstate(&thattr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setstacksize(&thattr, PTHREAD_STACK_MIN);
+
+    printf("%u sender(s) for %u s%s\n", threads, duration,
+           update_routes ? ", concurrent route updates" : "");
+
+    running = 1;
+    for (i = 0; i < threads; i++) {
+        /* one sender per CPU to contend on the tables */
+        CPU_ZERO(&cpus);
+        CPU_SET(i % cpu_count, &cpus);
+        pthread_attr_setaffinity_np(&thattr, sizeof(cpus), &cpus);
+
+        sender[i].index = i;
+        if (pthread_create(&sender[i].thread, &thattr, &send_loop,
+                           &sender[i]) != 0) {
+            perror("pthread_create failed");
+            threads = i;
+            break;
+        }
+    }
+
+    if (update_routes)
+        pthread_create(&update_thread, NULL, &update_loop, NULL);
+
+    run.tv_sec  = duration;
+    run.tv_nsec = 0;
+    nanosleep(&run, NULL);
+
+    running = 0;
+    for (i = 0; i < threads; i++)
+        pthread_join(sender[i].thread, NULL);
+    if (update_routes)
+        pthread_join(update_thread, NULL);
+
+    printf("thread  sends         no buffers  avg [ns]  max [ns]\n");
+    for (i = 0; i < threads; i++) {
+        printf("%-6u  %-12llu  %-10llu  %-8lld  %lld\n", i, sender[i].sends,
+               sender[i].no_buffers,
+               sender[i].sends ? sender[i].total / (long long)sender[i].sends
+                               : 0,
+               sender[i].max);
+        total_sends += sender[i].sends;
+        total_time  += sender[i].total;
+        if (sender[i].max > max)
+            max = sender[i].max;
+    }
+    printf("all     %-12llu              %-8lld  %lld\n", total_sends,
+           total_sends ? total_time / (long long)total_sends : 0, max);
+    if (update_routes)
+        printf("route updates: %llu\n", updates);
+
+ cleanup:
+    for (i = 0; i < routes; i++)
+        host_route(IOC_RT_HOST_ROUTE_DELETE, DEST_NET + 1 + i);
+    close(rtnet_fd);
+
+    return ret;
+}
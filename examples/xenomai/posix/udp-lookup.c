@@ -0,0 +1,241 @@
+/***
+ *
+ *  examples/xenomai/posix/udp-lookup.c
+ *
+ *  UDP Lookup Benchmark - measures the loopback round trip of a datagram
+ *                         while the number of bound UDP sockets grows
+ *
+ *  The benchmark binds 64, 1024 and 8192 sockets (limited by -n) to
+ *  consecutive ports and, at each step, sends datagrams to randomly chosen
+ *  ones and receives them again. As the send and receive paths are the same
+ *  for all steps, differences between the steps reflect the port lookup.
+ *
+ *  The stack has to be prepared for that many sockets plus the sending one,
+ *  e.g.
+ *
+ *      insmod rtnet.ko socket_rtskbs=2
+ *      insmod rtudp.ko udp_sockets=16384
+ *
+ *  and Xenomai must provide enough RTDM file descriptors
+ *  (CONFIG_XENO_OPT_RTDM_FILDES).
+ *
+ *  RTnet - real-time networking example
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <limits.h>
+
+#include <rtnet.h>
+
+unsigned int max_sockets = 8192;
+unsigned int rounds = 100000;
+unsigned int base_port = 40000;
+
+#define MAX_SOCKETS             32768
+
+static const unsigned int steps[] = { 64, 1024, 8192 };
+
+int tx_sock;
+int rx_sock[MAX_SOCKETS];
+unsigned int open_sockets;
+
+
+static inline long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static int open_socket(unsigned int index)
+{
+    struct sockaddr_in  local_addr;
+    int64_t             timeout = 100000000LL;
+    int                 sock;
+
+    if ((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+        return -1;
+
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family      = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    local_addr.sin_port        = htons(base_port + index);
+    if (bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    /* do not hang if a datagram gets lost */
+    ioctl(sock, RTNET_RTIOC_TIMEOUT, &timeout);
+
+    rx_sock[index] = sock;
+    return 0;
+}
+
+
+void *bench(void *arg)
+{
+    struct sched_param  param = { .sched_priority = 80 };
+    struct sockaddr_in  dest_addr;
+    unsigned int        seed = 1;
+    unsigned int        index;
+    unsigned int        i;
+    unsigned long long  lost = 0;
+    long long           start, elapsed;
+    long long           total = 0;
+    long long           max = 0;
+    char                data = 0;
+
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sin_family      = AF_INET;
+    dest_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (i = 0; i < rounds; i++) {
+        /* spread the datagrams over all sockets and hash buckets */
+        seed  = seed * 1103515245 + 12345;
+        index = (seed >> 8) % open_sockets;
+        dest_addr.sin_port = htons(base_port + index);
+
+        start = now();
+        if (sendto(tx_sock, &data, sizeof(data), 0,
+                   (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+            perror("sendto failed");
+            break;
+        }
+        if (recv(rx_sock[index], &data, sizeof(data), 0) < 0) {
+            lost++;
+            continue;
+        }
+        elapsed = now() - start;
+
+        total += elapsed;
+        if (elapsed > max)
+            max = elapsed;
+    }
+
+    printf("%-8u  %-10u  %-8lld  %-8lld  %llu\n", open_sockets, i,
+           (i > lost) ? total / (long long)(i - lost) : 0, max, lost);
+    return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in  local_addr;
+    pthread_attr_t      thattr;
+    pthread_t           thread;
+    unsigned int        step;
+    unsigned int        i;
+    int                 ret = 0;
+
+
+    while (1) {
+        switch (getopt(argc, argv, "n:r:p:")) {
+            case 'n':
+                max_sockets = atoi(optarg);
+                break;
+
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+
+            case 'p':
+                base_port = atoi(optarg);
+                break;
+
+            case -1:
+                goto end_of_opt;
+
+            default:
+                printf("usage: %s [-n <max_sockets>] [-r <rounds>] "
+                       "[-p <base_port>]\n", argv[0]);
+                return 0;
+        }
+    }
+ end_of_opt:
+
+    if (max_sockets == 0 || max_sockets > MAX_SOCKETS || rounds == 0 ||
+        base_port + max_sockets > 0xFFFF) {
+        printf("invalid arguments, see %s -h\n", argv[0]);
+        return 1;
+    }
+
+    mlockall(MCL_CURRENT|MCL_FUTURE);
+
+    if ((tx_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        perror("socket cannot be created");
+        return 1;
+    }
+
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family      = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(tx_sock, (struct sockaddr *)&local_addr,
+             sizeof(local_addr)) < 0) {
+        perror("cannot bind to local ip/port");
+        close(tx_sock);
+        return 1;
+    }
+
+    pthread_attr_init(&thattr);
+    pthread_attr_setdetachstate(&thattr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setstacksize(&thattr, PTHREAD_STACK_MIN);
+
+    printf("sockets   rounds      avg [ns]  max [ns]  lost\n");
+
+    for (step = 0; step < sizeof(steps) / sizeof(steps[0]); step++) {
+        while (open_sockets < steps[step] && open_sockets < max_sockets) {
+            if (open_socket(open_sockets) < 0) {
+                perror("cannot open socket (see udp_sockets)");
+                ret = 1;
+                goto cleanup;
+            }
+            open_sockets++;
+        }
+
+        if ((ret = pthread_create(&thread, &thattr, &bench, NULL))) {
+            errno = ret; perror("pthread_create failed");
+            ret = 1;
+            goto cleanup;
+        }
+        pthread_join(thread, NULL);
+
+        if (open_sockets == max_sockets)
+            break;
+    }
+
+ cleanup:
+    for (i = 0; i < open_sockets; i++)
+        close(rx_sock[i]);
+    close(tx_sock);
+
+    return ret;
+}
@@ -0,0 +1,305 @@
+/***
+ *
+ *  examples/xenomai/posix/udp-mmsg.c
+ *
+ *  Batched Datagram Benchmark - compares the per-datagram cost of the
+ *                               single-message socket calls with the
+ *                               RTNET_RTIOC_SENDMMSG/RECVMMSG IOCTLs
+ *
+ *  The benchmark sends bursts of small datagrams over the loopback device to
+ *  a second socket and drains them again, once via sendto/recv and once via
+ *  the multi-message IOCTLs, e.g.
+ *
+ *      udp-mmsg -b 32 -n 100000
+ *
+ *  Both sockets are assigned additional buffers for a full burst, see -b.
+ *
+ *  RTnet - real-time networking example
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <limits.h>
+
+#include <rtnet.h>
+
+unsigned int port = 37002;
+unsigned int burst = 32;
+unsigned int size = 64;
+unsigned int count = 100000;
+
+#define MAX_BURST               256
+#define MAX_PAYLOAD             1472
+
+struct result {
+    unsigned long long  datagrams;
+    long long           tx_time;
+    long long           rx_time;
+};
+
+int tx_sock, rx_sock;
+struct sockaddr_in dest_addr;
+
+char tx_data[MAX_BURST][MAX_PAYLOAD];
+char rx_data[MAX_BURST][MAX_PAYLOAD];
+struct iovec tx_iov[MAX_BURST];
+struct iovec rx_iov[MAX_BURST];
+struct rtnet_mmsghdr tx_vec[MAX_BURST];
+struct rtnet_mmsghdr rx_vec[MAX_BURST];
+
+
+static inline long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static int single_burst(struct result *res)
+{
+    long long   start;
+    unsigned int i;
+
+    start = now();
+    for (i = 0; i < burst; i++)
+        if (sendto(tx_sock, tx_data[i], size, 0,
+                   (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+            perror("sendto failed");
+            return -1;
+        }
+    res->tx_time += now() - start;
+
+    start = now();
+    for (i = 0; i < burst; i++)
+        if (recv(rx_sock, rx_data[i], sizeof(rx_data[i]), 0) < 0) {
+            perror("recv failed");
+            return -1;
+        }
+    res->rx_time += now() - start;
+
+    res->datagrams += burst;
+    return 0;
+}
+
+
+static int batched_burst(struct result *res)
+{
+    struct rtnet_mmsg_args  args;
+    long long               start;
+    unsigned int            done;
+    int                     ret;
+
+    start = now();
+    for (done = 0; done < burst; done += ret) {
+        args.msgvec = &tx_vec[done];
+        args.vlen   = burst - done;
+        args.flags  = 0;
+        ret = ioctl(tx_sock, RTNET_RTIOC_SENDMMSG, &args);
+        if (ret < 0) {
+            perror("RTNET_RTIOC_SENDMMSG failed");
+            return -1;
+        }
+    }
+    res->tx_time += now() - start;
+
+    start = now();
+    for (done = 0; done < burst; done += ret) {
+        args.msgvec = &rx_vec[done];
+        args.vlen   = burst - done;
+        args.flags  = 0;
+        ret = ioctl(rx_sock, RTNET_RTIOC_RECVMMSG, &args);
+        if (ret < 0) {
+            perror("RTNET_RTIOC_RECVMMSG failed");
+            return -1;
+        }
+    }
+    res->rx_time += now() - start;
+
+    res->datagrams += burst;
+    return 0;
+}
+
+
+static void rearm_vectors(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < burst; i++) {
+        tx_iov[i].iov_base = tx_data[i];
+        tx_iov[i].iov_len  = size;
+        rx_iov[i].iov_base = rx_data[i];
+        rx_iov[i].iov_len  = sizeof(rx_data[i]);
+    }
+}
+
+
+static void print_result(const char *name, struct result *res)
+{
+    long long n = res->datagrams ? res->datagrams : 1;
+
+    printf("%-8s  %-10llu  %-12lld  %lld\n", name, res->datagrams,
+           res->tx_time / n, res->rx_time / n);
+}
+
+
+void *bench(void *arg)
+{
+    struct sched_param  param = { .sched_priority = 80 };
+    struct result       *res = arg;
+    unsigned int        i;
+
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    for (i = 0; i < burst; i++) {
+        tx_vec[i].msg_hdr.msg_name    = &dest_addr;
+        tx_vec[i].msg_hdr.msg_namelen = sizeof(dest_addr);
+        tx_vec[i].msg_hdr.msg_iov     = &tx_iov[i];
+        tx_vec[i].msg_hdr.msg_iovlen  = 1;
+        rx_vec[i].msg_hdr.msg_iov     = &rx_iov[i];
+        rx_vec[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    while (res[0].datagrams < count) {
+        if (single_burst(&res[0]) < 0)
+            break;
+
+        /* the stack consumes the iovecs, rearm them */
+        rearm_vectors();
+        if (batched_burst(&res[1]) < 0)
+            break;
+    }
+    return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in  local_addr;
+    struct result       res[2];
+    pthread_attr_t      thattr;
+    pthread_t           thread;
+    int64_t             timeout = 1000000000LL;
+    int                 add_rtskbs;
+    int                 ret;
+
+
+    while (1) {
+        switch (getopt(argc, argv, "b:s:n:p:")) {
+            case 'b':
+                burst = atoi(optarg);
+                break;
+
+            case 's':
+                size = atoi(optarg);
+                break;
+
+            case 'n':
+                count = atoi(optarg);
+                break;
+
+            case 'p':
+                port = atoi(optarg);
+                break;
+
+            case -1:
+                goto end_of_opt;
+
+            default:
+                printf("usage: %s [-b <burst>] [-s <payload_size>] "
+                       "[-n <datagrams>] [-p <port>]\n", argv[0]);
+                return 0;
+        }
+    }
+ end_of_opt:
+
+    if (burst == 0 || burst > MAX_BURST || size == 0 || size > MAX_PAYLOAD) {
+        printf("invalid arguments, see %s -h\n", argv[0]);
+        return 1;
+    }
+
+    mlockall(MCL_CURRENT|MCL_FUTURE);
+
+    if ((tx_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0 ||
+        (rx_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        perror("socket cannot be created");
+        return 1;
+    }
+
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family      = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    local_addr.sin_port        = htons(port);
+    if (bind(rx_sock, (struct sockaddr *)&local_addr,
+             sizeof(local_addr)) < 0) {
+        perror("cannot bind to local ip/port");
+        ret = 1;
+        goto cleanup;
+    }
+
+    /* both sockets have to hold a full burst */
+    add_rtskbs = burst;
+    if (ioctl(tx_sock, RTNET_RTIOC_EXTPOOL, &add_rtskbs) != add_rtskbs ||
+        ioctl(rx_sock, RTNET_RTIOC_EXTPOOL, &add_rtskbs) != add_rtskbs)
+        perror("WARNING: ioctl(RTNET_RTIOC_EXTPOOL)");
+
+    /* do not hang if a datagram gets lost */
+    ioctl(rx_sock, RTNET_RTIOC_TIMEOUT, &timeout);
+
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sin_family      = AF_INET;
+    dest_addr.sin_port        = htons(port);
+    dest_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    memset(res, 0, sizeof(res));
+    rearm_vectors();
+
+    pthread_attr_init(&thattr);
+    pthread_attr_setdetachstate(&thattr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setstacksize(&thattr, PTHREAD_STACK_MIN);
+
+    printf("%u datagrams of %u bytes in bursts of %u\n", count, size, burst);
+
+    ret = pthread_create(&thread, &thattr, &bench, res);
+    if (ret) {
+        errno = ret; perror("pthread_create failed");
+        ret = 1;
+        goto cleanup;
+    }
+    pthread_join(thread, NULL);
+
+    printf("mode      datagrams   tx [ns/dgm]   rx [ns/dgm]\n");
+    print_result("single", &res[0]);
+    print_result("batched", &res[1]);
+    ret = 0;
+
+ cleanup:
+    close(tx_sock);
+    close(rx_sock);
+
+    return ret;
+}
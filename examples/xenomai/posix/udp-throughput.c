@@ -0,0 +1,330 @@
+/***
+ *
+ *  examples/xenomai/posix/udp-throughput.c
+ *
+ *  UDP Throughput Benchmark - streams datagrams of a given size from a
+ *                             sender to a receiver and reports throughput
+ *                             and the real-time CPU time spent per byte
+ *
+ *  Run it once with standard frames and once after raising the MTU (see
+ *  rtifconfig mtu option and the rtskb_size module parameter) to compare
+ *  the per-packet overhead, e.g.
+ *
+ *      receiver: udp-throughput -r
+ *      sender:   udp-throughput -d 10.0.0.2 -s 1472
+ *                udp-throughput -d 10.0.0.2 -s 8972
+ *
+ *  The CPU load is derived from a spinning low-priority real-time thread
+ *  which is calibrated before the test starts. Pin the program to the CPU
+ *  handling the NIC interrupts (taskset) to get meaningful numbers.
+ *
+ *  RTnet - real-time networking example
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include <limits.h>
+
+#include <rtnet.h>
+
+char *dest_ip_s = "";
+unsigned int port = 37000;
+unsigned int size = 1472;
+unsigned int duration = 10; /* s */
+int receiver_mode = 0;
+
+#define DEFAULT_ADD_BUFFERS     100
+#define MAX_PAYLOAD             65507
+
+#define SPIN_PERIOD             50000000LL  /* ns */
+#define SPIN_PAUSE              1000000     /* ns */
+
+int sock;
+char buffer[MAX_PAYLOAD];
+
+volatile int spinning;
+volatile unsigned long long spin_count;
+
+unsigned long long packets, bytes, dropped;
+long long first_rx, last_rx;
+
+
+static inline long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/* Consumes the CPU time left over by the stack. It pauses periodically so
+ * that Linux and the watchdog are not starved during long runs. */
+void *spinner(void *arg)
+{
+    struct sched_param  param = { .sched_priority = 1 };
+    struct timespec     pause = { 0, SPIN_PAUSE };
+    long long           period_end;
+
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    while (spinning) {
+        period_end = now() + SPIN_PERIOD;
+        while (now() < period_end)
+            spin_count++;
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+
+void *transmitter(void *arg)
+{
+    struct sched_param  param = { .sched_priority = 80 };
+    struct sockaddr_in  *dest_addr = arg;
+    struct timespec     backoff = { 0, 100000 };
+    struct timespec     pause = { 0, SPIN_PAUSE };
+    long long           end, period_end;
+
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    end = now() + duration * 1000000000LL;
+    period_end = now() + SPIN_PERIOD;
+    while (now() < end) {
+        /* same duty cycle as the spinner, Linux needs to breathe */
+        if (now() >= period_end) {
+            nanosleep(&pause, NULL);
+            period_end = now() + SPIN_PERIOD;
+        }
+
+        if (sendto(sock, buffer, size, 0, (struct sockaddr *)dest_addr,
+                   sizeof(struct sockaddr_in)) < 0) {
+            if (errno != ENOBUFS && errno != EAGAIN) {
+                perror("sendto failed");
+                break;
+            }
+            /* pools exhausted, let the NIC catch up */
+            dropped++;
+            nanosleep(&backoff, NULL);
+            continue;
+        }
+        packets++;
+        bytes += size;
+    }
+    return NULL;
+}
+
+
+void *receiver(void *arg)
+{
+    struct sched_param  param = { .sched_priority = 80 };
+    int                 ret;
+
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    while (1) {
+        ret = recv(sock, buffer, sizeof(buffer), 0);
+        if (ret < 0) {
+            /* the timeout marks the end of the stream */
+            if (errno != ETIMEDOUT && errno != EBADF)
+                perror("recv failed");
+            break;
+        }
+
+        last_rx = now();
+        if (packets == 0)
+            first_rx = last_rx;
+        packets++;
+        bytes += ret;
+    }
+    return NULL;
+}
+
+
+static int spin(pthread_t *thread, pthread_attr_t *thattr)
+{
+    spin_count = 0;
+    spinning = 1;
+    return pthread_create(thread, thattr, &spinner, NULL);
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in  local_addr;
+    struct sockaddr_in  dest_addr;
+    int                 add_rtskbs = DEFAULT_ADD_BUFFERS;
+    int64_t             timeout;
+    pthread_attr_t      thattr;
+    pthread_t           spin_thread;
+    pthread_t           work_thread;
+    struct timespec     calib = { 1, 0 };
+    double              spins_per_ns;
+    double              busy;
+    long long           start, elapsed;
+    int                 ret;
+
+
+    while (1) {
+        switch (getopt(argc, argv, "rd:p:s:t:b:")) {
+            case 'r':
+                receiver_mode = 1;
+                break;
+
+            case 'd':
+                dest_ip_s = optarg;
+                break;
+
+            case 'p':
+                port = atoi(optarg);
+                break;
+
+            case 's':
+                size = atoi(optarg);
+                break;
+
+            case 't':
+                duration = atoi(optarg);
+                break;
+
+            case 'b':
+                add_rtskbs = atoi(optarg);
+                break;
+
+            case -1:
+                goto end_of_opt;
+
+            default:
+                printf("usage: %s -r | -d <dest_ip> [-s <payload_size>] "
+                       "[-t <secs>]\n"
+                       "       [-p <port>] [-b <add_buffers>]\n", argv[0]);
+                return 0;
+        }
+    }
+ end_of_opt:
+
+    if ((!receiver_mode && !dest_ip_s[0]) || size == 0 ||
+        size > MAX_PAYLOAD) {
+        printf("invalid arguments, see %s -h\n", argv[0]);
+        return 1;
+    }
+
+    mlockall(MCL_CURRENT|MCL_FUTURE);
+
+    if ((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        perror("socket cannot be created");
+        return 1;
+    }
+
+    local_addr.sin_family      = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    local_addr.sin_port        = htons(receiver_mode ? port : 0);
+    if (bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
+        perror("cannot bind to local ip/port");
+        close(sock);
+        return 1;
+    }
+
+    ret = ioctl(sock, RTNET_RTIOC_EXTPOOL, &add_rtskbs);
+    if (ret != add_rtskbs)
+        perror("WARNING: ioctl(RTNET_RTIOC_EXTPOOL)");
+
+    pthread_attr_init(&thattr);
+    pthread_attr_setdetachstate(&thattr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setstacksize(&thattr, PTHREAD_STACK_MIN);
+
+    /* calibrate the spinner on an idle system */
+    printf("calibrating...\n");
+    start = now();
+    if (spin(&spin_thread, &thattr) != 0) {
+        perror("pthread_create(spinner) failed");
+        close(sock);
+        return 1;
+    }
+    nanosleep(&calib, NULL);
+    spinning = 0;
+    pthread_join(spin_thread, NULL);
+    spins_per_ns = (double)spin_count / (now() - start);
+
+    if (receiver_mode) {
+        /* stop after the stream has paused for one second */
+        timeout = 1000000000LL;
+        ioctl(sock, RTNET_RTIOC_TIMEOUT, &timeout);
+        printf("waiting for stream on port %u\n", port);
+    } else {
+        dest_addr.sin_family = AF_INET;
+        dest_addr.sin_port   = htons(port);
+        inet_aton(dest_ip_s, &dest_addr.sin_addr);
+        printf("sending %u byte datagrams to %s for %u s\n",
+               size, dest_ip_s, duration);
+    }
+
+    start = now();
+    spin(&spin_thread, &thattr);
+    ret = pthread_create(&work_thread, &thattr,
+                         receiver_mode ? &receiver : &transmitter,
+                         &dest_addr);
+    if (ret) {
+        errno = ret; perror("pthread_create failed");
+        spinning = 0;
+        pthread_join(spin_thread, NULL);
+        close(sock);
+        return 1;
+    }
+    pthread_join(work_thread, NULL);
+    spinning = 0;
+    pthread_join(spin_thread, NULL);
+    elapsed = now() - start;
+
+    /* CPU time not consumed by the spinner went into the test */
+    busy = elapsed - spin_count / spins_per_ns;
+    if (busy < 0)
+        busy = 0;
+
+    if (receiver_mode) {
+        /* only account the streaming period */
+        elapsed = last_rx - first_rx;
+        if (elapsed <= 0)
+            elapsed = 1;
+    }
+
+    printf("packets:     %llu\n", packets);
+    printf("bytes:       %llu\n", bytes);
+    if (!receiver_mode)
+        printf("no buffers:  %llu\n", dropped);
+    printf("throughput:  %.1f Mbit/s, %.0f packets/s\n",
+           bytes * 8000.0 / elapsed, packets * 1e9 / elapsed);
+    printf("CPU load:    %.1f %%\n", busy * 100 / elapsed);
+    if (bytes > 0)
+        printf("CPU/byte:    %.3f ns\n", busy / bytes);
+
+    while ((close(sock) < 0) && (errno == EAGAIN)) {
+        printf("socket busy - waiting...\n");
+        sleep(1);
+    }
+
+    return 0;
+}
@@ -47,7 +47,12 @@ static inline void rt_arp_solicit(struct rtnet_device *rtdev, u32 target)
                 NULL, NULL, NULL);
 }
 
-void __init rt_arp_init(void);
+int rt_arp_resolve(struct rtnet_device *rtdev, u32 addr, struct rtskb *skb);
+int rt_arp_resolve_queue(struct rtnet_device *rtdev, u32 addr,
+                         struct rtskb_queue *queue, unsigned int count);
+void rt_arp_flush(struct rtnet_device *rtdev);
+
+int __init rt_arp_init(void);
 void rt_arp_release(void);
 
 
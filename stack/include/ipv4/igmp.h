@@ -0,0 +1,61 @@
+/***
+ *
+ *  ipv4/igmp.h - IPv4 multicast group management
+ *
+ *  RTnet - real-time networking subsystem
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTNET_IGMP_H_
+#define __RTNET_IGMP_H_
+
+#include <linux/init.h>
+#include <linux/types.h>
+
+#include <rtdev.h>
+#include <rtskb.h>
+
+
+#define RT_IGMP_PRIO            RTSKB_PRIO_VALUE(QUEUE_MIN_PRIO-1, \
+                                                 RTSKB_DEF_NRT_CHANNEL)
+
+#define IGMP_POOL_SIZE          8
+
+#define RT_IP_MC_DEFAULT_TTL    1
+
+
+struct rtsocket;
+
+static inline int rt_ip_is_multicast(u32 addr)
+{
+    return (addr & htonl(0xF0000000)) == htonl(0xE0000000);
+}
+
+struct rtnet_device *rt_ip_mc_dev(u32 ifaddr, int ifindex);
+
+int rt_ip_mc_join(struct rtsocket *sock, u32 group, u32 ifaddr, int ifindex);
+int rt_ip_mc_leave(struct rtsocket *sock, u32 group, u32 ifaddr, int ifindex);
+void rt_ip_mc_drop_socket(struct rtsocket *sock);
+void rt_ip_mc_flush(struct rtnet_device *rtdev);
+
+int rt_ip_mc_check(u32 group, struct rtnet_device *rtdev);
+
+int __init rt_igmp_init(void);
+void rt_igmp_release(void);
+
+
+#endif  /* __RTNET_IGMP_H_ */
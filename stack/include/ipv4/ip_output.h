@@ -33,9 +33,12 @@
 
 extern int rt_ip_build_xmit(struct rtsocket *sk,
     int getfrag (const void *, unsigned char *, unsigned int, unsigned int),
-    const void *frag, unsigned length, struct dest_route *rt, int flags);
+    const void *frag, unsigned length, struct dest_route *rt, int flags,
+    nanosecs_abs_t txtime);
+extern int rt_ip_xmit_rtskb(struct rtsocket *sk, struct rtskb *skb,
+                            struct dest_route *rt);
 
-extern void __init rt_ip_init(void);
+extern int __init rt_ip_init(void);
 extern void rt_ip_release(void);
 
 
@@ -35,11 +35,28 @@ struct dest_route {
     u32                 ip;
     unsigned char       dev_addr[MAX_ADDR_LEN];
     struct rtnet_device *rtdev;
+    unsigned int        hh_len;     /* 0 if no template available */
+    unsigned char       hh_data[HH_DATA_MOD];
+    u32                 neigh_ip;   /* next hop still to be resolved, or 0 */
+};
+
+/* Per-socket cache of the last output route. It holds no reference on the
+ * device, the route generation counter is checked instead. */
+struct route_cache {
+    rtdm_lock_t         lock;
+    unsigned int        genid;
+    u32                 daddr;
+    u32                 saddr;
+    struct dest_route   route;
 };
 
 
 int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
                          struct rtnet_device *rtdev);
+int rt_ip_route_confirm_host(u32 addr, unsigned char *dev_addr,
+                             struct rtnet_device *rtdev, int create);
+void rt_ip_route_age_hosts(nanosecs_abs_t now, nanosecs_rel_t reachable_time,
+                           unsigned int max_probes);
 void rt_ip_route_del_all(struct rtnet_device *rtdev);
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
@@ -55,6 +72,41 @@ int rt_ip_route_del_host(u32 addr, struct rtnet_device *rtdev);
 int rt_ip_route_get_host(u32 addr, char* if_name, unsigned char *dev_addr,
                          struct rtnet_device *rtdev);
 int rt_ip_route_output(struct dest_route *rt_buf, u32 daddr, u32 saddr);
+int rt_ip_route_output_cached(struct route_cache *rc,
+                              struct dest_route *rt_buf, u32 daddr, u32 saddr);
+int rt_ip_route_output_mc(struct dest_route *rt_buf, u32 daddr, u32 saddr,
+                          int ifindex);
+
+static inline void rt_ip_route_cache_init(struct route_cache *rc)
+{
+    rtdm_lock_init(&rc->lock);
+    rc->route.rtdev = NULL;
+}
+
+/***
+ *  rt_ip_hard_header - push link layer header for an IP packet
+ *
+ *  Uses the header template of the route if available, otherwise falls back
+ *  to the hard_header handler of the device. Returns the header length or a
+ *  negative error code.
+ */
+static inline int rt_ip_hard_header(struct rtskb *skb, struct dest_route *rt)
+{
+    struct rtnet_device *rtdev = rt->rtdev;
+
+
+    if (likely(rt->hh_len != 0)) {
+        skb->mac.raw = rtskb_push(skb, rt->hh_len);
+        memcpy(skb->mac.raw, rt->hh_data, rt->hh_len);
+        return rt->hh_len;
+    }
+
+    if (rtdev->hard_header == NULL)
+        return 0;
+
+    return rtdev->hard_header(skb, rtdev, ETH_P_IP, rt->dev_addr,
+                              rtdev->dev_addr, skb->len);
+}
 
 int __init rt_ip_routing_init(void);
 void rt_ip_routing_release(void);
@@ -25,7 +25,8 @@
 #include <rtskb.h>
 #include <ipv4/protocol.h>
 
-/* Maximum number of active tcp sockets, must be power of 2 */
+/* Default maximum number of active tcp sockets, see module parameter
+   tcp_sockets */
 #define RT_TCP_SOCKETS      32
 
 /*Maximum number of active tcp connections, must be power of 2 */
@@ -26,8 +26,13 @@
 #ifndef __RTNET_UDP_H_
 #define __RTNET_UDP_H_
 
-/* Maximum number of active udp sockets
-   Only increase with care (look-up delays!), must be power of 2 */
+/* Default maximum number of active udp sockets, see module parameter
+   udp_sockets */
 #define RT_UDP_SOCKETS      64
 
+/* not provided by kernels before 3.9, value of most architectures */
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT        15
+#endif
+
 #endif  /* __RTNET_UDP_H_ */
@@ -28,10 +28,18 @@
 
 #define MAX_RT_DEVICES                  8
 
+/* RX filter types (flow steering) */
+#define RTDEV_RX_FILTER_ETHERTYPE       1
+#define RTDEV_RX_FILTER_UDP_DPORT       2
+
+/* RX filter queue: the queue the driver reserves for real-time flows */
+#define RTDEV_RX_QUEUE_RT               0xFFFFFFFF
+
 
 #ifdef __KERNEL__
 
 #include <asm/atomic.h>
+#include <linux/init.h>
 #include <linux/netdevice.h>
 
 #include <rtskb.h>
@@ -46,6 +54,28 @@
 #define NETIF_F_LLTX                    4096
 #endif
 
+/* hardware transmits frames at rtskb.txtime, see rtnet_txtime.c */
+#define RTNETIF_F_TXTIME                0x40000000
+
+
+/***
+ *  rtdev_rx_filter - flow steering rule
+ */
+struct rtdev_rx_filter {
+    unsigned int        type;       /* RTDEV_RX_FILTER_*            */
+    unsigned int        value;      /* ethertype or UDP port (host order) */
+    unsigned int        queue;      /* RX queue or RTDEV_RX_QUEUE_RT */
+};
+
+#define RTDEV_MC_ADDRS                  16
+
+/***
+ *  rtdev_mc_addr - multicast filter entry
+ */
+struct rtdev_mc_addr {
+    unsigned char       addr[MAX_ADDR_LEN];
+    unsigned int        users;      /* joined groups mapping to it  */
+};
 
 enum rtnet_link_state {
 	__RTNET_LINK_STATE_XOFF = 0,
@@ -103,6 +133,10 @@ struct rtnet_device {
     int                 promiscuity;
     int                 allmulti;
 
+    /* Multicast filter, managed via rtdev_mc_add/del under nrt_lock */
+    struct rtdev_mc_addr mc_list[RTDEV_MC_ADDRS];
+    unsigned int        mc_count;
+
     __u32               local_ip;   /* IP address in network order  */
     __u32               broadcast_ip; /* broadcast IP in network order */
 
@@ -145,6 +179,9 @@ struct rtnet_device {
 
     int                 (*do_ioctl)(struct rtnet_device *rtdev, 
 				    unsigned int request, void * cmd);
+    /* optional, only called while the device is down */
+    int                 (*change_mtu)(struct rtnet_device *rtdev,
+                                      int new_mtu);
     struct net_device_stats *(*get_stats)(struct rtnet_device *rtdev);
 
     /* DMA pre-mapping hooks */
@@ -152,6 +189,16 @@ struct rtnet_device {
                                      struct rtskb *skb);
     void                (*unmap_rtskb)(struct rtnet_device *rtdev,
                                        struct rtskb *skb);
+
+    /* Flow steering hooks (optional), called with nrt_lock held */
+    int                 (*add_rx_filter)(struct rtnet_device *rtdev,
+                                         struct rtdev_rx_filter *filter);
+    int                 (*del_rx_filter)(struct rtnet_device *rtdev,
+                                         struct rtdev_rx_filter *filter);
+
+    /* Multicast filter hook (optional), called with nrt_lock held while the
+     * device is up. Has to program mc_list and the IFF_ALLMULTI state. */
+    void                (*set_multicast_list)(struct rtnet_device *rtdev);
 };
 
 
@@ -209,12 +256,20 @@ static inline void rtdev_dereference(struct rtnet_device *rtdev)
 }
 
 int rtdev_xmit(struct rtskb *skb);
+int rtdev_xmit_burst(struct rtskb_queue *queue);
+
+/* provided by rtnet_txtime.c */
+void rtnet_txtime_queue(struct rtskb *skb);
+void rtnet_txtime_flush(struct rtnet_device *rtdev);
+int __init rtnet_txtime_init(void);
+void rtnet_txtime_release(void);
 
 #ifdef CONFIG_RTNET_ADDON_PROXY
 int rtdev_xmit_proxy(struct rtskb *skb);
 #endif
 
 unsigned int rt_hard_mtu(struct rtnet_device *rtdev, unsigned int priority);
+int rtdev_set_mtu(struct rtnet_device *rtdev, unsigned int mtu);
 
 int rtdev_open(struct rtnet_device *rtdev);
 int rtdev_close(struct rtnet_device *rtdev);
@@ -222,6 +277,14 @@ int rtdev_close(struct rtnet_device *rtdev);
 int rtdev_map_rtskb(struct rtskb *skb);
 void rtdev_unmap_rtskb(struct rtskb *skb);
 
+int rtdev_add_rx_filter(struct rtnet_device *rtdev,
+                        struct rtdev_rx_filter *filter);
+int rtdev_del_rx_filter(struct rtnet_device *rtdev,
+                        struct rtdev_rx_filter *filter);
+
+int rtdev_mc_add(struct rtnet_device *rtdev, const unsigned char *addr);
+int rtdev_mc_del(struct rtnet_device *rtdev, const unsigned char *addr);
+
 #endif  /* __KERNEL__ */
 
 #endif  /* __RTDEV_H_ */
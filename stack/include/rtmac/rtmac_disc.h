@@ -43,6 +43,7 @@ struct rtmac_priv {
     struct net_device_stats vnic_stats;
     struct rtskb_queue      vnic_skb_pool;
     unsigned int            vnic_max_mtu;
+    int                     rx_filter;  /* RTmac RX filter installed */
 
     u8                      disc_priv[0] __attribute__ ((aligned(16)));
 };
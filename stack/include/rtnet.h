@@ -63,6 +63,7 @@ typedef int64_t                 nanosecs_rel_t;
 
 /* sub-classes: RTDM_CLASS_NETWORK */
 #define RTDM_SUBCLASS_RTNET     0
+#define RTDM_SUBCLASS_RTNET_EVQ 1       /* socket event queue "rtevq" */
 
 #define RTIOC_TYPE_NETWORK      RTDM_CLASS_NETWORK
 
@@ -77,6 +78,66 @@ typedef int64_t                 nanosecs_rel_t;
  * Use RTNET_RTIOC_TIMEOUT with any negative timeout value instead. */
 #define RTNET_RTIOC_EXTPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x14, unsigned int)
 #define RTNET_RTIOC_SHRPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x15, unsigned int)
+#define RTNET_RTIOC_RECVMMSG    _IOWR(RTIOC_TYPE_NETWORK, 0x16, \
+                                      struct rtnet_mmsg_args)
+#define RTNET_RTIOC_SENDMMSG    _IOWR(RTIOC_TYPE_NETWORK, 0x17, \
+                                      struct rtnet_mmsg_args)
+
+/* message vector entry for RTNET_RTIOC_RECVMMSG/SENDMMSG */
+struct rtnet_mmsghdr {
+    struct msghdr           msg_hdr;
+    unsigned int            msg_len;    /* bytes received or sent */
+};
+
+/* argument of RTNET_RTIOC_RECVMMSG/SENDMMSG, the IOCTL returns the number
+ * of processed messages */
+struct rtnet_mmsg_args {
+    struct rtnet_mmsghdr    *msgvec;
+    unsigned int            vlen;
+    unsigned int            flags;      /* MSG_xxx, applied to all messages */
+};
+
+#define RTNET_MMSG_MAX          1024    /* maximum vlen per call */
+
+/* Limits the receive queue to the given number of messages, 0 for no limit.
+ * When the queue is full, the oldest message is overwritten. */
+#define RTNET_RTIOC_QUEUEDEPTH  _IOW(RTIOC_TYPE_NETWORK, 0x1D, unsigned int)
+/* number of messages overwritten due to the queue depth limit */
+#define RTNET_RTIOC_OVERWRITTEN _IOR(RTIOC_TYPE_NETWORK, 0x1E, unsigned int)
+
+/* Event queues: sockets are registered once at a queue opened from the
+ * "rtevq" device, RTNET_RTIOC_EVQ_WAIT then returns the sockets which have
+ * received data. A socket is reported again as long as data is pending. */
+#define RTNET_RTIOC_EVQ_ADD     _IOW(RTIOC_TYPE_NETWORK, 0x1F, \
+                                     struct rtnet_evq_ctl)
+#define RTNET_RTIOC_EVQ_DEL     _IOW(RTIOC_TYPE_NETWORK, 0x20, \
+                                     struct rtnet_evq_ctl)
+#define RTNET_RTIOC_EVQ_WAIT    _IOWR(RTIOC_TYPE_NETWORK, 0x21, \
+                                      struct rtnet_evq_wait)
+
+#define RTNET_EVQ_IN            0x0001  /* data can be received */
+
+/* argument of RTNET_RTIOC_EVQ_ADD/DEL */
+struct rtnet_evq_ctl {
+    int                     fd;         /* RTnet socket */
+    unsigned int            events;     /* RTNET_EVQ_IN */
+    uint64_t                data;       /* returned with each event */
+};
+
+struct rtnet_evq_event {
+    uint64_t                data;
+    int                     fd;
+    unsigned int            events;
+};
+
+/* argument of RTNET_RTIOC_EVQ_WAIT, the IOCTL returns the number of events */
+struct rtnet_evq_wait {
+    struct rtnet_evq_event  *events;
+    unsigned int            maxevents;
+    nanosecs_rel_t          timeout;    /* 0: infinite, < 0: non-blocking */
+};
+
+#define RTNET_EVQ_MAX_EVENTS    32      /* maximum events per call */
 
 /* socket transmission priorities */
 #define SOCK_MAX_PRIO           0
@@ -106,6 +167,44 @@ struct rtnet_callback {
 #define RTNET_RTIOC_CALLBACK    _IOW(RTIOC_TYPE_NETWORK, 0x12, \
                                      struct rtnet_callback)
 
+/* zero-copy receive for in-kernel users, see RTNET_RTIOC_BORROW */
+struct rtnet_borrow {
+    struct iovec    *iov;       /* in: receives the read-only payload views */
+    int             iovlen;     /* in: array size, out: entries used */
+    size_t          len;        /* out: payload length */
+    void            *name;      /* in: optional source address buffer */
+    socklen_t       namelen;    /* out: address length */
+    int             flags;      /* in: MSG_DONTWAIT */
+    void            *handle;    /* out: pass back via RTNET_RTIOC_RELEASE */
+};
+
+/* Lends the next datagram to the caller instead of copying it. The buffers
+ * remain charged to the socket pool until they are handed back. */
+#define RTNET_RTIOC_BORROW      _IOWR(RTIOC_TYPE_NETWORK, 0x18, \
+                                      struct rtnet_borrow)
+#define RTNET_RTIOC_RELEASE     _IOW(RTIOC_TYPE_NETWORK, 0x19, \
+                                     struct rtnet_borrow)
+
+/* zero-copy transmit for in-kernel users, see RTNET_RTIOC_TXRESERVE */
+struct rtnet_txbuf {
+    size_t          len;        /* in: payload size, may shrink on commit */
+    void            *data;      /* out: payload area to be filled */
+    const void      *name;      /* in: optional destination (commit) */
+    socklen_t       namelen;    /* in: address length (commit) */
+    int             flags;      /* in: MSG_xxx (commit) */
+    void            *handle;    /* out: cleared once passed to the stack */
+};
+
+/* Reserves a socket pool buffer whose payload can be written in place.
+ * RTNET_RTIOC_TXCOMMIT adds the protocol headers and sends it, and
+ * RTNET_RTIOC_TXABORT returns an unused buffer. */
+#define RTNET_RTIOC_TXRESERVE   _IOWR(RTIOC_TYPE_NETWORK, 0x1A, \
+                                      struct rtnet_txbuf)
+#define RTNET_RTIOC_TXCOMMIT    _IOW(RTIOC_TYPE_NETWORK, 0x1B, \
+                                     struct rtnet_txbuf)
+#define RTNET_RTIOC_TXABORT     _IOW(RTIOC_TYPE_NETWORK, 0x1C, \
+                                     struct rtnet_txbuf)
+
 /* utility functions */
 
 /* provided by rt_ipv4 */
@@ -85,7 +85,7 @@ struct rtnet_core_cmd {
             __u32       set_dev_flags;
             __u32       clear_dev_flags;
             __u32       dev_addr_type;
-            __u32       __padding;
+            __u32       mtu;            /* 0: keep current MTU */
             __u8        dev_addr[DEV_ADDR_LEN];
         } up;
 
@@ -99,6 +99,13 @@ struct rtnet_core_cmd {
             __u8        dev_addr[DEV_ADDR_LEN];
         } info;
 
+        struct {
+            __u32       type;
+            __u32       value;
+            __u32       queue;
+            __u32       __padding;
+        } filter;
+
         __u64 __padding[8];
     } args;
 };
@@ -119,5 +126,9 @@ struct rtnet_core_cmd {
 #define IOC_RT_IFINFO                   _IOWR(RTNET_IOC_TYPE_CORE, 2 |  \
                                               RTNET_IOC_NODEV_PARAM,    \
                                               struct rtnet_core_cmd)
+#define IOC_RT_IFFILTER_ADD             _IOW(RTNET_IOC_TYPE_CORE, 3,    \
+                                             struct rtnet_core_cmd)
+#define IOC_RT_IFFILTER_DEL             _IOW(RTNET_IOC_TYPE_CORE, 4,    \
+                                             struct rtnet_core_cmd)
 
 #endif  /* __RTNET_CHRDEV_H_ */
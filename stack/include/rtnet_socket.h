@@ -28,16 +28,44 @@
 #define __RTNET_SOCKET_H_
 
 #include <asm/atomic.h>
+#include <linux/init.h>
 #include <linux/list.h>
+#include <linux/socket.h>
 
 #include <rtdev.h>
 #include <rtnet.h>
 #include <rtnet_sys.h>
 #include <stack_mgr.h>
+#include <ipv4/route.h>
 
 #include <rtdm/rtdm_driver.h>
 
 
+/* not provided by kernels before 2.6.22, value of most architectures */
+#ifndef SO_TIMESTAMPNS
+#define SO_TIMESTAMPNS          35
+#define SCM_TIMESTAMPNS         SO_TIMESTAMPNS
+#endif
+
+/* not provided by kernels before 4.19 */
+#ifndef SO_TXTIME
+#define SO_TXTIME               61
+#define SCM_TXTIME              SO_TXTIME
+
+struct sock_txtime {
+    clockid_t               clockid;    /* reference for SCM_TXTIME */
+    u32                     flags;
+};
+#else
+#include <linux/net_tstamp.h>
+#endif
+
+/* room for link, IP, and transport headers in front of reserved payloads */
+#define RTNET_TX_HEADROOM       64
+
+struct rt_ip_mc_membership;
+struct rtnet_evq_entry;
+
 struct rtsocket {
     unsigned short          protocol;
 
@@ -53,6 +81,11 @@ struct rtsocket {
     nanosecs_rel_t          timeout;    /* receive timeout, 0 for infinite */
 
     rtdm_sem_t              pending_sem;
+    unsigned int            queue_depth; /* 0 for unlimited */
+    unsigned int            overwritten; /* messages dropped by the limit */
+    int                     rx_timestamp; /* SO_TIMESTAMPNS set */
+    int                     txtime;     /* SO_TXTIME set */
+    struct rtnet_evq_entry  *evq_entry; /* event queue registration */
 
     void                    (*callback_func)(struct rtdm_dev_context *,
                                              void *arg);
@@ -69,6 +102,14 @@ struct rtsocket {
             int             reg_index;  /* index in port registry */
             u8              tos;
             u8              state;
+            u8              reuseport;  /* SO_REUSEPORT set */
+            unsigned int    frag_count; /* messages being reassembled */
+
+            u8              mc_ttl;     /* TTL of multicast datagrams */
+            int             mc_ifindex; /* multicast output device or 0 */
+            struct rt_ip_mc_membership *mc_list; /* joined groups */
+
+            struct route_cache rt_cache; /* last output route */
         } inet;
 
         /* packet socket specific */
@@ -98,6 +139,24 @@ int rt_socket_common_ioctl(struct rtdm_dev_context *context,
 int rt_socket_if_ioctl(struct rtdm_dev_context *context,
                        rtdm_user_info_t *user_info,
                        int request, void *arg);
+struct rtskb *rt_socket_enqueue(struct rtsocket *sock, struct rtskb *skb);
+int rt_socket_lend(struct rtskb *skb, size_t len, struct rtnet_borrow *borrow);
+int rt_socket_txbuf_check(struct rtsocket *sock, rtdm_user_info_t *user_info,
+                          struct rtnet_txbuf *txbuf);
+int rt_socket_setsockopt(struct rtsocket *sock, int optname,
+                         const void *optval, socklen_t optlen);
+int rt_socket_getsockopt(struct rtsocket *sock, int optname,
+                         void *optval, socklen_t *optlen);
+void rt_socket_put_stamp(struct rtsocket *sock, struct msghdr *msg,
+                         struct rtskb *skb);
+int rt_socket_get_txtime(struct rtsocket *sock, const struct msghdr *msg,
+                         nanosecs_abs_t *txtime);
+
+/* provided by rtnet_evq.c */
+void rtnet_evq_signal(struct rtsocket *sock);
+void rtnet_evq_detach(struct rtsocket *sock);
+int __init rtnet_evq_init(void);
+void rtnet_evq_release(void);
 #ifdef CONFIG_RTNET_SELECT_SUPPORT
 int rt_socket_select_bind(struct rtdm_dev_context *context,
                           rtdm_selector_t *selector,
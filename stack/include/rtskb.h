@@ -163,6 +163,7 @@ struct rtskb {
     unsigned int        priority;   /* bit 0..15: prio, 16..31: user-defined */
 
     struct rtsocket     *sk;        /* assigned socket */
+    int                 lent;       /* handed out to an in-kernel user */
     struct rtnet_device *rtdev;     /* source or destination device */
 
     nanosecs_abs_t      time_stamp; /* arrival or transmission (RTcap) time */
@@ -172,6 +173,9 @@ struct rtskb {
      */
     nanosecs_abs_t      *xmit_stamp;
 
+    /* launch time (RTDM clock), 0 to transmit immediately */
+    nanosecs_abs_t      txtime;
+
     /* transport layer */
     union
     {
@@ -267,6 +271,9 @@ struct rtskb_prio_queue {
 
 #define ALIGN_RTSKB_STRUCT_LEN      SKB_DATA_ALIGN(sizeof(struct rtskb))
 #define RTSKB_SIZE                  1544    /* maximum needed by pcnet32-rt */
+#define RTSKB_MAX_SIZE              (16384 + 64) /* upper limit of rtskb_size */
+
+extern unsigned int rtskb_buf_size;     /* data buffer size of all rtskbs     */
 
 extern unsigned int rtskb_pools;        /* current number of rtskb pools      */
 extern unsigned int rtskb_pools_max;    /* maximum number of rtskb pools      */
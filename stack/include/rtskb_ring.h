@@ -0,0 +1,352 @@
+/***
+ *
+ *  include/rtskb_ring.h - common descriptor ring helpers for RTnet drivers
+ *
+ *  RTnet - real-time networking subsystem
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTSKB_RING_H_
+#define __RTSKB_RING_H_
+
+#ifdef __KERNEL__
+
+#include <linux/dma-mapping.h>
+
+#include <rtdev.h>
+#include <rtskb.h>
+
+
+/***
+
+Descriptor Ring Helpers
+-----------------------
+
+These helpers factor out the buffer handling every DMA ring driver needs, so
+that the per-packet paths look the same across drivers and can be optimised
+in a single place. The descriptor layout itself remains driver business.
+
+All buffers handled here are expected to be pre-mapped, i.e. the driver has
+to install rtdev->map_rtskb/unmap_rtskb hooks (rtskb_ring_map/unmap can serve
+as their implementation). The stack then maps every rtskb once when it enters
+a pool, and the hot paths only need rtskb_data_dma_addr(). As the mapping
+stays in place, the frame data still has to be synchronised per packet. This
+matters when buffers are bounced (e.g. swiotlb with 32-bit DMA masks) or the
+caches are not coherent.
+
+Receive side: rtskb_ring_rx_alloc() provides a buffer for an empty slot.
+Drivers which hand filled buffers up and refill the ring in a second loop
+(followed by a single doorbell/tail update) use rtskb_ring_rx_take().
+Drivers which keep the ring fully populated all the time use
+rtskb_ring_rx_swap(). It tries to replace the filled buffer and recycles it
+in place if the pool is exhausted, dropping the frame.
+
+Small frames (e.g. TDMA sync or ARP) can instead be copied out of the ring
+by rtskb_ring_rx_copybreak(). The copy is taken from a separate pool, and the
+ring buffer is recycled in place. Bursts of small frames then drain only the
+copy pool while the device pool remains available for large frames.
+Drivers offering this expose the size threshold as "copybreak" module
+parameter.
+
+Transmit side: rtskb_ring_tx_sync() passes a frame to the device right before
+its descriptor is handed over. rtskb_ring_tx_reclaim() collects completed buffers on a
+private queue while the driver lock is held, and rtskb_ring_tx_free() hands
+them back to their pools afterwards, grouping consecutive buffers of the same
+pool under one pool lock.
+
+*/
+
+
+/***
+ *  rtskb_ring_map - map an rtskb buffer for device access
+ *  @dev: device to map for
+ *  @skb: buffer to map
+ *
+ *  Suitable as implementation of rtdev->map_rtskb. The whole buffer is
+ *  mapped so that any headroom reserved by the driver is covered as well.
+ */
+static inline dma_addr_t rtskb_ring_map(struct device *dev, struct rtskb *skb)
+{
+    dma_addr_t addr;
+
+    addr = dma_map_single(dev, skb->buf_start, rtskb_buf_size,
+                          DMA_BIDIRECTIONAL);
+    if (dma_mapping_error(dev, addr)) {
+        dev_err(dev, "DMA map failed\n");
+        return RTSKB_UNMAPPED;
+    }
+    return addr;
+}
+
+/***
+ *  rtskb_ring_unmap - release a mapping set up by rtskb_ring_map
+ *  @dev: device the buffer was mapped for
+ *  @skb: buffer to unmap
+ */
+static inline void rtskb_ring_unmap(struct device *dev, struct rtskb *skb)
+{
+    dma_unmap_single(dev, skb->buf_dma_addr, rtskb_buf_size,
+                     DMA_BIDIRECTIONAL);
+}
+
+
+/***
+ *  rtskb_ring_rx_alloc - allocate a pre-mapped receive buffer
+ *  @rtdev:   device the buffer is dedicated to
+ *  @pool:    pool to allocate from
+ *  @size:    buffer size
+ *  @reserve: headroom in front of the frame (e.g. 2 for IP alignment)
+ *  @dma:     returns the bus address the device shall write to
+ */
+static inline struct rtskb *rtskb_ring_rx_alloc(struct rtnet_device *rtdev,
+                                                struct rtskb_queue *pool,
+                                                unsigned int size,
+                                                unsigned int reserve,
+                                                dma_addr_t *dma)
+{
+    struct rtskb *skb;
+
+    skb = dev_alloc_rtskb(size, pool);
+    if (unlikely(skb == NULL))
+        return NULL;
+
+    rtskb_reserve(skb, reserve);
+    skb->rtdev = rtdev;
+    *dma = rtskb_data_dma_addr(skb, 0);
+
+    return skb;
+}
+
+/***
+ *  rtskb_ring_rx_take - remove a filled buffer from its ring slot
+ *  @dev:  device the buffer is mapped for
+ *  @slot: ring slot
+ *  @len:  length of the received frame
+ *
+ *  The slot is left empty and has to be refilled by the driver, preferably
+ *  in a batch after the receive loop. The frame is synchronised for CPU
+ *  access.
+ */
+static inline struct rtskb *rtskb_ring_rx_take(struct device *dev,
+                                               struct rtskb **slot,
+                                               unsigned int len)
+{
+    struct rtskb *skb = *slot;
+
+    *slot = NULL;
+    dma_sync_single_for_cpu(dev, rtskb_data_dma_addr(skb, 0), len,
+                            DMA_BIDIRECTIONAL);
+    rtskb_put(skb, len);
+
+    return skb;
+}
+
+/***
+ *  rtskb_ring_rx_swap - replace a filled buffer in its ring slot
+ *  @dev:     device the buffer is mapped for
+ *  @slot:    ring slot
+ *  @pool:    pool to take the replacement from
+ *  @size:    buffer size
+ *  @reserve: headroom in front of the frame
+ *  @len:     length of the received frame
+ *  @dma:     returns the bus address to put into the descriptor
+ *
+ *  Returns the filled buffer, synchronised for CPU access, or NULL if no
+ *  replacement was available. In the latter case the frame is dropped and
+ *  the old buffer stays in the slot, so the descriptor can be handed back to
+ *  the hardware in any case.
+ */
+static inline struct rtskb *rtskb_ring_rx_swap(struct device *dev,
+                                               struct rtskb **slot,
+                                               struct rtskb_queue *pool,
+                                               unsigned int size,
+                                               unsigned int reserve,
+                                               unsigned int len,
+                                               dma_addr_t *dma)
+{
+    struct rtskb *skb = *slot;
+    struct rtskb *new_skb;
+
+    new_skb = rtskb_ring_rx_alloc(skb->rtdev, pool, size, reserve, dma);
+    if (unlikely(new_skb == NULL)) {
+        *dma = rtskb_data_dma_addr(skb, 0);
+        return NULL;
+    }
+
+    *slot = new_skb;
+    dma_sync_single_for_cpu(dev, rtskb_data_dma_addr(skb, 0), len,
+                            DMA_BIDIRECTIONAL);
+    rtskb_put(skb, len);
+
+    return skb;
+}
+
+/***
+ *  rtskb_ring_rx_copy - copy a received frame into a new buffer
+ *  @rtdev:   receiving device
+ *  @pool:    pool to take the buffer from
+ *  @data:    frame data, already synchronised for CPU access
+ *  @len:     length of the frame
+ *  @reserve: headroom in front of the frame
+ *
+ *  Returns the new buffer, or NULL if the pool is exhausted.
+ */
+static inline struct rtskb *rtskb_ring_rx_copy(struct rtnet_device *rtdev,
+                                               struct rtskb_queue *pool,
+                                               const void *data,
+                                               unsigned int len,
+                                               unsigned int reserve)
+{
+    struct rtskb *skb;
+
+    skb = dev_alloc_rtskb(len + reserve, pool);
+    if (unlikely(skb == NULL))
+        return NULL;
+
+    rtskb_reserve(skb, reserve);
+    skb->rtdev = rtdev;
+    memcpy(rtskb_put(skb, len), data, len);
+
+    return skb;
+}
+
+/***
+ *  rtskb_ring_rx_copybreak - copy a small frame out of a ring buffer
+ *  @dev:     device the ring buffer is mapped for
+ *  @skb:     filled ring buffer
+ *  @pool:    pool to take the copy from
+ *  @len:     length of the received frame
+ *  @reserve: headroom in front of the frame
+ *
+ *  Returns the copy, or NULL if the pool is exhausted. The ring buffer is
+ *  left untouched in both cases, so the driver can hand it back to the
+ *  hardware right away.
+ */
+static inline struct rtskb *rtskb_ring_rx_copybreak(struct device *dev,
+                                                    struct rtskb *skb,
+                                                    struct rtskb_queue *pool,
+                                                    unsigned int len,
+                                                    unsigned int reserve)
+{
+    struct rtskb *new_skb;
+    dma_addr_t addr = rtskb_data_dma_addr(skb, 0);
+
+    dma_sync_single_for_cpu(dev, addr, len, DMA_BIDIRECTIONAL);
+    new_skb = rtskb_ring_rx_copy(skb->rtdev, pool, skb->data, len, reserve);
+    dma_sync_single_for_device(dev, addr, len, DMA_BIDIRECTIONAL);
+
+    return new_skb;
+}
+
+
+/***
+ *  rtskb_ring_tx_sync - pass a frame to the device for transmission
+ *  @dev: device the buffer is mapped for
+ *  @skb: frame to be sent
+ *
+ *  Returns the bus address of the frame. Call it after the last CPU write
+ *  to the frame (including the xmit_stamp patch) and before the descriptor
+ *  is handed to the hardware.
+ */
+static inline dma_addr_t rtskb_ring_tx_sync(struct device *dev,
+                                            struct rtskb *skb)
+{
+    dma_addr_t addr = rtskb_data_dma_addr(skb, 0);
+
+    dma_sync_single_for_device(dev, addr, skb->len, DMA_BIDIRECTIONAL);
+
+    return addr;
+}
+
+/***
+ *  rtskb_ring_tx_reclaim - collect a completed transmit buffer
+ *  @slot: ring slot
+ *  @done: private queue collecting the buffers to be released
+ *
+ *  Meant to be called under the driver lock, release the collected buffers
+ *  via rtskb_ring_tx_free() after dropping it.
+ */
+static inline void rtskb_ring_tx_reclaim(struct rtskb **slot,
+                                         struct rtskb_queue *done)
+{
+    struct rtskb *skb = *slot;
+
+    *slot = NULL;
+    __rtskb_queue_tail(done, skb);
+}
+
+/***
+ *  rtskb_ring_tx_free - release buffers collected by rtskb_ring_tx_reclaim
+ *  @done: private queue
+ */
+static inline void rtskb_ring_tx_free(struct rtskb_queue *done)
+{
+#ifdef CONFIG_RTNET_ADDON_RTCAP
+    struct rtskb *skb;
+
+    /* captured buffers need the slow path */
+    while ((skb = __rtskb_dequeue(done)) != NULL)
+        dev_kfree_rtskb(skb);
+#else
+    struct rtskb_queue  *pool;
+    struct rtskb        *first;
+    struct rtskb        *last;
+    struct rtskb        *next;
+    rtdm_lockctx_t      context;
+#ifdef CONFIG_RTNET_CHECKED
+    unsigned int        count;
+#endif
+
+    next = done->first;
+    while (next != NULL) {
+        first = next;
+        last  = first->chain_end;
+        pool  = first->pool;
+#ifdef CONFIG_RTNET_CHECKED
+        count = first->chain_len;
+#endif
+
+        /* collect the run of chains belonging to the same pool, accounted
+         * per chain head like kfree_rtskb does */
+        while (last->next != NULL && last->next->pool == pool) {
+#ifdef CONFIG_RTNET_CHECKED
+            count += last->next->chain_len;
+#endif
+            last = last->next->chain_end;
+        }
+        next = last->next;
+        last->next = NULL;
+
+        rtdm_lock_get_irqsave(&pool->lock, context);
+        if (pool->first == NULL)
+            pool->first = first;
+        else
+            pool->last->next = first;
+        pool->last = last;
+#ifdef CONFIG_RTNET_CHECKED
+        pool->pool_balance += count;
+#endif
+        rtdm_lock_put_irqrestore(&pool->lock, context);
+    }
+
+    done->first = NULL;
+#endif /* CONFIG_RTNET_ADDON_RTCAP */
+}
+
+#endif /* __KERNEL__ */
+
+#endif  /* __RTSKB_RING_H_ */
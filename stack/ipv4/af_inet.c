@@ -31,6 +31,7 @@
 #include <rtnet_rtpc.h>
 #include <ipv4/arp.h>
 #include <ipv4/icmp.h>
+#include <ipv4/igmp.h>
 #include <ipv4/ip_output.h>
 #include <ipv4/protocol.h>
 #include <ipv4/route.h>
@@ -270,13 +271,23 @@ static void rt_ip_ifup(struct rtnet_device *rtdev,
 
 static void rt_ip_ifdown(struct rtnet_device *rtdev)
 {
+    rt_arp_flush(rtdev);
     rt_ip_route_del_all(rtdev);
 }
 
 
 
+static void rt_ip_unregister_device(struct rtnet_device *rtdev)
+{
+    /* group memberships survive a down/up cycle, but not the device */
+    rt_ip_mc_flush(rtdev);
+    rt_ip_ifdown(rtdev);
+}
+
+
+
 static struct rtdev_event_hook  rtdev_hook = {
-    .unregister_device = rt_ip_ifdown,
+    .unregister_device = rt_ip_unregister_device,
     .ifup =              rt_ip_ifup,
     .ifdown =            rt_ip_ifdown
 };
@@ -295,8 +306,8 @@ static int __init rt_ipv4_proto_init(void)
 
 
     /* Network-Layer */
-    rt_ip_init();
-    rt_arp_init();
+    if ((result = rt_ip_init()) < 0)
+        return result;
 
     /* Transport-Layer */
     for (i=0; i<MAX_RT_INET_PROTOCOLS; i++)
@@ -314,13 +325,24 @@ static int __init rt_ipv4_proto_init(void)
 
     if ((result = rt_ip_routing_init()) < 0)
         goto err1;
-    if ((result = rtnet_register_ioctls(&ipv4_ioctls)) < 0)
+    /* ARP ages the host routes, so it depends on the routing tables */
+    if ((result = rt_arp_init()) < 0)
         goto err2;
+    if ((result = rt_igmp_init()) < 0)
+        goto err3;
+    if ((result = rtnet_register_ioctls(&ipv4_ioctls)) < 0)
+        goto err4;
 
     rtdev_add_event_hook(&rtdev_hook);
 
     return 0;
 
+  err4:
+    rt_igmp_release();
+
+  err3:
+    rt_arp_release();
+
   err2:
     rt_ip_routing_release();
 
@@ -330,7 +352,6 @@ static int __init rt_ipv4_proto_init(void)
 #endif /* CONFIG_PROC_FS */
 
     rt_icmp_release();
-    rt_arp_release();
     rt_ip_release();
 
     return result;
@@ -341,6 +362,8 @@ static void __exit rt_ipv4_proto_release(void)
 {
     rtdev_del_event_hook(&rtdev_hook);
     rtnet_unregister_ioctls(&ipv4_ioctls);
+    rt_igmp_release();
+    rt_arp_release();
     rt_ip_routing_release();
 
 #ifdef CONFIG_PROC_FS
@@ -351,7 +374,6 @@ static void __exit rt_ipv4_proto_release(void)
     rt_icmp_release();
 
     /* Network-Layer */
-    rt_arp_release();
     rt_ip_release();
 }
 
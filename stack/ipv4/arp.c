@@ -21,6 +21,9 @@
  *
  */
 
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+
 #include <rtdev.h>
 #include <stack_mgr.h>
 #include <ipv4/arp.h>
@@ -29,6 +32,48 @@
 #include <ipv4/ip_input.h>
 #endif /* CONFIG_RTNET_ADDON_PROXY_ARP */
 
+
+/* Neighbour whose address is being resolved (state "incomplete") */
+struct arp_pending {
+    u32                 ip;         /* 0 if unused */
+    struct rtnet_device *rtdev;
+    struct rtskb_queue  queue;      /* packets waiting for the reply */
+    unsigned int        queue_len;
+    unsigned int        probes;
+    nanosecs_abs_t      next_probe;
+};
+
+#define ARP_TIMER_PERIOD    100000000LL /* ns */
+#define ARP_AGING_TICKS     10          /* aging pass every second */
+
+static unsigned int         arp_pending_entries = 32;
+static unsigned int         arp_queue_len = 3;
+static unsigned int         arp_retrans_time = 1000;  /* ms */
+static unsigned int         arp_max_probes = 3;
+static unsigned int         arp_reachable_time = 30;  /* s */
+
+module_param(arp_pending_entries, uint, 0444);
+MODULE_PARM_DESC(arp_pending_entries, "number of neighbours which can be "
+                 "resolved concurrently (default: 32)");
+module_param(arp_queue_len, uint, 0444);
+MODULE_PARM_DESC(arp_queue_len, "packets held per unresolved neighbour "
+                 "(default: 3)");
+module_param(arp_retrans_time, uint, 0444);
+MODULE_PARM_DESC(arp_retrans_time, "interval between ARP requests to an "
+                 "unresolved neighbour in ms (default: 1000)");
+module_param(arp_max_probes, uint, 0444);
+MODULE_PARM_DESC(arp_max_probes, "unanswered requests after which a neighbour "
+                 "is considered unreachable (default: 3)");
+module_param(arp_reachable_time, uint, 0444);
+MODULE_PARM_DESC(arp_reachable_time, "time after which learned host routes "
+                 "are probed again in s, 0 disables aging (default: 30)");
+
+static struct arp_pending   *arp_pending;
+static rtdm_lock_t          arp_pending_lock = RTDM_LOCK_UNLOCKED;
+static rtdm_task_t          arp_timer_task;
+static int                  arp_timer_shutdown;
+
+
 /***
  *  arp_send:   Create and send an arp packet. If (dest_hw == NULL),
  *              we create a broadcast message.
@@ -103,6 +148,334 @@ void rt_arp_send(int type, int ptype, u32 dest_ip, struct rtnet_device *rtdev,
 
 
 
+/***
+ *  rt_arp_free_queue - drops packets waiting for an address resolution
+ */
+static void rt_arp_free_queue(struct rtskb_queue *queue)
+{
+    struct rtskb *skb;
+
+
+    while ((skb = __rtskb_dequeue(queue)) != NULL)
+        kfree_rtskb(skb);
+}
+
+
+
+/***
+ *  rt_arp_hold - starts address resolution and holds packets meanwhile
+ *  @queue:   packets to be held, always consumed
+ *  @count:   number of packets in @queue
+ *  @replace: drop the oldest held packets if the new ones do not fit,
+ *            otherwise drop the new ones and return -EAGAIN
+ */
+static int rt_arp_hold(struct rtnet_device *rtdev, u32 addr,
+                       struct rtskb_queue *queue, unsigned int count,
+                       int replace)
+{
+    struct arp_pending  *entry = NULL;
+    struct rtskb_queue  dropped;
+    struct rtskb        *skb;
+    rtdm_lockctx_t      context;
+    unsigned int        i;
+    int                 solicit = 0;
+    int                 ret = 0;
+
+
+    /* the packets must not block the pool of their socket meanwhile */
+    for (skb = queue->first; skb != NULL; skb = skb->next)
+        if (rtskb_acquire(skb, &global_pool) != 0) {
+            rt_arp_free_queue(queue);
+            return -ENOBUFS;
+        }
+
+    rtskb_queue_init(&dropped);
+
+    rtdm_lock_get_irqsave(&arp_pending_lock, context);
+
+    if (!(rtdev->flags & IFF_UP) || (arp_pending == NULL))
+        goto drop;
+
+    for (i = 0; i < arp_pending_entries; i++)
+        if ((arp_pending[i].ip == addr) && (arp_pending[i].rtdev == rtdev)) {
+            entry = &arp_pending[i];
+            break;
+        }
+
+    if (entry == NULL) {
+        for (i = 0; i < arp_pending_entries; i++)
+            if (arp_pending[i].ip == 0) {
+                entry = &arp_pending[i];
+                break;
+            }
+        if (entry == NULL)
+            goto drop;
+
+        rtdev_reference(rtdev);
+        entry->ip         = addr;
+        entry->rtdev      = rtdev;
+        entry->probes     = 1;
+        entry->next_probe = rtdm_clock_read() +
+            (nanosecs_rel_t)arp_retrans_time * 1000000;
+        solicit = 1;
+    }
+
+    if (count > 0) {
+        if (replace)
+            while ((entry->queue_len > 0) &&
+                   (entry->queue_len + count > arp_queue_len)) {
+                __rtskb_queue_tail(&dropped, __rtskb_dequeue(&entry->queue));
+                entry->queue_len--;
+            }
+
+        if (entry->queue_len + count <= arp_queue_len) {
+            while ((skb = __rtskb_dequeue(queue)) != NULL)
+                __rtskb_queue_tail(&entry->queue, skb);
+            entry->queue_len += count;
+        } else if (!replace)
+            ret = -EAGAIN;
+    }
+
+    rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+
+    rt_arp_free_queue(&dropped);
+    rt_arp_free_queue(queue);
+
+    if (solicit)
+        rt_arp_solicit(rtdev, addr);
+
+    return ret;
+
+  drop:
+    rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+
+    rt_arp_free_queue(queue);
+
+    return -ENOBUFS;
+}
+
+
+
+/***
+ *  rt_arp_resolve - starts address resolution of a neighbour
+ *  @rtdev: device the neighbour is attached to
+ *  @addr:  IP of the neighbour
+ *  @skb:   IP packet without link layer header to be sent once the address
+ *          is known, or NULL
+ *
+ *  Sends an ARP request if the neighbour is not being resolved yet. The
+ *  packet is always consumed. If the queue of the neighbour is full, the
+ *  oldest packet is dropped. Returns -ENOBUFS if no resolution could be
+ *  started.
+ */
+int rt_arp_resolve(struct rtnet_device *rtdev, u32 addr, struct rtskb *skb)
+{
+    struct rtskb_queue  queue;
+
+
+    rtskb_queue_init(&queue);
+    if (skb != NULL)
+        __rtskb_queue_tail(&queue, skb);
+
+    return rt_arp_hold(rtdev, addr, &queue, (skb != NULL) ? 1 : 0, 1);
+}
+
+
+
+/***
+ *  rt_arp_resolve_queue - starts address resolution, holding a datagram
+ *  @rtdev: device the neighbour is attached to
+ *  @addr:  IP of the neighbour
+ *  @queue: packets without link layer header, e.g. all fragments of a
+ *          datagram
+ *  @count: number of packets in @queue
+ *
+ *  Like rt_arp_resolve, but the packets are held all together or not at all.
+ *  If they do not fit into the free room of the neighbour's queue, they are
+ *  dropped and -EAGAIN is returned. The queue is always consumed.
+ */
+int rt_arp_resolve_queue(struct rtnet_device *rtdev, u32 addr,
+                         struct rtskb_queue *queue, unsigned int count)
+{
+    return rt_arp_hold(rtdev, addr, queue, count, 0);
+}
+
+
+
+/***
+ *  rt_arp_take_pending - ends the resolution of a neighbour
+ *  @queue: returns the packets waiting for the neighbour
+ *
+ *  Returns 1 if the neighbour was being resolved, 0 otherwise.
+ */
+static int rt_arp_take_pending(struct rtnet_device *rtdev, u32 addr,
+                               struct rtskb_queue *queue)
+{
+    struct arp_pending  *entry;
+    rtdm_lockctx_t      context;
+    unsigned int        i;
+
+
+    rtdm_lock_get_irqsave(&arp_pending_lock, context);
+
+    for (i = 0; i < arp_pending_entries; i++) {
+        entry = &arp_pending[i];
+        if ((entry->ip == addr) && (entry->rtdev == rtdev)) {
+            *queue = entry->queue;
+            rtskb_queue_init(&entry->queue);
+            entry->queue_len = 0;
+            entry->ip        = 0;
+
+            rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+
+            /* the queued packets still refer to the device */
+            return 1;
+        }
+    }
+
+    rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_arp_xmit_pending - sends the packets held for a resolved neighbour
+ *
+ *  Drops the reference on the device taken by rt_arp_resolve.
+ */
+static void rt_arp_xmit_pending(struct rtnet_device *rtdev,
+                                struct rtskb_queue *queue,
+                                unsigned char *dev_addr)
+{
+    struct rtskb *skb;
+
+
+    while ((skb = __rtskb_dequeue(queue)) != NULL) {
+        if (rtdev->hard_header &&
+            (rtdev->hard_header(skb, rtdev, ETH_P_IP, dev_addr,
+                                rtdev->dev_addr, skb->len) < 0)) {
+            kfree_rtskb(skb);
+            continue;
+        }
+        rtdev_xmit(skb);
+    }
+
+    rtdev_dereference(rtdev);
+}
+
+
+
+/***
+ *  rt_arp_flush - drops all resolutions pending on a device
+ */
+void rt_arp_flush(struct rtnet_device *rtdev)
+{
+    struct arp_pending  *entry;
+    struct rtnet_device *pending_dev;
+    struct rtskb_queue  queue;
+    rtdm_lockctx_t      context;
+    unsigned int        i;
+
+
+    for (i = 0; i < arp_pending_entries; i++) {
+        entry = &arp_pending[i];
+
+        rtdm_lock_get_irqsave(&arp_pending_lock, context);
+
+        if ((entry->ip == 0) || ((rtdev != NULL) && (entry->rtdev != rtdev))) {
+            rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+            continue;
+        }
+
+        pending_dev = entry->rtdev;
+        queue = entry->queue;
+        rtskb_queue_init(&entry->queue);
+        entry->queue_len = 0;
+        entry->ip        = 0;
+
+        rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+
+        rt_arp_free_queue(&queue);
+        rtdev_dereference(pending_dev);
+    }
+}
+
+
+
+/***
+ *  rt_arp_timer - retransmits ARP requests and ages learned host routes
+ */
+static void rt_arp_timer(void *arg)
+{
+    struct arp_pending  *entry;
+    struct rtnet_device *rtdev;
+    struct rtskb_queue  queue;
+    nanosecs_abs_t      now;
+    rtdm_lockctx_t      context;
+    unsigned int        ticks = 0;
+    unsigned int        i;
+    u32                 addr;
+
+
+    while (!arp_timer_shutdown) {
+        now = rtdm_clock_read();
+
+        for (i = 0; i < arp_pending_entries; i++) {
+            entry = &arp_pending[i];
+
+            rtdm_lock_get_irqsave(&arp_pending_lock, context);
+
+            if ((entry->ip == 0) || (now < entry->next_probe)) {
+                rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+                continue;
+            }
+
+            addr  = entry->ip;
+            rtdev = entry->rtdev;
+
+            if (entry->probes >= arp_max_probes) {
+                /* give up, the neighbour is unreachable */
+                queue = entry->queue;
+                rtskb_queue_init(&entry->queue);
+                entry->queue_len = 0;
+                entry->ip        = 0;
+
+                rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+
+                rt_arp_free_queue(&queue);
+                rtdev_dereference(rtdev);
+
+                /*ERRMSG*/rtdm_printk("RTnet: host %u.%u.%u.%u unreachable\n",
+                                      NIPQUAD(addr));
+                continue;
+            }
+
+            entry->probes++;
+            entry->next_probe = now +
+                (nanosecs_rel_t)arp_retrans_time * 1000000;
+            rtdev_reference(rtdev);
+
+            rtdm_lock_put_irqrestore(&arp_pending_lock, context);
+
+            rt_arp_solicit(rtdev, addr);
+            rtdev_dereference(rtdev);
+        }
+
+        if ((arp_reachable_time > 0) && (++ticks >= ARP_AGING_TICKS)) {
+            ticks = 0;
+            rt_ip_route_age_hosts(now,
+                (nanosecs_rel_t)arp_reachable_time * 1000000000,
+                arp_max_probes);
+        }
+
+        rtdm_task_wait_period();
+    }
+}
+
+
+
 /***
  *  arp_rcv:    Receive an arp request by the device layer.
  */
@@ -114,6 +487,8 @@ int rt_arp_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     unsigned char       *sha;
     u32                 sip, tip;
     u16                 dev_type = rtdev->type;
+    struct rtskb_queue  queue;
+    int                 pending;
 
     /*
      *  The hardware length of the packet should match the hardware length
@@ -166,15 +541,24 @@ int rt_arp_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     arp_ptr += rtdev->addr_len;
     memcpy(&tip, arp_ptr, 4);
 
-    /* process only requests/replies directed to us */
+    /* process only requests/replies directed to us and gratuitous ARP */
     if (tip == rtdev->local_ip) {
-        rt_ip_route_add_host(sip, sha, rtdev);
+        pending = rt_arp_take_pending(rtdev, sip, &queue);
+        rt_ip_route_confirm_host(sip, sha, rtdev, 1);
+        if (pending)
+            rt_arp_xmit_pending(rtdev, &queue, sha);
 
 #ifndef CONFIG_RTNET_ADDON_PROXY_ARP
         if (arp->ar_op == __constant_htons(ARPOP_REQUEST))
             rt_arp_send(ARPOP_REPLY, ETH_P_ARP, sip, rtdev, tip, sha,
                         rtdev->dev_addr, sha);
 #endif /* CONFIG_RTNET_ADDON_PROXY_ARP */
+    } else if ((sip == tip) && (sip != INADDR_ANY)) {
+        /* only refresh known neighbours, unless we are waiting for it */
+        pending = rt_arp_take_pending(rtdev, sip, &queue);
+        rt_ip_route_confirm_host(sip, sha, rtdev, pending);
+        if (pending)
+            rt_arp_xmit_pending(rtdev, &queue, sha);
     }
 
 out:
@@ -200,9 +584,31 @@ static struct rtpacket_type arp_packet_type = {
 /***
  *  rt_arp_init
  */
-void __init rt_arp_init(void)
+int __init rt_arp_init(void)
 {
+    unsigned int    i;
+    int             ret;
+
+
+    arp_pending = kcalloc(arp_pending_entries, sizeof(struct arp_pending),
+                          GFP_KERNEL);
+    if (arp_pending == NULL)
+        return -ENOMEM;
+
+    for (i = 0; i < arp_pending_entries; i++)
+        rtskb_queue_init(&arp_pending[i].queue);
+
+    ret = rtdm_task_init(&arp_timer_task, "rtnet-arp", rt_arp_timer, NULL,
+                         RTDM_TASK_LOWEST_PRIORITY, ARP_TIMER_PERIOD);
+    if (ret < 0) {
+        kfree(arp_pending);
+        arp_pending = NULL;
+        return ret;
+    }
+
     rtdev_add_pack(&arp_packet_type);
+
+    return 0;
 }
 
 
@@ -213,4 +619,12 @@ void __init rt_arp_init(void)
 void rt_arp_release(void)
 {
     rtdev_remove_pack(&arp_packet_type);
+
+    arp_timer_shutdown = 1;
+    rtdm_task_unblock(&arp_timer_task);
+    rtdm_task_join_nrt(&arp_timer_task, 100);
+
+    rt_arp_flush(NULL);
+    kfree(arp_pending);
+    arp_pending = NULL;
 }
@@ -35,6 +35,7 @@
 #include <rtnet_socket.h>
 #include <ipv4_chrdev.h>
 #include <ipv4/icmp.h>
+#include <ipv4/igmp.h>
 #include <ipv4/ip_fragment.h>
 #include <ipv4/ip_output.h>
 #include <ipv4/protocol.h>
@@ -196,7 +197,7 @@ static void rt_icmp_send_reply(struct icmp_bxm *icmp_param, struct rtskb *skb)
 
     err = rt_ip_build_xmit(&icmp_socket, rt_icmp_glue_reply_bits, icmp_param,
                            sizeof(struct icmphdr) + icmp_param->data_len,
-                           &rt, MSG_DONTWAIT);
+                           &rt, MSG_DONTWAIT, 0);
 
     rtdev_dereference(rt.rtdev);
 
@@ -322,7 +323,7 @@ static int rt_icmp_send_request(u32 daddr, struct icmp_bxm *icmp_param)
         err = -EMSGSIZE;
     else
         err = rt_ip_build_xmit(&icmp_socket, rt_icmp_glue_request_bits,
-                               icmp_param, size, &rt, MSG_DONTWAIT);
+                               icmp_param, size, &rt, MSG_DONTWAIT, 0);
 
     rtdev_dereference(rt.rtdev);
 
@@ -527,6 +528,9 @@ void __init rt_icmp_init(void)
         printk("RTnet: allocated only %d icmp rtskbs\n", skbs);
 
     icmp_socket.prot.inet.tos = 0;
+    icmp_socket.prot.inet.frag_count = 0;
+    icmp_socket.prot.inet.mc_ttl = RT_IP_MC_DEFAULT_TTL;
+    icmp_socket.prot.inet.mc_list = NULL;
 
     rt_inet_add_protocol(&icmp_protocol);
 }
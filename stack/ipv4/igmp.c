@@ -0,0 +1,621 @@
+/***
+ *
+ *  ipv4/igmp.c - IPv4 multicast group management (IGMPv2) for RTnet
+ *
+ *  RTnet - real-time networking subsystem
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/if_arp.h>
+#include <linux/igmp.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <net/checksum.h>
+#include <net/ip.h>
+
+#include <rtdev.h>
+#include <rtskb.h>
+#include <rtnet_socket.h>
+#include <ipv4/igmp.h>
+#include <ipv4/protocol.h>
+
+
+/*
+ * Number of distinct (group, device) pairs which can be joined at the same
+ * time, summed up over all sockets.
+ */
+static unsigned int ip_mc_groups = 32;
+
+module_param(ip_mc_groups, uint, 0444);
+MODULE_PARM_DESC(ip_mc_groups, "number of multicast groups which can be "
+                 "joined concurrently (default: 32)");
+
+#define RT_IGMP_SIZE    (sizeof(struct iphdr) + 4 + sizeof(struct igmphdr))
+
+struct rt_ip_mc_group {
+    u32                 addr;       /* group address */
+    int                 ifindex;    /* device, 0 after it was unregistered */
+    unsigned int        users;      /* memberships, 0 if the slot is free */
+};
+
+struct rt_ip_mc_membership {
+    struct rt_ip_mc_membership  *next;
+    struct rt_ip_mc_group       *group;
+};
+
+static struct rt_ip_mc_group    *mc_groups;
+static unsigned int             mc_groups_used; /* high water mark */
+
+/* mc_lock protects the group table against the receive path, mc_nrt_lock
+ * serialises joins and leaves and protects the socket membership lists */
+static rtdm_lock_t              mc_lock = RTDM_LOCK_UNLOCKED;
+static DEFINE_MUTEX(mc_nrt_lock);
+
+static struct {
+    /*
+     * Scratch pad, provided so that rt_socket_dereference(&igmp_socket);
+     * remains legal.
+     */
+    struct rtdm_dev_context dummy;
+
+    /*
+     *  Socket receiving the IGMP queries
+     *  It is not part of the socket pool.
+     */
+    struct rtsocket socket;
+} igmp_socket_container;
+
+#define igmp_socket     igmp_socket_container.socket
+
+
+
+/***
+ *  rt_igmp_send - send a membership report or leave message
+ *  @rtdev: output device
+ *  @type:  IGMPV2_HOST_MEMBERSHIP_REPORT or IGMP_HOST_LEAVE_MESSAGE
+ *  @group: group address
+ *
+ *  Like ARP, the messages are taken from the global pool. They carry the
+ *  Router Alert option and a TTL of 1 (RFC 2236).
+ */
+static void rt_igmp_send(struct rtnet_device *rtdev, int type, u32 group)
+{
+    struct rtskb    *skb;
+    struct iphdr    *iph;
+    struct igmphdr  *igmph;
+    unsigned char   *opt;
+    unsigned char   dev_addr[MAX_ADDR_LEN];
+    u32             daddr;
+
+
+    if ((rtdev->type != ARPHRD_ETHER) || !(rtdev->flags & IFF_UP) ||
+        (rtdev->local_ip == 0))
+        return;
+
+    daddr = (type == IGMP_HOST_LEAVE_MESSAGE) ?
+        htonl(INADDR_ALLRTRS_GROUP) : group;
+
+    skb = alloc_rtskb(RT_IGMP_SIZE + rtdev->hard_header_len + 15,
+                      &global_pool);
+    if (skb == NULL)
+        return;
+
+    rtskb_reserve(skb, (rtdev->hard_header_len + 15) & ~15);
+
+    skb->rtdev    = rtdev;
+    skb->protocol = __constant_htons(ETH_P_IP);
+    skb->priority = RT_IGMP_PRIO;
+    skb->nh.iph   = iph = (struct iphdr *)rtskb_put(skb, RT_IGMP_SIZE);
+
+    iph->version  = 4;
+    iph->ihl      = 6;    /* Router Alert option */
+    iph->tos      = 0xC0; /* internetwork control */
+    iph->tot_len  = htons(RT_IGMP_SIZE);
+    iph->id       = 0;
+    iph->frag_off = htons(IP_DF);
+    iph->ttl      = 1;
+    iph->protocol = IPPROTO_IGMP;
+    iph->saddr    = rtdev->local_ip;
+    iph->daddr    = daddr;
+
+    opt = (unsigned char *)(iph + 1);
+    opt[0] = IPOPT_RA;
+    opt[1] = 4;
+    opt[2] = 0;
+    opt[3] = 0;
+
+    iph->check    = 0;
+    iph->check    = ip_fast_csum((unsigned char *)iph, iph->ihl);
+
+    igmph = (struct igmphdr *)(opt + 4);
+    igmph->type   = type;
+    igmph->code   = 0;
+    igmph->group  = group;
+    igmph->csum   = 0;
+    igmph->csum   = ip_compute_csum((unsigned char *)igmph,
+                                    sizeof(struct igmphdr));
+
+    ip_eth_mc_map(daddr, dev_addr);
+    if (rtdev->hard_header &&
+        (rtdev->hard_header(skb, rtdev, ETH_P_IP, dev_addr, rtdev->dev_addr,
+                            skb->len) < 0)) {
+        kfree_rtskb(skb);
+        return;
+    }
+
+    rtdev_xmit(skb);
+}
+
+
+
+/***
+ *  rt_ip_mc_dev - select the device for a multicast membership or transmission
+ *  @ifaddr:  local address of the device, or INADDR_ANY
+ *  @ifindex: index of the device, or 0
+ *
+ *  If neither is given, the first device which is up and has an IP address
+ *  assigned is used, loopback excluded.
+ *
+ *  Note: increments refcount on returned rtdev
+ */
+struct rtnet_device *rt_ip_mc_dev(u32 ifaddr, int ifindex)
+{
+    struct rtnet_device *rtdev;
+    int                 i;
+
+
+    if (ifindex > 0)
+        return rtdev_get_by_index(ifindex);
+
+    for (i = 1; i <= MAX_RT_DEVICES; i++) {
+        rtdev = rtdev_get_by_index(i);
+        if (rtdev == NULL)
+            continue;
+
+        if (ifaddr != INADDR_ANY) {
+            if (rtdev->local_ip == ifaddr)
+                return rtdev;
+        } else if ((rtdev->flags & IFF_UP) &&
+                   !(rtdev->flags & IFF_LOOPBACK) && (rtdev->local_ip != 0))
+            return rtdev;
+
+        rtdev_dereference(rtdev);
+    }
+
+    return NULL;
+}
+
+
+
+/***
+ *  rt_ip_mc_put - drop a reference on a group
+ *
+ *  The last user removes the group from the table and the device filter and
+ *  signals the leave.
+ *
+ *  Note: must be called with mc_nrt_lock held
+ */
+static void rt_ip_mc_put(struct rt_ip_mc_group *group)
+{
+    struct rtnet_device *rtdev;
+    unsigned char       dev_addr[MAX_ADDR_LEN];
+    rtdm_lockctx_t      context;
+    int                 ifindex;
+
+
+    rtdm_lock_get_irqsave(&mc_lock, context);
+    if (--group->users > 0) {
+        rtdm_lock_put_irqrestore(&mc_lock, context);
+        return;
+    }
+    ifindex = group->ifindex;
+    rtdm_lock_put_irqrestore(&mc_lock, context);
+
+    if ((ifindex == 0) || ((rtdev = rtdev_get_by_index(ifindex)) == NULL))
+        return;
+
+    if (group->addr != htonl(INADDR_ALLHOSTS_GROUP))
+        rt_igmp_send(rtdev, IGMP_HOST_LEAVE_MESSAGE, group->addr);
+
+    if (rtdev->type == ARPHRD_ETHER) {
+        ip_eth_mc_map(group->addr, dev_addr);
+
+        mutex_lock(&rtdev->nrt_lock);
+        rtdev_mc_del(rtdev, dev_addr);
+        mutex_unlock(&rtdev->nrt_lock);
+    }
+
+    rtdev_dereference(rtdev);
+}
+
+
+
+/***
+ *  rt_ip_mc_join - join a multicast group (IP_ADD_MEMBERSHIP)
+ *  @sock:    socket
+ *  @group:   group address
+ *  @ifaddr:  local address of the device, or INADDR_ANY
+ *  @ifindex: index of the device, or 0
+ *
+ *  The first membership of a group on a device programs the device filter
+ *  and sends an unsolicited report.
+ */
+int rt_ip_mc_join(struct rtsocket *sock, u32 group, u32 ifaddr, int ifindex)
+{
+    struct rt_ip_mc_membership  *membership;
+    struct rt_ip_mc_membership  *iter;
+    struct rt_ip_mc_group       *entry = NULL;
+    struct rt_ip_mc_group       *free_entry = NULL;
+    struct rtnet_device         *rtdev;
+    unsigned char               dev_addr[MAX_ADDR_LEN];
+    rtdm_lockctx_t              context;
+    unsigned int                i;
+    int                         ret = 0;
+
+
+    if (!rt_ip_is_multicast(group))
+        return -EINVAL;
+
+    rtdev = rt_ip_mc_dev(ifaddr, ifindex);
+    if (rtdev == NULL)
+        return -ENODEV;
+
+    membership = kmalloc(sizeof(struct rt_ip_mc_membership), GFP_KERNEL);
+    if (membership == NULL) {
+        rtdev_dereference(rtdev);
+        return -ENOMEM;
+    }
+
+    mutex_lock(&mc_nrt_lock);
+
+    for (i = 0; i < ip_mc_groups; i++) {
+        if (mc_groups[i].users == 0) {
+            if (free_entry == NULL)
+                free_entry = &mc_groups[i];
+        } else if ((mc_groups[i].addr == group) &&
+                   (mc_groups[i].ifindex == rtdev->ifindex)) {
+            entry = &mc_groups[i];
+            break;
+        }
+    }
+
+    if (entry != NULL) {
+        for (iter = sock->prot.inet.mc_list; iter != NULL; iter = iter->next)
+            if (iter->group == entry) {
+                ret = -EADDRINUSE;
+                goto out;
+            }
+
+        rtdm_lock_get_irqsave(&mc_lock, context);
+        entry->users++;
+        rtdm_lock_put_irqrestore(&mc_lock, context);
+    } else {
+        if (free_entry == NULL) {
+            ret = -ENOBUFS;
+            goto out;
+        }
+        entry = free_entry;
+
+        if (rtdev->type == ARPHRD_ETHER) {
+            ip_eth_mc_map(group, dev_addr);
+
+            mutex_lock(&rtdev->nrt_lock);
+            ret = rtdev_mc_add(rtdev, dev_addr);
+            mutex_unlock(&rtdev->nrt_lock);
+
+            if (ret < 0)
+                goto out;
+        }
+
+        rtdm_lock_get_irqsave(&mc_lock, context);
+        entry->addr    = group;
+        entry->ifindex = rtdev->ifindex;
+        entry->users   = 1;
+        if (entry - mc_groups >= mc_groups_used)
+            mc_groups_used = entry - mc_groups + 1;
+        rtdm_lock_put_irqrestore(&mc_lock, context);
+
+        if (group != htonl(INADDR_ALLHOSTS_GROUP))
+            rt_igmp_send(rtdev, IGMPV2_HOST_MEMBERSHIP_REPORT, group);
+    }
+
+    membership->group = entry;
+    membership->next  = sock->prot.inet.mc_list;
+    sock->prot.inet.mc_list = membership;
+    membership = NULL;
+
+  out:
+    mutex_unlock(&mc_nrt_lock);
+
+    kfree(membership);
+    rtdev_dereference(rtdev);
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_ip_mc_leave - leave a multicast group (IP_DROP_MEMBERSHIP)
+ *  @sock:    socket
+ *  @group:   group address
+ *  @ifaddr:  local address of the device, or INADDR_ANY
+ *  @ifindex: index of the device, or 0
+ */
+int rt_ip_mc_leave(struct rtsocket *sock, u32 group, u32 ifaddr, int ifindex)
+{
+    struct rt_ip_mc_membership  **pprev;
+    struct rt_ip_mc_membership  *membership;
+    struct rtnet_device         *rtdev;
+    int                         ret = -EADDRNOTAVAIL;
+
+
+    rtdev = rt_ip_mc_dev(ifaddr, ifindex);
+    if (rtdev == NULL)
+        return -ENODEV;
+
+    mutex_lock(&mc_nrt_lock);
+
+    for (pprev = &sock->prot.inet.mc_list; (membership = *pprev) != NULL;
+         pprev = &membership->next)
+        if ((membership->group->addr == group) &&
+            (membership->group->ifindex == rtdev->ifindex)) {
+            *pprev = membership->next;
+            rt_ip_mc_put(membership->group);
+            kfree(membership);
+            ret = 0;
+            break;
+        }
+
+    mutex_unlock(&mc_nrt_lock);
+
+    rtdev_dereference(rtdev);
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_ip_mc_drop_socket - leave all groups of a closing socket
+ *  @sock: socket
+ */
+void rt_ip_mc_drop_socket(struct rtsocket *sock)
+{
+    struct rt_ip_mc_membership  *membership;
+
+
+    if (sock->prot.inet.mc_list == NULL)
+        return;
+
+    mutex_lock(&mc_nrt_lock);
+
+    while ((membership = sock->prot.inet.mc_list) != NULL) {
+        sock->prot.inet.mc_list = membership->next;
+        rt_ip_mc_put(membership->group);
+        kfree(membership);
+    }
+
+    mutex_unlock(&mc_nrt_lock);
+}
+EXPORT_SYMBOL(rt_ip_mc_drop_socket);
+
+
+
+/***
+ *  rt_ip_mc_flush - detach all groups from an unregistering device
+ *  @rtdev: the device
+ *
+ *  The memberships remain until the sockets leave or close, but they no
+ *  longer match any traffic, even if a new device gets the same index.
+ */
+void rt_ip_mc_flush(struct rtnet_device *rtdev)
+{
+    rtdm_lockctx_t  context;
+    unsigned int    i;
+
+
+    mutex_lock(&mc_nrt_lock);
+    rtdm_lock_get_irqsave(&mc_lock, context);
+
+    for (i = 0; i < mc_groups_used; i++)
+        if (mc_groups[i].ifindex == rtdev->ifindex)
+            mc_groups[i].ifindex = 0;
+
+    rtdm_lock_put_irqrestore(&mc_lock, context);
+    mutex_unlock(&mc_nrt_lock);
+}
+
+
+
+/***
+ *  rt_ip_mc_check - receive filter for multicast datagrams
+ *  @group:  destination address of the datagram
+ *  @rtdev:  receiving device
+ *
+ *  Returns non-zero if the group has been joined on the device. The NIC
+ *  filters are hash based, so unwanted groups may still reach the stack.
+ */
+int rt_ip_mc_check(u32 group, struct rtnet_device *rtdev)
+{
+    rtdm_lockctx_t  context;
+    unsigned int    i;
+    int             ret = 0;
+
+
+    if (group == htonl(INADDR_ALLHOSTS_GROUP))
+        return 1;
+
+    rtdm_lock_get_irqsave(&mc_lock, context);
+
+    for (i = 0; i < mc_groups_used; i++)
+        if ((mc_groups[i].addr == group) && (mc_groups[i].users > 0) &&
+            (mc_groups[i].ifindex == rtdev->ifindex)) {
+            ret = 1;
+            break;
+        }
+
+    rtdm_lock_put_irqrestore(&mc_lock, context);
+
+    return ret;
+}
+EXPORT_SYMBOL(rt_ip_mc_check);
+
+
+
+/***
+ *  rt_igmp_query - answer a membership query
+ *  @rtdev: receiving device
+ *  @group: queried group, 0 for a general query
+ *
+ *  Reports are sent right away instead of after a random delay. This keeps
+ *  the stack free of per-group timers and is harmless on the small segments
+ *  RTnet is used on.
+ */
+static void rt_igmp_query(struct rtnet_device *rtdev, u32 group)
+{
+    rtdm_lockctx_t  context;
+    unsigned int    i;
+    u32             addr;
+
+
+    for (i = 0; i < mc_groups_used; i++) {
+        rtdm_lock_get_irqsave(&mc_lock, context);
+        addr = mc_groups[i].addr;
+        if ((mc_groups[i].users == 0) ||
+            (mc_groups[i].ifindex != rtdev->ifindex) ||
+            ((group != 0) && (addr != group)))
+            addr = 0;
+        rtdm_lock_put_irqrestore(&mc_lock, context);
+
+        if ((addr != 0) && (addr != htonl(INADDR_ALLHOSTS_GROUP)))
+            rt_igmp_send(rtdev, IGMPV2_HOST_MEMBERSHIP_REPORT, addr);
+    }
+}
+
+
+
+/***
+ *  rt_igmp_dest_socket
+ */
+static struct rtsocket *rt_igmp_dest_socket(struct rtskb *skb)
+{
+    /* Note that the socket's refcount is not used by this protocol.
+     * The socket returned here is static and not part of the global pool. */
+    return &igmp_socket;
+}
+
+
+
+/***
+ *  rt_igmp_rcv
+ */
+static void rt_igmp_rcv(struct rtskb *skb)
+{
+    struct igmphdr  *igmph = (struct igmphdr *)skb->h.raw;
+
+
+    /* check header sanity and don't accept fragmented packets */
+    if ((skb->len < sizeof(struct igmphdr)) || (skb->next != NULL))
+        goto cleanup;
+
+    if (ip_compute_csum(skb->h.raw, skb->len))
+        goto cleanup;
+
+    /* reports of other members are ignored, we do not delay our own */
+    if (igmph->type == IGMP_HOST_MEMBERSHIP_QUERY)
+        rt_igmp_query(skb->rtdev, igmph->group);
+
+  cleanup:
+    kfree_rtskb(skb);
+}
+
+
+
+/***
+ *  rt_igmp_rcv_err
+ */
+static void rt_igmp_rcv_err(struct rtskb *skb)
+{
+    rtdm_printk("RTnet: rt_igmp_rcv err\n");
+}
+
+
+
+/***
+ *  rt_igmp_socket
+ */
+static int rt_igmp_socket(struct rtdm_dev_context *context,
+                          rtdm_user_info_t *user_info)
+{
+    /* we don't support user-created IGMP sockets */
+    return -ENOPROTOOPT;
+}
+
+
+
+static struct rtinet_protocol igmp_protocol = {
+    .protocol =     IPPROTO_IGMP,
+    .dest_socket =  &rt_igmp_dest_socket,
+    .rcv_handler =  &rt_igmp_rcv,
+    .err_handler =  &rt_igmp_rcv_err,
+    .init_socket =  &rt_igmp_socket
+};
+
+
+
+/***
+ *  rt_igmp_init
+ */
+int __init rt_igmp_init(void)
+{
+    unsigned int skbs;
+
+
+    if (ip_mc_groups == 0)
+        ip_mc_groups = 1;
+
+    mc_groups = kcalloc(ip_mc_groups, sizeof(struct rt_ip_mc_group),
+                        GFP_KERNEL);
+    if (mc_groups == NULL)
+        return -ENOMEM;
+
+    skbs = rt_bare_socket_init(&igmp_socket, IPPROTO_IGMP, RT_IGMP_PRIO,
+                               IGMP_POOL_SIZE);
+    if (skbs < IGMP_POOL_SIZE)
+        printk("RTnet: allocated only %d igmp rtskbs\n", skbs);
+
+    rt_inet_add_protocol(&igmp_protocol);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_igmp_release
+ */
+void rt_igmp_release(void)
+{
+    rt_inet_del_protocol(&igmp_protocol);
+    rt_bare_socket_cleanup(&igmp_socket);
+
+    kfree(mc_groups);
+}
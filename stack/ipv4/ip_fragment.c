@@ -21,6 +21,11 @@
 
 
 #include <linux/module.h>
+#include <linux/jhash.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/random.h>
+#include <linux/slab.h>
 #include <net/checksum.h>
 #include <net/ip.h>
 
@@ -38,227 +43,423 @@
 #endif /* CONFIG_RTNET_ADDON_PROXY */
 
 /*
- * This defined sets the number of incoming fragmented IP messages that
- * can be handled in parallel.
+ * Number of incoming fragmented IP messages that can be handled in parallel,
+ * the share a single socket may occupy, and the time after which incomplete
+ * messages are dropped.
  */
-#define COLLECTOR_COUNT 10
+static unsigned int ip_collectors = 64;
+static unsigned int ip_frag_quota = 16;
+static unsigned int ip_frag_timeout = 1000; /* ms */
+
+/*
+ * Fragments arriving ahead of the first one cannot be accounted to a socket
+ * yet. They are held at the expense of a dedicated pool of this size.
+ */
+static unsigned int ip_frag_rtskbs = 32;
+
+module_param(ip_collectors, uint, 0444);
+MODULE_PARM_DESC(ip_collectors, "number of IP messages which can be "
+                 "reassembled concurrently (default: 64)");
+module_param(ip_frag_quota, uint, 0444);
+MODULE_PARM_DESC(ip_frag_quota, "maximum number of IP messages reassembled "
+                 "per socket, 0 for no limit (default: 16)");
+module_param(ip_frag_timeout, uint, 0444);
+MODULE_PARM_DESC(ip_frag_timeout, "time after which incomplete IP messages "
+                 "are dropped in ms (default: 1000)");
+module_param(ip_frag_rtskbs, uint, 0444);
+MODULE_PARM_DESC(ip_frag_rtskbs, "number of fragments which can be held "
+                 "before the first fragment of their message (default: 32)");
 
 struct ip_collector
 {
-    int   in_use;
+    struct ip_collector *next;      /* hash chain */
+    struct list_head    list;       /* age list or free list */
+
     __u32 saddr;
     __u32 daddr;
     __u16 id;
     __u8  protocol;
 
-    struct rtskb_queue frags;
-    struct rtsocket *sock;
-    unsigned int buf_size;
+    struct rtskb_queue frags;       /* sorted by offset, without overlaps */
+    struct rtsocket *sock;          /* NULL until the first fragment arrived */
+    int unclaimed;                  /* no socket, fragments are passed on */
+    unsigned int received;          /* bytes collected so far */
+    unsigned int total_len;         /* known after the last fragment, else 0 */
+    nanosecs_abs_t expires;
 };
 
-static struct ip_collector collector[COLLECTOR_COUNT];
+static struct ip_collector  *collector;
+static struct ip_collector  **collector_hash;
+static unsigned int         collector_hash_mask;
+static u32                  collector_hash_rnd;
+
+/* in use, oldest first */
+static LIST_HEAD(collector_age_list);
+static LIST_HEAD(collector_free_list);
+static rtdm_lock_t          collector_lock = RTDM_LOCK_UNLOCKED;
+
+static rtdm_timer_t         collector_timer;
+static struct rtskb_queue   frag_pool;
 
 
-static void alloc_collector(struct rtskb *skb, struct rtsocket *sock)
+
+static inline struct ip_collector **collector_bucket(__u32 saddr, __u16 id,
+                                                     __u8 protocol)
 {
-    int                 i;
-    rtdm_lockctx_t      context;
-    struct ip_collector *p_coll;
-    struct iphdr        *iph = skb->nh.iph;
+    return &collector_hash[jhash_3words(saddr, id, protocol,
+                                        collector_hash_rnd) &
+                           collector_hash_mask];
+}
 
 
-    /*
-     * Find a free collector
-     *
-     * Note: We once used to clean up probably outdated chains, but the
-     * algorithm was not stable enough and could cause incorrect drops even
-     * under medium load. If we run in overload, we will loose data anyhow.
-     * What we should do in the future is to account collectors per socket or
-     * socket owner and set quotations.
-     * Garbage collection is now performed only on socket close.
-     */
-    for (i = 0; i < COLLECTOR_COUNT; i++) {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
-
-        if (!p_coll->in_use) {
-            p_coll->in_use        = 1;
-            p_coll->buf_size      = skb->len;
-            p_coll->frags.first   = skb;
-            p_coll->frags.last    = skb;
-            p_coll->saddr         = iph->saddr;
-            p_coll->daddr         = iph->daddr;
-            p_coll->id            = iph->id;
-            p_coll->protocol      = iph->protocol;
-            p_coll->sock          = sock;
-
-            rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-
-            return;
-        }
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
+/*
+ * Looks up the collector of the message the fragment belongs to.
+ * Note: must be called with collector_lock held
+ */
+static struct ip_collector *find_collector(struct iphdr *iph)
+{
+    struct ip_collector *p_coll =
+        *collector_bucket(iph->saddr, iph->id, iph->protocol);
+
+
+    while (p_coll != NULL) {
+        if ((iph->saddr    == p_coll->saddr) &&
+            (iph->id       == p_coll->id) &&
+            (iph->protocol == p_coll->protocol) &&
+            (iph->daddr    == p_coll->daddr))
+            return p_coll;
+        p_coll = p_coll->next;
     }
 
-    rtdm_printk("RTnet: IP fragmentation - no collector available\n");
-    kfree_rtskb(skb);
+    return NULL;
+}
+
+
+
+static inline unsigned int frag_offset(struct rtskb *skb)
+{
+    return (ntohs(skb->nh.iph->frag_off) & IP_OFFSET) << 3;
 }
 
 
 
 /*
- * Return a pointer to the collector that holds the message which
- * fits to the iphdr of the passed rtskb.
- * */
-static struct rtskb *add_to_collector(struct rtskb *skb, unsigned int offset, int more_frags)
+ * Releases collected fragments one by one. Unlike a completed chain, they may
+ * still belong to different pools.
+ */
+static void free_fragments(struct rtskb *skb)
+{
+    struct rtskb *next;
+
+
+    while (skb != NULL) {
+        next = skb->next;
+        skb->next = NULL;
+        kfree_rtskb(skb);
+        skb = next;
+    }
+}
+
+
+
+/*
+ * Passes fragments of messages without a real-time receiver to the proxy, or
+ * drops them if there is none.
+ */
+static void forward_fragments(struct rtskb *skb)
+{
+    struct rtskb *next;
+
+
+    while (skb != NULL) {
+        next = skb->next;
+        skb->next = NULL;
+#ifdef CONFIG_RTNET_ADDON_PROXY
+        if (rt_ip_fallback_handler) {
+            __rtskb_push(skb, skb->nh.iph->ihl*4);
+            rt_ip_fallback_handler(skb);
+        } else
+#endif
+            kfree_rtskb(skb);
+        skb = next;
+    }
+}
+
+
+
+/*
+ * Unhashes the collector and puts it back on the free list. Returns the
+ * collected fragments which have to be released by the caller after dropping
+ * the lock.
+ * Note: must be called with collector_lock held
+ */
+static struct rtskb *release_collector(struct ip_collector *p_coll)
+{
+    struct ip_collector **last_ptr =
+        collector_bucket(p_coll->saddr, p_coll->id, p_coll->protocol);
+
+
+    while (*last_ptr != p_coll)
+        last_ptr = &(*last_ptr)->next;
+    *last_ptr = p_coll->next;
+
+    list_move_tail(&p_coll->list, &collector_free_list);
+    if (p_coll->sock != NULL)
+        p_coll->sock->prot.inet.frag_count--;
+
+    return p_coll->frags.first;
+}
+
+
+
+/*
+ * Sets up a collector for the message of the fragment.
+ * Note: must be called with collector_lock held
+ */
+static struct ip_collector *alloc_collector(struct rtskb *skb)
 {
-    int                 i;
-    rtdm_lockctx_t      context;
     struct ip_collector *p_coll;
+    struct ip_collector **bucket;
     struct iphdr        *iph = skb->nh.iph;
-    struct rtskb        *first_skb;
 
 
-    /* Search in existing collectors */
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-    {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+    if (unlikely(list_empty(&collector_free_list))) {
+        rtdm_printk("RTnet: IP fragmentation - no collector available\n");
+        return NULL;
+    }
 
-        if (p_coll->in_use  &&
-            (iph->saddr    == p_coll->saddr) &&
-            (iph->daddr    == p_coll->daddr) &&
-            (iph->id       == p_coll->id) &&
-            (iph->protocol == p_coll->protocol))
-        {
-            first_skb = p_coll->frags.first;
+    p_coll = list_entry(collector_free_list.next, struct ip_collector, list);
+    list_move_tail(&p_coll->list, &collector_age_list);
+
+    p_coll->frags.first   = NULL;
+    p_coll->frags.last    = NULL;
+    p_coll->saddr         = iph->saddr;
+    p_coll->daddr         = iph->daddr;
+    p_coll->id            = iph->id;
+    p_coll->protocol      = iph->protocol;
+    p_coll->sock          = NULL;
+    p_coll->unclaimed     = 0;
+    p_coll->received      = 0;
+    p_coll->total_len     = 0;
+    p_coll->expires       = rtdm_clock_read() +
+        (nanosecs_rel_t)ip_frag_timeout * 1000000;
+
+    bucket = collector_bucket(iph->saddr, iph->id, iph->protocol);
+    p_coll->next = *bucket;
+    *bucket      = p_coll;
+
+    return p_coll;
+}
 
-            /* Acquire the rtskb at the expense of the protocol pool */
-            if (rtskb_acquire(skb, &p_coll->sock->skb_pool) != 0) {
-                /* We have to drop this fragment => clean up the whole chain */
-                p_coll->in_use = 0;
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
 
+/*
+ * Accounts the message to the socket found via its first fragment. Fragments
+ * which arrived earlier are moved from the fragment pool to the socket pool.
+ * Note: must be called with collector_lock held
+ */
+static int assign_collector(struct ip_collector *p_coll, struct rtsocket *sock)
+{
+    struct rtskb *skb;
+
+
+    if (unlikely((ip_frag_quota != 0) &&
+                 (sock->prot.inet.frag_count >= ip_frag_quota))) {
 #ifdef FRAG_DBG
-                rtdm_printk("RTnet: Compensation pool empty - IP fragments "
-                            "dropped (saddr:%x, daddr:%x)\n",
-                            iph->saddr, iph->daddr);
+        rtdm_printk("RTnet: IP fragmentation - socket quota exceeded\n");
 #endif
+        return -ENOBUFS;
+    }
 
-                kfree_rtskb(first_skb);
-                kfree_rtskb(skb);
-                return NULL;
-            }
+    for (skb = p_coll->frags.first; skb != NULL; skb = skb->next)
+        if (rtskb_acquire(skb, &sock->skb_pool) != 0)
+            return -ENOBUFS;
 
-            /* Optimized version of __rtskb_queue_tail */
-            skb->next = NULL;
-            p_coll->frags.last->next = skb;
-            p_coll->frags.last = skb;
+    p_coll->sock = sock;
+    sock->prot.inet.frag_count++;
 
-            /* Extend the chain */
-            first_skb->chain_end = skb;
-#ifdef CONFIG_RTNET_CHECKED
-            first_skb->chain_len++;
-#endif
+    return 0;
+}
 
-            /* Sanity check: unordered fragments are not allowed! */
-            if (offset != p_coll->buf_size) {
-                /* We have to drop this fragment => clean up the whole chain */
-                p_coll->in_use = 0;
-                skb = first_skb;
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-                break; /* leave the for loop */
-            }
 
-            p_coll->buf_size += skb->len;
+/*
+ * Inserts the fragment into the collector of its message. Returns the
+ * completed message as rtskb chain, or NULL if it is still incomplete. On
+ * errors, the fragment is not inserted. -EEXIST reports an overlapping
+ * fragment, any other error requires to drop the whole message.
+ * Note: must be called with collector_lock held
+ */
+static struct rtskb *add_to_collector(struct ip_collector *p_coll,
+                                      struct rtskb *skb, struct rtsocket *sock,
+                                      unsigned int offset, int more_frags,
+                                      int *err)
+{
+    struct rtskb        **last_ptr = &p_coll->frags.first;
+    struct rtskb        *prev = NULL;
+    struct rtskb        *next;
+    struct rtskb        *first_skb;
+    unsigned int        end = offset + skb->len;
+#ifdef CONFIG_RTNET_CHECKED
+    int                 count = 0;
+#endif
 
-            if (!more_frags) {
-                p_coll->in_use = 0;
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-                return first_skb;
-            } else {
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-                return NULL;
-            }
-        }
+    *err = 0;
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
+    if (sock != NULL) {
+        if (p_coll->sock != NULL)
+            goto overlap;   /* duplicate first fragment */
+        if ((*err = assign_collector(p_coll, sock)) < 0)
+            return NULL;
+    } else if (p_coll->sock != NULL) {
+        /* Acquire the rtskb at the expense of the protocol pool */
+        if (rtskb_acquire(skb, &p_coll->sock->skb_pool) != 0) {
+#ifdef FRAG_DBG
+            rtdm_printk("RTnet: Compensation pool empty - IP fragments "
+                        "dropped (saddr:%x, daddr:%x)\n",
+                        p_coll->saddr, p_coll->daddr);
+#endif
+            *err = -ENOBUFS;
+            return NULL;
+        }
     }
 
-#ifdef CONFIG_RTNET_ADDON_PROXY
-    if (rt_ip_fallback_handler) {
-	    __rtskb_push(skb, iph->ihl*4);
-	    rt_ip_fallback_handler(skb);
-	    return NULL;
+    /* Fragments mostly arrive in order, so try to append first */
+    if ((p_coll->frags.last != NULL) &&
+        (offset >= frag_offset(p_coll->frags.last))) {
+        prev     = p_coll->frags.last;
+        last_ptr = &prev->next;
+    } else
+        while ((*last_ptr != NULL) && (frag_offset(*last_ptr) < offset)) {
+            prev     = *last_ptr;
+            last_ptr = &prev->next;
+        }
+    next = *last_ptr;
+
+    if (((prev != NULL) && (frag_offset(prev) + prev->len > offset)) ||
+        ((next != NULL) && (frag_offset(next) < end)))
+        goto overlap;
+
+    if (!more_frags) {
+        if ((p_coll->total_len != 0) || (p_coll->frags.last != NULL &&
+             frag_offset(p_coll->frags.last) + p_coll->frags.last->len > end)) {
+            /* conflicting message ends */
+            *err = -EINVAL;
+            goto drop;
+        }
+        p_coll->total_len = end;
+    } else if ((p_coll->total_len != 0) && (end > p_coll->total_len)) {
+        *err = -EINVAL;
+        goto drop;
     }
+
+    skb->next = next;
+    *last_ptr = skb;
+    if (next == NULL)
+        p_coll->frags.last = skb;
+    p_coll->received += skb->len;
+
+    /* Complete without holes? */
+    if ((p_coll->sock == NULL) || (p_coll->total_len == 0) ||
+        (p_coll->received != p_coll->total_len))
+        return NULL;
+
+    first_skb = p_coll->frags.first;
+    first_skb->chain_end = p_coll->frags.last;
+#ifdef CONFIG_RTNET_CHECKED
+    for (skb = first_skb; skb != NULL; skb = skb->next)
+        count += skb->chain_len;
+    first_skb->chain_len = count;
 #endif
 
+    release_collector(p_coll);
+
+    return first_skb;
+
+  overlap:
 #ifdef FRAG_DBG
-    rtdm_printk("RTnet: Unordered IP fragment (saddr:%x, daddr:%x)"
-                " - dropped\n", iph->saddr, iph->daddr);
+    rtdm_printk("RTnet: Overlapping IP fragment (saddr:%x, daddr:%x)"
+                " - dropped\n", p_coll->saddr, p_coll->daddr);
 #endif
-
-    kfree_rtskb(skb);
+    *err = -EEXIST;
+  drop:
     return NULL;
 }
 
 
 
 /*
- * Cleans up all collectors referring to the specified socket.
- * This is now the only kind of garbage collection we do.
+ * Cleans up all collectors referring to the specified socket, or all
+ * collectors if sock is NULL.
  */
 void rt_ip_frag_invalidate_socket(struct rtsocket *sock)
 {
-    int                 i;
     rtdm_lockctx_t      context;
     struct ip_collector *p_coll;
+    struct list_head    *entry;
+    struct rtskb        *first_skb;
 
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-    {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+  restart:
+    rtdm_lock_get_irqsave(&collector_lock, context);
 
-        if ((p_coll->in_use) && (p_coll->sock == sock))
-        {
-            p_coll->in_use = 0;
-            kfree_rtskb(p_coll->frags.first);
-        }
+    list_for_each(entry, &collector_age_list) {
+        p_coll = list_entry(entry, struct ip_collector, list);
+
+        if ((sock == NULL) || (p_coll->sock == sock)) {
+            first_skb = release_collector(p_coll);
+
+            rtdm_lock_put_irqrestore(&collector_lock, context);
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
+            free_fragments(first_skb);
+            goto restart;
+        }
     }
+
+    rtdm_lock_put_irqrestore(&collector_lock, context);
 }
 EXPORT_SYMBOL(rt_ip_frag_invalidate_socket);
 
 
 
 /*
- * Cleans up all existing collectors
+ * Drops messages which are not completed in time. The age list is ordered by
+ * creation time, so only expired entries are touched.
  */
-static void cleanup_all_collectors(void)
+static void collector_timeout(rtdm_timer_t *timer)
 {
-    int                 i;
     rtdm_lockctx_t      context;
     struct ip_collector *p_coll;
+    struct rtskb        *first_skb;
+    nanosecs_abs_t      now = rtdm_clock_read();
 
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-    {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+    while (1) {
+        rtdm_lock_get_irqsave(&collector_lock, context);
 
-        if (p_coll->in_use)
-        {
-            p_coll->in_use = 0;
-            kfree_rtskb(p_coll->frags.first);
-        }
+        if (list_empty(&collector_age_list))
+            break;
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
+        p_coll = list_entry(collector_age_list.next, struct ip_collector,
+                            list);
+        if (p_coll->expires > now)
+            break;
+
+#ifdef FRAG_DBG
+        rtdm_printk("RTnet: IP fragments timed out (saddr:%x, daddr:%x)\n",
+                    p_coll->saddr, p_coll->daddr);
+#endif
+
+        first_skb = release_collector(p_coll);
+
+        rtdm_lock_put_irqrestore(&collector_lock, context);
+
+        free_fragments(first_skb);
     }
+
+    rtdm_lock_put_irqrestore(&collector_lock, context);
 }
 
 
@@ -266,15 +467,21 @@ static void cleanup_all_collectors(void)
 /*
  * This function returns an rtskb that contains the complete, accumulated IP message.
  * If not all fragments of the IP message have been received yet, it returns NULL
+ * Fragments may arrive in any order.
  * Note: the IP header must have already been pulled from the rtskb!
  * */
 struct rtskb *rt_ip_defrag(struct rtskb *skb, struct rtinet_protocol *ipprot)
 {
-    unsigned int    more_frags;
-    unsigned int    offset;
-    struct rtsocket *sock;
-    struct iphdr    *iph = skb->nh.iph;
-    int             ret;
+    unsigned int        more_frags;
+    unsigned int        offset;
+    struct rtsocket     *sock = NULL;
+    struct iphdr        *iph = skb->nh.iph;
+    struct ip_collector *p_coll;
+    struct rtskb        *first_skb = NULL;
+    struct rtskb        *drop_skb = NULL;
+    rtdm_lockctx_t      context;
+    int                 unclaimed;
+    int                 ret;
 
 
     /* Parse the IP header */
@@ -288,15 +495,31 @@ struct rtskb *rt_ip_defrag(struct rtskb *skb, struct rtinet_protocol *ipprot)
     {
         /* Get the destination socket */
         if ((sock = ipprot->dest_socket(skb)) == NULL) {
-#ifdef CONFIG_RTNET_ADDON_PROXY
-                if (rt_ip_fallback_handler) {
-                    __rtskb_push(skb, iph->ihl*4);
-                    rt_ip_fallback_handler(skb);
-                    return NULL;
-                }
-#endif
-            /* Drop the rtskb */
-            kfree_rtskb(skb);
+            /* Mark the message as unclaimed, so that the fragments held so
+             * far and any later ones are passed on as well */
+            rtdm_lock_get_irqsave(&collector_lock, context);
+
+            p_coll = find_collector(iph);
+            if (p_coll == NULL)
+                p_coll = alloc_collector(skb);
+            else if (p_coll->sock != NULL) {
+                /* duplicate first fragment */
+                rtdm_lock_put_irqrestore(&collector_lock, context);
+
+                kfree_rtskb(skb);
+                return NULL;
+            }
+            if (p_coll != NULL) {
+                p_coll->unclaimed   = 1;
+                drop_skb            = p_coll->frags.first;
+                p_coll->frags.first = NULL;
+                p_coll->frags.last  = NULL;
+            }
+
+            rtdm_lock_put_irqrestore(&collector_lock, context);
+
+            forward_fragments(skb);
+            forward_fragments(drop_skb);
             return NULL;
         }
 
@@ -305,42 +528,136 @@ struct rtskb *rt_ip_defrag(struct rtskb *skb, struct rtinet_protocol *ipprot)
 
         /* socket is now implicitely locked by the missing rtskb */
         rt_socket_dereference(sock);
+    } else {
+        /* Pass fragments of unclaimed messages on right away, they must not
+         * occupy the fragment pool */
+        rtdm_lock_get_irqsave(&collector_lock, context);
+        p_coll = find_collector(iph);
+        unclaimed = (p_coll != NULL) && p_coll->unclaimed;
+        rtdm_lock_put_irqrestore(&collector_lock, context);
+
+        if (unclaimed) {
+            forward_fragments(skb);
+            return NULL;
+        }
+
+        /* Hold the rtskb until the socket is known */
+        ret = rtskb_acquire(skb, &frag_pool);
+    }
+
+    if (ret != 0) {
+        /* Drop the rtskb */
+        kfree_rtskb(skb);
+        return NULL;
+    }
+
+    rtdm_lock_get_irqsave(&collector_lock, context);
+
+    p_coll = find_collector(iph);
+    if (p_coll == NULL) {
+        p_coll = alloc_collector(skb);
+        if (p_coll == NULL) {
+            rtdm_lock_put_irqrestore(&collector_lock, context);
 
-        if (ret != 0) {
-            /* Drop the rtskb */
             kfree_rtskb(skb);
-        } else {
-            /* Allocates a new collector */
-            alloc_collector(skb, sock);
+            return NULL;
         }
+    } else if (unlikely(p_coll->unclaimed)) {
+        /* the first fragment came in meanwhile */
+        rtdm_lock_put_irqrestore(&collector_lock, context);
+
+        forward_fragments(skb);
         return NULL;
     }
-    else
-    {
-        /* Add to an existing collector */
-        return add_to_collector(skb, offset, more_frags);
+
+    first_skb = add_to_collector(p_coll, skb, sock, offset, more_frags, &ret);
+    /* Unless the fragment just overlaps, clean up the whole message */
+    if ((ret < 0) && (ret != -EEXIST))
+        drop_skb = release_collector(p_coll);
+
+    rtdm_lock_put_irqrestore(&collector_lock, context);
+
+    if (ret < 0) {
+        free_fragments(drop_skb);
+        kfree_rtskb(skb);
     }
+
+    return first_skb;
 }
 
 
 
 int __init rt_ip_fragment_init(void)
 {
-    int i;
+    unsigned int    i;
+    unsigned int    buckets;
+    nanosecs_rel_t  interval;
+    int             ret;
+
+
+    if (ip_collectors == 0)
+        ip_collectors = 1;
+    if (ip_frag_timeout == 0)
+        ip_frag_timeout = 1;
 
+    /* at least one bucket per collector keeps the chains short */
+    buckets = roundup_pow_of_two(ip_collectors);
 
-    /* Probably not needed (static variable...) */
-    memset(collector, 0, sizeof(collector));
+    collector = kcalloc(ip_collectors, sizeof(struct ip_collector),
+                        GFP_KERNEL);
+    collector_hash = kcalloc(buckets, sizeof(struct ip_collector *),
+                             GFP_KERNEL);
+    if ((collector == NULL) || (collector_hash == NULL)) {
+        ret = -ENOMEM;
+        goto err1;
+    }
+
+    collector_hash_mask = buckets - 1;
+    get_random_bytes(&collector_hash_rnd, sizeof(collector_hash_rnd));
+
+    for (i = 0; i < ip_collectors; i++)
+        list_add_tail(&collector[i].list, &collector_free_list);
+
+    if (rtskb_pool_init(&frag_pool, ip_frag_rtskbs) < ip_frag_rtskbs) {
+        ret = -ENOMEM;
+        goto err2;
+    }
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-        rtdm_lock_init(&collector[i].frags.lock);
+    ret = rtdm_timer_init(&collector_timer, collector_timeout,
+                          "rtnet-ipfrag");
+    if (ret < 0)
+        goto err2;
+
+    /* expire messages at most 25% late */
+    interval = (nanosecs_rel_t)ip_frag_timeout * 1000000 / 4;
+    ret = rtdm_timer_start(&collector_timer, interval, interval,
+                           RTDM_TIMERMODE_RELATIVE);
+    if (ret < 0) {
+        rtdm_timer_destroy(&collector_timer);
+        goto err2;
+    }
 
     return 0;
+
+  err2:
+    rtskb_pool_release(&frag_pool);
+
+  err1:
+    INIT_LIST_HEAD(&collector_free_list);
+    kfree(collector_hash);
+    kfree(collector);
+    return ret;
 }
 
 
 
 void rt_ip_fragment_cleanup(void)
 {
-    cleanup_all_collectors();
+    rtdm_timer_destroy(&collector_timer);
+
+    rt_ip_frag_invalidate_socket(NULL);
+
+    rtskb_pool_release(&frag_pool);
+    kfree(collector_hash);
+    kfree(collector);
 }
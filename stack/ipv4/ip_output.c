@@ -27,6 +27,8 @@
 
 #include <rtnet_socket.h>
 #include <stack_mgr.h>
+#include <ipv4/arp.h>
+#include <ipv4/igmp.h>
 #include <ipv4/ip_fragment.h>
 #include <ipv4/ip_input.h>
 #include <ipv4/route.h>
@@ -41,64 +43,67 @@ static u16          rt_ip_id_count = 0;
 int rt_ip_build_xmit_slow(struct rtsocket *sk,
         int getfrag(const void *, char *, unsigned int, unsigned int),
         const void *frag, unsigned length, struct dest_route *rt,
-        int msg_flags, unsigned int mtu, unsigned int prio)
+        int msg_flags, nanosecs_abs_t txtime, unsigned int mtu,
+        unsigned int prio)
 {
-    int             err, next_err;
-    struct rtskb    *skb;
-    struct rtskb    *next_skb;
-    struct          iphdr *iph;
-    struct          rtnet_device *rtdev = rt->rtdev;
-    unsigned int    fragdatalen;
-    unsigned int    offset = 0;
-    u16             msg_rt_ip_id;
-    rtdm_lockctx_t  context;
-    unsigned int    rtskb_size;
-    int             hh_len = (rtdev->hard_header_len + 15) & ~15;
+    int                 err;
+    struct rtskb        *skb;
+    struct rtskb_queue  frags;
+    struct              iphdr *iph;
+    struct              rtnet_device *rtdev = rt->rtdev;
+    unsigned int        fragdatalen;
+    unsigned int        offset = 0;
+    unsigned int        count = 0;
+    u16                 msg_rt_ip_id;
+    rtdm_lockctx_t      context;
+    unsigned int        rtskb_size;
+    int                 hh_len = (rtdev->hard_header_len + 15) & ~15;
+    u8                  ttl;
 
 
     #define FRAGHEADERLEN sizeof(struct iphdr)
 
     fragdatalen  = ((mtu - FRAGHEADERLEN) & ~7);
 
-    /* Store id in local variable */
-    rtdm_lock_get_irqsave(&rt_ip_id_lock, context);
-    msg_rt_ip_id = rt_ip_id_count++;
-    rtdm_lock_put_irqrestore(&rt_ip_id_lock, context);
+    ttl = rt_ip_is_multicast(rt->ip) ? sk->prot.inet.mc_ttl : 255;
 
     rtskb_size = mtu + hh_len + 15;
 
-    /* TODO: delay previous skb until ALL errors are catched which may occure
-             during next skb setup */
+    /* Reserve all fragments first, a truncated datagram would only waste
+     * wire time and a collector on the receiver side */
+    rtskb_queue_init(&frags);
+    for (offset = 0; offset < length; offset += fragdatalen) {
+        skb = alloc_rtskb(rtskb_size, &sk->skb_pool);
+        if (skb == NULL) {
+            err = -ENOBUFS;
+            goto error;
+        }
+        __rtskb_queue_tail(&frags, skb);
+        count++;
+    }
 
-    /* Preallocate first rtskb */
-    skb = alloc_rtskb(rtskb_size, &sk->skb_pool);
-    if (skb == NULL)
-        return -ENOBUFS;
+    /* Store id in local variable */
+    rtdm_lock_get_irqsave(&rt_ip_id_lock, context);
+    msg_rt_ip_id = rt_ip_id_count++;
+    rtdm_lock_put_irqrestore(&rt_ip_id_lock, context);
 
-    for (offset = 0; offset < length; offset += fragdatalen)
+    for (skb = frags.first, offset = 0; skb != NULL;
+         skb = skb->next, offset += fragdatalen)
     {
         int fraglen; /* The length (IP, including ip-header) of this
                         very fragment */
         __u16 frag_off = offset >> 3 ;
 
 
-        next_err = 0;
-        if (offset >= length - fragdatalen)
+        if (skb->next == NULL)
         {
             /* last fragment */
             fraglen  = FRAGHEADERLEN + length - offset ;
-            next_skb = NULL;
         }
         else
         {
             fraglen = FRAGHEADERLEN + fragdatalen;
             frag_off |= IP_MF;
-
-            next_skb = alloc_rtskb(rtskb_size, &sk->skb_pool);
-            if (next_skb == NULL) {
-                frag_off &= ~IP_MF; /* cut the chain */
-                next_err = -ENOBUFS;
-            }
         }
 
         rtskb_reserve(skb, hh_len);
@@ -106,6 +111,7 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
         skb->rtdev    = rtdev;
         skb->nh.iph   = iph = (struct iphdr *)rtskb_put(skb, fraglen);
         skb->priority = prio;
+        skb->txtime   = txtime;
 
         iph->version  = 4;
         iph->ihl      = 5;    /* 20 byte header - no options */
@@ -113,7 +119,7 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
         iph->tot_len  = htons(fraglen);
         iph->id       = htons(msg_rt_ip_id);
         iph->frag_off = htons(frag_off);
-        iph->ttl      = 255;
+        iph->ttl      = ttl;
         iph->protocol = sk->protocol;
         iph->saddr    = rtdev->local_ip;
         iph->daddr    = rt->ip;
@@ -124,34 +130,27 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
                           fraglen - FRAGHEADERLEN)) )
             goto error;
 
-        if (rtdev->hard_header) {
-            err = rtdev->hard_header(skb, rtdev, ETH_P_IP, rt->dev_addr,
-                                     rtdev->dev_addr, skb->len);
+        if (likely(rt->neigh_ip == 0)) {
+            err = rt_ip_hard_header(skb, rt);
             if (err < 0)
                 goto error;
         }
+    }
 
-        err = rtdev_xmit(skb);
-
-        skb = next_skb;
+    if (unlikely(rt->neigh_ip != 0))
+        /* hold the whole datagram until the next hop is resolved, or drop
+         * it if it does not fit into the pending queue */
+        return rt_arp_resolve_queue(rtdev, rt->neigh_ip, &frags, count);
 
-        if (err != 0) {
-            err = -EAGAIN;
-            goto error;
-        }
+    /* Hand the complete datagram to the driver in one go */
+    if (rtdev_xmit_burst(&frags) != 0)
+        return -EAGAIN;
 
-        if (next_err != 0)
-            return next_err;
-    }
     return 0;
 
   error:
-    if (skb != NULL) {
+    while ((skb = __rtskb_dequeue(&frags)) != NULL)
         kfree_rtskb(skb);
-
-        if (next_skb != NULL)
-            kfree_rtskb(next_skb);
-    }
     return err;
 }
 
@@ -159,11 +158,14 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
 
 /***
  *  Fast path for unfragmented packets.
+ *
+ *  A non-zero txtime holds the datagram until that launch time (RTDM clock),
+ *  see rtnet_txtime.c.
  */
 int rt_ip_build_xmit(struct rtsocket *sk,
         int getfrag(const void *, char *, unsigned int, unsigned int),
         const void *frag, unsigned length, struct dest_route *rt,
-        int msg_flags)
+        int msg_flags, nanosecs_abs_t txtime)
 {
     int                     err = 0;
     struct rtskb            *skb;
@@ -191,7 +193,7 @@ int rt_ip_build_xmit(struct rtsocket *sk,
     if (length > mtu)
         return rt_ip_build_xmit_slow(sk, getfrag, frag,
                                      length - sizeof(struct iphdr),
-                                     rt, msg_flags, mtu, prio);
+                                     rt, msg_flags, txtime, mtu, prio);
 
     /* Store id in local variable */
     rtdm_lock_get_irqsave(&rt_ip_id_lock, context);
@@ -209,6 +211,7 @@ int rt_ip_build_xmit(struct rtsocket *sk,
     skb->rtdev    = rtdev;
     skb->nh.iph   = iph = (struct iphdr *) rtskb_put(skb, length);
     skb->priority = prio;
+    skb->txtime   = txtime;
 
     iph->version  = 4;
     iph->ihl      = 5;
@@ -216,7 +219,7 @@ int rt_ip_build_xmit(struct rtsocket *sk,
     iph->tot_len  = htons(length);
     iph->id       = htons(msg_rt_ip_id);
     iph->frag_off = htons(IP_DF);
-    iph->ttl      = 255;
+    iph->ttl      = rt_ip_is_multicast(rt->ip) ? sk->prot.inet.mc_ttl : 255;
     iph->protocol = sk->protocol;
     iph->saddr    = rtdev->local_ip;
     iph->daddr    = rt->ip;
@@ -227,14 +230,16 @@ int rt_ip_build_xmit(struct rtsocket *sk,
                       length - 5 /*iph->ihl*/ * 4)) )
         goto error;
 
-    if (rtdev->hard_header) {
-        err = rtdev->hard_header(skb, rtdev, ETH_P_IP, rt->dev_addr,
-                                 rtdev->dev_addr, skb->len);
+    if (unlikely(rt->neigh_ip != 0))
+        /* hold the packet until the next hop is resolved */
+        err = rt_arp_resolve(rtdev, rt->neigh_ip, skb);
+    else {
+        err = rt_ip_hard_header(skb, rt);
         if (err < 0)
             goto error;
-    }
 
-    err = rtdev_xmit(skb);
+        err = rtdev_xmit(skb);
+    }
 
     if (err)
         return -EAGAIN;
@@ -248,6 +253,78 @@ int rt_ip_build_xmit(struct rtsocket *sk,
 EXPORT_SYMBOL(rt_ip_build_xmit);
 
 
+/***
+ *  rt_ip_xmit_rtskb - transmit a datagram prepared in a socket buffer
+ *  @sk:  sending socket
+ *  @skb: buffer from the socket pool, data pointing to the transport header
+ *  @rt:  output route
+ *
+ *  The caller reserves RTNET_TX_HEADROOM in front of the data. Fragmentation
+ *  is not supported, the datagram has to fit into the MTU. The buffer is
+ *  consumed in any case.
+ */
+int rt_ip_xmit_rtskb(struct rtsocket *sk, struct rtskb *skb,
+                     struct dest_route *rt)
+{
+    struct rtnet_device     *rtdev = rt->rtdev;
+    struct iphdr            *iph;
+    unsigned int            length = skb->len + sizeof(struct iphdr);
+    unsigned int            prio;
+    unsigned int            hh_len;
+    u16                     msg_rt_ip_id;
+    rtdm_lockctx_t          context;
+    int                     err;
+
+
+    prio   = (volatile unsigned int)sk->priority;
+    hh_len = (rtdev->hard_header_len+15)&~15;
+
+    if (length > rtdev->get_mtu(rtdev, prio) ||
+        skb->data - skb->buf_start < hh_len + sizeof(struct iphdr)) {
+        kfree_rtskb(skb);
+        return -EMSGSIZE;
+    }
+
+    rtdm_lock_get_irqsave(&rt_ip_id_lock, context);
+    msg_rt_ip_id = rt_ip_id_count++;
+    rtdm_lock_put_irqrestore(&rt_ip_id_lock, context);
+
+    skb->rtdev    = rtdev;
+    skb->nh.iph   = iph = (struct iphdr *)__rtskb_push(skb, sizeof(*iph));
+    skb->priority = prio;
+
+    iph->version  = 4;
+    iph->ihl      = 5;
+    iph->tos      = sk->prot.inet.tos;
+    iph->tot_len  = htons(length);
+    iph->id       = htons(msg_rt_ip_id);
+    iph->frag_off = htons(IP_DF);
+    iph->ttl      = rt_ip_is_multicast(rt->ip) ? sk->prot.inet.mc_ttl : 255;
+    iph->protocol = sk->protocol;
+    iph->saddr    = rtdev->local_ip;
+    iph->daddr    = rt->ip;
+    iph->check    = 0; /* required! */
+    iph->check    = ip_fast_csum((unsigned char *)iph, 5 /*iph->ihl*/);
+
+    if (unlikely(rt->neigh_ip != 0))
+        /* hold the packet until the next hop is resolved */
+        err = rt_arp_resolve(rtdev, rt->neigh_ip, skb);
+    else {
+        err = rt_ip_hard_header(skb, rt);
+        if (err < 0) {
+            kfree_rtskb(skb);
+            return err;
+        }
+
+        err = rtdev_xmit(skb);
+    }
+
+    return err ? -EAGAIN : 0;
+}
+
+EXPORT_SYMBOL(rt_ip_xmit_rtskb);
+
+
 
 /***
  *  IP protocol layer initialiser
@@ -262,10 +339,17 @@ static struct rtpacket_type ip_packet_type = {
 /***
  *  ip_init
  */
-void __init rt_ip_init(void)
+int __init rt_ip_init(void)
 {
+    int ret;
+
+
+    if ((ret = rt_ip_fragment_init()) < 0)
+        return ret;
+
     rtdev_add_pack(&ip_packet_type);
-    rt_ip_fragment_init();
+
+    return 0;
 }
 
 
@@ -275,6 +359,6 @@ void __init rt_ip_init(void)
  */
 void rt_ip_release(void)
 {
-    rt_ip_fragment_cleanup();
     rtdev_remove_pack(&ip_packet_type);
+    rt_ip_fragment_cleanup();
 }
@@ -26,6 +26,95 @@
 #include <linux/in.h>
 
 #include <rtnet_socket.h>
+#include <ipv4/igmp.h>
+
+
+static int rt_ip_mc_setsockopt(struct rtsocket *s, int optname,
+                               const void *optval, socklen_t optlen)
+{
+    const struct ip_mreqn   *mreq = optval;
+    struct rtnet_device     *rtdev;
+    u32                     ifaddr;
+    int                     ifindex = 0;
+    int                     val;
+
+
+    if (s->protocol != IPPROTO_UDP)
+        return -ENOPROTOOPT;
+
+    switch (optname) {
+        case IP_ADD_MEMBERSHIP:
+        case IP_DROP_MEMBERSHIP:
+            /* group management may sleep */
+            if (rtdm_in_rt_context())
+                return -ENOSYS;
+
+            /* struct ip_mreq is the prefix of struct ip_mreqn */
+            if (optlen < sizeof(struct ip_mreq))
+                return -EINVAL;
+            if (optlen >= sizeof(struct ip_mreqn))
+                ifindex = mreq->imr_ifindex;
+
+            if (optname == IP_ADD_MEMBERSHIP)
+                return rt_ip_mc_join(s, mreq->imr_multiaddr.s_addr,
+                                     mreq->imr_address.s_addr, ifindex);
+            else
+                return rt_ip_mc_leave(s, mreq->imr_multiaddr.s_addr,
+                                      mreq->imr_address.s_addr, ifindex);
+
+        case IP_MULTICAST_IF:
+            if (optlen < sizeof(struct in_addr))
+                return -EINVAL;
+            if (optlen >= sizeof(struct ip_mreqn)) {
+                ifaddr  = mreq->imr_address.s_addr;
+                ifindex = mreq->imr_ifindex;
+            } else
+                ifaddr  = ((struct in_addr *)optval)->s_addr;
+
+            if ((ifaddr == INADDR_ANY) && (ifindex == 0))
+                s->prot.inet.mc_ifindex = 0;
+            else {
+                rtdev = rt_ip_mc_dev(ifaddr, ifindex);
+                if (rtdev == NULL)
+                    return -EADDRNOTAVAIL;
+
+                s->prot.inet.mc_ifindex = rtdev->ifindex;
+                rtdev_dereference(rtdev);
+            }
+            return 0;
+
+        case IP_MULTICAST_TTL:
+            if (optlen >= sizeof(int))
+                val = *(int *)optval;
+            else if (optlen >= sizeof(unsigned char))
+                val = *(unsigned char *)optval;
+            else
+                return -EINVAL;
+
+            if (val == -1)
+                val = RT_IP_MC_DEFAULT_TTL;
+            if ((val < 0) || (val > 255))
+                return -EINVAL;
+
+            s->prot.inet.mc_ttl = val;
+            return 0;
+
+        case IP_MULTICAST_LOOP:
+            if (optlen >= sizeof(int))
+                val = *(int *)optval;
+            else if (optlen >= sizeof(unsigned char))
+                val = *(unsigned char *)optval;
+            else
+                return -EINVAL;
+
+            /* own datagrams are never looped back */
+            return val ? -EOPNOTSUPP : 0;
+
+        default:
+            return -ENOPROTOOPT;
+    }
+}
+
 
 
 int rt_ip_setsockopt(struct rtsocket *s, int level, int optname,
@@ -37,14 +126,22 @@ int rt_ip_setsockopt(struct rtsocket *s, int level, int optname,
     if (level != SOL_IP)
         return -ENOPROTOOPT;
 
-    if (optlen < sizeof(unsigned int))
-        return -EINVAL;
-
     switch (optname) {
         case IP_TOS:
+            if (optlen < sizeof(unsigned int))
+                return -EINVAL;
+
             s->prot.inet.tos = *(unsigned int *)optval;
             break;
 
+        case IP_ADD_MEMBERSHIP:
+        case IP_DROP_MEMBERSHIP:
+        case IP_MULTICAST_IF:
+        case IP_MULTICAST_TTL:
+        case IP_MULTICAST_LOOP:
+            err = rt_ip_mc_setsockopt(s, optname, optval, optlen);
+            break;
+
         default:
             err = -ENOPROTOOPT;
             break;
@@ -55,6 +152,27 @@ int rt_ip_setsockopt(struct rtsocket *s, int level, int optname,
 
 
 
+static int rt_ip_mc_getsockopt_if(struct rtsocket *s, struct in_addr *addr)
+{
+    struct rtnet_device *rtdev;
+
+
+    addr->s_addr = INADDR_ANY;
+    if (s->prot.inet.mc_ifindex == 0)
+        return 0;
+
+    rtdev = rtdev_get_by_index(s->prot.inet.mc_ifindex);
+    if (rtdev == NULL)
+        return -ENODEV;
+
+    addr->s_addr = rtdev->local_ip;
+    rtdev_dereference(rtdev);
+
+    return 0;
+}
+
+
+
 int rt_ip_getsockopt(struct rtsocket *s, int level, int optname,
                      void *optval, socklen_t *optlen)
 {
@@ -70,6 +188,21 @@ int rt_ip_getsockopt(struct rtsocket *s, int level, int optname,
             *optlen = sizeof(unsigned int);
             break;
 
+        case IP_MULTICAST_TTL:
+            *(unsigned int *)optval = s->prot.inet.mc_ttl;
+            *optlen = sizeof(unsigned int);
+            break;
+
+        case IP_MULTICAST_LOOP:
+            *(unsigned int *)optval = 0;
+            *optlen = sizeof(unsigned int);
+            break;
+
+        case IP_MULTICAST_IF:
+            err = rt_ip_mc_getsockopt_if(s, (struct in_addr *)optval);
+            *optlen = sizeof(struct in_addr);
+            break;
+
         default:
             err = -ENOPROTOOPT;
             break;
@@ -22,26 +22,86 @@
  *
  */
 
+#include <linux/jhash.h>
+#include <linux/log2.h>
 #include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/seqlock.h>
+#include <linux/workqueue.h>
 #include <net/ip.h>
 
 #include <rtnet_internal.h>
 #include <rtnet_port.h>
 #include <rtnet_chrdev.h>
+#include <ethernet/eth.h>
 #include <ipv4/af_inet.h>
+#include <ipv4/arp.h>
+#include <ipv4/igmp.h>
 #include <ipv4/route.h>
 
 
-/* FIXME: should also become some tunable parameter */
-#define ROUTER_FORWARD_PRIO \
-    RTSKB_PRIO_VALUE(QUEUE_MAX_PRIO+(QUEUE_MIN_PRIO-QUEUE_MAX_PRIO+1)/2, \
-                     RTSKB_DEF_RT_CHANNEL)
+#ifdef CONFIG_RTNET_RTIPV4_ROUTER
+#define ROUTER_FORWARD_QUEUE_PRIO \
+    (QUEUE_MAX_PRIO+(QUEUE_MIN_PRIO-QUEUE_MAX_PRIO+1)/2)
+
+/* Forwarding flow cache: maps (saddr, daddr, tos) to the output route,
+ * including its prebuilt link layer header, and to the transmission
+ * priority. Like the socket route caches, entries hold no device reference
+ * but are validated against route_genid, so every change of the routing
+ * tables flushes the cache implicitly. */
+struct fwd_flow {
+    u32                     saddr;
+    u32                     daddr;
+    u8                      tos;
+    unsigned int            genid;
+    unsigned int            priority;
+    struct dest_route       route;      /* rtdev is NULL if unused */
+};
+
+static unsigned int         router_flows = 256;
+static unsigned int         router_tos_prio[8] = {
+    [0 ... 7] = ROUTER_FORWARD_QUEUE_PRIO
+};
+
+module_param(router_flows, uint, 0444);
+MODULE_PARM_DESC(router_flows, "size of the forwarding flow cache, rounded "
+                 "up to a power of two (default: 256)");
+module_param_array(router_tos_prio, uint, NULL, 0444);
+MODULE_PARM_DESC(router_tos_prio, "transmission priority (0 = highest, 31 = "
+                 "lowest) of forwarded packets per IP precedence 0..7 "
+                 "(default: 16 for all)");
+
+static struct fwd_flow      *fwd_flows;
+static unsigned int         fwd_flow_mask;
+static u32                  fwd_flow_rnd;
+static unsigned long        fwd_flow_hits;
+static unsigned long        fwd_flow_misses;
+static rtdm_lock_t          fwd_flow_lock = RTDM_LOCK_UNLOCKED;
+#endif /* CONFIG_RTNET_RTIPV4_ROUTER */
 
 
 /* First-level routing: explicite host routes */
 struct host_route {
     struct host_route       *next;
     struct dest_route       dest_host;
+    unsigned int            state;
+    unsigned int            probes;     /* unanswered probes while stale */
+    nanosecs_abs_t          confirmed;  /* last confirmation via ARP */
+};
+
+/* Neighbour states of host routes */
+#define RT_NEIGH_PERMANENT      0   /* configured, never ages */
+#define RT_NEIGH_REACHABLE      1   /* learned via ARP, recently confirmed */
+#define RT_NEIGH_STALE          2   /* learned via ARP, being probed */
+
+/* Probes sent per hash bucket and aging pass, the rest follows next pass */
+#define HOST_PROBES_PER_BUCKET  4
+
+struct host_probe {
+    u32                     ip;
+    unsigned char           dev_addr[MAX_ADDR_LEN];
+    struct rtnet_device     *rtdev;
 };
 
 /* Second-level routing: routes to other networks */
@@ -50,50 +110,171 @@ struct net_route {
     u32                     dest_net_ip;
     u32                     dest_net_mask;
     u32                     gw_ip;
+    unsigned int            prefix_len;
 };
 
-#if (CONFIG_RTNET_RTIPV4_HOST_ROUTES & (CONFIG_RTNET_RTIPV4_HOST_ROUTES - 1))
-# error CONFIG_RTNET_RTIPV4_HOST_ROUTES must be power of 2
-#endif
-#if CONFIG_RTNET_RTIPV4_HOST_ROUTES < 256
-# define HOST_HASH_TBL_SIZE 64
-#else
-# define HOST_HASH_TBL_SIZE ((CONFIG_RTNET_RTIPV4_HOST_ROUTES / 256) * 64)
-#endif
-#define HOST_HASH_KEY_MASK  (HOST_HASH_TBL_SIZE-1)
+/* Storage for host routes, allocated in blocks as the table grows */
+struct host_route_block {
+    struct host_route_block *next;
+    struct host_route       routes[0];
+};
+
+#define HOST_HASH_MIN_SIZE      64
+#define HOST_ROUTES_PER_BLOCK   512
+#define DEFAULT_MAX_HOST_ROUTES 4096
+
+static unsigned int         host_routes = CONFIG_RTNET_RTIPV4_HOST_ROUTES;
+static unsigned int         max_host_routes = DEFAULT_MAX_HOST_ROUTES;
 
-static struct host_route    host_routes[CONFIG_RTNET_RTIPV4_HOST_ROUTES];
+module_param(host_routes, uint, 0444);
+MODULE_PARM_DESC(host_routes, "initial number of host routes");
+module_param(max_host_routes, uint, 0444);
+MODULE_PARM_DESC(max_host_routes, "limit for the automatic growth of the "
+                 "host routing table (default: 4096)");
+
+static struct host_route_block *host_route_blocks;
 static struct host_route    *free_host_route;
-static int                  allocated_host_routes;
-static struct host_route    *host_hash_tbl[HOST_HASH_TBL_SIZE];
+static unsigned int         allocated_host_routes;
+static unsigned int         total_host_routes;
+
+/* While the hash table is resized, buckets [0, host_hash_moved) of the old
+ * table have already been rehashed into host_hash_new. */
+static struct host_route    **host_hash_tbl;
+static unsigned int         host_hash_size;
+static struct host_route    **host_hash_new;
+static unsigned int         host_hash_new_size;
+static unsigned int         host_hash_moved;
+static unsigned int         host_hash_gen;
+static u32                  host_hash_rnd;
 static rtdm_lock_t          host_table_lock = RTDM_LOCK_UNLOCKED;
+static seqcount_t           host_table_seq;
+
+static DEFINE_MUTEX(host_resize_lock);
+static rtdm_nrtsig_t        host_resize_signal;
+static struct work_struct   host_resize_work;
+
+/* Route generation, incremented on every change of the routing tables. It
+ * invalidates the per-socket route caches (see rt_ip_route_output_cached). */
+static atomic_t             route_genid = ATOMIC_INIT(0);
+
+/* Output route lookups do not take the table locks. They run inside a lookup
+ * section instead, host route lookups additionally validate what they read
+ * against host_table_seq. The per-CPU section counter is odd while a lookup
+ * is in progress, so that writers can wait for lookups which may still use a
+ * removed route (see rt_route_sync_lookups). */
+static DEFINE_PER_CPU(unsigned int, route_lookup_seq);
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-#if (CONFIG_RTNET_RTIPV4_NET_ROUTES & (CONFIG_RTNET_RTIPV4_NET_ROUTES - 1))
-# error CONFIG_RTNET_RTIPV4_NET_ROUTES must be power of 2
+#if CONFIG_RTNET_RTIPV4_NET_ROUTES > 0xFFFF
+# error CONFIG_RTNET_RTIPV4_NET_ROUTES must be less than 65536
 #endif
-#if CONFIG_RTNET_RTIPV4_NET_ROUTES < 256
-# define NET_HASH_TBL_SIZE  64
-#else
-# define NET_HASH_TBL_SIZE  ((CONFIG_RTNET_RTIPV4_NET_ROUTES / 256) * 64)
-#endif
-#define NET_HASH_KEY_MASK   (NET_HASH_TBL_SIZE-1)
-#define NET_HASH_KEY_SHIFT  8
+
+/* Network routes are stored in a multibit trie of four levels with 8 bits
+ * each. A route is expanded over the slots of the level its prefix ends in.
+ * Each slot refers to the longest prefix of its level covering it (route
+ * index + 1 in the lower 16 bits) and to the node of the next level (node
+ * index in the upper 16 bits, node 0 is the root). A lookup takes at most
+ * one slot per level and remembers the last route it passed. */
+#define NET_TRIE_LEVELS         4
+#define NET_TRIE_STRIDE         8
+#define NET_TRIE_SLOTS          (1 << NET_TRIE_STRIDE)
+#define NET_TRIE_ROUTE_MASK     0xFFFF
+#define NET_TRIE_CHILD_SHIFT    16
+#define NET_TRIE_MAX_NODES      0x10000
 
 static struct net_route     net_routes[CONFIG_RTNET_RTIPV4_NET_ROUTES];
 static struct net_route     *free_net_route;
+static struct net_route     *net_route_list;
 static int                  allocated_net_routes;
-static struct net_route     *net_hash_tbl[NET_HASH_TBL_SIZE + 1];
-static unsigned int         net_hash_key_shift = NET_HASH_KEY_SHIFT;
+static unsigned int         net_trie_nodes = 2*CONFIG_RTNET_RTIPV4_NET_ROUTES+1;
+static u32                  **net_trie;
+static unsigned short       *net_trie_used;
+static unsigned short       *free_net_trie_node;
+static unsigned int         free_net_trie_nodes;
 static rtdm_lock_t          net_table_lock = RTDM_LOCK_UNLOCKED;
 
-module_param(net_hash_key_shift, uint, 0444);
-MODULE_PARM_DESC(net_hash_key_shift, "destination right shift for "
-                 "network hash key (default: 8)");
+module_param(net_trie_nodes, uint, 0444);
+MODULE_PARM_DESC(net_trie_nodes, "number of network routing trie nodes, "
+                 "1 KB each (default: 2 * network routes + 1)");
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
 
 
+/***
+ *  rt_route_lookup_enter - starts a lockless lookup section
+ *
+ *  Note: must be called with interrupts disabled
+ */
+static inline unsigned int rt_route_lookup_enter(void)
+{
+    unsigned int cpu = raw_smp_processor_id();
+
+
+    per_cpu(route_lookup_seq, cpu)++;
+    smp_mb();
+
+    return cpu;
+}
+
+
+
+static inline void rt_route_lookup_exit(unsigned int cpu)
+{
+    smp_mb();
+    per_cpu(route_lookup_seq, cpu)++;
+}
+
+
+
+/***
+ *  rt_route_sync_lookups - waits for all lookup sections in flight
+ *
+ *  Once this returns, no lookup can still refer to routes removed before.
+ *  The sections are short and run with interrupts disabled, so this is also
+ *  usable from real-time context.
+ */
+static void rt_route_sync_lookups(void)
+{
+    unsigned int    cpu;
+    unsigned int    seq;
+
+
+    smp_mb();
+
+    for_each_online_cpu(cpu) {
+        seq = per_cpu(route_lookup_seq, cpu);
+        if (seq & 1)
+            while (*(volatile unsigned int *)&per_cpu(route_lookup_seq, cpu)
+                   == seq)
+                cpu_relax();
+    }
+}
+
+
+
+static inline unsigned int rt_host_hash(u32 addr)
+{
+    return jhash_1word(addr, host_hash_rnd);
+}
+
+
+
+/***
+ *  rt_host_hash_chain - returns the hash chain for a host hash value
+ *
+ *  Note: must be called with host_table_lock held
+ */
+static inline struct host_route **rt_host_hash_chain(unsigned int hash)
+{
+    if (unlikely(host_hash_new != NULL) &&
+        ((hash & (host_hash_size - 1)) < host_hash_moved))
+        return &host_hash_new[hash & (host_hash_new_size - 1)];
+
+    return &host_hash_tbl[hash & (host_hash_size - 1)];
+}
+
+
+
 /***
  *  proc filesystem section
  */
@@ -101,32 +282,65 @@ MODULE_PARM_DESC(net_hash_key_shift, "destination right shift for "
 static int rt_route_read_proc(char *buf, char **start, off_t offset, int count,
                               int *eof, void *data)
 {
-#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-    u32 mask;
-#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+    struct host_route   *rt;
+    unsigned int        key;
+    unsigned int        len;
+    unsigned int        entries = 0;
+    unsigned int        used = 0;
+    unsigned int        longest = 0;
+    unsigned int        average = 0;
+    rtdm_lockctx_t      context;
     RTNET_PROC_PRINT_VARS(256);
 
 
-    if (!RTNET_PROC_PRINT("Host routes allocated/total:\t%d/%d\n"
-                          "Host hash table size:\t\t%d\n",
-                          allocated_host_routes,
-                          CONFIG_RTNET_RTIPV4_HOST_ROUTES,
-                          HOST_HASH_TBL_SIZE))
+    /* collect hash chain statistics, keep the table size stable meanwhile */
+    mutex_lock(&host_resize_lock);
+
+    for (key = 0; key < host_hash_size; key++) {
+        len = 0;
+
+        rtdm_lock_get_irqsave(&host_table_lock, context);
+        for (rt = host_hash_tbl[key]; rt != NULL; rt = rt->next)
+            len++;
+        rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+        if (len > 0) {
+            used++;
+            entries += len;
+            if (len > longest)
+                longest = len;
+        }
+    }
+
+    mutex_unlock(&host_resize_lock);
+
+    if (used > 0)
+        average = (entries * 100) / used;
+
+    if (!RTNET_PROC_PRINT("Host routes allocated/total/max:\t%u/%u/%u\n"
+                          "Host hash table size:\t\t%u\n"
+                          "Host hash chains used:\t\t%u\n"
+                          "Host hash chain length avg/max:\t%u.%02u/%u\n",
+                          allocated_host_routes, total_host_routes,
+                          max_host_routes, host_hash_size, used,
+                          average / 100, average % 100, longest))
         goto done;
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-    mask = NET_HASH_KEY_MASK << net_hash_key_shift;
     if (!RTNET_PROC_PRINT("Network routes allocated/total:\t%d/%d\n"
-                          "Network hash table size:\t%d\n"
-                          "Network hash key shift/mask:\t%d/%08X\n",
+                          "Network trie nodes used/total:\t%u/%u\n",
                           allocated_net_routes,
-                          CONFIG_RTNET_RTIPV4_NET_ROUTES, NET_HASH_TBL_SIZE,
-                          net_hash_key_shift, mask))
+                          CONFIG_RTNET_RTIPV4_NET_ROUTES,
+                          net_trie_nodes - free_net_trie_nodes,
+                          net_trie_nodes))
         goto done;
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
 #ifdef CONFIG_RTNET_RTIPV4_ROUTER
-    RTNET_PROC_PRINT("IP Router:\t\t\tyes\n");
+    RTNET_PROC_PRINT("IP Router:\t\t\tyes\n"
+                     "Forwarding flows:\t\t%u\n"
+                     "Forwarding cache hits/misses:\t%lu/%lu\n",
+                     fwd_flow_mask + 1, fwd_flow_hits, fwd_flow_misses);
 #else
     RTNET_PROC_PRINT("IP Router:\t\t\tno\n");
 #endif
@@ -140,8 +354,14 @@ static int rt_route_read_proc(char *buf, char **start, off_t offset, int count,
 static int rt_host_route_read_proc(char *buf, char **start, off_t offset,
                                    int count, int *eof, void *data)
 {
+    static const char   *state_name[] = {
+        [RT_NEIGH_PERMANENT] = "permanent",
+        [RT_NEIGH_REACHABLE] = "reachable",
+        [RT_NEIGH_STALE]     = "stale"
+    };
     struct host_route   *entry_ptr;
     struct dest_route   dest_host;
+    unsigned int        state;
     unsigned int        key;
     unsigned int        index;
     unsigned int        i;
@@ -150,10 +370,14 @@ static int rt_host_route_read_proc(char *buf, char **start, off_t offset,
     RTNET_PROC_PRINT_VARS_EX(80);
 
 
-    if (!RTNET_PROC_PRINT_EX("Hash\tDestination\tHW Address\t\tDevice\n"))
+    /* the table must not be resized while we walk it */
+    mutex_lock(&host_resize_lock);
+
+    if (!RTNET_PROC_PRINT_EX("Hash\tDestination\tHW Address\t\tDevice"
+                             "\tState\n"))
         goto done;
 
-    for (key = 0; key < HOST_HASH_TBL_SIZE; key++) {
+    for (key = 0; key < host_hash_size; key++) {
         index = 0;
         while (1) {
             rtdm_lock_get_irqsave(&host_table_lock, context);
@@ -170,17 +394,18 @@ static int rt_host_route_read_proc(char *buf, char **start, off_t offset,
 
             memcpy(&dest_host, &entry_ptr->dest_host,
                    sizeof(struct dest_route));
+            state = entry_ptr->state;
             rtdev_reference(dest_host.rtdev);
 
             rtdm_lock_put_irqrestore(&host_table_lock, context);
 
             res = RTNET_PROC_PRINT_EX("%02X\t%u.%u.%u.%-3u\t"
-                    "%02X:%02X:%02X:%02X:%02X:%02X\t%s\n",
+                    "%02X:%02X:%02X:%02X:%02X:%02X\t%s\t%s\n",
                     key, NIPQUAD(dest_host.ip),
                     dest_host.dev_addr[0], dest_host.dev_addr[1],
                     dest_host.dev_addr[2], dest_host.dev_addr[3],
                     dest_host.dev_addr[4], dest_host.dev_addr[5],
-                    dest_host.rtdev->name);
+                    dest_host.rtdev->name, state_name[state]);
             rtdev_dereference(dest_host.rtdev);
             if (!res)
                 goto done;
@@ -190,6 +415,8 @@ static int rt_host_route_read_proc(char *buf, char **start, off_t offset,
     }
 
   done:
+    mutex_unlock(&host_resize_lock);
+
     RTNET_PROC_PRINT_DONE_EX;
 }
 
@@ -203,55 +430,44 @@ static int rt_net_route_read_proc(char *buf, char **start, off_t offset,
     u32                 dest_net_ip;
     u32                 dest_net_mask;
     u32                 gw_ip;
-    unsigned int        key;
+    unsigned int        prefix_len;
     unsigned int        index;
     unsigned int        i;
     rtdm_lockctx_t      context;
     RTNET_PROC_PRINT_VARS_EX(80);
 
 
-    if (!RTNET_PROC_PRINT_EX("Hash\tDestination\tMask\t\t\tGateway\n"))
+    if (!RTNET_PROC_PRINT_EX("Prefix\tDestination\tMask\t\t\tGateway\n"))
         goto done;
 
-    for (key = 0; key < NET_HASH_TBL_SIZE + 1; key++) {
-        index = 0;
-        while (1) {
-            rtdm_lock_get_irqsave(&net_table_lock, context);
+    index = 0;
+    while (1) {
+        rtdm_lock_get_irqsave(&net_table_lock, context);
 
-            entry_ptr = net_hash_tbl[key];
+        entry_ptr = net_route_list;
 
-            for (i = 0; (i < index) && (entry_ptr != NULL); i++)
-                entry_ptr = entry_ptr->next;
+        for (i = 0; (i < index) && (entry_ptr != NULL); i++)
+            entry_ptr = entry_ptr->next;
 
-            if (entry_ptr == NULL) {
-                rtdm_lock_put_irqrestore(&net_table_lock, context);
-                break;
-            }
+        if (entry_ptr == NULL) {
+            rtdm_lock_put_irqrestore(&net_table_lock, context);
+            break;
+        }
 
-            dest_net_ip   = entry_ptr->dest_net_ip;
-            dest_net_mask = entry_ptr->dest_net_mask;
-            gw_ip         = entry_ptr->gw_ip;
+        dest_net_ip   = entry_ptr->dest_net_ip;
+        dest_net_mask = entry_ptr->dest_net_mask;
+        gw_ip         = entry_ptr->gw_ip;
+        prefix_len    = entry_ptr->prefix_len;
 
-            rtdm_lock_put_irqrestore(&net_table_lock, context);
+        rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-            if (key < NET_HASH_TBL_SIZE) {
-                if (!RTNET_PROC_PRINT_EX("%02X\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u"
-                                         "\t\t%u.%u.%u.%-3u\n",
-                                         key, NIPQUAD(dest_net_ip),
-                                         NIPQUAD(dest_net_mask),
-                                         NIPQUAD(gw_ip)))
-                    goto done;
-            } else {
-                if (!RTNET_PROC_PRINT_EX("*\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u\t\t"
-                                         "%u.%u.%u.%-3u\n",
-                                         NIPQUAD(dest_net_ip),
-                                         NIPQUAD(dest_net_mask),
-                                         NIPQUAD(gw_ip)))
-                    goto done;
-            }
+        if (!RTNET_PROC_PRINT_EX("/%u\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u\t\t"
+                                 "%u.%u.%u.%-3u\n",
+                                 prefix_len, NIPQUAD(dest_net_ip),
+                                 NIPQUAD(dest_net_mask), NIPQUAD(gw_ip)))
+            goto done;
 
-            index++;
-        }
+        index++;
     }
 
   done:
@@ -333,6 +549,7 @@ static inline struct host_route *rt_alloc_host_route(void)
 {
     rtdm_lockctx_t      context;
     struct host_route   *rt;
+    int                 grow;
 
 
     rtdm_lock_get_irqsave(&host_table_lock, context);
@@ -342,8 +559,15 @@ static inline struct host_route *rt_alloc_host_route(void)
         allocated_host_routes++;
     }
 
+    /* request more entries from Linux when 3/4 of the table are in use */
+    grow = (allocated_host_routes * 4 >= total_host_routes * 3) &&
+           (total_host_routes < max_host_routes);
+
     rtdm_lock_put_irqrestore(&host_table_lock, context);
 
+    if (grow)
+        rtdm_nrtsig_pend(&host_resize_signal);
+
     return rt;
 }
 
@@ -364,15 +588,23 @@ static inline void rt_free_host_route(struct host_route *rt)
 
 
 /***
- *  rt_ip_route_add_host: add or update host route
+ *  __rt_ip_route_add_host - add or update host route
+ *  @state:  RT_NEIGH_PERMANENT for configured routes, RT_NEIGH_REACHABLE for
+ *           routes learned via ARP
+ *  @create: add the route if it does not exist yet
+ *
+ *  Learned addresses update configured routes, but keep them permanent.
  */
-int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
-                         struct rtnet_device *rtdev)
+static int __rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
+                                  struct rtnet_device *rtdev,
+                                  unsigned int state, int create)
 {
     rtdm_lockctx_t      context;
-    struct host_route   *new_route;
+    struct host_route   *new_route = NULL;
     struct host_route   *rt;
-    unsigned int        key;
+    struct host_route   **chain;
+    nanosecs_abs_t      now = rtdm_clock_read();
+    unsigned int        hash;
     int                 ret = 0;
 
 
@@ -386,22 +618,40 @@ int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
 
     rtdm_lock_put_irqrestore(&rtdev->rtdev_lock, context);
 
-    if ((new_route = rt_alloc_host_route()) != NULL) {
+    if (create && (new_route = rt_alloc_host_route()) != NULL) {
         new_route->dest_host.ip    = addr;
         new_route->dest_host.rtdev = rtdev;
         memcpy(new_route->dest_host.dev_addr, dev_addr, rtdev->addr_len);
+        new_route->state           = state;
+        new_route->probes          = 0;
+        new_route->confirmed       = now;
     }
 
-    key = ntohl(addr) & HOST_HASH_KEY_MASK;
+    hash = rt_host_hash(addr);
 
     rtdm_lock_get_irqsave(&host_table_lock, context);
 
-    rt = host_hash_tbl[key];
+    chain = rt_host_hash_chain(hash);
+    rt = *chain;
     while (rt != NULL) {
         if ((rt->dest_host.ip == addr) &&
             (rt->dest_host.rtdev->local_ip == rtdev->local_ip)) {
-            rt->dest_host.rtdev = rtdev;
-            memcpy(rt->dest_host.dev_addr, dev_addr, rtdev->addr_len);
+            /* refreshing an unchanged route keeps the route caches valid */
+            if ((rt->dest_host.rtdev != rtdev) ||
+                (memcmp(rt->dest_host.dev_addr, dev_addr,
+                        rtdev->addr_len) != 0)) {
+                write_seqcount_begin(&host_table_seq);
+                rt->dest_host.rtdev = rtdev;
+                memcpy(rt->dest_host.dev_addr, dev_addr, rtdev->addr_len);
+                atomic_inc(&route_genid);
+                write_seqcount_end(&host_table_seq);
+            }
+
+            if ((state == RT_NEIGH_PERMANENT) ||
+                (rt->state != RT_NEIGH_PERMANENT))
+                rt->state = state;
+            rt->probes    = 0;
+            rt->confirmed = now;
 
             if (new_route)
                 rt_free_host_route(new_route);
@@ -414,9 +664,16 @@ int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
         rt = rt->next;
     }
 
-    if (new_route) {
-        new_route->next    = host_hash_tbl[key];
-        host_hash_tbl[key] = new_route;
+    if (!create) {
+        rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+        ret = -ENOENT;
+    } else if (new_route) {
+        new_route->next = *chain;
+        write_seqcount_begin(&host_table_seq);
+        *chain          = new_route;
+        atomic_inc(&route_genid);
+        write_seqcount_end(&host_table_seq);
 
         rtdm_lock_put_irqrestore(&host_table_lock, context);
     } else {
@@ -434,6 +691,34 @@ int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
 
 
 
+/***
+ *  rt_ip_route_add_host: add or update host route
+ */
+int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
+                         struct rtnet_device *rtdev)
+{
+    return __rt_ip_route_add_host(addr, dev_addr, rtdev, RT_NEIGH_PERMANENT,
+                                  1);
+}
+
+
+
+/***
+ *  rt_ip_route_confirm_host - add or refresh host route learned via ARP
+ *  @create: add the route if it does not exist yet, otherwise only refresh
+ *
+ *  Routes added this way age out if they are not confirmed any more (see
+ *  rt_ip_route_age_hosts).
+ */
+int rt_ip_route_confirm_host(u32 addr, unsigned char *dev_addr,
+                             struct rtnet_device *rtdev, int create)
+{
+    return __rt_ip_route_add_host(addr, dev_addr, rtdev, RT_NEIGH_REACHABLE,
+                                  create);
+}
+
+
+
 /***
  *  rt_ip_route_del_host - deletes specified host route
  */
@@ -442,21 +727,24 @@ int rt_ip_route_del_host(u32 addr, struct rtnet_device *rtdev)
     rtdm_lockctx_t      context;
     struct host_route   *rt;
     struct host_route   **last_ptr;
-    unsigned int        key;
+    unsigned int        hash;
 
 
-    key = ntohl(addr) & HOST_HASH_KEY_MASK;
-    last_ptr = &host_hash_tbl[key];
+    hash = rt_host_hash(addr);
 
     rtdm_lock_get_irqsave(&host_table_lock, context);
 
-    rt = host_hash_tbl[key];
+    last_ptr = rt_host_hash_chain(hash);
+    rt = *last_ptr;
     while (rt != NULL) {
         if ((rt->dest_host.ip == addr) &&
             (!rtdev || (rt->dest_host.rtdev->local_ip == rtdev->local_ip))) {
+            write_seqcount_begin(&host_table_seq);
             *last_ptr = rt->next;
 
             rt_free_host_route(rt);
+            atomic_inc(&route_genid);
+            write_seqcount_end(&host_table_seq);
 
             rtdm_lock_put_irqrestore(&host_table_lock, context);
 
@@ -474,45 +762,204 @@ int rt_ip_route_del_host(u32 addr, struct rtnet_device *rtdev)
 
 
 
+/***
+ *  rt_host_chain_del_all - deletes all routes of a device from a hash chain
+ *
+ *  Note: must be called with host_table_lock held and host_table_seq in
+ *        write mode
+ */
+static inline void rt_host_chain_del_all(struct host_route **last_ptr,
+                                         struct rtnet_device *rtdev)
+{
+    struct host_route   *rt;
+
+
+    while ((rt = *last_ptr) != NULL) {
+        if (rt->dest_host.rtdev == rtdev) {
+            *last_ptr = rt->next;
+
+            rt_free_host_route(rt);
+            atomic_inc(&route_genid);
+        } else
+            last_ptr = &rt->next;
+    }
+}
+
+
+
 /***
  *  rt_ip_route_del_all - deletes all routes associated with a specified device
  */
 void rt_ip_route_del_all(struct rtnet_device *rtdev)
 {
     rtdm_lockctx_t      context;
-    struct host_route   *host_rt;
-    struct host_route   **last_host_ptr;
-    unsigned int        key;
+    unsigned int        key = 0;
+    unsigned int        gen;
+    unsigned int        i;
     u32                 ip;
 
 
-    for (key = 0; key < HOST_HASH_TBL_SIZE; key++) {
-      host_start_over:
-        last_host_ptr = &host_hash_tbl[key];
+    rtdm_lock_get_irqsave(&host_table_lock, context);
+    gen = host_hash_gen;
+
+    /* Process one bucket of the current table per lock section. During a
+     * resize, the entries of an already moved bucket are spread over the
+     * new buckets sharing its lower hash bits. */
+    while (key < host_hash_size) {
+        write_seqcount_begin(&host_table_seq);
+
+        if (host_hash_new == NULL || key >= host_hash_moved)
+            rt_host_chain_del_all(&host_hash_tbl[key], rtdev);
+        else
+            for (i = key; i < host_hash_new_size; i += host_hash_size)
+                rt_host_chain_del_all(&host_hash_new[i], rtdev);
+
+        write_seqcount_end(&host_table_seq);
+
+        rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+        key++;
 
         rtdm_lock_get_irqsave(&host_table_lock, context);
 
-        host_rt = host_hash_tbl[key];
-        while (host_rt != NULL) {
-            if (host_rt->dest_host.rtdev == rtdev) {
-                *last_host_ptr = host_rt->next;
+        /* start over if the resize completed meanwhile */
+        if (host_hash_gen != gen) {
+            gen = host_hash_gen;
+            key = 0;
+        }
+    }
 
-                rt_free_host_route(host_rt);
+    rtdm_lock_put_irqrestore(&host_table_lock, context);
 
-                rtdm_lock_put_irqrestore(&host_table_lock, context);
+    if ((ip = rtdev->local_ip) != 0)
+        rt_ip_route_del_host(ip, rtdev);
 
-                goto host_start_over;
+    /* the device may be unregistered after this */
+    rt_route_sync_lookups();
+}
+
+
+
+/***
+ *  rt_host_chain_age - ages the learned routes of a hash chain
+ *
+ *  Collects up to @room probes to be sent and returns their number.
+ *
+ *  Note: must be called with host_table_lock held and host_table_seq in
+ *        write mode
+ */
+static inline unsigned int rt_host_chain_age(struct host_route **last_ptr,
+                                             nanosecs_abs_t now,
+                                             nanosecs_rel_t reachable_time,
+                                             unsigned int max_probes,
+                                             struct host_probe *probe,
+                                             unsigned int room)
+{
+    struct host_route   *rt;
+    unsigned int        probes = 0;
+
+
+    while ((rt = *last_ptr) != NULL) {
+        if ((rt->state == RT_NEIGH_REACHABLE) &&
+            (now - rt->confirmed >= reachable_time)) {
+            rt->state  = RT_NEIGH_STALE;
+            rt->probes = 0;
+        }
+
+        if (rt->state == RT_NEIGH_STALE) {
+            if (rt->probes >= max_probes) {
+                /* the neighbour did not answer, drop the route */
+                *last_ptr = rt->next;
+
+                rt_free_host_route(rt);
+                atomic_inc(&route_genid);
+                continue;
             }
 
-            last_host_ptr = &host_rt->next;
-            host_rt = host_rt->next;
+            if (probes < room) {
+                probe[probes].ip    = rt->dest_host.ip;
+                probe[probes].rtdev = rt->dest_host.rtdev;
+                memcpy(probe[probes].dev_addr, rt->dest_host.dev_addr,
+                       MAX_ADDR_LEN);
+                rtdev_reference(probe[probes].rtdev);
+
+                rt->probes++;
+                probes++;
+            }
         }
 
+        last_ptr = &rt->next;
+    }
+
+    return probes;
+}
+
+
+
+/***
+ *  rt_ip_route_age_hosts - ages host routes learned via ARP
+ *  @now:            current time
+ *  @reachable_time: time after which a confirmed route becomes stale
+ *  @max_probes:     unanswered probes after which a stale route is removed
+ *
+ *  Stale routes are still used for sending. Each call sends one unicast ARP
+ *  request to every stale neighbour, a reply turns the route reachable again.
+ *  Configured routes are never touched.
+ */
+void rt_ip_route_age_hosts(nanosecs_abs_t now, nanosecs_rel_t reachable_time,
+                           unsigned int max_probes)
+{
+    struct host_probe   probe[HOST_PROBES_PER_BUCKET];
+    rtdm_lockctx_t      context;
+    unsigned int        key = 0;
+    unsigned int        gen;
+    unsigned int        probes;
+    unsigned int        i;
+
+
+    rtdm_lock_get_irqsave(&host_table_lock, context);
+    gen = host_hash_gen;
+
+    /* walk the buckets like rt_ip_route_del_all does */
+    while (key < host_hash_size) {
+        probes = 0;
+
+        write_seqcount_begin(&host_table_seq);
+
+        if (host_hash_new == NULL || key >= host_hash_moved)
+            probes = rt_host_chain_age(&host_hash_tbl[key], now,
+                                       reachable_time, max_probes, probe,
+                                       HOST_PROBES_PER_BUCKET);
+        else
+            for (i = key; i < host_hash_new_size; i += host_hash_size)
+                probes += rt_host_chain_age(&host_hash_new[i], now,
+                                            reachable_time, max_probes,
+                                            &probe[probes],
+                                            HOST_PROBES_PER_BUCKET - probes);
+
+        write_seqcount_end(&host_table_seq);
+
         rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+        for (i = 0; i < probes; i++) {
+            rt_arp_send(ARPOP_REQUEST, ETH_P_ARP, probe[i].ip,
+                        probe[i].rtdev, probe[i].rtdev->local_ip,
+                        probe[i].dev_addr, NULL, NULL);
+            rtdev_dereference(probe[i].rtdev);
+        }
+
+        key++;
+
+        rtdm_lock_get_irqsave(&host_table_lock, context);
+
+        /* start over if the resize completed meanwhile */
+        if (host_hash_gen != gen) {
+            gen = host_hash_gen;
+            key = 0;
+        }
     }
 
-    if ((ip = rtdev->local_ip) != 0)
-        rt_ip_route_del_host(ip, rtdev);
+    rtdm_lock_put_irqrestore(&host_table_lock, context);
 }
 
 
@@ -524,14 +971,14 @@ int rt_ip_route_get_host(u32 addr, char *if_name, unsigned char *dev_addr,
 {
     rtdm_lockctx_t      context;
     struct host_route   *rt;
-    unsigned int        key;
+    unsigned int        hash;
 
 
-    key = ntohl(addr) & HOST_HASH_KEY_MASK;
+    hash = rt_host_hash(addr);
 
     rtdm_lock_get_irqsave(&host_table_lock, context);
 
-    rt = host_hash_tbl[key];
+    rt = *rt_host_hash_chain(hash);
     while (rt != NULL) {
         if ((rt->dest_host.ip == addr) &&
             (!rtdev || rt->dest_host.rtdev->local_ip == rtdev->local_ip)) {
@@ -585,7 +1032,52 @@ static inline void rt_free_net_route(struct net_route *rt)
 {
     rt->next       = free_net_route;
     free_net_route = rt;
-    allocated_host_routes--;
+    allocated_net_routes--;
+}
+
+
+
+/***
+ *  rt_net_prefix_level - returns the trie level a prefix ends in
+ */
+static inline unsigned int rt_net_prefix_level(unsigned int prefix_len)
+{
+    return prefix_len ? (prefix_len - 1) / NET_TRIE_STRIDE : 0;
+}
+
+
+
+/***
+ *  rt_net_trie_index - returns the slot index of an address on a trie level
+ *  @addr:  address in host byte order
+ *  @level: trie level
+ */
+static inline unsigned int rt_net_trie_index(u32 addr, unsigned int level)
+{
+    return (addr >> (32 - NET_TRIE_STRIDE * (level + 1))) &
+        (NET_TRIE_SLOTS - 1);
+}
+
+
+
+/***
+ *  rt_net_trie_set - updates a trie slot
+ *
+ *  Note: must be called with net_table_lock held
+ */
+static inline void rt_net_trie_set(unsigned int node, unsigned int index,
+                                   u32 entry)
+{
+    u32 *slot = &net_trie[node][index];
+
+
+    if ((*slot == 0) && (entry != 0))
+        net_trie_used[node]++;
+    else if ((*slot != 0) && (entry == 0))
+        net_trie_used[node]--;
+
+    /* lookups read the slot only once, a single store keeps it consistent */
+    ACCESS_ONCE(*slot) = entry;
 }
 
 
@@ -598,32 +1090,41 @@ int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr)
     rtdm_lockctx_t      context;
     struct net_route    *new_route;
     struct net_route    *rt;
-    struct net_route    **last_ptr;
-    unsigned int        key;
-    u32                 shifted_mask;
+    u32                 prefix;
+    u32                 entry;
+    unsigned int        prefix_len;
+    unsigned int        level;
+    unsigned int        node;
+    unsigned int        child;
+    unsigned int        index;
+    unsigned int        first;
+    unsigned int        last;
+    unsigned int        route;
+    unsigned int        cur;
+    unsigned int        l;
 
 
-    addr &= mask;
+    /* only contiguous masks describe a prefix */
+    if ((~ntohl(mask) + 1) & ~ntohl(mask))
+        return -EINVAL;
+
+    addr       &= mask;
+    prefix     = ntohl(addr);
+    prefix_len = hweight32(mask);
 
     if ((new_route = rt_alloc_net_route()) != NULL) {
         new_route->dest_net_ip   = addr;
         new_route->dest_net_mask = mask;
         new_route->gw_ip         = gw_addr;
+        new_route->prefix_len    = prefix_len;
     }
 
-    shifted_mask = NET_HASH_KEY_MASK << net_hash_key_shift;
-    if ((mask & shifted_mask) == shifted_mask)
-        key = (ntohl(addr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
-    else
-        key = NET_HASH_TBL_SIZE;
-    last_ptr = &net_hash_tbl[key];
-
     rtdm_lock_get_irqsave(&net_table_lock, context);
 
-    rt = net_hash_tbl[key];
-    while (rt != NULL) {
+    for (rt = net_route_list; rt != NULL; rt = rt->next) {
         if ((rt->dest_net_ip == addr) && (rt->dest_net_mask == mask)) {
             rt->gw_ip = gw_addr;
+            atomic_inc(&route_genid);
 
             if (new_route)
                 rt_free_net_route(new_route);
@@ -632,246 +1133,997 @@ int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr)
 
             return 0;
         }
-
-        last_ptr = &rt->next;
-        rt = rt->next;
     }
 
-    if (new_route) {
-        new_route->next = *last_ptr;
-        *last_ptr       = new_route;
-
-        rtdm_lock_put_irqrestore(&net_table_lock, context);
-
-        return 0;
-    } else {
+    if (!new_route) {
         rtdm_lock_put_irqrestore(&net_table_lock, context);
 
         /*ERRMSG*/rtdm_printk("RTnet: no more network routes available\n");
         return -ENOBUFS;
     }
-}
 
+    level = rt_net_prefix_level(prefix_len);
 
+    /* check for sufficient nodes before touching the trie */
+    node = 0;
+    for (l = 0; l < level; l++) {
+        child = net_trie[node][rt_net_trie_index(prefix, l)] >>
+            NET_TRIE_CHILD_SHIFT;
+        if (child == 0)
+            break;
+        node = child;
+    }
 
-/***
- *  rt_ip_route_del_net - deletes specified network route
+    if (level - l > free_net_trie_nodes) {
+        rt_free_net_route(new_route);
+
+        rtdm_lock_put_irqrestore(&net_table_lock, context);
+
+        /*ERRMSG*/rtdm_printk("RTnet: no more network trie nodes available\n");
+        return -ENOBUFS;
+    }
+
+    new_route->next = net_route_list;
+    net_route_list  = new_route;
+    route           = new_route - net_routes + 1;
+
+    /* the route has to be complete before it becomes visible */
+    smp_wmb();
+
+    /* new nodes are empty, linking them does not change any lookup yet */
+    node = 0;
+    for (l = 0; l < level; l++) {
+        index = rt_net_trie_index(prefix, l);
+        entry = net_trie[node][index];
+        child = entry >> NET_TRIE_CHILD_SHIFT;
+        if (child == 0) {
+            child = free_net_trie_node[--free_net_trie_nodes];
+            rt_net_trie_set(node, index,
+                            entry | (child << NET_TRIE_CHILD_SHIFT));
+        }
+        node = child;
+    }
+
+    /* expand the prefix, but keep longer ones of the same level */
+    index = rt_net_trie_index(prefix, level);
+    first = index & ~((1 << (NET_TRIE_STRIDE * (level + 1) - prefix_len)) - 1);
+    last  = index | ((1 << (NET_TRIE_STRIDE * (level + 1) - prefix_len)) - 1);
+
+    for (index = first; index <= last; index++) {
+        entry = net_trie[node][index];
+        cur   = entry & NET_TRIE_ROUTE_MASK;
+        if ((cur == 0) || (net_routes[cur - 1].prefix_len < prefix_len))
+            rt_net_trie_set(node, index,
+                            (entry & ~NET_TRIE_ROUTE_MASK) | route);
+    }
+
+    atomic_inc(&route_genid);
+
+    rtdm_lock_put_irqrestore(&net_table_lock, context);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_ip_route_del_net - deletes specified network route
  */
 int rt_ip_route_del_net(u32 addr, u32 mask)
 {
     rtdm_lockctx_t      context;
     struct net_route    *rt;
+    struct net_route    *repl_rt;
     struct net_route    **last_ptr;
-    unsigned int        key;
-    u32                 shifted_mask;
+    u32                 prefix;
+    u32                 entry;
+    unsigned int        path[NET_TRIE_LEVELS];
+    unsigned int        level;
+    unsigned int        node;
+    unsigned int        index;
+    unsigned int        first;
+    unsigned int        last;
+    unsigned int        route;
+    unsigned int        repl;
+    unsigned int        l;
 
 
     addr &= mask;
 
-    shifted_mask = NET_HASH_KEY_MASK << net_hash_key_shift;
-    if ((mask & shifted_mask) == shifted_mask)
-        key = (ntohl(addr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
-    else
-        key = NET_HASH_TBL_SIZE;
-    last_ptr = &net_hash_tbl[key];
-
     rtdm_lock_get_irqsave(&net_table_lock, context);
 
-    rt = net_hash_tbl[key];
+    last_ptr = &net_route_list;
+    rt = net_route_list;
     while (rt != NULL) {
-        if ((rt->dest_net_ip == addr) && (rt->dest_net_mask == mask)) {
-            *last_ptr = rt->next;
+        if ((rt->dest_net_ip == addr) && (rt->dest_net_mask == mask))
+            break;
 
-            rt_free_net_route(rt);
+        last_ptr = &rt->next;
+        rt = rt->next;
+    }
 
-            rtdm_lock_put_irqrestore(&net_table_lock, context);
+    if (rt == NULL) {
+        rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-            return 0;
-        }
+        return -ENOENT;
+    }
 
-        last_ptr = &rt->next;
-        rt = rt->next;
+    *last_ptr = rt->next;
+
+    prefix = ntohl(addr);
+    level  = rt_net_prefix_level(rt->prefix_len);
+    route  = rt - net_routes + 1;
+
+    /* the longest shorter prefix of the same level takes over the slots,
+     * shorter prefixes of upper levels are found by the lookup anyway */
+    repl = 0;
+    for (repl_rt = net_route_list; repl_rt != NULL; repl_rt = repl_rt->next)
+        if ((rt_net_prefix_level(repl_rt->prefix_len) == level) &&
+            (repl_rt->prefix_len < rt->prefix_len) &&
+            ((addr & repl_rt->dest_net_mask) == repl_rt->dest_net_ip) &&
+            ((repl == 0) ||
+             (repl_rt->prefix_len > net_routes[repl - 1].prefix_len)))
+            repl = repl_rt - net_routes + 1;
+
+    path[0] = 0;
+    for (l = 0; l < level; l++)
+        path[l + 1] = net_trie[path[l]][rt_net_trie_index(prefix, l)] >>
+            NET_TRIE_CHILD_SHIFT;
+    node = path[level];
+
+    index = rt_net_trie_index(prefix, level);
+    first = index & ~((1 << (NET_TRIE_STRIDE * (level + 1) -
+                             rt->prefix_len)) - 1);
+    last  = index | ((1 << (NET_TRIE_STRIDE * (level + 1) -
+                            rt->prefix_len)) - 1);
+
+    for (index = first; index <= last; index++) {
+        entry = net_trie[node][index];
+        if ((entry & NET_TRIE_ROUTE_MASK) == route)
+            rt_net_trie_set(node, index,
+                            (entry & ~NET_TRIE_ROUTE_MASK) | repl);
+    }
+
+    /* unlink nodes which became empty, bottom-up */
+    for (l = level; (l > 0) && (net_trie_used[path[l]] == 0); l--) {
+        index = rt_net_trie_index(prefix, l - 1);
+        rt_net_trie_set(path[l - 1], index,
+                        net_trie[path[l - 1]][index] & NET_TRIE_ROUTE_MASK);
     }
 
+    atomic_inc(&route_genid);
+
+    /* lookups in flight may still refer to the route or the nodes */
+    rt_route_sync_lookups();
+
+    for (; level > l; level--)
+        free_net_trie_node[free_net_trie_nodes++] = path[level];
+    rt_free_net_route(rt);
+
     rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-    return -ENOENT;
+    return 0;
 }
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
 
 
 /***
- *  rt_ip_route_output - looks up output route
+ *  rt_ip_route_build_hh - prepares link layer header template of a route
+ */
+static inline void rt_ip_route_build_hh(struct dest_route *rt)
+{
+    struct rtnet_device *rtdev = rt->rtdev;
+    struct ethhdr       *eth = (struct ethhdr *)rt->hh_data;
+
+
+    /* only plain Ethernet headers can be precomputed */
+    if (rtdev->hard_header != rt_eth_header) {
+        rt->hh_len = 0;
+        return;
+    }
+
+    if (rtdev->flags & (IFF_LOOPBACK|IFF_NOARP))
+        memset(eth->h_dest, 0, ETH_ALEN);
+    else
+        memcpy(eth->h_dest, rt->dev_addr, ETH_ALEN);
+    memcpy(eth->h_source, rtdev->dev_addr, ETH_ALEN);
+    eth->h_proto = htons(ETH_P_IP);
+
+    rt->hh_len = ETH_HLEN;
+}
+
+
+
+/***
+ *  rt_host_route_lookup - looks up host route without locking
  *
- *  Note: increments refcount on returned rtdev in rt_buf
+ *  Note: must be called inside a lookup section, increments refcount on
+ *        returned rtdev in rt_buf
  */
-int rt_ip_route_output(struct dest_route *rt_buf, u32 daddr, u32 saddr)
+static inline int rt_host_route_lookup(struct dest_route *rt_buf, u32 daddr,
+                                       u32 saddr)
 {
-    rtdm_lockctx_t      context;
     struct host_route   *host_rt;
-    unsigned int        key;
+    struct host_route   **chain;
+    struct rtnet_device *rtdev;
+    unsigned int        hash = rt_host_hash(daddr);
+    unsigned int        seq;
 
-#ifndef CONFIG_RTNET_RTIPV4_NETROUTING
-    #define DADDR       daddr
-#else
-    #define DADDR       real_daddr
 
-    struct net_route    *net_rt;
-    int                 lookup_gw  = 1;
-    u32                 real_daddr = daddr;
+  retry:
+    seq = read_seqcount_begin(&host_table_seq);
 
+    /* table pointer and size have to match before indexing */
+    chain = rt_host_hash_chain(hash);
+    if (read_seqcount_retry(&host_table_seq, seq))
+        goto retry;
 
-  restart:
-#endif /* !CONFIG_RTNET_RTIPV4_NETROUTING */
+    host_rt = *chain;
+    while (host_rt != NULL) {
+        /* never follow a link which may have changed meanwhile */
+        if (read_seqcount_retry(&host_table_seq, seq))
+            goto retry;
 
-    key = ntohl(daddr) & HOST_HASH_KEY_MASK;
+        if ((host_rt->dest_host.ip == daddr) &&
+            ((saddr == INADDR_ANY) ||
+             (host_rt->dest_host.rtdev->local_ip == saddr))) {
+            rtdev = host_rt->dest_host.rtdev;
+            memcpy(rt_buf->dev_addr, &host_rt->dest_host.dev_addr,
+                   sizeof(rt_buf->dev_addr));
 
-    rtdm_lock_get_irqsave(&host_table_lock, context);
+            if (read_seqcount_retry(&host_table_seq, seq))
+                goto retry;
 
-    host_rt = host_hash_tbl[key];
-    if (likely(saddr == INADDR_ANY))
-        while (host_rt != NULL) {
-            if (host_rt->dest_host.ip == daddr) {
-              host_route_found:
-                memcpy(rt_buf->dev_addr, &host_rt->dest_host.dev_addr,
-                       sizeof(rt_buf->dev_addr));
-                rt_buf->rtdev = host_rt->dest_host.rtdev;
-                rtdev_reference(rt_buf->rtdev);
+            rt_buf->rtdev = rtdev;
+            rtdev_reference(rtdev);
 
-                rtdm_lock_put_irqrestore(&host_table_lock, context);
+            return 0;
+        }
+        host_rt = host_rt->next;
+    }
 
-                rt_buf->ip = DADDR;
+    if (read_seqcount_retry(&host_table_seq, seq))
+        goto retry;
+
+    return -ENOENT;
+}
 
-                return 0;
-            }
-            host_rt = host_rt->next;
-        }
-    else
-        while (host_rt != NULL) {
-            if ((host_rt->dest_host.ip == daddr) &&
-                (host_rt->dest_host.rtdev->local_ip == saddr))
-                goto host_route_found;
-            host_rt = host_rt->next;
-        }
 
-    rtdm_lock_put_irqrestore(&host_table_lock, context);
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-    if (lookup_gw) {
-        lookup_gw = 0;
-        key = (ntohl(daddr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
+/***
+ *  rt_net_route_lookup - looks up gateway of longest matching prefix
+ *
+ *  Takes one trie slot per level and no locks, regardless of the number and
+ *  the masks of the routes.
+ *
+ *  Note: must be called inside a lookup section
+ */
+static inline int rt_net_route_lookup(u32 daddr, u32 *gw_addr)
+{
+    u32                 addr = ntohl(daddr);
+    u32                 *node = net_trie[0];
+    u32                 entry;
+    unsigned int        route = 0;
+    unsigned int        child;
+    unsigned int        level;
 
-        rtdm_lock_get_irqsave(&net_table_lock, context);
 
-        net_rt = net_hash_tbl[key];
-        while (net_rt != NULL) {
-            if (net_rt->dest_net_ip == (daddr & net_rt->dest_net_mask)) {
-                daddr = net_rt->gw_ip;
+    for (level = 0; level < NET_TRIE_LEVELS; level++) {
+        entry = ACCESS_ONCE(node[rt_net_trie_index(addr, level)]);
 
-                rtdm_lock_put_irqrestore(&net_table_lock, context);
+        /* remember the longest prefix seen so far */
+        if (entry & NET_TRIE_ROUTE_MASK)
+            route = entry & NET_TRIE_ROUTE_MASK;
 
-                /* start over, now using the gateway ip as destination */
-                goto restart;
-            }
+        child = entry >> NET_TRIE_CHILD_SHIFT;
+        if (child == 0)
+            break;
 
-            net_rt = net_rt->next;
+        smp_read_barrier_depends();
+        node = net_trie[child];
+    }
+
+    if (route == 0)
+        return -ENOENT;
+
+    smp_read_barrier_depends();
+    *gw_addr = ACCESS_ONCE(net_routes[route - 1].gw_ip);
+
+    return 0;
+}
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+
+
+/***
+ *  rt_ip_route_neigh_dev - finds the device a neighbour is attached to
+ *
+ *  The subnet of a device is derived from its broadcast address. Returns the
+ *  device with incremented refcount, or NULL if no subnet matches.
+ */
+static struct rtnet_device *rt_ip_route_neigh_dev(u32 addr, u32 saddr)
+{
+    struct rtnet_device *rtdev;
+    u32                 host_bits;
+    int                 i;
+
+
+    for (i = 1; i <= MAX_RT_DEVICES; i++) {
+        if ((rtdev = rtdev_get_by_index(i)) == NULL)
+            continue;
+
+        if (((rtdev->flags & (IFF_UP | IFF_NOARP | IFF_LOOPBACK)) == IFF_UP) &&
+            (rtdev->local_ip != 0) &&
+            ((saddr == INADDR_ANY) || (saddr == rtdev->local_ip))) {
+            /* the host part are the trailing ones of the broadcast address */
+            host_bits = ntohl(rtdev->broadcast_ip);
+            host_bits &= ~(host_bits + 1);
+
+            if (((addr ^ rtdev->local_ip) & htonl(~host_bits)) == 0)
+                return rtdev;
         }
 
-        rtdm_lock_put_irqrestore(&net_table_lock, context);
+        rtdev_dereference(rtdev);
+    }
 
-        /* last try: no hash key */
-        rtdm_lock_get_irqsave(&net_table_lock, context);
+    return NULL;
+}
+
+
+
+/***
+ *  __rt_ip_route_output - looks up output route
+ *  @hold: also return routes to neighbours which are not resolved yet
+ *
+ *  The lookup does not take any lock, it only retries if the routing tables
+ *  were changed meanwhile.
+ *
+ *  If the next hop is unknown but attached to a local subnet, its address
+ *  resolution is started. With @hold set, the route to the neighbour is
+ *  returned right away with neigh_ip set to the next hop. Packets sent via
+ *  such a route have to be passed to rt_arp_resolve.
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+static int __rt_ip_route_output(struct dest_route *rt_buf, u32 daddr,
+                                u32 saddr, int hold)
+{
+    rtdm_lockctx_t      context;
+    struct rtnet_device *rtdev;
+    unsigned int        cpu;
+    u32                 addr = daddr;
+    int                 ret;
+
+
+    rtdm_lock_irqsave(context);
+    cpu = rt_route_lookup_enter();
+
+    ret = rt_host_route_lookup(rt_buf, addr, saddr);
 
-        net_rt = net_hash_tbl[NET_HASH_TBL_SIZE];
-        while (net_rt != NULL) {
-            if (net_rt->dest_net_ip == (daddr & net_rt->dest_net_mask)) {
-                daddr = net_rt->gw_ip;
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+    /* start over, now using the gateway ip as destination */
+    if ((ret < 0) && (rt_net_route_lookup(daddr, &addr) == 0))
+        ret = rt_host_route_lookup(rt_buf, addr, saddr);
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+    rt_route_lookup_exit(cpu);
+    rtdm_lock_irqrestore(context);
 
-                rtdm_lock_put_irqrestore(&net_table_lock, context);
+    if (unlikely(ret < 0)) {
+        if ((rtdev = rt_ip_route_neigh_dev(addr, saddr)) != NULL) {
+            if (hold) {
+                memset(rt_buf->dev_addr, 0, sizeof(rt_buf->dev_addr));
+                rt_buf->ip       = daddr;
+                rt_buf->rtdev    = rtdev;
+                rt_buf->hh_len   = 0;
+                rt_buf->neigh_ip = addr;
 
-                /* start over, now using the gateway ip as destination */
-                goto restart;
+                return 0;
             }
 
-            net_rt = net_rt->next;
+            rt_arp_resolve(rtdev, addr, NULL);
+            rtdev_dereference(rtdev);
         }
 
-        rtdm_lock_put_irqrestore(&net_table_lock, context);
+        /*ERRMSG*/rtdm_printk("RTnet: host %u.%u.%u.%u unreachable\n",
+                              NIPQUAD(daddr));
+        return -EHOSTUNREACH;
     }
-#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
-    /*ERRMSG*/rtdm_printk("RTnet: host %u.%u.%u.%u unreachable\n", NIPQUAD(daddr));
-    return -EHOSTUNREACH;
+    rt_buf->ip       = daddr;
+    rt_buf->neigh_ip = 0;
+    rt_ip_route_build_hh(rt_buf);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_ip_route_output - looks up output route
+ *
+ *  Fails with -EHOSTUNREACH if the next hop is not resolved yet.
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+int rt_ip_route_output(struct dest_route *rt_buf, u32 daddr, u32 saddr)
+{
+    return __rt_ip_route_output(rt_buf, daddr, saddr, 0);
+}
+
+
+
+/***
+ *  rt_ip_route_output_cached - looks up output route via a route cache
+ *  @rc:    per-socket cache
+ *  @rt_buf: returns the route
+ *  @daddr: destination address
+ *  @saddr: source address or INADDR_ANY
+ *
+ *  Repeated lookups of the same destination are served from the cache as
+ *  long as the routing tables remain unchanged. The route may refer to an
+ *  unresolved neighbour (see __rt_ip_route_output), such routes are not
+ *  cached.
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+int rt_ip_route_output_cached(struct route_cache *rc,
+                              struct dest_route *rt_buf, u32 daddr, u32 saddr)
+{
+    rtdm_lockctx_t      context;
+    unsigned int        cpu;
+    unsigned int        genid;
+    int                 ret;
+
+
+    rtdm_lock_get_irqsave(&rc->lock, context);
+
+    /* Checking the generation inside a lookup section ensures that the
+     * device has not been unregistered: its routes are deleted on shutdown,
+     * which bumps the generation and then waits for all lookup sections. */
+    cpu = rt_route_lookup_enter();
+
+    if (likely((rc->route.rtdev != NULL) && (rc->daddr == daddr) &&
+               (rc->saddr == saddr) &&
+               (rc->genid == atomic_read(&route_genid)))) {
+        memcpy(rt_buf, &rc->route, sizeof(struct dest_route));
+        rtdev_reference(rt_buf->rtdev);
+
+        rt_route_lookup_exit(cpu);
+        rtdm_lock_put_irqrestore(&rc->lock, context);
+
+        return 0;
+    }
+
+    rt_route_lookup_exit(cpu);
+    rtdm_lock_put_irqrestore(&rc->lock, context);
+
+    /* the lookup must not be based on tables older than genid */
+    genid = atomic_read(&route_genid);
+    smp_rmb();
+
+    ret = __rt_ip_route_output(rt_buf, daddr, saddr, 1);
+    if ((ret < 0) || (rt_buf->neigh_ip != 0))
+        return ret;
+
+    rtdm_lock_get_irqsave(&rc->lock, context);
+
+    memcpy(&rc->route, rt_buf, sizeof(struct dest_route));
+    rc->daddr = daddr;
+    rc->saddr = saddr;
+    rc->genid = genid;
+
+    rtdm_lock_put_irqrestore(&rc->lock, context);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_ip_route_output_mc - builds output route for a multicast destination
+ *  @rt_buf:  returns the route
+ *  @daddr:   group address
+ *  @saddr:   source address or INADDR_ANY
+ *  @ifindex: output device as set via IP_MULTICAST_IF, or 0
+ *
+ *  Groups are not kept in the routing tables. The device is selected by
+ *  rt_ip_mc_dev(), and the hardware address is derived from the group
+ *  (RFC 1112).
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+int rt_ip_route_output_mc(struct dest_route *rt_buf, u32 daddr, u32 saddr,
+                          int ifindex)
+{
+    struct rtnet_device *rtdev;
+
+
+    rtdev = rt_ip_mc_dev(saddr, ifindex);
+    if (rtdev == NULL)
+        return -ENETUNREACH;
+
+    rt_buf->ip       = daddr;
+    rt_buf->rtdev    = rtdev;
+    rt_buf->neigh_ip = 0;
+
+    if (rtdev->type == ARPHRD_ETHER)
+        ip_eth_mc_map(daddr, rt_buf->dev_addr);
+    else
+        memcpy(rt_buf->dev_addr, rtdev->broadcast, MAX_ADDR_LEN);
+
+    rt_ip_route_build_hh(rt_buf);
+
+    return 0;
 }
 
 
 
 #ifdef CONFIG_RTNET_RTIPV4_ROUTER
+/***
+ *  rt_ip_route_fwd_lookup - looks up the route of a forwarded packet
+ *  @rt_buf:   returns the route
+ *  @priority: returns the transmission priority
+ *  @iph:      header of the packet
+ *
+ *  Flows are served from the forwarding cache as long as the routing tables
+ *  remain unchanged. Only routes to resolved neighbours are cached.
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+static int rt_ip_route_fwd_lookup(struct dest_route *rt_buf,
+                                  unsigned int *priority, struct iphdr *iph)
+{
+    struct fwd_flow     *flow;
+    rtdm_lockctx_t      context;
+    unsigned int        cpu;
+    unsigned int        genid;
+    int                 ret;
+
+
+    flow = &fwd_flows[jhash_3words(iph->saddr, iph->daddr, iph->tos,
+                                   fwd_flow_rnd) & fwd_flow_mask];
+
+    rtdm_lock_get_irqsave(&fwd_flow_lock, context);
+    cpu = rt_route_lookup_enter();
+
+    if (likely((flow->route.rtdev != NULL) && (flow->daddr == iph->daddr) &&
+               (flow->saddr == iph->saddr) && (flow->tos == iph->tos) &&
+               (flow->genid == atomic_read(&route_genid)))) {
+        memcpy(rt_buf, &flow->route, sizeof(struct dest_route));
+        *priority = flow->priority;
+        rtdev_reference(rt_buf->rtdev);
+        fwd_flow_hits++;
+
+        rt_route_lookup_exit(cpu);
+        rtdm_lock_put_irqrestore(&fwd_flow_lock, context);
+
+        return 0;
+    }
+
+    fwd_flow_misses++;
+
+    rt_route_lookup_exit(cpu);
+    rtdm_lock_put_irqrestore(&fwd_flow_lock, context);
+
+    /* the lookup must not be based on tables older than genid */
+    genid = atomic_read(&route_genid);
+    smp_rmb();
+
+    ret = rt_ip_route_output(rt_buf, iph->daddr, INADDR_ANY);
+    if (ret < 0)
+        return ret;
+
+    *priority = RTSKB_PRIO_VALUE(router_tos_prio[iph->tos >> 5],
+                                 RTSKB_DEF_RT_CHANNEL);
+
+    rtdm_lock_get_irqsave(&fwd_flow_lock, context);
+
+    memcpy(&flow->route, rt_buf, sizeof(struct dest_route));
+    flow->saddr    = iph->saddr;
+    flow->daddr    = iph->daddr;
+    flow->tos      = iph->tos;
+    flow->genid    = genid;
+    flow->priority = *priority;
+
+    rtdm_lock_put_irqrestore(&fwd_flow_lock, context);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_ip_route_forward - forwards a packet not addressed to this station
+ *
+ *  Forwarding is reduced to a TTL update, the prebuilt link layer header of
+ *  the cached route, and the transmission. The packet is acquired from the
+ *  global pool to compensate the receiving device.
+ *
+ *  Returns 0 if the packet is for local delivery, 1 otherwise.
+ */
 int rt_ip_route_forward(struct rtskb *rtskb, u32 daddr)
 {
     struct rtnet_device *rtdev = rtskb->rtdev;
+    struct iphdr        *iph = rtskb->nh.iph;
     struct dest_route   dest;
+    unsigned int        priority;
 
 
     if (likely((daddr == rtdev->local_ip) || (daddr == rtdev->broadcast_ip) ||
-        (rtdev->flags & IFF_LOOPBACK)))
+        (rtdev->flags & IFF_LOOPBACK) || rt_ip_is_multicast(daddr)))
         return 0;
 
+    /* no ICMP time exceeded, just drop */
+    if (iph->ttl <= 1)
+        goto error;
+
     if (rtskb_acquire(rtskb, &global_pool) != 0) {
         /*ERRMSG*/rtdm_printk("RTnet: router overloaded, dropping packet\n");
         goto error;
     }
 
-    if (rt_ip_route_output(&dest, daddr, INADDR_ANY) < 0) {
+    if (rt_ip_route_fwd_lookup(&dest, &priority, iph) < 0) {
         /*ERRMSG*/rtdm_printk("RTnet: unable to forward packet from %u.%u.%u.%u\n",
-                              NIPQUAD(rtskb->nh.iph->saddr));
+                              NIPQUAD(iph->saddr));
         goto error;
     }
 
+    ip_decrease_ttl(iph);
+
     rtskb->rtdev    = dest.rtdev;
-    rtskb->priority = ROUTER_FORWARD_PRIO;
+    rtskb->priority = priority;
 
-    if ((dest.rtdev->hard_header) &&
-        (dest.rtdev->hard_header(rtskb, dest.rtdev, ETH_P_IP, dest.dev_addr,
-                                 dest.rtdev->dev_addr, rtskb->len) < 0))
+    if (rt_ip_hard_header(rtskb, &dest) < 0) {
+        rtdev_dereference(dest.rtdev);
         goto error;
+    }
 
     rtdev_xmit(rtskb);
 
+    rtdev_dereference(dest.rtdev);
+
     return 1;
 
   error:
     kfree_rtskb(rtskb);
     return 1;
 }
+
+
+
+/***
+ *  rt_ip_route_fwd_init - sets up the forwarding flow cache
+ */
+static int __init rt_ip_route_fwd_init(void)
+{
+    unsigned int i;
+
+
+    for (i = 0; i < ARRAY_SIZE(router_tos_prio); i++)
+        if (router_tos_prio[i] > QUEUE_MIN_PRIO)
+            router_tos_prio[i] = QUEUE_MIN_PRIO;
+
+    if (router_flows == 0)
+        router_flows = 1;
+    router_flows = roundup_pow_of_two(router_flows);
+
+    fwd_flows = kcalloc(router_flows, sizeof(struct fwd_flow), GFP_KERNEL);
+    if (fwd_flows == NULL)
+        return -ENOMEM;
+
+    fwd_flow_mask = router_flows - 1;
+    get_random_bytes(&fwd_flow_rnd, sizeof(fwd_flow_rnd));
+
+    return 0;
+}
 #endif /* CONFIG_RTNET_RTIPV4_ROUTER */
 
 
 
+/***
+ *  rt_grow_host_routes - adds a block of free host routes
+ *
+ *  Note: must be called with host_resize_lock held
+ */
+static int rt_grow_host_routes(unsigned int count)
+{
+    struct host_route_block *block;
+    rtdm_lockctx_t          context;
+    unsigned int            i;
+
+
+    block = kmalloc(sizeof(struct host_route_block) +
+                    count * sizeof(struct host_route), GFP_KERNEL);
+    if (block == NULL)
+        return -ENOMEM;
+
+    for (i = 0; i < count - 1; i++)
+        block->routes[i].next = &block->routes[i+1];
+
+    block->next       = host_route_blocks;
+    host_route_blocks = block;
+
+    rtdm_lock_get_irqsave(&host_table_lock, context);
+
+    block->routes[count-1].next = free_host_route;
+    free_host_route    = &block->routes[0];
+    total_host_routes += count;
+
+    rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_host_hash_resize - moves all host routes into a new hash table
+ *
+ *  The old buckets are rehashed one by one, each with host_table_lock held
+ *  only briefly, so that real-time lookups are never delayed by more than a
+ *  single chain move.
+ *
+ *  Note: must be called with host_resize_lock held
+ */
+static int rt_host_hash_resize(unsigned int new_size)
+{
+    struct host_route   **new_tbl;
+    struct host_route   **old_tbl;
+    struct host_route   **chain;
+    struct host_route   *rt;
+    rtdm_lockctx_t      context;
+    unsigned int        key;
+
+
+    new_tbl = kcalloc(new_size, sizeof(struct host_route *), GFP_KERNEL);
+    if (new_tbl == NULL)
+        return -ENOMEM;
+
+    rtdm_lock_get_irqsave(&host_table_lock, context);
+    write_seqcount_begin(&host_table_seq);
+    host_hash_new      = new_tbl;
+    host_hash_new_size = new_size;
+    host_hash_moved    = 0;
+    write_seqcount_end(&host_table_seq);
+    rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+    for (key = 0; key < host_hash_size; key++) {
+        rtdm_lock_get_irqsave(&host_table_lock, context);
+        write_seqcount_begin(&host_table_seq);
+
+        /* append to the new chains to preserve the lookup order */
+        while ((rt = host_hash_tbl[key]) != NULL) {
+            host_hash_tbl[key] = rt->next;
+
+            chain = &new_tbl[rt_host_hash(rt->dest_host.ip) & (new_size - 1)];
+            while (*chain != NULL)
+                chain = &(*chain)->next;
+            rt->next = NULL;
+            *chain   = rt;
+        }
+        host_hash_moved = key + 1;
+
+        write_seqcount_end(&host_table_seq);
+        rtdm_lock_put_irqrestore(&host_table_lock, context);
+    }
+
+    rtdm_lock_get_irqsave(&host_table_lock, context);
+    write_seqcount_begin(&host_table_seq);
+
+    old_tbl         = host_hash_tbl;
+    host_hash_tbl   = new_tbl;
+    host_hash_size  = new_size;
+    host_hash_new   = NULL;
+    host_hash_moved = 0;
+    host_hash_gen++;
+
+    write_seqcount_end(&host_table_seq);
+    rtdm_lock_put_irqrestore(&host_table_lock, context);
+
+    /* lockless lookups may still walk the old table */
+    rt_route_sync_lookups();
+    kfree(old_tbl);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_host_route_resize - grows the host routing table (Linux context)
+ */
+static void rt_host_route_resize(struct work_struct *work)
+{
+    unsigned int    count;
+
+
+    mutex_lock(&host_resize_lock);
+
+    while ((allocated_host_routes * 4 >= total_host_routes * 3) &&
+           (total_host_routes < max_host_routes)) {
+        count = min(total_host_routes, max_host_routes - total_host_routes);
+        count = min(count, (unsigned int)HOST_ROUTES_PER_BLOCK);
+
+        if (rt_grow_host_routes(count) < 0) {
+            /*ERRMSG*/printk("RTnet: unable to grow host routing table\n");
+            break;
+        }
+    }
+
+    /* keep the hash load factor at or below one */
+    while (host_hash_size < total_host_routes)
+        if (rt_host_hash_resize(host_hash_size * 2) < 0) {
+            /*ERRMSG*/printk("RTnet: unable to resize host hash table\n");
+            break;
+        }
+
+    mutex_unlock(&host_resize_lock);
+}
+
+
+
+static void rt_host_route_signal_handler(rtdm_nrtsig_t nrtsig, void *arg)
+{
+    schedule_work(&host_resize_work);
+}
+
+
+
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+/***
+ *  rt_net_trie_release - frees the network routing trie
+ */
+static void rt_net_trie_release(void)
+{
+    unsigned int i;
+
+
+    if (net_trie != NULL)
+        for (i = 0; i < net_trie_nodes; i++)
+            kfree(net_trie[i]);
+
+    kfree(net_trie);
+    kfree(net_trie_used);
+    kfree(free_net_trie_node);
+}
+
+
+
+/***
+ *  rt_net_trie_init - allocates the nodes of the network routing trie
+ */
+static int __init rt_net_trie_init(void)
+{
+    unsigned int i;
+
+
+    /* node indices have to fit into the upper half of a slot */
+    net_trie_nodes = clamp_t(unsigned int, net_trie_nodes, 1,
+                             NET_TRIE_MAX_NODES);
+
+    net_trie           = kcalloc(net_trie_nodes, sizeof(u32 *), GFP_KERNEL);
+    net_trie_used      = kcalloc(net_trie_nodes, sizeof(unsigned short),
+                                 GFP_KERNEL);
+    free_net_trie_node = kcalloc(net_trie_nodes, sizeof(unsigned short),
+                                 GFP_KERNEL);
+    if ((net_trie == NULL) || (net_trie_used == NULL) ||
+        (free_net_trie_node == NULL))
+        goto err;
+
+    for (i = 0; i < net_trie_nodes; i++) {
+        net_trie[i] = kcalloc(NET_TRIE_SLOTS, sizeof(u32), GFP_KERNEL);
+        if (net_trie[i] == NULL)
+            goto err;
+    }
+
+    /* node 0 is the root and always in use */
+    for (i = net_trie_nodes - 1; i > 0; i--)
+        free_net_trie_node[free_net_trie_nodes++] = i;
+
+    return 0;
+
+  err:
+    rt_net_trie_release();
+    return -ENOMEM;
+}
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+
+
 /***
  *  rt_ip_routing_init: initialize
  */
 int __init rt_ip_routing_init(void)
 {
-    int i;
+    struct host_route_block *block;
+    unsigned int            count;
+    int                     ret;
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+    int                     i;
+#endif
+
+
+    get_random_bytes(&host_hash_rnd, sizeof(host_hash_rnd));
+    seqcount_init(&host_table_seq);
+
+    if (host_routes == 0)
+        host_routes = 1;
+
+    host_hash_size = HOST_HASH_MIN_SIZE;
+    while (host_hash_size < host_routes)
+        host_hash_size *= 2;
 
+    host_hash_tbl = kcalloc(host_hash_size, sizeof(struct host_route *),
+                            GFP_KERNEL);
+    if (host_hash_tbl == NULL)
+        return -ENOMEM;
 
-    for (i = 0; i < CONFIG_RTNET_RTIPV4_HOST_ROUTES-2; i++)
-        host_routes[i].next = &host_routes[i+1];
-    free_host_route = &host_routes[0];
+    while (total_host_routes < host_routes) {
+        count = min(host_routes - total_host_routes,
+                    (unsigned int)HOST_ROUTES_PER_BLOCK);
+        if (rt_grow_host_routes(count) < 0) {
+            ret = -ENOMEM;
+            goto err1;
+        }
+    }
+
+    INIT_WORK(&host_resize_work, rt_host_route_resize);
+
+    ret = rtdm_nrtsig_init(&host_resize_signal, rt_host_route_signal_handler,
+                           NULL);
+    if (ret < 0)
+        goto err1;
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-    for (i = 0; i < CONFIG_RTNET_RTIPV4_NET_ROUTES-2; i++)
+    for (i = 0; i < CONFIG_RTNET_RTIPV4_NET_ROUTES-1; i++)
         net_routes[i].next = &net_routes[i+1];
     free_net_route = &net_routes[0];
+
+    ret = rt_net_trie_init();
+    if (ret < 0)
+        goto err2;
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
+#ifdef CONFIG_RTNET_RTIPV4_ROUTER
+    ret = rt_ip_route_fwd_init();
+    if (ret < 0)
+        goto err3;
+#endif /* CONFIG_RTNET_RTIPV4_ROUTER */
+
 #ifdef CONFIG_PROC_FS
-    return rt_route_proc_register();
-#else /* !CONFIG_PROC_FS */
+    ret = rt_route_proc_register();
+    if (ret < 0)
+        goto err4;
+#endif /* CONFIG_PROC_FS */
+
     return 0;
+
+#ifdef CONFIG_PROC_FS
+  err4:
 #endif /* CONFIG_PROC_FS */
+#ifdef CONFIG_RTNET_RTIPV4_ROUTER
+    kfree(fwd_flows);
+
+  err3:
+#endif /* CONFIG_RTNET_RTIPV4_ROUTER */
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+    rt_net_trie_release();
+
+  err2:
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+    rtdm_nrtsig_destroy(&host_resize_signal);
+
+  err1:
+    while ((block = host_route_blocks) != NULL) {
+        host_route_blocks = block->next;
+        kfree(block);
+    }
+    kfree(host_hash_tbl);
+
+    return ret;
 }
 
 
@@ -881,9 +2133,29 @@ int __init rt_ip_routing_init(void)
  */
 void rt_ip_routing_release(void)
 {
+    struct host_route_block *block;
+
+
 #ifdef CONFIG_PROC_FS
     rt_route_proc_unregister();
 #endif /* CONFIG_PROC_FS */
+
+    rtdm_nrtsig_destroy(&host_resize_signal);
+    cancel_work_sync(&host_resize_work);
+
+#ifdef CONFIG_RTNET_RTIPV4_ROUTER
+    kfree(fwd_flows);
+#endif /* CONFIG_RTNET_RTIPV4_ROUTER */
+
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+    rt_net_trie_release();
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+    while ((block = host_route_blocks) != NULL) {
+        host_route_blocks = block->next;
+        kfree(block);
+    }
+    kfree(host_hash_tbl);
 }
 
 
@@ -891,3 +2163,5 @@ EXPORT_SYMBOL(rt_ip_route_add_host);
 EXPORT_SYMBOL(rt_ip_route_del_host);
 EXPORT_SYMBOL(rt_ip_route_del_all);
 EXPORT_SYMBOL(rt_ip_route_output);
+EXPORT_SYMBOL(rt_ip_route_output_cached);
+EXPORT_SYMBOL(rt_ip_route_output_mc);
@@ -21,6 +21,9 @@
 
 #include <linux/moduleparam.h>
 #include <linux/list.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
 #include <linux/skbuff.h>
 #include <linux/module.h>
 #include <linux/delay.h>
@@ -33,6 +36,7 @@
 #include <rtdev.h>
 #include <rtnet_port.h>
 #include <ipv4/tcp.h>
+#include <ipv4/igmp.h>
 #include <ipv4/ip_sock.h>
 #include <ipv4/ip_output.h>
 #include <ipv4/ip_fragment.h>
@@ -177,29 +181,34 @@ MODULE_LICENSE("GPL");
 
 static struct tcp_socket rst_socket;
 
+static u32 tcp_sockets         = RT_TCP_SOCKETS;
 static u32 tcp_auto_port_start = 1024;
-static u32 tcp_auto_port_mask  = ~(RT_TCP_SOCKETS-1);
-static u32 free_ports          = RT_TCP_SOCKETS;
-#define RT_PORT_BITMAP_WORDS                                    \
-    ((RT_TCP_SOCKETS + BITS_PER_LONG - 1) / BITS_PER_LONG)
-static unsigned long      port_bitmap[RT_PORT_BITMAP_WORDS];
+static u32 tcp_auto_port_mask;
+static u32 free_ports;
+static unsigned long      *port_bitmap;
 
-static struct tcp_socket* port_registry[RT_TCP_SOCKETS];
+static struct tcp_socket  **port_registry;
 static rtdm_lock_t        tcp_socket_base_lock = RTDM_LOCK_UNLOCKED;
 
-static struct hlist_head port_hash[RT_TCP_SOCKETS * 2];
-#define port_hash_mask (RT_TCP_SOCKETS * 2 - 1)
+/* twice as many buckets as sockets */
+static struct hlist_head  *port_hash;
+static unsigned int       port_hash_bits;
+#define port_hash_bucket(sport) hash_32((sport), port_hash_bits)
 
+module_param(tcp_sockets, uint, 0444);
 module_param(tcp_auto_port_start, uint, 0444);
 module_param(tcp_auto_port_mask, uint, 0444);
+MODULE_PARM_DESC(tcp_sockets, "Maximum number of TCP sockets, rounded up to "
+                 "a power of 2 (default: 32)");
 MODULE_PARM_DESC(tcp_auto_port_start, "Start of automatically assigned "
                  "port range for TCP");
 MODULE_PARM_DESC(tcp_auto_port_mask, "Mask that defines port range for TCP "
-                 "for automatic assignment");
+                 "for automatic assignment (default: derived from "
+                 "tcp_sockets)");
 
 static inline struct tcp_socket *port_hash_search(u32 saddr, u16 sport)
 {
-    u32 bucket = sport & port_hash_mask;
+    u32 bucket = port_hash_bucket(sport);
     struct tcp_socket *ts;
     struct hlist_node *n;
 
@@ -220,7 +229,7 @@ static int port_hash_insert(struct tcp_socket *ts, u32 saddr, u16 sport)
     if (port_hash_search(saddr, sport))
         return -EADDRINUSE;
 
-    bucket = sport & port_hash_mask;
+    bucket = port_hash_bucket(sport);
     ts->saddr = saddr;
     ts->sport = sport;
     ts->daddr = 0;
@@ -586,8 +595,7 @@ static int rt_ip_build_frame(struct rtskb *skb, struct rtsocket *sk,
     iph->check    = ip_fast_csum((u8 *)iph, 5 /*iph->ihl*/);
 
     rtdev_reference(rt->rtdev);
-    ret = rtdev->hard_header(skb, rtdev, ETH_P_IP, rt->dev_addr,
-                             rtdev->dev_addr, skb->len);
+    ret = rt_ip_hard_header(skb, rt);
     rtdev_dereference(rt->rtdev);
 
     if (ret != rtdev->hard_header_len) {
@@ -1130,6 +1138,7 @@ static void rt_tcp_rcv(struct rtskb *skb)
 
     rtskb_queue_tail(&skb->sk->incoming, skb);
     rtdm_sem_up(&ts->sock.pending_sem);
+    rtnet_evq_signal(&ts->sock);
 
     /* inform retransmission subsystem about arrived ack */
     if (th->ack) {
@@ -1186,13 +1195,15 @@ static int rt_tcp_window_send(struct tcp_socket *ts, u32 data_len,
 static int rt_tcp_socket_create(struct tcp_socket* ts)
 {
     rtdm_lockctx_t  context;
-    int             i;
     int             index;
     struct rtsocket *sock = &ts->sock;
 
     sock->prot.inet.saddr = INADDR_ANY;
     sock->prot.inet.state = TCP_CLOSE;
     sock->prot.inet.tos   = 0;
+    sock->prot.inet.frag_count = 0;
+    sock->prot.inet.mc_ttl = RT_IP_MC_DEFAULT_TTL;
+    sock->prot.inet.mc_list = NULL;
     /*
       rtdm_printk("rttcp: rt_tcp_socket_create 0x%p\n", ts);
     */
@@ -1235,18 +1246,20 @@ static int rt_tcp_socket_create(struct tcp_socket* ts)
     free_ports--;
 
     /* find free auto-port in bitmap */
-    for (i = 0; i < RT_PORT_BITMAP_WORDS; i++)
-        if (port_bitmap[i] != (unsigned long)-1)
-            break;
-    index = ffz(port_bitmap[i]);
-    set_bit(index, &port_bitmap[i]);
-    index += i*32;
+    index = find_first_zero_bit(port_bitmap, tcp_sockets);
+    set_bit(index, port_bitmap);
     sock->prot.inet.reg_index = index;
-    sock->prot.inet.sport     = index + tcp_auto_port_start;
+    sock->prot.inet.sport     = htons(ntohs(tcp_auto_port_start) + index);
 
     /* register TCP socket */
     port_registry[index] = ts;
-    port_hash_insert(ts, INADDR_ANY, sock->prot.inet.sport);
+    if (port_hash_insert(ts, INADDR_ANY, sock->prot.inet.sport)) {
+        sock->prot.inet.reg_index = -1;
+        clear_bit(index, port_bitmap);
+        free_ports++;
+        rtdm_lock_put_irqrestore(&tcp_socket_base_lock, context);
+        return -EADDRINUSE;
+    }
 
     rtdm_lock_put_irqrestore(&tcp_socket_base_lock, context);
 
@@ -1304,7 +1317,7 @@ static void rt_tcp_socket_destruct(struct tcp_socket* ts)
     if (sock->prot.inet.reg_index >= 0) {
         index = sock->prot.inet.reg_index;
 
-        clear_bit(index % BITS_PER_LONG, &port_bitmap[index / BITS_PER_LONG]);
+        clear_bit(index, port_bitmap);
         port_hash_del(port_registry[index]);
         free_ports++;
         sock->prot.inet.reg_index = -1;
@@ -1448,7 +1461,8 @@ static int rt_tcp_bind(struct tcp_socket *ts, const struct sockaddr *addr,
 
     port_hash_del(ts);
     if (port_hash_insert(ts, usin->sin_addr.s_addr,
-                         usin->sin_port ?: index + tcp_auto_port_start)) {
+                         usin->sin_port ?:
+                             htons(ntohs(tcp_auto_port_start) + index))) {
         port_hash_insert(ts, ts->saddr, ts->sport);
 
         ret = -EADDRINUSE;
@@ -2053,6 +2067,9 @@ static ssize_t rt_tcp_recvmsg(struct rtdm_dev_context *sockctx,
     len = msg->msg_iov[0].iov_len;
     buf = msg->msg_iov[0].iov_base;
 
+    /* no control messages */
+    msg->msg_controllen = 0;
+
     return rt_tcp_read(sockctx, user_info, buf, len);
 }
 
@@ -2194,7 +2211,7 @@ static int rt_tcp_proc_read(char *buf, char **start, off_t offset,
                              "Foreign Address         State\n"))
         goto done;
 
-    for (index = 0; index < RT_TCP_SOCKETS; index++) {
+    for (index = 0; index < tcp_sockets; index++) {
         rtdm_lock_get_irqsave(&tcp_socket_base_lock, context);
 
         ts = port_registry[index];
@@ -2216,7 +2233,7 @@ static int rt_tcp_proc_read(char *buf, char **start, off_t offset,
                      NIPQUAD(daddr), ntohs(dport));
 
             ret = RTNET_PROC_PRINT_EX("%04X    %-23s %-23s %s\n",
-                                      sport & port_hash_mask, sbuffer, dbuffer,
+                                      port_hash_bucket(sport), sbuffer, dbuffer,
                                       rt_tcp_string_of_state(state));
             if (!ret)
                 break;
@@ -2265,14 +2282,34 @@ int __init rt_tcp_init(void)
     int i;
     int ret;
 
-    if ((tcp_auto_port_start < 0) ||
-        (tcp_auto_port_start >= 0x10000 - RT_TCP_SOCKETS))
+    if (tcp_sockets == 0 || tcp_sockets > 0x8000)
+        tcp_sockets = RT_TCP_SOCKETS;
+    tcp_sockets    = roundup_pow_of_two(tcp_sockets);
+    free_ports     = tcp_sockets;
+    port_hash_bits = ilog2(tcp_sockets) + 1;
+
+    /* the mask has to cover all auto-assigned ports */
+    tcp_auto_port_mask &= ~(tcp_sockets - 1);
+    if (tcp_auto_port_mask == 0)
+        tcp_auto_port_mask = ~(tcp_sockets - 1);
+    if (tcp_auto_port_start >= 0x10000 - tcp_sockets)
         tcp_auto_port_start = 1024;
     tcp_auto_port_start = htons(tcp_auto_port_start &
                                 (tcp_auto_port_mask & 0xFFFF));
     tcp_auto_port_mask  = htons(tcp_auto_port_mask | 0xFFFF0000);
 
-    for (i = 0; i < ARRAY_SIZE(port_hash); i++)
+    port_registry = kcalloc(tcp_sockets, sizeof(struct tcp_socket *),
+                            GFP_KERNEL);
+    port_bitmap   = kcalloc(BITS_TO_LONGS(tcp_sockets), sizeof(unsigned long),
+                            GFP_KERNEL);
+    port_hash     = kcalloc(1 << port_hash_bits, sizeof(struct hlist_head),
+                            GFP_KERNEL);
+    if (!port_registry || !port_bitmap || !port_hash) {
+        ret = -ENOMEM;
+        goto out_0;
+    }
+
+    for (i = 0; i < (1 << port_hash_bits); i++)
         INIT_HLIST_HEAD(&port_hash[i]);
 
     /* Perform essential initialization of the RST|ACK socket */
@@ -2321,6 +2358,11 @@ int __init rt_tcp_init(void)
  out_1:
     rt_bare_socket_cleanup(&rst_socket.sock);
 
+ out_0:
+    kfree(port_hash);
+    kfree(port_bitmap);
+    kfree(port_registry);
+
     return ret;
 }
 
@@ -2341,6 +2383,10 @@ void __exit rt_tcp_release(void)
     rt_bare_socket_cleanup(&rst_socket.sock);
 
     rtdm_dev_unregister(&tcp_device, 1000);
+
+    kfree(port_hash);
+    kfree(port_bitmap);
+    kfree(port_registry);
 }
 
 module_init(rt_tcp_init);
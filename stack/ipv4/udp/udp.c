@@ -29,13 +29,21 @@
 #include <linux/udp.h>
 #include <linux/tcp.h>
 #include <net/checksum.h>
+#include <net/ip.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
 
 #include <rtskb.h>
 #include <rtnet_internal.h>
 #include <rtnet_port.h>
 #include <rtnet_iovec.h>
 #include <rtnet_socket.h>
+#include <ipv4/igmp.h>
 #include <ipv4/ip_fragment.h>
 #include <ipv4/ip_output.h>
 #include <ipv4/ip_sock.h>
@@ -52,6 +60,7 @@
 struct udp_socket {
     u16             sport;      /* local port */
     u32             saddr;      /* local ip-addr */
+    int             reuseport;  /* member of a SO_REUSEPORT group */
     struct rtsocket *sock;
     struct hlist_node link;
 };
@@ -70,33 +79,53 @@ struct udp_socket {
  *  this range will be rejected when passed to bind_rt().
 
  */
+static unsigned int         udp_sockets     = RT_UDP_SOCKETS;
 static unsigned int         auto_port_start = 1024;
-static unsigned int         auto_port_mask  = ~(RT_UDP_SOCKETS-1);
-static int                  free_ports      = RT_UDP_SOCKETS;
-#define RT_PORT_BITMAP_WORDS \
-    ((RT_UDP_SOCKETS + BITS_PER_LONG - 1) / BITS_PER_LONG)
-static unsigned long        port_bitmap[RT_PORT_BITMAP_WORDS];
-static struct udp_socket    port_registry[RT_UDP_SOCKETS];
+static unsigned int         auto_port_mask;
+static int                  free_ports;
+static unsigned long        *port_bitmap;
+static struct udp_socket    *port_registry;
 static rtdm_lock_t          udp_socket_base_lock = RTDM_LOCK_UNLOCKED;
 
-static struct hlist_head port_hash[RT_UDP_SOCKETS * 2];
-#define port_hash_mask (RT_UDP_SOCKETS * 2 - 1)
+/* twice as many buckets as sockets, hashed so that both sequential auto
+ * ports and user port ranges spread evenly */
+static struct hlist_head    *port_hash;
+static unsigned int         port_hash_bits;
+#define port_hash_bucket(sport) hash_32((sport), port_hash_bits)
+
+/***
+ *  Lock-free port lookup
+
+ *  The receive path walks the port hash without taking udp_socket_base_lock.
+ *  Readers run short sections with interrupts disabled and only mark them in
+ *  a per-CPU sequence counter (odd while inside), so no cache line is shared
+ *  between the cores. Writers modify the hash under udp_socket_base_lock
+ *  using the RCU list primitives. Before a registry entry is reused or its
+ *  socket released, they wait via udp_lookup_sync() until all sections which
+ *  may still see the old entry have left, like rt_route_sync_lookups.
+
+ */
+static DEFINE_PER_CPU(unsigned int, lookup_seq);
 
 MODULE_LICENSE("GPL");
 
+module_param(udp_sockets, uint, 0444);
 module_param(auto_port_start, uint, 0444);
 module_param(auto_port_mask, uint, 0444);
+MODULE_PARM_DESC(udp_sockets, "Maximum number of UDP sockets, rounded up to "
+                 "a power of 2 (default: 64)");
 MODULE_PARM_DESC(auto_port_start, "Start of automatically assigned port range");
 MODULE_PARM_DESC(auto_port_mask,
-                 "Mask that defines port range for automatic assignment");
+                 "Mask that defines port range for automatic assignment "
+                 "(default: derived from udp_sockets)");
 
 static inline struct udp_socket *port_hash_search(u32 saddr, u16 sport)
 {
-	unsigned bucket = sport & port_hash_mask;
+	unsigned bucket = port_hash_bucket(sport);
 	struct udp_socket *sock;
 	struct hlist_node *n;
 
-	hlist_for_each_entry(sock, n, &port_hash[bucket], link)
+	hlist_for_each_entry_rcu(sock, n, &port_hash[bucket], link)
 		if (sock->sport == sport &&
 		    (saddr == INADDR_ANY
 		     || sock->saddr == saddr
@@ -106,46 +135,238 @@ static inline struct udp_socket *port_hash_search(u32 saddr, u16 sport)
 	return NULL;
 }
 
-static inline int port_hash_insert(struct udp_socket *sock, u32 saddr, u16 sport)
+/* Sockets bound to the same multicast group share the port, they all receive
+ * the group's datagrams. Sockets which set SO_REUSEPORT before binding to the
+ * same address and port form a group that shares the unicast datagrams. */
+static inline int port_hash_conflict(struct udp_socket *self, u32 saddr,
+				     u16 sport, int reuseport)
 {
-	unsigned bucket;
+	unsigned bucket = port_hash_bucket(sport);
+	struct udp_socket *sock;
+	struct hlist_node *n;
 
-	if (port_hash_search(saddr, sport))
-		return -EADDRINUSE;
+	hlist_for_each_entry(sock, n, &port_hash[bucket], link)
+		if (sock != self && sock->sport == sport &&
+		    (saddr == INADDR_ANY
+		     || sock->saddr == saddr
+		     || sock->saddr == INADDR_ANY) &&
+		    !(sock->saddr == saddr &&
+		      (rt_ip_is_multicast(saddr)
+		       || (reuseport && sock->reuseport))))
+			return 1;
+
+	return 0;
+}
+
+/* The caller has to check for conflicts first. */
+static inline void port_hash_add(struct udp_socket *sock, u32 saddr, u16 sport,
+				 int reuseport)
+{
+	unsigned bucket = port_hash_bucket(sport);
 
-	bucket = sport & port_hash_mask;
 	sock->saddr = saddr;
 	sock->sport = sport;
-	hlist_add_head(&sock->link, &port_hash[bucket]);
+	sock->reuseport = reuseport;
+	hlist_add_head_rcu(&sock->link, &port_hash[bucket]);
+}
+
+static inline int port_hash_insert(struct udp_socket *sock, u32 saddr, u16 sport,
+				   int reuseport)
+{
+	if (port_hash_conflict(sock, saddr, sport, reuseport))
+		return -EADDRINUSE;
+
+	port_hash_add(sock, saddr, sport, reuseport);
 	return 0;
 }
 
+/* Picks the member of first's SO_REUSEPORT group that receives the flow.
+ * The same flow always goes to the same member while the group is unchanged,
+ * so the datagrams of a flow stay in order. */
+static inline struct udp_socket *port_hash_select(struct udp_socket *first,
+						  u32 flow)
+{
+	unsigned bucket = port_hash_bucket(first->sport);
+	struct udp_socket *sock;
+	struct hlist_node *n;
+	unsigned int members = 0;
+
+	hlist_for_each_entry_rcu(sock, n, &port_hash[bucket], link)
+		if (sock->reuseport && sock->sport == first->sport &&
+		    sock->saddr == first->saddr)
+			members++;
+
+	if (members <= 1)
+		return first;
+	members = ((u64)flow * members) >> 32;
+
+	/* the group may have changed meanwhile, first is always valid */
+	hlist_for_each_entry_rcu(sock, n, &port_hash[bucket], link)
+		if (sock->reuseport && sock->sport == first->sport &&
+		    sock->saddr == first->saddr && members-- == 0)
+			return sock;
+
+	return first;
+}
+
+/* The entry must not be reused before udp_lookup_sync() returned.
+ * Deleting an unhashed entry is a no-op. */
 static inline void port_hash_del(struct udp_socket *sock)
 {
-	hlist_del(&sock->link);
+	if (!hlist_unhashed(&sock->link))
+		hlist_del_init_rcu(&sock->link);
+}
+
+/* Note: must be called with interrupts disabled */
+static inline unsigned int udp_lookup_begin(void)
+{
+    unsigned int cpu = raw_smp_processor_id();
+
+    per_cpu(lookup_seq, cpu)++;
+    smp_mb();
+
+    return cpu;
+}
+
+static inline void udp_lookup_end(unsigned int cpu)
+{
+    smp_mb();
+    per_cpu(lookup_seq, cpu)++;
+}
+
+/***
+ *  udp_lookup_sync - wait for all lookup sections in flight
+ *
+ *  The sections are short and run with interrupts disabled, so this only
+ *  spins briefly on CPUs which are inside a section. It may be called from
+ *  real-time context and with udp_socket_base_lock held.
+ */
+static void udp_lookup_sync(void)
+{
+    unsigned int    cpu;
+    unsigned int    seq;
+
+
+    smp_mb();
+
+    for_each_online_cpu(cpu) {
+        seq = per_cpu(lookup_seq, cpu);
+        if (seq & 1)
+            while (*(volatile unsigned int *)&per_cpu(lookup_seq, cpu) == seq)
+                cpu_relax();
+    }
 }
 
 /***
  *  rt_udp_v4_lookup
  */
-static inline struct rtsocket *rt_udp_v4_lookup(u32 daddr, u16 dport)
+static inline struct rtsocket *rt_udp_v4_lookup(u32 daddr, u16 dport,
+                                                u32 saddr, u16 sport)
 {
-    rtdm_lockctx_t  context;
-    struct udp_socket *sock;
+    struct udp_socket   *sock;
+    struct rtsocket     *rtsock = NULL;
+    rtdm_lockctx_t      context;
+    unsigned int        cpu;
+
+    rtdm_lock_irqsave(context);
+    cpu = udp_lookup_begin();
 
-    rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
     sock = port_hash_search(daddr, dport);
+    if (sock && sock->reuseport)
+        sock = port_hash_select(sock, jhash_3words(saddr, daddr,
+                                                   ((u32)sport << 16) | dport,
+                                                   0));
     if (sock) {
-	    rt_socket_reference(sock->sock);
+        rtsock = sock->sock;
+        rt_socket_reference(rtsock);
+    }
 
-	    rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+    udp_lookup_end(cpu);
+    rtdm_lock_irqrestore(context);
 
-	    return sock->sock;
+    return rtsock;
+}
+
+
+
+void rt_udp_rcv(struct rtskb *skb);
+
+/***
+ *  rt_udp_mc_lookup - find the receivers of a multicast datagram
+ *  @skb:   the datagram, not yet acquired by any socket
+ *  @daddr: group address
+ *  @dport: destination port
+ *
+ *  Returns the first matching socket which takes over skb. All further
+ *  sockets get their own copy, taken from their pools and delivered right
+ *  away. Each of them is referenced until its copy is queued. Fragmented
+ *  datagrams are only passed to the first socket.
+ */
+static struct rtsocket *rt_udp_mc_lookup(struct rtskb *skb, u32 daddr,
+                                         u16 dport)
+{
+    struct rtskb_queue  copies;
+    struct udp_socket   *sock;
+    struct hlist_node   *n;
+    struct rtsocket     *first = NULL;
+    struct rtsocket     *rtsock;
+    struct rtskb        *copy;
+    unsigned int        hdr_len = skb->data - skb->nh.raw;
+    unsigned int        len = hdr_len + skb->len;
+    int                 fragmented;
+    rtdm_lockctx_t      context;
+    unsigned int        cpu;
+
+
+    fragmented = skb->nh.iph->frag_off & htons(IP_MF | IP_OFFSET);
+    rtskb_queue_init(&copies);
+
+    rtdm_lock_irqsave(context);
+    cpu = udp_lookup_begin();
+
+    hlist_for_each_entry_rcu(sock, n, &port_hash[port_hash_bucket(dport)],
+                             link) {
+        if (sock->sport != dport ||
+            (sock->saddr != daddr && sock->saddr != INADDR_ANY))
+            continue;
+
+        if (first == NULL) {
+            first = sock->sock;
+            rt_socket_reference(first);
+            if (fragmented)
+                break;
+            continue;
+        }
+
+        copy = alloc_rtskb(len, &sock->sock->skb_pool);
+        if (copy == NULL)
+            continue;
+        copy->sk = sock->sock;
+        rt_socket_reference(copy->sk);
+        __rtskb_queue_tail(&copies, copy);
     }
 
-    rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
-	    
-    return NULL;
+    udp_lookup_end(cpu);
+    rtdm_lock_irqrestore(context);
+
+    while ((copy = __rtskb_dequeue(&copies)) != NULL) {
+        copy->nh.raw = rtskb_put(copy, len);
+        memcpy(copy->nh.raw, skb->nh.raw, len);
+        copy->h.raw = __rtskb_pull(copy, hdr_len);
+
+        copy->rtdev      = skb->rtdev;
+        copy->protocol   = skb->protocol;
+        copy->pkt_type   = skb->pkt_type;
+        copy->time_stamp = skb->time_stamp;
+        copy->ip_summed  = skb->ip_summed;
+        copy->csum       = skb->csum;
+
+        rtsock = copy->sk;
+        rt_udp_rcv(copy);
+        rt_socket_dereference(rtsock);
+    }
+
+    return first;
 }
 
 
@@ -161,6 +382,7 @@ int rt_udp_bind(struct rtsocket *sock, const struct sockaddr *addr,
     struct sockaddr_in  *usin = (struct sockaddr_in *)addr;
     rtdm_lockctx_t      context;
     int                 index;
+    u16                 sport;
     int                 err = 0;
 
 
@@ -180,23 +402,31 @@ int rt_udp_bind(struct rtsocket *sock, const struct sockaddr *addr,
         goto unlock_out;
     }
 
-    port_hash_del(&port_registry[index]);
-    if (port_hash_insert(&port_registry[index],
-			 usin->sin_addr.s_addr,
-			 usin->sin_port ?: index + auto_port_start)) {
-	    port_hash_insert(&port_registry[index],
-			     port_registry[index].saddr,
-			     port_registry[index].sport);
-	    rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
-	    return -EADDRINUSE;
+    sport = usin->sin_port ?: htons(ntohs(auto_port_start) + index);
+    if (port_hash_conflict(&port_registry[index], usin->sin_addr.s_addr,
+                           sport, sock->prot.inet.reuseport)) {
+        err = -EADDRINUSE;
+        goto unlock_out;
     }
 
+    /* lookups may still walk along the entry, let them leave it before it
+     * is linked into another bucket - the lock is kept, so the new address
+     * cannot be taken meanwhile */
+    port_hash_del(&port_registry[index]);
+    udp_lookup_sync();
+    port_hash_add(&port_registry[index], usin->sin_addr.s_addr, sport,
+                  sock->prot.inet.reuseport);
+
+    rtdm_lock_get(&sock->param_lock);
+
     /* set the source-addr */
     sock->prot.inet.saddr = port_registry[index].saddr;
 
     /* set source port, if not set by user */
     sock->prot.inet.sport = port_registry[index].sport;
 
+    rtdm_lock_put(&sock->param_lock);
+
  unlock_out:
     rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
 
@@ -222,16 +452,18 @@ int rt_udp_connect(struct rtsocket *sock, const struct sockaddr *serv_addr,
             return -EBADF;
 
         rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+        rtdm_lock_get(&sock->param_lock);
 
         sock->prot.inet.saddr = INADDR_ANY;
         /* Note: The following line differs from standard stacks, and we also
                  don't remove the socket from the port list. Might get fixed in
                  the future... */
-        sock->prot.inet.sport = index + auto_port_start;
+        sock->prot.inet.sport = htons(ntohs(auto_port_start) + index);
         sock->prot.inet.daddr = INADDR_ANY;
         sock->prot.inet.dport = 0;
         sock->prot.inet.state = TCP_CLOSE;
 
+        rtdm_lock_put(&sock->param_lock);
         rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
     } else {
         if ((addrlen < (int)sizeof(struct sockaddr_in)) ||
@@ -245,10 +477,13 @@ int rt_udp_connect(struct rtsocket *sock, const struct sockaddr *serv_addr,
             return -EINVAL;
         }
 
+        rtdm_lock_get(&sock->param_lock);
+
         sock->prot.inet.state = TCP_ESTABLISHED;
         sock->prot.inet.daddr = usin->sin_addr.s_addr;
         sock->prot.inet.dport = usin->sin_port;
 
+        rtdm_lock_put(&sock->param_lock);
         rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
     }
 
@@ -266,7 +501,6 @@ int rt_udp_socket(struct rtdm_dev_context *sockctx,
 {
     struct rtsocket *sock = (struct rtsocket *)&sockctx->dev_private;
     int             ret;
-    int             i;
     int             index;
     rtdm_lockctx_t  context;
 
@@ -277,6 +511,12 @@ int rt_udp_socket(struct rtdm_dev_context *sockctx,
     sock->prot.inet.saddr = INADDR_ANY;
     sock->prot.inet.state = TCP_CLOSE;
     sock->prot.inet.tos   = 0;
+    sock->prot.inet.reuseport  = 0;
+    sock->prot.inet.frag_count = 0;
+    sock->prot.inet.mc_ttl     = RT_IP_MC_DEFAULT_TTL;
+    sock->prot.inet.mc_ifindex = 0;
+    sock->prot.inet.mc_list    = NULL;
+    rt_ip_route_cache_init(&sock->prot.inet.rt_cache);
 
     rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
 
@@ -289,22 +529,27 @@ int rt_udp_socket(struct rtdm_dev_context *sockctx,
     free_ports--;
 
     /* find free auto-port in bitmap */
-    for (i = 0; i < RT_PORT_BITMAP_WORDS; i++)
-        if (port_bitmap[i] != (unsigned long)-1)
-            break;
-    index = ffz(port_bitmap[i]);
-    set_bit(index, &port_bitmap[i]);
-    index += i*32;
+    index = find_first_zero_bit(port_bitmap, udp_sockets);
+    set_bit(index, port_bitmap);
     sock->prot.inet.reg_index = index;
-    sock->prot.inet.sport     = index + auto_port_start;
+    sock->prot.inet.sport     = htons(ntohs(auto_port_start) + index);
 
-    /* register UDP socket */
-    port_hash_insert(&port_registry[index], INADDR_ANY, sock->prot.inet.sport);
+    /* register UDP socket, lookups may find it right after the insertion */
     port_registry[index].sock  = sock;
+    ret = port_hash_insert(&port_registry[index], INADDR_ANY,
+                           sock->prot.inet.sport, 0);
+    if (ret < 0) {
+        sock->prot.inet.reg_index = -1;
+        clear_bit(index, port_bitmap);
+        free_ports++;
+    }
 
     rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
 
-    return 0;
+    if (ret < 0)
+        rt_socket_cleanup(sockctx);
+
+    return ret;
 }
 
 
@@ -317,7 +562,7 @@ int rt_udp_close(struct rtdm_dev_context *sockctx,
 {
     struct rtsocket *sock = (struct rtsocket *)&sockctx->dev_private;
     struct rtskb    *del;
-    int             port;
+    int             port = -1;
     rtdm_lockctx_t  context;
 
 
@@ -327,16 +572,27 @@ int rt_udp_close(struct rtdm_dev_context *sockctx,
 
     if (sock->prot.inet.reg_index >= 0) {
         port = sock->prot.inet.reg_index;
-        clear_bit(port % BITS_PER_LONG, &port_bitmap[port / BITS_PER_LONG]);
-	port_hash_del(&port_registry[port]);
-
-        free_ports++;
+        port_hash_del(&port_registry[port]);
 
         sock->prot.inet.reg_index = -1;
     }
 
     rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
 
+    if (port >= 0) {
+        /* lookups may still hold the entry, release it afterwards */
+        udp_lookup_sync();
+
+        rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+
+        clear_bit(port, port_bitmap);
+        free_ports++;
+
+        rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+    }
+
+    rt_ip_mc_drop_socket(sock);
+
     /* cleanup already collected fragments */
     rt_ip_frag_invalidate_socket(sock);
 
@@ -349,17 +605,137 @@ int rt_udp_close(struct rtdm_dev_context *sockctx,
 
 
 
+/***
+ *  rt_udp_borrow - lend the next datagram to an in-kernel caller
+ */
+static int rt_udp_borrow(struct rtdm_dev_context *sockctx,
+                         rtdm_user_info_t *user_info,
+                         struct rtnet_borrow *borrow)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rtskb        *skb;
+    struct udphdr       *uh;
+    struct sockaddr_in  *sin;
+    nanosecs_rel_t      timeout = sock->timeout;
+    int                 ret;
+
+
+    /* socket buffers are not mapped into user space */
+    if (user_info)
+        return -EACCES;
+
+    if (!rtdm_in_rt_context())
+        return -ENOSYS;
+
+    /* non-blocking receive? */
+    if (testbits(borrow->flags, MSG_DONTWAIT))
+        timeout = -1;
+
+    ret = rtdm_sem_timeddown(&sock->pending_sem, timeout, NULL);
+    if (unlikely(ret < 0))
+        switch (ret) {
+            case -EWOULDBLOCK:
+            case -ETIMEDOUT:
+            case -EINTR:
+                return ret;
+
+            default:
+                return -EBADF;   /* socket has been closed */
+        }
+
+    skb = rtskb_dequeue_chain(&sock->incoming);
+    RTNET_ASSERT(skb != NULL, return -EFAULT;);
+
+    uh = skb->h.uh;
+    __rtskb_pull(skb, sizeof(struct udphdr));
+
+    ret = rt_socket_lend(skb, ntohs(uh->len) - sizeof(struct udphdr), borrow);
+    if (unlikely(ret < 0)) {
+        /* leave the datagram for a caller with a larger vector */
+        __rtskb_push(skb, sizeof(struct udphdr));
+        rtskb_queue_head(&sock->incoming, skb);
+        rtdm_sem_up(&sock->pending_sem);
+        return ret;
+    }
+
+    sin = borrow->name;
+    borrow->namelen = sizeof(*sin);
+    if (sin) {
+        sin->sin_family      = AF_INET;
+        sin->sin_port        = uh->source;
+        sin->sin_addr.s_addr = skb->nh.iph->saddr;
+    }
+
+    borrow->handle = skb;
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_udp_setsockopt - socket level options of UDP sockets
+ */
+static int rt_udp_setsockopt(struct rtsocket *sock, int optname,
+                             const void *optval, socklen_t optlen)
+{
+    switch (optname) {
+        case SO_REUSEPORT:
+            /* only evaluated by the next bind */
+            if (optlen < sizeof(int))
+                return -EINVAL;
+
+            sock->prot.inet.reuseport = (*(int *)optval != 0);
+            return 0;
+
+        default:
+            return rt_socket_setsockopt(sock, optname, optval, optlen);
+    }
+}
+
+
+
+static int rt_udp_getsockopt(struct rtsocket *sock, int optname,
+                             void *optval, socklen_t *optlen)
+{
+    if (*optlen < sizeof(int))
+        return -EINVAL;
+
+    switch (optname) {
+        case SO_REUSEPORT:
+            *(int *)optval = sock->prot.inet.reuseport;
+            *optlen = sizeof(int);
+            return 0;
+
+        default:
+            return rt_socket_getsockopt(sock, optname, optval, optlen);
+    }
+}
+
+
+
+static int rt_udp_commit(struct rtdm_dev_context *sockctx,
+                         rtdm_user_info_t *user_info,
+                         struct rtnet_txbuf *txbuf);
+
 int rt_udp_ioctl(struct rtdm_dev_context *sockctx,
                  rtdm_user_info_t *user_info,
                  unsigned int request, void *arg)
 {
     struct rtsocket *sock = (struct rtsocket *)&sockctx->dev_private;
     struct _rtdm_setsockaddr_args *setaddr = arg;
+    struct _rtdm_getsockopt_args  *getopt  = arg;
+    struct _rtdm_setsockopt_args  *setopt  = arg;
 
 
     /* fast path for common socket IOCTLs */
-    if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK)
+    if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK) {
+        if (request == RTNET_RTIOC_BORROW)
+            return rt_udp_borrow(sockctx, user_info, arg);
+        if (request == RTNET_RTIOC_TXCOMMIT)
+            return rt_udp_commit(sockctx, user_info, arg);
         return rt_socket_common_ioctl(sockctx, user_info, request, arg);
+    }
 
     switch (request) {
         case _RTIOC_BIND:
@@ -368,9 +744,23 @@ int rt_udp_ioctl(struct rtdm_dev_context *sockctx,
         case _RTIOC_CONNECT:
             return rt_udp_connect(sock, setaddr->addr, setaddr->addrlen);
 
+        case _RTIOC_SETSOCKOPT:
+            if (setopt->level != SOL_SOCKET)
+                break;
+            return rt_udp_setsockopt(sock, setopt->optname, setopt->optval,
+                                     setopt->optlen);
+
+        case _RTIOC_GETSOCKOPT:
+            if (getopt->level != SOL_SOCKET)
+                break;
+            return rt_udp_getsockopt(sock, getopt->optname, getopt->optval,
+                                     getopt->optlen);
+
         default:
-            return rt_ip_ioctl(sockctx, user_info, request, arg);
+            break;
     }
+
+    return rt_ip_ioctl(sockctx, user_info, request, arg);
 }
 
 
@@ -462,6 +852,8 @@ ssize_t rt_udp_recvmsg(struct rtdm_dev_context *sockctx,
     if (data_len > 0)
         msg->msg_flags |= MSG_TRUNC;
 
+    rt_socket_put_stamp(sock, msg, first_skb);
+
     if ((msg_flags & MSG_PEEK) == 0)
         kfree_rtskb(first_skb);
     else {
@@ -533,18 +925,15 @@ static int rt_udp_getfrag(const void *p, unsigned char *to,
 
 
 /***
- *  rt_udp_sendmsg
+ *  rt_udp_route - resolve source and destination of an outgoing datagram
+ *
+ *  Fills in the addresses and ports of @ufh. On success, the caller has to
+ *  release the device reference held by @rt.
  */
-ssize_t rt_udp_sendmsg(struct rtdm_dev_context *sockctx,
-                       rtdm_user_info_t *user_info,
-                       const struct msghdr *msg, int msg_flags)
+static int rt_udp_route(struct rtsocket *sock, const struct sockaddr_in *usin,
+                        socklen_t namelen, struct dest_route *rt,
+                        struct udpfakehdr *ufh)
 {
-    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
-    size_t              len   = rt_iovec_len(msg->msg_iov, msg->msg_iovlen);
-    int                 ulen  = len + sizeof(struct udphdr);
-    struct sockaddr_in  *usin;
-    struct udpfakehdr   ufh;
-    struct dest_route   rt;
     u32                 saddr;
     u32                 daddr;
     u16                 dport;
@@ -552,58 +941,100 @@ ssize_t rt_udp_sendmsg(struct rtdm_dev_context *sockctx,
     rtdm_lockctx_t      context;
 
 
-    if ((len < 0) || (len > 0xFFFF-sizeof(struct iphdr)-sizeof(struct udphdr)))
-        return -EMSGSIZE;
-
-    if (msg_flags & MSG_OOB)   /* Mirror BSD error message compatibility */
-        return -EOPNOTSUPP;
-
-    if (msg_flags & ~(MSG_DONTROUTE|MSG_DONTWAIT) )
-        return -EINVAL;
-
-    if ((msg->msg_name) && (msg->msg_namelen==sizeof(struct sockaddr_in))) {
-        usin = (struct sockaddr_in*) msg->msg_name;
-
+    /* bind and connect update the socket's addresses under its param_lock,
+       the global lock is not needed here */
+    if ((usin) && (namelen==sizeof(struct sockaddr_in))) {
         if ((usin->sin_family != AF_INET) && (usin->sin_family != AF_UNSPEC))
             return -EINVAL;
 
         daddr = usin->sin_addr.s_addr;
         dport = usin->sin_port;
 
-        rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+        rtdm_lock_get_irqsave(&sock->param_lock, context);
     } else {
-        rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+        rtdm_lock_get_irqsave(&sock->param_lock, context);
 
-        if (sock->prot.inet.state != TCP_ESTABLISHED)
+        if (sock->prot.inet.state != TCP_ESTABLISHED) {
+            rtdm_lock_put_irqrestore(&sock->param_lock, context);
             return -ENOTCONN;
+        }
 
         daddr = sock->prot.inet.daddr;
         dport = sock->prot.inet.dport;
     }
-    saddr         = sock->prot.inet.saddr;
-    ufh.uh.source = sock->prot.inet.sport;
+    saddr          = sock->prot.inet.saddr;
+    ufh->uh.source = sock->prot.inet.sport;
 
-    rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+    rtdm_lock_put_irqrestore(&sock->param_lock, context);
 
     if ((daddr | dport) == 0)
         return -EINVAL;
 
-    /* get output route */
-    err = rt_ip_route_output(&rt, daddr, saddr);
+    /* a socket bound to a group sends from its device address */
+    if (rt_ip_is_multicast(saddr))
+        saddr = INADDR_ANY;
+
+    /* get output route, usually from the socket's route cache */
+    if (rt_ip_is_multicast(daddr))
+        err = rt_ip_route_output_mc(rt, daddr, saddr,
+                                    sock->prot.inet.mc_ifindex);
+    else
+        err = rt_ip_route_output_cached(&sock->prot.inet.rt_cache, rt,
+                                        daddr, saddr);
     if (err)
         return err;
 
     /* we found a route, remember the routing dest-addr could be the netmask */
-    ufh.saddr     = saddr != INADDR_ANY ? saddr : rt.rtdev->local_ip;
-    ufh.daddr     = daddr;
-    ufh.uh.dest   = dport;
+    ufh->saddr   = saddr != INADDR_ANY ? saddr : rt->rtdev->local_ip;
+    ufh->daddr   = daddr;
+    ufh->uh.dest = dport;
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_udp_sendmsg
+ */
+ssize_t rt_udp_sendmsg(struct rtdm_dev_context *sockctx,
+                       rtdm_user_info_t *user_info,
+                       const struct msghdr *msg, int msg_flags)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    size_t              len   = rt_iovec_len(msg->msg_iov, msg->msg_iovlen);
+    int                 ulen  = len + sizeof(struct udphdr);
+    struct udpfakehdr   ufh;
+    struct dest_route   rt;
+    nanosecs_abs_t      txtime;
+    int                 err;
+
+
+    if ((len < 0) || (len > 0xFFFF-sizeof(struct iphdr)-sizeof(struct udphdr)))
+        return -EMSGSIZE;
+
+    if (msg_flags & MSG_OOB)   /* Mirror BSD error message compatibility */
+        return -EOPNOTSUPP;
+
+    if (msg_flags & ~(MSG_DONTROUTE|MSG_DONTWAIT) )
+        return -EINVAL;
+
+    err = rt_socket_get_txtime(sock, msg, &txtime);
+    if (err)
+        return err;
+
+    err = rt_udp_route(sock, msg->msg_name, msg->msg_namelen, &rt, &ufh);
+    if (err)
+        return err;
+
     ufh.uh.len    = htons(ulen);
     ufh.uh.check  = 0;
     ufh.iov       = msg->msg_iov;
     ufh.iovlen    = msg->msg_iovlen;
     ufh.wcheck    = 0;
 
-    err = rt_ip_build_xmit(sock, rt_udp_getfrag, &ufh, ulen, &rt, msg_flags);
+    err = rt_ip_build_xmit(sock, rt_udp_getfrag, &ufh, ulen, &rt, msg_flags,
+                           txtime);
 
     rtdev_dereference(rt.rtdev);
 
@@ -615,6 +1046,60 @@ ssize_t rt_udp_sendmsg(struct rtdm_dev_context *sockctx,
 
 
 
+/***
+ *  rt_udp_commit - send a datagram written into a reserved buffer
+ */
+static int rt_udp_commit(struct rtdm_dev_context *sockctx,
+                         rtdm_user_info_t *user_info,
+                         struct rtnet_txbuf *txbuf)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rtskb        *skb = txbuf->handle;
+    struct udpfakehdr   ufh;
+    struct udphdr       *uh;
+    struct dest_route   rt;
+    unsigned int        ulen;
+    int                 err;
+
+
+    if (txbuf->flags & ~(MSG_DONTROUTE|MSG_DONTWAIT))
+        return -EINVAL;
+
+    err = rt_socket_txbuf_check(sock, user_info, txbuf);
+    if (err)
+        return err;
+
+    /* the buffer stays with the caller if there is no route */
+    err = rt_udp_route(sock, txbuf->name, txbuf->namelen, &rt, &ufh);
+    if (err)
+        return err;
+
+    txbuf->handle = NULL;
+    skb->lent     = 0;
+
+    ulen = skb->len + sizeof(struct udphdr);
+    uh = (struct udphdr *)__rtskb_push(skb, sizeof(struct udphdr));
+    uh->source = ufh.uh.source;
+    uh->dest   = ufh.uh.dest;
+    uh->len    = htons(ulen);
+    uh->check  = 0;
+    uh->check  = csum_tcpudp_magic(ufh.saddr, ufh.daddr, ulen, IPPROTO_UDP,
+                                   csum_partial(skb->data, ulen, 0));
+    if (uh->check == 0)
+        uh->check = -1;
+
+    err = rt_ip_xmit_rtskb(sock, skb, &rt);
+
+    rtdev_dereference(rt.rtdev);
+
+    if (!err)
+        return txbuf->len;
+    else
+        return err;
+}
+
+
+
 /***
  *  rt_udp_check
  */
@@ -653,12 +1138,20 @@ struct rtsocket *rt_udp_dest_socket(struct rtskb *skb)
     if (skb->ip_summed != CHECKSUM_UNNECESSARY)
         skb->csum = csum_tcpudp_nofold(saddr, daddr, ulen, IPPROTO_UDP, 0);
 
+    if (rt_ip_is_multicast(daddr)) {
+        if (!rt_ip_mc_check(daddr, rtdev))
+            return NULL;
+
+        skb->sk = rt_udp_mc_lookup(skb, daddr, uh->dest);
+        return skb->sk;
+    }
+
     /* patch broadcast daddr */
     if (daddr == rtdev->broadcast_ip)
         daddr = rtdev->local_ip;
 
     /* find the destination socket */
-    skb->sk = rt_udp_v4_lookup(daddr, uh->dest);
+    skb->sk = rt_udp_v4_lookup(daddr, uh->dest, saddr, uh->source);
 
     return skb->sk;
 }
@@ -671,13 +1164,15 @@ struct rtsocket *rt_udp_dest_socket(struct rtskb *skb)
 void rt_udp_rcv (struct rtskb *skb)
 {
     struct rtsocket *sock = skb->sk;
+    struct rtskb    *old;
     void            (*callback_func)(struct rtdm_dev_context *, void *);
     void            *callback_arg;
     rtdm_lockctx_t  context;
 
 
-    rtskb_queue_tail(&sock->incoming, skb);
-    rtdm_sem_up(&sock->pending_sem);
+    old = rt_socket_enqueue(sock, skb);
+    if (old != NULL)
+        kfree_rtskb(old);
 
     rtdm_lock_get_irqsave(&sock->param_lock, context);
     callback_func = sock->callback_func;
@@ -749,18 +1244,52 @@ static struct rtdm_device udp_device = {
  */
 static int __init rt_udp_init(void)
 {
-    int i;
-    if ((auto_port_start < 0) || (auto_port_start >= 0x10000 - RT_UDP_SOCKETS))
+    unsigned int    i;
+    int             ret;
+
+
+    if (udp_sockets == 0 || udp_sockets > 0x8000)
+        udp_sockets = RT_UDP_SOCKETS;
+    udp_sockets    = roundup_pow_of_two(udp_sockets);
+    free_ports     = udp_sockets;
+    port_hash_bits = ilog2(udp_sockets) + 1;
+
+    /* the mask has to cover all auto-assigned ports */
+    auto_port_mask &= ~(udp_sockets - 1);
+    if (auto_port_mask == 0)
+        auto_port_mask = ~(udp_sockets - 1);
+    if (auto_port_start >= 0x10000 - udp_sockets)
         auto_port_start = 1024;
     auto_port_start = htons(auto_port_start & (auto_port_mask & 0xFFFF));
     auto_port_mask  = htons(auto_port_mask | 0xFFFF0000);
 
+    port_registry = kcalloc(udp_sockets, sizeof(struct udp_socket),
+                            GFP_KERNEL);
+    port_bitmap   = kcalloc(BITS_TO_LONGS(udp_sockets), sizeof(unsigned long),
+                            GFP_KERNEL);
+    port_hash     = kcalloc(1 << port_hash_bits, sizeof(struct hlist_head),
+                            GFP_KERNEL);
+    if (!port_registry || !port_bitmap || !port_hash) {
+        ret = -ENOMEM;
+        goto err;
+    }
+
+    for (i = 0; i < (1 << port_hash_bits); i++)
+        INIT_HLIST_HEAD(&port_hash[i]);
+
     rt_inet_add_protocol(&udp_protocol);
 
-    for (i = 0; i < ARRAY_SIZE(port_hash); i++)
-	    INIT_HLIST_HEAD(&port_hash[i]);
+    ret = rtdm_dev_register(&udp_device);
+    if (ret == 0)
+        return 0;
+
+    rt_inet_del_protocol(&udp_protocol);
 
-    return rtdm_dev_register(&udp_device);
+ err:
+    kfree(port_hash);
+    kfree(port_bitmap);
+    kfree(port_registry);
+    return ret;
 }
 
 
@@ -772,6 +1301,10 @@ static void __exit rt_udp_release(void)
 {
     rtdm_dev_unregister(&udp_device, 1000);
     rt_inet_del_protocol(&udp_protocol);
+
+    kfree(port_hash);
+    kfree(port_bitmap);
+    kfree(port_registry);
 }
 
 module_init(rt_udp_init);
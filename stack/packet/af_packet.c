@@ -40,6 +40,7 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     struct rtsocket *sock   = container_of(pt, struct rtsocket,
                                            prot.packet.packet_type);
     int             ifindex = sock->prot.packet.ifindex;
+    struct rtskb    *old;
     void            (*callback_func)(struct rtdm_dev_context *, void *);
     void            *callback_arg;
     rtdm_lockctx_t  context;
@@ -62,8 +63,11 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
         }
 
     rtdev_reference(skb->rtdev);
-    rtskb_queue_tail(&sock->incoming, skb);
-    rtdm_sem_up(&sock->pending_sem);
+    old = rt_socket_enqueue(sock, skb);
+    if (old != NULL) {
+        rtdev_dereference(old->rtdev);
+        kfree_rtskb(old);
+    }
 
     rtdm_lock_get_irqsave(&sock->param_lock, context);
     callback_func = sock->callback_func;
@@ -232,6 +236,172 @@ static int rt_packet_close(struct rtdm_dev_context *sockctx,
 
 
 
+/***
+ *  rt_packet_borrow - lend the next packet to an in-kernel caller
+ */
+static int rt_packet_borrow(struct rtdm_dev_context *sockctx,
+                            rtdm_user_info_t *user_info,
+                            struct rtnet_borrow *borrow)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rtskb        *rtskb;
+    struct rtnet_device *rtdev;
+    struct sockaddr_ll  *sll;
+    nanosecs_rel_t      timeout = sock->timeout;
+    int                 ret;
+
+
+    /* socket buffers are not mapped into user space */
+    if (user_info)
+        return -EACCES;
+
+    if (!rtdm_in_rt_context())
+        return -ENOSYS;
+
+    /* non-blocking receive? */
+    if (testbits(borrow->flags, MSG_DONTWAIT))
+        timeout = -1;
+
+    ret = rtdm_sem_timeddown(&sock->pending_sem, timeout, NULL);
+    if (unlikely(ret < 0))
+        switch (ret) {
+            case -EWOULDBLOCK:
+            case -ETIMEDOUT:
+            case -EINTR:
+                return ret;
+
+            default:
+                return -EBADF;   /* socket has been closed */
+        }
+
+    rtskb = rtskb_dequeue_chain(&sock->incoming);
+    RTNET_ASSERT(rtskb != NULL, return -EFAULT;);
+
+    /* Include the header in raw delivery */
+    if (sockctx->device->socket_type != SOCK_DGRAM)
+        rtskb_push(rtskb, rtskb->data - rtskb->mac.raw);
+
+    ret = rt_socket_lend(rtskb, rtskb->len, borrow);
+    if (unlikely(ret < 0)) {
+        rtskb_queue_head(&sock->incoming, rtskb);
+        rtdm_sem_up(&sock->pending_sem);
+        return ret;
+    }
+
+    rtdev = rtskb->rtdev;
+
+    sll = borrow->name;
+    borrow->namelen = sizeof(*sll);
+    if (sll != NULL) {
+        sll->sll_family   = AF_PACKET;
+        sll->sll_hatype   = rtdev->type;
+        sll->sll_protocol = rtskb->protocol;
+        sll->sll_pkttype  = rtskb->pkt_type;
+        sll->sll_ifindex  = rtdev->ifindex;
+
+        /* Ethernet specific - we rather need some parse handler here */
+        memcpy(sll->sll_addr, rtskb->mac.ethernet->h_source, ETH_ALEN);
+        sll->sll_halen = ETH_ALEN;
+    }
+
+    /* the borrower only sees the payload, drop the device now */
+    rtdev_dereference(rtdev);
+
+    borrow->handle = rtskb;
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_packet_commit - send a frame written into a reserved buffer
+ */
+static int rt_packet_commit(struct rtdm_dev_context *sockctx,
+                            rtdm_user_info_t *user_info,
+                            struct rtnet_txbuf *txbuf)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    const struct sockaddr_ll *sll = txbuf->name;
+    struct rtskb        *rtskb = txbuf->handle;
+    struct rtnet_device *rtdev;
+    unsigned short      proto;
+    const unsigned char *addr;
+    size_t              len = txbuf->len;
+    int                 ifindex;
+    int                 ret;
+
+
+    if (txbuf->flags & ~MSG_DONTWAIT)
+        return -EINVAL;
+
+    ret = rt_socket_txbuf_check(sock, user_info, txbuf);
+    if (ret)
+        return ret;
+
+    if (sll == NULL) {
+        ifindex = sock->prot.packet.ifindex;
+        proto   = sock->prot.packet.packet_type.type;
+        addr    = NULL;
+    } else {
+        if ((txbuf->namelen < sizeof(struct sockaddr_ll)) ||
+            (txbuf->namelen <
+                (sll->sll_halen + offsetof(struct sockaddr_ll, sll_addr))) ||
+            ((sll->sll_family != AF_PACKET) &&
+            (sll->sll_family != AF_UNSPEC)))
+        return -EINVAL;
+
+        ifindex = sll->sll_ifindex;
+        proto   = sll->sll_protocol;
+        addr    = sll->sll_addr;
+    }
+
+    if ((rtdev = rtdev_get_by_index(ifindex)) == NULL)
+        return -ENODEV;
+
+    /* the checks leave the buffer with the caller */
+    if ((len > rtdev->mtu + ((sockctx->device->socket_type == SOCK_RAW) ?
+                             rtdev->hard_header_len : 0)) ||
+        (rtdev->hard_header_len > RTNET_TX_HEADROOM)) {
+        ret = -EMSGSIZE;
+        goto out;
+    }
+
+    if ((sll != NULL) && (sll->sll_halen != rtdev->addr_len)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    rtskb->rtdev    = rtdev;
+    rtskb->priority = sock->priority;
+
+    if (rtdev->hard_header && sockctx->device->socket_type == SOCK_DGRAM &&
+        rtdev->hard_header(rtskb, rtdev, ntohs(proto),
+                           (void *)addr, NULL, len) < 0) {
+        /* restore the payload view for a retry */
+        __rtskb_pull(rtskb, rtskb->len - len);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    txbuf->handle = NULL;
+    rtskb->lent   = 0;
+
+    if ((rtdev->flags & IFF_UP) != 0) {
+        if ((ret = rtdev_xmit(rtskb)) == 0)
+            ret = len;
+    } else {
+        kfree_rtskb(rtskb);
+        ret = -ENETDOWN;
+    }
+
+ out:
+    rtdev_dereference(rtdev);
+    return ret;
+}
+
+
+
 /***
  *  rt_packet_ioctl
  */
@@ -242,11 +412,18 @@ static int rt_packet_ioctl(struct rtdm_dev_context *sockctx,
     struct rtsocket *sock = (struct rtsocket *)&sockctx->dev_private;
     struct _rtdm_setsockaddr_args *setaddr = arg;
     struct _rtdm_getsockaddr_args *getaddr = arg;
+    struct _rtdm_getsockopt_args  *getopt  = arg;
+    struct _rtdm_setsockopt_args  *setopt  = arg;
 
 
     /* fast path for common socket IOCTLs */
-    if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK)
+    if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK) {
+        if (request == RTNET_RTIOC_BORROW)
+            return rt_packet_borrow(sockctx, user_info, arg);
+        if (request == RTNET_RTIOC_TXCOMMIT)
+            return rt_packet_commit(sockctx, user_info, arg);
         return rt_socket_common_ioctl(sockctx, user_info, request, arg);
+    }
 
     switch (request) {
         case _RTIOC_BIND:
@@ -256,6 +433,18 @@ static int rt_packet_ioctl(struct rtdm_dev_context *sockctx,
             return rt_packet_getsockname(sock, getaddr->addr,
                                          getaddr->addrlen);
 
+        case _RTIOC_SETSOCKOPT:
+            if (setopt->level != SOL_SOCKET)
+                return -ENOPROTOOPT;
+            return rt_socket_setsockopt(sock, setopt->optname, setopt->optval,
+                                        setopt->optlen);
+
+        case _RTIOC_GETSOCKOPT:
+            if (getopt->level != SOL_SOCKET)
+                return -ENOPROTOOPT;
+            return rt_socket_getsockopt(sock, getopt->optname, getopt->optval,
+                                        getopt->optlen);
+
         default:
             return rt_socket_if_ioctl(sockctx, user_info, request, arg);
     }
@@ -331,6 +520,8 @@ static ssize_t rt_packet_recvmsg(struct rtdm_dev_context *sockctx,
 
     rt_memcpy_tokerneliovec(msg->msg_iov, rtskb->data, copy_len);
 
+    rt_socket_put_stamp(sock, msg, rtskb);
+
     if ((msg_flags & MSG_PEEK) == 0) {
         rtdev_dereference(rtskb->rtdev);
         kfree_rtskb(rtskb);
@@ -358,6 +549,7 @@ static ssize_t rt_packet_sendmsg(struct rtdm_dev_context *sockctx,
     struct rtskb        *rtskb;
     unsigned short      proto;
     unsigned char       *addr;
+    nanosecs_abs_t      txtime;
     int                 ifindex;
     int                 ret = 0;
 
@@ -367,6 +559,10 @@ static ssize_t rt_packet_sendmsg(struct rtdm_dev_context *sockctx,
     if (msg_flags & ~MSG_DONTWAIT)
         return -EINVAL;
 
+    ret = rt_socket_get_txtime(sock, msg, &txtime);
+    if (ret)
+        return ret;
+
     if (sll == NULL) {
         /* Note: We do not care about races with rt_packet_bind here -
            the user has to do so. */
@@ -413,6 +609,7 @@ static ssize_t rt_packet_sendmsg(struct rtdm_dev_context *sockctx,
 
     rtskb->rtdev    = rtdev;
     rtskb->priority = sock->priority;
+    rtskb->txtime   = txtime;
 
     if (rtdev->hard_header) {
         int hdr_len;
@@ -335,6 +335,15 @@ static int rtskb_map(struct rtnet_device *rtdev, struct rtskb *skb)
         printk("RTnet: device %s maps skb differently than others. "
                "Different IOMMU domain?\nThis is not supported.\n",
                rtdev->name);
+
+        if (rtdev->unmap_rtskb) {
+            /* The hook takes the address from the buffer, which other
+             * devices may be using right now. Pass a copy instead. */
+            struct rtskb tmp = *skb;
+
+            tmp.buf_dma_addr = addr;
+            rtdev->unmap_rtskb(rtdev, &tmp);
+        }
         return -EACCES;
     }
 
@@ -374,9 +383,25 @@ int rtdev_map_rtskb(struct rtskb *skb)
 
 
 
+/* requires rtnet_devices_nrt_lock, rtdev must not be listed anymore/yet */
+static int __rtdev_other_mappers(struct rtnet_device *rtdev)
+{
+    int i;
+
+    for (i = 0; i < MAX_RT_DEVICES; i++)
+        if (rtnet_devices[i] && rtnet_devices[i] != rtdev &&
+            rtnet_devices[i]->map_rtskb)
+            return 1;
+
+    return 0;
+}
+
+
+
 static int rtdev_map_all_rtskbs(struct rtnet_device *rtdev)
 {
     struct rtskb *skb;
+    int others;
     int err = 0;
 
     if (!rtdev->map_rtskb)
@@ -388,6 +413,18 @@ static int rtdev_map_all_rtskbs(struct rtnet_device *rtdev)
            break;
     }
 
+    if (!err)
+        return 0;
+
+    /* unwind the mappings established so far (skb itself failed) */
+    others = __rtdev_other_mappers(rtdev);
+    list_for_each_entry_continue_reverse(skb, &rtskb_list, entry) {
+        if (rtdev->unmap_rtskb)
+            rtdev->unmap_rtskb(rtdev, skb);
+        if (!others)
+            skb->buf_dma_addr = RTSKB_UNMAPPED;
+    }
+
     return err;
 }
 
@@ -398,21 +435,21 @@ void rtdev_unmap_rtskb(struct rtskb *skb)
     struct rtnet_device *rtdev;
     int i;
 
-    if (skb->buf_dma_addr == RTSKB_UNMAPPED)
-        return;
-
     mutex_lock(&rtnet_devices_nrt_lock);
 
+    /* listed even if no device mapped it (yet or anymore) */
     list_del(&skb->entry);
 
-    for (i = 0; i < MAX_RT_DEVICES; i++) {
-        rtdev = rtnet_devices[i];
-        if (rtdev && rtdev->unmap_rtskb) {
-            rtdev->unmap_rtskb(rtdev, skb);
+    if (skb->buf_dma_addr != RTSKB_UNMAPPED) {
+        for (i = 0; i < MAX_RT_DEVICES; i++) {
+            rtdev = rtnet_devices[i];
+            if (rtdev && rtdev->unmap_rtskb) {
+                rtdev->unmap_rtskb(rtdev, skb);
+            }
         }
-    }
 
-    skb->buf_dma_addr = RTSKB_UNMAPPED;
+        skb->buf_dma_addr = RTSKB_UNMAPPED;
+    }
 
     mutex_unlock(&rtnet_devices_nrt_lock);
 }
@@ -422,12 +459,21 @@ void rtdev_unmap_rtskb(struct rtskb *skb)
 static void rtdev_unmap_all_rtskbs(struct rtnet_device *rtdev)
 {
     struct rtskb *skb;
+    int others;
 
-    if (!rtdev->unmap_rtskb)
+    if (!rtdev->map_rtskb)
         return;
 
+    /* Once the last mapping device is gone, the addresses are stale. Reset
+     * them so that a re-registered device does not fail the consistency
+     * check in rtskb_map() (e.g. on module reload behind an IOMMU). */
+    others = __rtdev_other_mappers(rtdev);
+
     list_for_each_entry(skb, &rtskb_list, entry) {
-        rtdev->unmap_rtskb(rtdev, skb);
+        if (rtdev->unmap_rtskb)
+            rtdev->unmap_rtskb(rtdev, skb);
+        if (!others)
+            skb->buf_dma_addr = RTSKB_UNMAPPED;
     }
 }
 
@@ -484,6 +530,7 @@ int rt_register_rtnetdev(struct rtnet_device *rtdev)
         /* allow only one loopback device */
         if (loopback_device) {
             rtdm_lock_put_irqrestore(&rtnet_devices_rt_lock, context);
+            rtdev_unmap_all_rtskbs(rtdev);
             mutex_unlock(&rtnet_devices_nrt_lock);
             return -EEXIST;
         }
@@ -637,11 +684,142 @@ int rtdev_close(struct rtnet_device *rtdev)
     rtdev->flags &= ~(IFF_UP|IFF_RUNNING);
     clear_bit(__RTNET_LINK_STATE_START, &rtdev->link_state);
 
+    /* drop frames still waiting for their launch time */
+    rtnet_txtime_flush(rtdev);
+
     return ret;
 }
 
 
 
+/***
+ *  rtdev_add_rx_filter - install a flow steering rule
+ *  @rtdev:  the device
+ *  @filter: the rule
+ *
+ *  Frames matching the rule are directed to the given RX queue of the NIC.
+ *  Returns -EOPNOTSUPP if the driver cannot steer flows.
+ *
+ *  Note: must be called with rtdev->nrt_lock acquired
+ */
+int rtdev_add_rx_filter(struct rtnet_device *rtdev,
+                        struct rtdev_rx_filter *filter)
+{
+    if (!rtdev->add_rx_filter)
+        return -EOPNOTSUPP;
+
+    if ((filter->type != RTDEV_RX_FILTER_ETHERTYPE &&
+         filter->type != RTDEV_RX_FILTER_UDP_DPORT) ||
+        filter->value > 0xFFFF)
+        return -EINVAL;
+
+    return rtdev->add_rx_filter(rtdev, filter);
+}
+
+
+
+/***
+ *  rtdev_del_rx_filter - remove a flow steering rule
+ *  @rtdev:  the device
+ *  @filter: the rule as passed to rtdev_add_rx_filter
+ *
+ *  Note: must be called with rtdev->nrt_lock acquired
+ */
+int rtdev_del_rx_filter(struct rtnet_device *rtdev,
+                        struct rtdev_rx_filter *filter)
+{
+    if (!rtdev->del_rx_filter)
+        return -EOPNOTSUPP;
+
+    return rtdev->del_rx_filter(rtdev, filter);
+}
+
+
+
+static void rtdev_update_mc_filter(struct rtnet_device *rtdev)
+{
+    if (rtdev->allmulti > 0)
+        rtdev->flags |= IFF_ALLMULTI;
+    else
+        rtdev->flags &= ~IFF_ALLMULTI;
+
+    if (rtdev->set_multicast_list && (rtdev->flags & IFF_UP))
+        rtdev->set_multicast_list(rtdev);
+}
+
+
+
+/***
+ *  rtdev_mc_add - add a hardware address to the multicast filter
+ *  @rtdev: the device
+ *  @addr:  multicast hardware address
+ *
+ *  Addresses are reference counted. If the filter list is full, the device
+ *  falls back to all-multicast reception until enough addresses are removed
+ *  again. Devices without set_multicast_list are expected to receive all
+ *  multicast frames.
+ *
+ *  Note: must be called with rtdev->nrt_lock acquired
+ */
+int rtdev_mc_add(struct rtnet_device *rtdev, const unsigned char *addr)
+{
+    unsigned int i;
+
+
+    for (i = 0; i < rtdev->mc_count; i++)
+        if (memcmp(rtdev->mc_list[i].addr, addr, rtdev->addr_len) == 0) {
+            rtdev->mc_list[i].users++;
+            return 0;
+        }
+
+    if (rtdev->mc_count < RTDEV_MC_ADDRS) {
+        memcpy(rtdev->mc_list[i].addr, addr, rtdev->addr_len);
+        rtdev->mc_list[i].users = 1;
+        rtdev->mc_count++;
+    } else
+        rtdev->allmulti++;
+
+    rtdev_update_mc_filter(rtdev);
+
+    return 0;
+}
+
+
+
+/***
+ *  rtdev_mc_del - remove a hardware address from the multicast filter
+ *  @rtdev: the device
+ *  @addr:  address as passed to rtdev_mc_add
+ *
+ *  Note: must be called with rtdev->nrt_lock acquired
+ */
+int rtdev_mc_del(struct rtnet_device *rtdev, const unsigned char *addr)
+{
+    unsigned int i;
+
+
+    for (i = 0; i < rtdev->mc_count; i++)
+        if (memcmp(rtdev->mc_list[i].addr, addr, rtdev->addr_len) == 0) {
+            if (--rtdev->mc_list[i].users > 0)
+                return 0;
+
+            rtdev->mc_list[i] = rtdev->mc_list[--rtdev->mc_count];
+            rtdev_update_mc_filter(rtdev);
+            return 0;
+        }
+
+    /* must have been one of the overflowing addresses */
+    if (rtdev->allmulti == 0)
+        return -ENOENT;
+
+    if (--rtdev->allmulti == 0)
+        rtdev_update_mc_filter(rtdev);
+
+    return 0;
+}
+
+
+
 static int rtdev_locked_xmit(struct rtskb *skb, struct rtnet_device *rtdev)
 {
     int ret;
@@ -671,6 +849,15 @@ int rtdev_xmit(struct rtskb *rtskb)
 
     RTNET_ASSERT(rtdev != NULL, return -EINVAL;);
 
+    /* hold frames with a launch time unless the hardware does it */
+    if (rtskb->txtime != 0 && !(rtdev->features & RTNETIF_F_TXTIME)) {
+        if (rtskb->txtime > rtdm_clock_read()) {
+            rtnet_txtime_queue(rtskb);
+            return 0;
+        }
+        rtskb->txtime = 0;
+    }
+
     err = rtdev->start_xmit(rtskb, rtdev);
     if (err) {
         /* on error we must free the rtskb here */
@@ -684,6 +871,71 @@ int rtdev_xmit(struct rtskb *rtskb)
 
 
 
+/***
+ *  rtdev_xmit_burst - send a sequence of real-time packets
+ *  @queue: private queue of packets for the same device
+ *
+ *  The packets are passed to the driver back-to-back, i.e. without packets
+ *  of other senders in between if the device is serialised by the stack.
+ *  All packets are consumed, even on error. Returns the first error.
+ */
+int rtdev_xmit_burst(struct rtskb_queue *queue)
+{
+    struct rtnet_device *rtdev;
+    struct rtskb        *skb;
+    int                 err = 0;
+
+
+    if (queue->first == NULL)
+        return 0;
+
+    rtdev = queue->first->rtdev;
+
+    RTNET_ASSERT(rtdev != NULL, return -EINVAL;);
+
+    /* all packets share the launch time, see rtdev_xmit */
+    if (queue->first->txtime != 0 && !(rtdev->features & RTNETIF_F_TXTIME) &&
+        queue->first->txtime > rtdm_clock_read()) {
+        while ((skb = __rtskb_dequeue(queue)) != NULL)
+            rtnet_txtime_queue(skb);
+        return 0;
+    }
+
+    if (rtdev->start_xmit == rtdev_locked_xmit) {
+        /* one lock round-trip for the whole burst */
+        rtdm_mutex_lock(&rtdev->xmit_mutex);
+
+        while ((skb = __rtskb_dequeue(queue)) != NULL) {
+            err = rtdev->hard_start_xmit(skb, rtdev);
+            if (err) {
+                kfree_rtskb(skb);
+                break;
+            }
+        }
+
+        rtdm_mutex_unlock(&rtdev->xmit_mutex);
+    } else
+        /* RTmac disciplines or drivers doing their own locking */
+        while ((skb = __rtskb_dequeue(queue)) != NULL) {
+            err = rtdev->start_xmit(skb, rtdev);
+            if (err) {
+                kfree_rtskb(skb);
+                break;
+            }
+        }
+
+    if (err) {
+        while ((skb = __rtskb_dequeue(queue)) != NULL)
+            kfree_rtskb(skb);
+
+        rtdm_printk("hard_start_xmit returned %d\n", err);
+    }
+
+    return err;
+}
+
+
+
 #ifdef CONFIG_RTNET_ADDON_PROXY
 /***
  *      rtdev_xmit_proxy - send rtproxy packet
@@ -727,6 +979,43 @@ unsigned int rt_hard_mtu(struct rtnet_device *rtdev, unsigned int priority)
 }
 
 
+/***
+ *  rtdev_set_mtu - change the MTU of a device
+ *  @rtdev: the device, must be down
+ *  @mtu:   new MTU
+ *
+ *  MTUs beyond standard Ethernet require rtskbs of sufficient size, see the
+ *  rtskb_size module parameter. The driver may apply further restrictions.
+ *
+ *  Note: must be called with rtdev->nrt_lock acquired
+ */
+int rtdev_set_mtu(struct rtnet_device *rtdev, unsigned int mtu)
+{
+    int ret;
+
+
+    if (mtu == rtdev->mtu)
+        return 0;
+
+    /* RTmac disciplines size their slots according to the MTU */
+    if ((rtdev->flags & IFF_UP) || rtdev->mac_disc)
+        return -EBUSY;
+
+    if (!rtdev->change_mtu)
+        return -EOPNOTSUPP;
+
+    /* keep the headroom RTSKB_SIZE provides for standard frames */
+    if ((mtu < 68) || (mtu > rtskb_buf_size - (RTSKB_SIZE - ETH_DATA_LEN)))
+        return -EINVAL;
+
+    ret = rtdev->change_mtu(rtdev, mtu);
+    if (ret == 0)
+        rtdev->mtu = mtu;
+
+    return ret;
+}
+
+
 EXPORT_SYMBOL(rt_alloc_etherdev);
 EXPORT_SYMBOL(rtdev_free);
 
@@ -744,9 +1033,16 @@ EXPORT_SYMBOL(rtdev_get_by_hwaddr);
 EXPORT_SYMBOL(rtdev_get_loopback);
 
 EXPORT_SYMBOL(rtdev_xmit);
+EXPORT_SYMBOL(rtdev_xmit_burst);
 
 #ifdef CONFIG_RTNET_ADDON_PROXY
 EXPORT_SYMBOL(rtdev_xmit_proxy);
 #endif
 
 EXPORT_SYMBOL(rt_hard_mtu);
+EXPORT_SYMBOL(rtdev_set_mtu);
+
+EXPORT_SYMBOL(rtdev_add_rx_filter);
+EXPORT_SYMBOL(rtdev_del_rx_filter);
+EXPORT_SYMBOL(rtdev_mc_add);
+EXPORT_SYMBOL(rtdev_mc_del);
@@ -31,6 +31,7 @@
 #include <rtnet_internal.h>
 #include <rtmac/rtmac_disc.h>
 #include <rtmac/rtmac_proc.h>
+#include <rtmac/rtmac_proto.h>
 #include <rtmac/rtmac_vnic.h>
 
 
@@ -38,6 +39,12 @@
 static DEFINE_MUTEX(disc_list_lock);
 static LIST_HEAD(disc_list);
 
+static struct rtdev_rx_filter rtmac_rx_filter = {
+    .type   = RTDEV_RX_FILTER_ETHERTYPE,
+    .value  = ETH_RTMAC,
+    .queue  = RTDEV_RX_QUEUE_RT
+};
+
 
 
 /***
@@ -93,6 +100,11 @@ int rtmac_disc_attach(struct rtnet_device *rtdev, struct rtmac_disc *disc)
         rtdev->get_mtu = disc->get_mtu;
     rtdev->mac_detach = rtmac_disc_detach;
 
+    /* Steer all RTmac frames, in particular the TDMA synchronisation, to the
+     * real-time RX queue of the NIC so that they never wait behind bulk
+     * traffic. This is best effort, most drivers cannot do it. */
+    priv->rx_filter = (rtdev_add_rx_filter(rtdev, &rtmac_rx_filter) == 0);
+
     RTNET_MOD_INC_USE_COUNT_EX(rtdev->rt_owner);
     rtdev_reference(rtdev);
 
@@ -146,6 +158,9 @@ int rtmac_disc_detach(struct rtnet_device *rtdev)
 
     rtmac_vnic_cleanup(rtdev);
 
+    if (priv->rx_filter)
+        rtdev_del_rx_filter(rtdev, &rtmac_rx_filter);
+
     /* restore start_xmit and get_mtu */
     rtdev->start_xmit = priv->orig_start_xmit;
     rtdev->get_mtu    = rt_hard_mtu;
@@ -196,8 +196,12 @@ static struct net_device_stats *rtmac_vnic_get_stats(struct net_device *dev)
 
 static int rtmac_vnic_change_mtu(struct net_device *dev, int new_mtu)
 {
+    struct rtnet_device *rtdev = *(struct rtnet_device **)netdev_priv(dev);
+
+
+    /* the RT device may run with jumbo frames */
     if ((new_mtu < 68) ||
-        ((unsigned)new_mtu > 1500 - sizeof(struct rtmac_hdr)))
+        ((unsigned)new_mtu > rtdev->mac_priv->vnic_max_mtu))
         return -EINVAL;
     dev->mtu = new_mtu;
     return 0;
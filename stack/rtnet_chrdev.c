@@ -109,6 +109,7 @@ static int rtnet_core_ioctl(struct rtnet_device *rtdev, unsigned int request,
     struct rtnet_core_cmd   cmd;
     struct list_head        *entry;
     struct rtdev_event_hook *hook;
+    struct rtdev_rx_filter  filter;
     int                     ret;
     rtdm_lockctx_t          context;
 
@@ -122,16 +123,24 @@ static int rtnet_core_ioctl(struct rtnet_device *rtdev, unsigned int request,
             if (mutex_lock_interruptible(&rtdev->nrt_lock))
                 return -ERESTARTSYS;
 
-            /* We cannot change the promisc flag or the hardware address if
-               the device is already up. */
+            /* We cannot change the promisc flag, the hardware address or
+               the MTU if the device is already up. */
             if ((rtdev->flags & IFF_UP) &&
                 (((cmd.args.up.set_dev_flags | cmd.args.up.clear_dev_flags) &
                   IFF_PROMISC) ||
-                 (cmd.args.up.dev_addr_type != ARPHRD_VOID))) {
+                 (cmd.args.up.dev_addr_type != ARPHRD_VOID) ||
+                 ((cmd.args.up.mtu != 0) &&
+                  (cmd.args.up.mtu != rtdev->mtu)))) {
                 ret = -EBUSY;
                 goto up_out;
             }
 
+            if (cmd.args.up.mtu != 0) {
+                ret = rtdev_set_mtu(rtdev, cmd.args.up.mtu);
+                if (ret < 0)
+                    goto up_out;
+            }
+
             rtdev->flags |= cmd.args.up.set_dev_flags;
             rtdev->flags &= ~cmd.args.up.clear_dev_flags;
 
@@ -232,6 +241,23 @@ static int rtnet_core_ioctl(struct rtnet_device *rtdev, unsigned int request,
                 return -EFAULT;
             break;
 
+        case IOC_RT_IFFILTER_ADD:
+        case IOC_RT_IFFILTER_DEL:
+            filter.type  = cmd.args.filter.type;
+            filter.value = cmd.args.filter.value;
+            filter.queue = cmd.args.filter.queue;
+
+            if (mutex_lock_interruptible(&rtdev->nrt_lock))
+                return -ERESTARTSYS;
+
+            if (request == IOC_RT_IFFILTER_ADD)
+                ret = rtdev_add_rx_filter(rtdev, &filter);
+            else
+                ret = rtdev_del_rx_filter(rtdev, &filter);
+
+            mutex_unlock(&rtdev->nrt_lock);
+            break;
+
         default:
             ret = -ENOTTY;
     }
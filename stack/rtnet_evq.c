@@ -0,0 +1,509 @@
+/***
+ *
+ *  stack/rtnet_evq.c - event queues for RTnet sockets
+ *
+ *  RTnet - real-time networking subsystem
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/posix_types.h>
+#include <linux/slab.h>
+
+#include <rtnet_internal.h>
+#include <rtnet_socket.h>
+
+
+/***
+ *  Socket event queues
+ *
+ *  Each open instance of the "rtevq" device is a queue. A socket can be
+ *  registered at one queue, the registration entry is then linked to both.
+ *  When a buffer is queued on the socket, the entry is appended to the
+ *  ready list of the queue, unless it is already waiting there. The waiter
+ *  takes a batch of entries per call and keeps them on the reported list.
+ *  They return to the ready list with the next call if their socket still
+ *  holds data, so nothing is lost if a socket is not fully drained.
+ *
+ *  Locking: evq_lock serialises registration changes, so neither a socket
+ *  nor a queue can vanish while an entry is being linked or unlinked. The
+ *  receive path only takes the socket's param_lock and the queue lock.
+ */
+struct rtnet_evq {
+    rtdm_lock_t             lock;
+    rtdm_event_t            ready_event;
+    struct list_head        entries;    /* all registrations */
+    struct list_head        ready;      /* sockets to be reported */
+    struct list_head        reported;   /* reported by the last wait */
+    int                     closed;
+};
+
+struct rtnet_evq_entry {
+    struct list_head        entry_link;
+    struct list_head        ready_link; /* ready or reported list */
+    int                     state;
+    struct rtnet_evq        *evq;
+    struct rtsocket         *sock;
+    int                     fd;         /* as passed by the user */
+    uint64_t                data;
+};
+
+#define EVQ_IDLE                0
+#define EVQ_READY               1
+#define EVQ_REPORTED            2
+
+/* The POSIX skin of Xenomai hands out RTDM descriptors above the Linux ones,
+ * see __pse51_rtdm_fd_start. */
+#ifdef CONFIG_XENO_OPT_RTDM_FILDES
+#define EVQ_POSIX_FD_START      (__FD_SETSIZE - CONFIG_XENO_OPT_RTDM_FILDES)
+#endif
+
+static rtdm_lock_t evq_lock = RTDM_LOCK_UNLOCKED;
+
+
+/* call with evq->lock held */
+static inline void evq_queue(struct rtnet_evq *evq,
+                             struct rtnet_evq_entry *entry)
+{
+    if (entry->state == EVQ_READY)
+        return;
+
+    if (entry->state == EVQ_REPORTED)
+        list_del(&entry->ready_link);
+    list_add_tail(&entry->ready_link, &evq->ready);
+    entry->state = EVQ_READY;
+
+    rtdm_event_signal(&evq->ready_event);
+}
+
+
+
+/* call with evq_lock held, returns the entry to be freed */
+static struct rtnet_evq_entry *evq_unlink(struct rtsocket *sock)
+{
+    struct rtnet_evq_entry  *entry;
+    struct rtnet_evq        *evq;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_get_irqsave(&sock->param_lock, context);
+    entry = sock->evq_entry;
+    sock->evq_entry = NULL;
+    rtdm_lock_put_irqrestore(&sock->param_lock, context);
+
+    if (entry == NULL)
+        return NULL;
+
+    evq = entry->evq;
+    rtdm_lock_get_irqsave(&evq->lock, context);
+    list_del(&entry->entry_link);
+    if (entry->state != EVQ_IDLE)
+        list_del(&entry->ready_link);
+    rtdm_lock_put_irqrestore(&evq->lock, context);
+
+    return entry;
+}
+
+
+
+/***
+ *  rtnet_evq_signal - report new data of a socket to its event queue
+ *  @sock: socket which has just queued a received buffer
+ */
+void rtnet_evq_signal(struct rtsocket *sock)
+{
+    struct rtnet_evq_entry  *entry;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_get_irqsave(&sock->param_lock, context);
+
+    entry = sock->evq_entry;
+    if (entry != NULL) {
+        rtdm_lock_get(&entry->evq->lock);
+        evq_queue(entry->evq, entry);
+        rtdm_lock_put(&entry->evq->lock);
+    }
+
+    rtdm_lock_put_irqrestore(&sock->param_lock, context);
+}
+
+EXPORT_SYMBOL(rtnet_evq_signal);
+
+
+
+/***
+ *  rtnet_evq_detach - remove a closing socket from its event queue
+ *  Note: must be called from Linux context.
+ */
+void rtnet_evq_detach(struct rtsocket *sock)
+{
+    struct rtnet_evq_entry  *entry;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_get_irqsave(&evq_lock, context);
+    entry = evq_unlink(sock);
+    rtdm_lock_put_irqrestore(&evq_lock, context);
+
+    kfree(entry);
+}
+
+
+
+static struct rtsocket *evq_get_socket(int fd, struct rtdm_dev_context **ctx)
+{
+    struct rtdm_dev_context *sockctx;
+
+
+#ifdef EVQ_POSIX_FD_START
+    if (fd >= EVQ_POSIX_FD_START)
+        fd -= EVQ_POSIX_FD_START;
+#endif
+
+    sockctx = rtdm_context_get(fd);
+    if (sockctx == NULL)
+        return NULL;
+
+    if (sockctx->device->device_class != RTDM_CLASS_NETWORK ||
+        sockctx->device->device_sub_class != RTDM_SUBCLASS_RTNET ||
+        !(sockctx->device->device_flags & RTDM_PROTOCOL_DEVICE)) {
+        rtdm_context_unlock(sockctx);
+        return NULL;
+    }
+
+    *ctx = sockctx;
+    return (struct rtsocket *)&sockctx->dev_private;
+}
+
+
+
+static int evq_add(struct rtnet_evq *evq, struct rtnet_evq_ctl *ctl)
+{
+    struct rtnet_evq_entry  *entry;
+    struct rtdm_dev_context *sockctx;
+    struct rtsocket         *sock;
+    rtdm_lockctx_t          context;
+    int                     ret = 0;
+
+
+    if (ctl->events & ~RTNET_EVQ_IN)
+        return -EINVAL;
+
+    entry = kmalloc(sizeof(struct rtnet_evq_entry), GFP_KERNEL);
+    if (entry == NULL)
+        return -ENOMEM;
+
+    sock = evq_get_socket(ctl->fd, &sockctx);
+    if (sock == NULL) {
+        kfree(entry);
+        return -EBADF;
+    }
+
+    entry->evq   = evq;
+    entry->sock  = sock;
+    entry->fd    = ctl->fd;
+    entry->data  = ctl->data;
+    entry->state = EVQ_IDLE;
+
+    rtdm_lock_get_irqsave(&evq_lock, context);
+
+    if (evq->closed) {
+        ret = -EBADF;
+        goto out;
+    }
+
+    rtdm_lock_get(&sock->param_lock);
+    if (sock->evq_entry != NULL)
+        ret = -EEXIST;
+    else
+        sock->evq_entry = entry;
+    rtdm_lock_put(&sock->param_lock);
+    if (ret < 0)
+        goto out;
+
+    rtdm_lock_get(&evq->lock);
+    list_add_tail(&entry->entry_link, &evq->entries);
+    /* data which arrived before the registration */
+    if (sock->incoming.first != NULL)
+        evq_queue(evq, entry);
+    rtdm_lock_put(&evq->lock);
+
+    entry = NULL;
+
+ out:
+    rtdm_lock_put_irqrestore(&evq_lock, context);
+
+    /* a socket closed meanwhile detaches again once we drop the reference */
+    rtdm_context_unlock(sockctx);
+    kfree(entry);
+
+    return ret;
+}
+
+
+
+static int evq_del(struct rtnet_evq *evq, struct rtnet_evq_ctl *ctl)
+{
+    struct rtnet_evq_entry  *entry = NULL;
+    struct rtdm_dev_context *sockctx;
+    struct rtsocket         *sock;
+    rtdm_lockctx_t          context;
+    int                     ret = -ENOENT;
+
+
+    sock = evq_get_socket(ctl->fd, &sockctx);
+    if (sock == NULL)
+        return -EBADF;
+
+    rtdm_lock_get_irqsave(&evq_lock, context);
+
+    /* the registration can only change under evq_lock */
+    if (sock->evq_entry != NULL && sock->evq_entry->evq == evq) {
+        entry = evq_unlink(sock);
+        ret = 0;
+    }
+
+    rtdm_lock_put_irqrestore(&evq_lock, context);
+
+    rtdm_context_unlock(sockctx);
+    kfree(entry);
+
+    return ret;
+}
+
+
+
+static int evq_wait(struct rtnet_evq *evq, rtdm_user_info_t *user_info,
+                    struct rtnet_evq_wait *wait)
+{
+    struct rtnet_evq_event  events[RTNET_EVQ_MAX_EVENTS];
+    struct rtnet_evq_entry  *entry;
+    struct rtnet_evq_entry  *tmp;
+    unsigned int            max = wait->maxevents;
+    unsigned int            n = 0;
+    rtdm_toseq_t            timeout_seq;
+    rtdm_lockctx_t          context;
+    int                     ret;
+
+
+    if (max == 0)
+        return -EINVAL;
+    if (max > RTNET_EVQ_MAX_EVENTS)
+        max = RTNET_EVQ_MAX_EVENTS;
+
+    rtdm_toseq_init(&timeout_seq, wait->timeout);
+
+    while (1) {
+        rtdm_lock_get_irqsave(&evq->lock, context);
+
+        /* level-triggered: report sockets again which still hold data */
+        list_for_each_entry_safe(entry, tmp, &evq->reported, ready_link) {
+            list_del(&entry->ready_link);
+            entry->state = EVQ_IDLE;
+            if (entry->sock->incoming.first != NULL)
+                evq_queue(evq, entry);
+        }
+
+        while (n < max && !list_empty(&evq->ready)) {
+            entry = list_entry(evq->ready.next, struct rtnet_evq_entry,
+                               ready_link);
+            list_move_tail(&entry->ready_link, &evq->reported);
+            entry->state = EVQ_REPORTED;
+
+            events[n].data   = entry->data;
+            events[n].fd     = entry->fd;
+            events[n].events = RTNET_EVQ_IN;
+            n++;
+        }
+
+        rtdm_lock_put_irqrestore(&evq->lock, context);
+
+        if (n > 0)
+            break;
+
+        ret = rtdm_event_timedwait(&evq->ready_event, wait->timeout,
+                                   &timeout_seq);
+        if (ret == -EIDRM)
+            return -EBADF;  /* queue has been closed */
+        if (ret < 0)
+            return ret;
+    }
+
+    if (user_info) {
+        if (!rtdm_rw_user_ok(user_info, wait->events,
+                             n * sizeof(struct rtnet_evq_event)) ||
+            rtdm_copy_to_user(user_info, wait->events, events,
+                              n * sizeof(struct rtnet_evq_event)))
+            return -EFAULT;
+    } else
+        memcpy(wait->events, events, n * sizeof(struct rtnet_evq_event));
+
+    return n;
+}
+
+
+
+static int rtnet_evq_open(struct rtdm_dev_context *context,
+                          rtdm_user_info_t *user_info, int oflags)
+{
+    struct rtnet_evq *evq = (struct rtnet_evq *)context->dev_private;
+
+
+    rtdm_lock_init(&evq->lock);
+    rtdm_event_init(&evq->ready_event, 0);
+    INIT_LIST_HEAD(&evq->entries);
+    INIT_LIST_HEAD(&evq->ready);
+    INIT_LIST_HEAD(&evq->reported);
+    evq->closed = 0;
+
+    return 0;
+}
+
+
+
+static int rtnet_evq_close(struct rtdm_dev_context *context,
+                           rtdm_user_info_t *user_info)
+{
+    struct rtnet_evq        *evq = (struct rtnet_evq *)context->dev_private;
+    struct rtnet_evq_entry  *entry;
+    struct rtnet_evq_entry  *tmp;
+    LIST_HEAD(unlinked);
+    rtdm_lockctx_t          lock_ctx;
+    int                     was_closed;
+
+
+    rtdm_lock_get_irqsave(&evq_lock, lock_ctx);
+
+    was_closed  = evq->closed;
+    evq->closed = 1;
+
+    /* the registrations can only change under evq_lock */
+    list_for_each_entry(entry, &evq->entries, entry_link) {
+        rtdm_lock_get(&entry->sock->param_lock);
+        entry->sock->evq_entry = NULL;
+        rtdm_lock_put(&entry->sock->param_lock);
+    }
+
+    /* a concurrent evq_wait walks the lists under evq->lock */
+    rtdm_lock_get(&evq->lock);
+    list_splice_init(&evq->entries, &unlinked);
+    INIT_LIST_HEAD(&evq->ready);
+    INIT_LIST_HEAD(&evq->reported);
+    rtdm_lock_put(&evq->lock);
+
+    rtdm_lock_put_irqrestore(&evq_lock, lock_ctx);
+
+    /* no socket can signal the queue anymore, wake up a waiter with -EIDRM */
+    if (!was_closed)
+        rtdm_event_destroy(&evq->ready_event);
+
+    list_for_each_entry_safe(entry, tmp, &unlinked, entry_link)
+        kfree(entry);
+
+    return 0;
+}
+
+
+
+static int rtnet_evq_ioctl(struct rtdm_dev_context *context,
+                           rtdm_user_info_t *user_info,
+                           unsigned int request, void *arg)
+{
+    struct rtnet_evq        *evq = (struct rtnet_evq *)context->dev_private;
+    struct rtnet_evq_ctl    ctl;
+    struct rtnet_evq_wait   wait;
+
+
+    switch (request) {
+        case RTNET_RTIOC_EVQ_ADD:
+        case RTNET_RTIOC_EVQ_DEL:
+            /* registrations allocate memory */
+            if (rtdm_in_rt_context())
+                return -ENOSYS;
+
+            if (user_info) {
+                if (!rtdm_read_user_ok(user_info, arg, sizeof(ctl)) ||
+                    rtdm_copy_from_user(user_info, &ctl, arg, sizeof(ctl)))
+                    return -EFAULT;
+            } else
+                ctl = *(struct rtnet_evq_ctl *)arg;
+
+            if (request == RTNET_RTIOC_EVQ_ADD)
+                return evq_add(evq, &ctl);
+            else
+                return evq_del(evq, &ctl);
+
+        case RTNET_RTIOC_EVQ_WAIT:
+            if (!rtdm_in_rt_context())
+                return -ENOSYS;
+
+            if (user_info) {
+                if (!rtdm_read_user_ok(user_info, arg, sizeof(wait)) ||
+                    rtdm_copy_from_user(user_info, &wait, arg, sizeof(wait)))
+                    return -EFAULT;
+            } else
+                wait = *(struct rtnet_evq_wait *)arg;
+
+            return evq_wait(evq, user_info, &wait);
+
+        default:
+            return -ENOTTY;
+    }
+}
+
+
+
+static struct rtdm_device rtnet_evq_device = {
+    .struct_version =   RTDM_DEVICE_STRUCT_VER,
+
+    .device_flags =     RTDM_NAMED_DEVICE,
+    .context_size =     sizeof(struct rtnet_evq),
+    .device_name =      "rtevq",
+
+    .open_nrt =         rtnet_evq_open,
+
+    .ops = {
+        .close_nrt =    rtnet_evq_close,
+        .ioctl_rt =     rtnet_evq_ioctl,
+        .ioctl_nrt =    rtnet_evq_ioctl,
+    },
+
+    .device_class =     RTDM_CLASS_NETWORK,
+    .device_sub_class = RTDM_SUBCLASS_RTNET_EVQ,
+    .driver_name =      "rtevq",
+    .driver_version =   RTNET_RTDM_VER,
+    .peripheral_name =  "RTnet Socket Event Queue",
+    .provider_name =    rtnet_rtdm_provider_name,
+
+    .proc_name =        "rtevq"
+};
+
+
+
+int __init rtnet_evq_init(void)
+{
+    return rtdm_dev_register(&rtnet_evq_device);
+}
+
+
+
+void rtnet_evq_release(void)
+{
+    rtdm_dev_unregister(&rtnet_evq_device, 1000);
+}
@@ -101,7 +101,7 @@ static int rtnet_read_proc_rtskb(char *buf, char **start, off_t offset, int coun
     RTNET_PROC_PRINT_VARS(256);
 
 
-    rtskb_len = ALIGN_RTSKB_STRUCT_LEN + SKB_DATA_ALIGN(RTSKB_SIZE);
+    rtskb_len = ALIGN_RTSKB_STRUCT_LEN + rtskb_buf_size;
     RTNET_PROC_PRINT("Statistics\t\tCurrent\tMaximum\n"
                      "rtskb pools\t\t%d\t%d\n"
                      "rtskbs\t\t\t%d\t%d\n"
@@ -305,9 +305,21 @@ int __init rtnet_init(void)
     if ((err = rtpc_init()) != 0)
         goto err_out6;
 
+    if ((err = rtnet_evq_init()) != 0)
+        goto err_out7;
+
+    if ((err = rtnet_txtime_init()) != 0)
+        goto err_out8;
+
     return 0;
 
 
+err_out8:
+    rtnet_evq_release();
+
+err_out7:
+    rtpc_cleanup();
+
 err_out6:
     rtwlan_exit();
 
@@ -336,6 +348,10 @@ err_out1:
  */
 void __exit rtnet_release(void)
 {
+    rtnet_txtime_release();
+
+    rtnet_evq_release();
+
     rtpc_cleanup();
 
     rtwlan_exit();
@@ -0,0 +1,209 @@
+/***
+ *
+ *  stack/rtnet_txtime.c - time-triggered transmission
+ *
+ *  RTnet - real-time networking subsystem
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/moduleparam.h>
+
+#include <rtdev.h>
+#include <rtnet_internal.h>
+#include <rtskb.h>
+
+
+/***
+ *  Time-triggered transmission
+ *
+ *  Frames carrying a launch time (rtskb.txtime) are held on a queue sorted
+ *  by that time. The release task sleeps until the earliest launch time and
+ *  then passes the frame to its device. Frames due at the same time keep
+ *  their order, so the fragments of a datagram are released back-to-back.
+ *  Devices announcing RTNETIF_F_TXTIME never get here, their hardware waits
+ *  for the launch time itself.
+ *
+ *  Each queued frame holds a reference on its device. When a device is
+ *  closed, its queued frames are dropped.
+ */
+
+static unsigned int txtime_prio = RTDM_TASK_HIGHEST_PRIORITY;
+module_param(txtime_prio, uint, 0444);
+MODULE_PARM_DESC(txtime_prio, "Priority of the time-triggered transmission task");
+
+static struct rtskb_queue   txtime_queue;
+static rtdm_event_t         txtime_event;
+static rtdm_task_t          txtime_task;
+
+
+
+/***
+ *  rtnet_txtime_queue - hold a frame until its launch time
+ *  @skb: frame with rtdev and txtime set
+ *
+ *  The frame is consumed. Usually called via rtdev_xmit.
+ */
+void rtnet_txtime_queue(struct rtskb *skb)
+{
+    struct rtskb    **link;
+    rtdm_lockctx_t  context;
+    int             first;
+
+
+    rtdev_reference(skb->rtdev);
+
+    rtdm_lock_get_irqsave(&txtime_queue.lock, context);
+
+    if (txtime_queue.first == NULL ||
+        txtime_queue.last->txtime <= skb->txtime) {
+        /* common case: launch times are increasing */
+        first = (txtime_queue.first == NULL);
+        __rtskb_queue_tail(&txtime_queue, skb);
+    } else {
+        /* insert behind all frames due earlier or at the same time */
+        for (link = &txtime_queue.first; (*link)->txtime <= skb->txtime;
+             link = &(*link)->next);
+
+        first     = (link == &txtime_queue.first);
+        skb->next = *link;
+        *link     = skb;
+    }
+
+    rtdm_lock_put_irqrestore(&txtime_queue.lock, context);
+
+    /* the release task has to recalculate its timeout */
+    if (first)
+        rtdm_event_signal(&txtime_event);
+}
+
+
+
+/***
+ *  rtnet_txtime_flush - drop all held frames of a device
+ *  @rtdev: the device
+ */
+void rtnet_txtime_flush(struct rtnet_device *rtdev)
+{
+    struct rtskb_queue  dropped;
+    struct rtskb        **link;
+    struct rtskb        *skb;
+    rtdm_lockctx_t      context;
+
+
+    rtskb_queue_init(&dropped);
+
+    rtdm_lock_get_irqsave(&txtime_queue.lock, context);
+
+    txtime_queue.last = NULL;
+    link = &txtime_queue.first;
+    while ((skb = *link) != NULL) {
+        if (skb->rtdev == rtdev) {
+            *link = skb->next;
+            __rtskb_queue_tail(&dropped, skb);
+        } else {
+            txtime_queue.last = skb;
+            link = &skb->next;
+        }
+    }
+
+    rtdm_lock_put_irqrestore(&txtime_queue.lock, context);
+
+    while ((skb = __rtskb_dequeue(&dropped)) != NULL) {
+        kfree_rtskb(skb);
+        rtdev_dereference(rtdev);
+    }
+}
+
+
+
+static void txtime_release_task(void *arg)
+{
+    struct rtskb        *skb;
+    struct rtnet_device *rtdev;
+    nanosecs_rel_t      timeout;
+    rtdm_lockctx_t      context;
+    int                 ret;
+
+
+    while (1) {
+        rtdm_lock_get_irqsave(&txtime_queue.lock, context);
+
+        skb = txtime_queue.first;
+        if (skb == NULL)
+            timeout = 0;    /* infinite, wait for the next frame */
+        else {
+            timeout = (nanosecs_rel_t)(skb->txtime - rtdm_clock_read());
+            if (timeout <= 0) {
+                __rtskb_dequeue(&txtime_queue);
+
+                rtdm_lock_put_irqrestore(&txtime_queue.lock, context);
+
+                rtdev = skb->rtdev;
+                skb->txtime = 0;
+
+                if (rtdev->flags & IFF_UP)
+                    rtdev_xmit(skb);
+                else
+                    kfree_rtskb(skb);
+
+                rtdev_dereference(rtdev);
+                continue;
+            }
+        }
+
+        rtdm_lock_put_irqrestore(&txtime_queue.lock, context);
+
+        ret = rtdm_event_timedwait(&txtime_event, timeout, NULL);
+        if (ret < 0 && ret != -ETIMEDOUT)
+            break;
+    }
+}
+
+
+
+int __init rtnet_txtime_init(void)
+{
+    int ret;
+
+
+    rtskb_queue_init(&txtime_queue);
+    rtdm_event_init(&txtime_event, 0);
+
+    ret = rtdm_task_init(&txtime_task, "rtnet-txtime", txtime_release_task,
+                         NULL, txtime_prio, 0);
+    if (ret < 0)
+        rtdm_event_destroy(&txtime_event);
+
+    return ret;
+}
+
+
+
+void rtnet_txtime_release(void)
+{
+    struct rtskb *skb;
+
+
+    rtdm_event_destroy(&txtime_event);
+    rtdm_task_join_nrt(&txtime_task, 100);
+
+    /* all devices are gone at this point, the queue should be empty */
+    while ((skb = __rtskb_dequeue(&txtime_queue)) != NULL) {
+        rtdev_dereference(skb->rtdev);
+        kfree_rtskb(skb);
+    }
+}
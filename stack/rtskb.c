@@ -34,6 +34,15 @@ static unsigned int global_rtskbs    = DEFAULT_GLOBAL_RTSKBS;
 module_param(global_rtskbs, uint, 0444);
 MODULE_PARM_DESC(global_rtskbs, "Number of realtime socket buffers in global pool");
 
+static unsigned int rtskb_size       = RTSKB_SIZE;
+module_param(rtskb_size, uint, 0444);
+MODULE_PARM_DESC(rtskb_size, "Data size of realtime socket buffers, "
+                 "increase for jumbo frames");
+
+/* data buffer size of all rtskbs, derived from rtskb_size */
+unsigned int rtskb_buf_size;
+EXPORT_SYMBOL(rtskb_buf_size);
+
 
 /* Linux slab pool for rtskbs */
 static struct kmem_cache *rtskb_slab_pool;
@@ -162,7 +171,7 @@ struct rtskb *alloc_rtskb(unsigned int size, struct rtskb_queue *pool)
     struct rtskb *skb;
 
 
-    RTNET_ASSERT(size <= SKB_DATA_ALIGN(RTSKB_SIZE), return NULL;);
+    RTNET_ASSERT(size <= rtskb_buf_size, return NULL;);
 
     skb = rtskb_dequeue(pool);
     if (!skb)
@@ -182,6 +191,8 @@ struct rtskb *alloc_rtskb(unsigned int size, struct rtskb_queue *pool)
     skb->len = 0;
     skb->pkt_type = PACKET_HOST;
     skb->xmit_stamp = NULL;
+    skb->txtime = 0;
+    skb->lent = 0;
 
 #ifdef CONFIG_RTNET_ADDON_RTCAP
     skb->cap_flags = 0;
@@ -329,7 +340,7 @@ unsigned int rtskb_pool_extend(struct rtskb_queue *pool,
         skb->pool = pool;
         skb->buf_start = ((unsigned char *)skb) + ALIGN_RTSKB_STRUCT_LEN;
 #ifdef CONFIG_RTNET_CHECKED
-        skb->buf_end = skb->buf_start + SKB_DATA_ALIGN(RTSKB_SIZE) - 1;
+        skb->buf_end = skb->buf_start + rtskb_buf_size - 1;
 #endif
 
         if (rtdev_map_rtskb(skb) < 0)
@@ -456,8 +467,16 @@ EXPORT_SYMBOL_GPL(rtskb_clone);
 
 int rtskb_pools_init(void)
 {
+    if (rtskb_size < RTSKB_SIZE)
+        rtskb_size = RTSKB_SIZE;
+    else if (rtskb_size > RTSKB_MAX_SIZE) {
+        printk("RTnet: rtskb_size limited to %d\n", RTSKB_MAX_SIZE);
+        rtskb_size = RTSKB_MAX_SIZE;
+    }
+    rtskb_buf_size = SKB_DATA_ALIGN(rtskb_size);
+
     rtskb_slab_pool = kmem_cache_create("rtskb_slab_pool",
-        ALIGN_RTSKB_STRUCT_LEN + SKB_DATA_ALIGN(RTSKB_SIZE),
+        ALIGN_RTSKB_STRUCT_LEN + rtskb_buf_size,
         0, SLAB_HWCACHE_ALIGN, NULL
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,23)
         , NULL
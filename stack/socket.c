@@ -30,6 +30,7 @@
 #include <linux/ip.h>
 #include <linux/tcp.h>
 #include <asm/bitops.h>
+#include <asm/div64.h>
 
 #include <rtnet.h>
 #include <rtnet_internal.h>
@@ -71,10 +72,15 @@ int rt_socket_init(struct rtdm_dev_context *sockctx, unsigned short protocol)
 
 
     sock->callback_func = NULL;
+    sock->evq_entry = NULL;
 
     rtskb_queue_init(&sock->incoming);
 
     sock->timeout = 0;
+    sock->queue_depth = 0;
+    sock->overwritten = 0;
+    sock->rx_timestamp = 0;
+    sock->txtime = 0;
 
     rtdm_lock_init(&sock->param_lock);
     rtdm_sem_init(&sock->pending_sem, 0);
@@ -111,6 +117,8 @@ int rt_socket_cleanup(struct rtdm_dev_context *sockctx)
 
     rtdm_sem_destroy(&sock->pending_sem);
 
+    rtnet_evq_detach(sock);
+
     mutex_lock(&sock->pool_nrt_lock);
 
     set_bit(SKB_POOL_CLOSED, &sockctx->context_flags);
@@ -131,6 +139,253 @@ int rt_socket_cleanup(struct rtdm_dev_context *sockctx)
 
 
 
+/***
+ *  rt_socket_enqueue - hand a received buffer chain over to the readers
+ *  @sock: receiving socket
+ *  @skb:  buffer chain, already owned by the socket pool
+ *
+ *  If the socket's queue depth limit is reached, the oldest chain is removed
+ *  in favour of the new one and returned to the caller for release. Readers
+ *  are only woken up if nothing was overwritten, so pending_sem keeps
+ *  matching the queue length.
+ */
+struct rtskb *rt_socket_enqueue(struct rtsocket *sock, struct rtskb *skb)
+{
+    struct rtskb    *old = NULL;
+    struct rtskb    *iter;
+    unsigned int    depth = sock->queue_depth;
+    unsigned int    queued = 0;
+    rtdm_lockctx_t  context;
+
+
+    rtdm_lock_get_irqsave(&sock->incoming.lock, context);
+
+    if (depth > 0) {
+        /* only walks up to the limit, which is typically small */
+        for (iter = sock->incoming.first; iter != NULL;
+             iter = iter->chain_end->next)
+            if (++queued >= depth)
+                break;
+
+        if (queued >= depth) {
+            old = __rtskb_dequeue_chain(&sock->incoming);
+            sock->overwritten++;
+        }
+    }
+
+    __rtskb_queue_tail(&sock->incoming, skb);
+
+    rtdm_lock_put_irqrestore(&sock->incoming.lock, context);
+
+    if (old == NULL)
+        rtdm_sem_up(&sock->pending_sem);
+
+    rtnet_evq_signal(sock);
+
+    return old;
+}
+
+
+
+/***
+ *  rt_socket_lend - describe a received buffer chain to a borrower
+ *  @skb:    first buffer of the chain, data pointing to the payload
+ *  @len:    payload length
+ *  @borrow: request to fill in
+ *
+ *  Returns -EMSGSIZE if the chain does not fit into borrow->iov. The chain
+ *  is left untouched apart from trimming in this case. Otherwise, it is
+ *  marked as lent until it is passed back via RTNET_RTIOC_RELEASE.
+ */
+int rt_socket_lend(struct rtskb *skb, size_t len, struct rtnet_borrow *borrow)
+{
+    struct rtskb    *first = skb;
+    struct iovec    *iov = borrow->iov;
+    size_t          left = len;
+    int             i = 0;
+
+
+    do {
+        if (i == borrow->iovlen)
+            return -EMSGSIZE;
+
+        rtskb_trim(skb, left);
+
+        iov[i].iov_base = skb->data;
+        iov[i].iov_len  = skb->len;
+        left -= skb->len;
+        i++;
+
+        skb = skb->next;
+    } while (skb != NULL && left > 0);
+
+    borrow->iovlen = i;
+    borrow->len    = len - left;
+    first->lent    = 1;
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_socket_put_buffer - hand a borrowed or reserved buffer back
+ *
+ *  Handles which are not lent out (anymore) are rejected, so that a buffer
+ *  cannot be returned to its pool twice.
+ */
+static int rt_socket_put_buffer(struct rtsocket *sock,
+                                rtdm_user_info_t *user_info, void **handle)
+{
+    struct rtskb    *skb = *handle;
+    rtdm_lockctx_t  context;
+    int             lent;
+
+
+    if (user_info)
+        return -EACCES;
+
+    if (skb == NULL || skb->pool != &sock->skb_pool)
+        return -EINVAL;
+
+    /* concurrent releases of the same handle must not both succeed */
+    rtdm_lock_get_irqsave(&sock->param_lock, context);
+    lent = skb->lent;
+    skb->lent = 0;
+    rtdm_lock_put_irqrestore(&sock->param_lock, context);
+
+    if (!lent)
+        return -EINVAL;
+
+    *handle = NULL;
+    kfree_rtskb(skb);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_socket_txbuf_reserve - provide a buffer to be filled in place
+ */
+static int rt_socket_txbuf_reserve(struct rtsocket *sock,
+                                   rtdm_user_info_t *user_info,
+                                   struct rtnet_txbuf *txbuf)
+{
+    struct rtskb    *skb;
+
+
+    /* socket buffers are not mapped into user space */
+    if (user_info)
+        return -EACCES;
+
+    if (txbuf->len > rtskb_buf_size - RTNET_TX_HEADROOM)
+        return -EMSGSIZE;
+
+    skb = alloc_rtskb(RTNET_TX_HEADROOM + txbuf->len, &sock->skb_pool);
+    if (skb == NULL)
+        return -ENOBUFS;
+
+    rtskb_reserve(skb, RTNET_TX_HEADROOM);
+
+    txbuf->data   = rtskb_put(skb, txbuf->len);
+    txbuf->handle = skb;
+    skb->lent     = 1;
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_socket_txbuf_check - validate a buffer to be committed
+ *
+ *  Trims the buffer to the final payload length on success. The caller has
+ *  to clear rtskb.lent when it consumes the buffer.
+ */
+int rt_socket_txbuf_check(struct rtsocket *sock, rtdm_user_info_t *user_info,
+                          struct rtnet_txbuf *txbuf)
+{
+    struct rtskb    *skb = txbuf->handle;
+
+
+    if (user_info)
+        return -EACCES;
+
+    if (!rtdm_in_rt_context())
+        return -ENOSYS;
+
+    if (skb == NULL || skb->pool != &sock->skb_pool || !skb->lent ||
+        txbuf->len > skb->len)
+        return -EINVAL;
+
+    rtskb_trim(skb, txbuf->len);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_socket_mmsg - receive or send a vector of messages
+ *
+ *  Only the first message may block, the remaining ones are processed as long
+ *  as they do not have to wait. Returns the number of messages handled or,
+ *  if none could be handled, the error of the first one.
+ */
+static int rt_socket_mmsg(struct rtdm_dev_context *sockctx,
+                          rtdm_user_info_t *user_info, int request,
+                          struct rtnet_mmsg_args *args)
+{
+    struct rtnet_mmsghdr    *entry = args->msgvec;
+    struct msghdr           msg;
+    unsigned int            vlen = args->vlen;
+    int                     flags = args->flags;
+    unsigned int            i;
+    ssize_t                 ret;
+
+
+    /* the per-message handlers are RT-only */
+    if (!rtdm_in_rt_context())
+        return -ENOSYS;
+
+    if (sockctx->ops->recvmsg_rt == NULL || sockctx->ops->sendmsg_rt == NULL)
+        return -EOPNOTSUPP;
+
+    /* peeking would return the same datagram over and over */
+    if (flags & MSG_PEEK)
+        return -EINVAL;
+
+    if (vlen > RTNET_MMSG_MAX)
+        vlen = RTNET_MMSG_MAX;
+
+    for (i = 0; i < vlen; i++, entry++) {
+        msg = entry->msg_hdr;
+        msg.msg_flags = 0;
+
+        if (request == RTNET_RTIOC_RECVMMSG)
+            ret = sockctx->ops->recvmsg_rt(sockctx, user_info, &msg, flags);
+        else
+            ret = sockctx->ops->sendmsg_rt(sockctx, user_info, &msg, flags);
+
+        if (ret < 0)
+            return (i > 0) ? i : ret;
+
+        if (request == RTNET_RTIOC_RECVMMSG) {
+            entry->msg_hdr.msg_namelen    = msg.msg_namelen;
+            entry->msg_hdr.msg_controllen = msg.msg_controllen;
+            entry->msg_hdr.msg_flags      = msg.msg_flags;
+        }
+        entry->msg_len = ret;
+
+        flags |= MSG_DONTWAIT;
+    }
+
+    return i;
+}
+
+
+
 /***
  *  rt_socket_common_ioctl
  */
@@ -141,6 +396,8 @@ int rt_socket_common_ioctl(struct rtdm_dev_context *sockctx,
     struct rtsocket         *sock = (struct rtsocket *)&sockctx->dev_private;
     int                     ret = 0;
     struct rtnet_callback   *callback = arg;
+    struct rtnet_borrow     *borrow = arg;
+    struct rtnet_txbuf      *txbuf = arg;
     unsigned int            rtskbs;
     rtdm_lockctx_t          context;
 
@@ -154,6 +411,14 @@ int rt_socket_common_ioctl(struct rtdm_dev_context *sockctx,
             sock->timeout = *(nanosecs_rel_t *)arg;
             break;
 
+        case RTNET_RTIOC_QUEUEDEPTH:
+            sock->queue_depth = *(unsigned int *)arg;
+            break;
+
+        case RTNET_RTIOC_OVERWRITTEN:
+            *(unsigned int *)arg = sock->overwritten;
+            break;
+
         case RTNET_RTIOC_CALLBACK:
             if (user_info)
                 return -EACCES;
@@ -206,6 +471,23 @@ int rt_socket_common_ioctl(struct rtdm_dev_context *sockctx,
 
             break;
 
+        case RTNET_RTIOC_RELEASE:
+            ret = rt_socket_put_buffer(sock, user_info, &borrow->handle);
+            break;
+
+        case RTNET_RTIOC_TXRESERVE:
+            ret = rt_socket_txbuf_reserve(sock, user_info, txbuf);
+            break;
+
+        case RTNET_RTIOC_TXABORT:
+            ret = rt_socket_put_buffer(sock, user_info, &txbuf->handle);
+            break;
+
+        case RTNET_RTIOC_RECVMMSG:
+        case RTNET_RTIOC_SENDMMSG:
+            ret = rt_socket_mmsg(sockctx, user_info, request, arg);
+            break;
+
         default:
             ret = -EOPNOTSUPP;
             break;
@@ -216,6 +498,153 @@ int rt_socket_common_ioctl(struct rtdm_dev_context *sockctx,
 
 
 
+/***
+ *  rt_socket_setsockopt - socket level options common to all RTnet sockets
+ */
+int rt_socket_setsockopt(struct rtsocket *sock, int optname,
+                         const void *optval, socklen_t optlen)
+{
+    switch (optname) {
+        case SO_TIMESTAMPNS:
+            if (optlen < sizeof(int))
+                return -EINVAL;
+
+            sock->rx_timestamp = (*(int *)optval != 0);
+            return 0;
+
+        case SO_TXTIME:
+            if (optlen < sizeof(struct sock_txtime))
+                return -EINVAL;
+
+            /* launch times are only served against the RTDM clock, no
+             * deadline mode or error reporting */
+            if (((struct sock_txtime *)optval)->clockid != CLOCK_REALTIME ||
+                ((struct sock_txtime *)optval)->flags != 0)
+                return -EINVAL;
+
+            sock->txtime = 1;
+            return 0;
+
+        default:
+            return -ENOPROTOOPT;
+    }
+}
+
+
+
+int rt_socket_getsockopt(struct rtsocket *sock, int optname,
+                         void *optval, socklen_t *optlen)
+{
+    if (*optlen < sizeof(int))
+        return -EINVAL;
+
+    switch (optname) {
+        case SO_TIMESTAMPNS:
+            *(int *)optval = sock->rx_timestamp;
+            *optlen = sizeof(int);
+            return 0;
+
+        case SO_TXTIME:
+            if (*optlen < sizeof(struct sock_txtime))
+                return -EINVAL;
+
+            ((struct sock_txtime *)optval)->clockid = CLOCK_REALTIME;
+            ((struct sock_txtime *)optval)->flags   = 0;
+            *optlen = sizeof(struct sock_txtime);
+            return 0;
+
+        default:
+            return -ENOPROTOOPT;
+    }
+}
+
+
+
+/***
+ *  rt_socket_put_stamp - pass the arrival time of a received message
+ *  @sock: receiving socket
+ *  @msg:  message being received
+ *  @skb:  first buffer of the message
+ *
+ *  If SO_TIMESTAMPNS is enabled, the time the driver stamped on reception
+ *  is stored as SCM_TIMESTAMPNS control message. It is based on the RTDM
+ *  clock (rtdm_clock_read). Otherwise, msg_controllen is set to 0.
+ */
+void rt_socket_put_stamp(struct rtsocket *sock, struct msghdr *msg,
+                         struct rtskb *skb)
+{
+    struct cmsghdr  *cmsg = msg->msg_control;
+    struct timespec *ts;
+    u64             stamp = skb->time_stamp;
+
+
+    if (!sock->rx_timestamp) {
+        msg->msg_controllen = 0;
+        return;
+    }
+
+    if (cmsg == NULL ||
+        msg->msg_controllen < CMSG_SPACE(sizeof(struct timespec))) {
+        msg->msg_controllen = 0;
+        msg->msg_flags |= MSG_CTRUNC;
+        return;
+    }
+
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(struct timespec));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_TIMESTAMPNS;
+
+    ts = (struct timespec *)CMSG_DATA(cmsg);
+    ts->tv_nsec = do_div(stamp, 1000000000);
+    ts->tv_sec  = stamp;
+
+    msg->msg_controllen = CMSG_SPACE(sizeof(struct timespec));
+}
+
+
+
+/***
+ *  rt_socket_get_txtime - launch time requested for an outgoing message
+ *  @sock:   sending socket
+ *  @msg:    message being sent
+ *  @txtime: returns the launch time, 0 if none was passed
+ *
+ *  If SO_TXTIME is enabled, the message may carry an SCM_TXTIME control
+ *  message with a 64-bit launch time based on the RTDM clock
+ *  (rtdm_clock_read), which is CLOCK_REALTIME of the Xenomai skins. Launch
+ *  times in the past are served immediately. Other control messages are
+ *  ignored.
+ */
+int rt_socket_get_txtime(struct rtsocket *sock, const struct msghdr *msg,
+                         nanosecs_abs_t *txtime)
+{
+    struct cmsghdr  *cmsg;
+
+
+    *txtime = 0;
+
+    if (!sock->txtime)
+        return 0;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR((struct msghdr *)msg, cmsg)) {
+        if (!CMSG_OK(msg, cmsg))
+            return -EINVAL;
+
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TXTIME)
+            continue;
+
+        if (cmsg->cmsg_len != CMSG_LEN(sizeof(u64)))
+            return -EINVAL;
+
+        *txtime = *(u64 *)CMSG_DATA(cmsg);
+    }
+
+    return 0;
+}
+
+
+
 /***
  *  rt_socket_if_ioctl
  */
@@ -333,3 +762,10 @@ EXPORT_SYMBOL(rt_socket_init);
 EXPORT_SYMBOL(rt_socket_cleanup);
 EXPORT_SYMBOL(rt_socket_common_ioctl);
 EXPORT_SYMBOL(rt_socket_if_ioctl);
+EXPORT_SYMBOL(rt_socket_enqueue);
+EXPORT_SYMBOL(rt_socket_lend);
+EXPORT_SYMBOL(rt_socket_txbuf_check);
+EXPORT_SYMBOL(rt_socket_setsockopt);
+EXPORT_SYMBOL(rt_socket_getsockopt);
+EXPORT_SYMBOL(rt_socket_put_stamp);
+EXPORT_SYMBOL(rt_socket_get_txtime);
@@ -166,8 +166,10 @@ void help(void)
     fprintf(stderr, "Usage:\n"
         "\trtifconfig [-a] [<dev>]\n"
         "\trtifconfig <dev> up [<addr> [netmask <mask>]] "
-            "[hw <HW> <address>] [[-]promisc]\n"
+            "[hw <HW> <address>] [[-]promisc] [mtu <size>]\n"
         "\trtifconfig <dev> down\n"
+        "\trtifconfig <dev> filter add|del ethertype <type>|udp <port> "
+            "[queue <n>]\n"
         );
 
     exit(1);
@@ -321,6 +323,7 @@ void do_up(int argc, char *argv[])
     struct in_addr      addr;
     __u32               ip_mask;
     struct ether_addr   hw_addr;
+    char                *end;
 
 
     if ((argc > 3) && (inet_aton(argv[3], &addr))) {
@@ -348,6 +351,7 @@ void do_up(int argc, char *argv[])
     cmd.args.up.set_dev_flags   = 0;
     cmd.args.up.clear_dev_flags = 0;
     cmd.args.up.dev_addr_type   = 0xFFFF;
+    cmd.args.up.mtu             = 0;
 
     /* parse optional parameters */
     for ( ; i < argc; i++) {
@@ -369,6 +373,12 @@ void do_up(int argc, char *argv[])
         } else if (strcmp(argv[i], "-promisc") == 0) {
             cmd.args.up.set_dev_flags   &= ~IFF_PROMISC;
             cmd.args.up.clear_dev_flags |= IFF_PROMISC;
+        } else if (strcmp(argv[i], "mtu") == 0) {
+            if (++i >= argc)
+                help();
+            cmd.args.up.mtu = strtoul(argv[i], &end, 0);
+            if ((*end != 0) || (cmd.args.up.mtu == 0))
+                help();
         } else
             help();
     }
@@ -402,6 +412,61 @@ void do_down(int argc,char *argv[])
 
 
 
+void do_filter(int argc, char *argv[])
+{
+    unsigned long   value;
+    char            *end;
+    int             request = 0;
+    int             ret;
+    int             i;
+
+
+    if (argc < 6)
+        help();
+
+    if (strcmp(argv[3], "add") == 0)
+        request = IOC_RT_IFFILTER_ADD;
+    else if (strcmp(argv[3], "del") == 0)
+        request = IOC_RT_IFFILTER_DEL;
+    else
+        help();
+
+    if (strcmp(argv[4], "ethertype") == 0)
+        cmd.args.filter.type = RTDEV_RX_FILTER_ETHERTYPE;
+    else if (strcmp(argv[4], "udp") == 0)
+        cmd.args.filter.type = RTDEV_RX_FILTER_UDP_DPORT;
+    else
+        help();
+
+    value = strtoul(argv[5], &end, 0);
+    if ((*end != 0) || (value > 0xFFFF))
+        help();
+    cmd.args.filter.value = value;
+
+    /* default: the queue the driver reserves for real-time traffic */
+    cmd.args.filter.queue = RTDEV_RX_QUEUE_RT;
+
+    for (i = 6; i < argc; i++) {
+        if (strcmp(argv[i], "queue") == 0) {
+            if (++i >= argc)
+                help();
+            cmd.args.filter.queue = strtoul(argv[i], &end, 0);
+            if (*end != 0)
+                help();
+        } else
+            help();
+    }
+
+    ret = ioctl(f, request, &cmd);
+    if (ret < 0) {
+        perror("ioctl");
+        exit(1);
+    }
+    exit(0);
+}
+
+
+
 int main(int argc, char *argv[])
 {
     if ((argc > 1) && (strcmp(argv[1], "--help") == 0))
@@ -433,6 +498,8 @@ int main(int argc, char *argv[])
         do_up(argc,argv);
     if (strcmp(argv[2], "down") == 0)
         do_down(argc,argv);
+    if (strcmp(argv[2], "filter") == 0)
+        do_filter(argc,argv);
 
     help();
 